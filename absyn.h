@@ -1,13 +1,11 @@
 #ifndef ABSYN_H
 #define ABSYN_H
 #include "absyn_common.h"
+#include "arena.h"
+#include "literal.h"
 #include "location.h"
 #include "symbol.h"
-#include <vector>
-
-namespace yy {
-absyn::ExprAST *expseq_to_expr(absyn::ExprSeq *);
-}
+#include <optional>
 
 namespace absyn {
 using symbol::Symbol;
@@ -27,13 +25,23 @@ enum class Op : int {
   kOr,
 };
 
+struct ExprWithLoc {
+  ExprAST exp;
+  Location pos;
+};
+
+struct SymbolWithLoc {
+  Symbol sym;
+  Location pos;
+};
+
 struct RExprField {
   Symbol name;
   ExprAST value;
   Location pos;
 
-  RExprField(const char *name, ExprAST *value, Location pos)
-      : name(name), value(std::move(*value)), pos(pos) {}
+  RExprField(Symbol name, ExprAST *value, Location pos)
+      : name(name), value(*value), pos(pos) {}
 };
 
 struct Type {
@@ -41,8 +49,8 @@ struct Type {
   Ty type;
   Location pos;
 
-  Type(const char *name, Ty *type, Location pos)
-      : name(name), type(std::move(*type)), pos(pos) {}
+  Type(Symbol name, Ty *type, Location pos)
+      : name(name), type(*type), pos(pos) {}
 };
 
 struct RTyField {
@@ -50,74 +58,15 @@ struct RTyField {
   bool escape{true};
   Location pos;
 
-  RTyField(const char *name, const char *type_id, Location pos)
+  RTyField(Symbol name, Symbol type_id, Location pos)
       : name(name), type_id(type_id), pos(pos) {}
 };
 
-struct ExprWithLoc {
-  ExprAST exp;
-  Location pos;
-};
-
-struct SymbolWithLoc {
-  Symbol sym;
-  Location pos;
-};
-
-// Temporary classes for AST building convenience {{{
-class ExprSeq {
-  std::vector<ExprWithLoc> seq;
-  friend class CallExprAST;
-  friend class SeqExprAST;
-  friend ExprAST *yy::expseq_to_expr(ExprSeq *);
-
-public:
-  ExprSeq() = default;
-  void AddExpr(ExprAST *exp, Location pos) {
-    seq.push_back({std::move(*exp), pos});
-  }
-};
-
-class DeclSeq {
-  std::vector<DeclAST> seq;
-  friend class LetExprAST;
-
-public:
-  DeclSeq() = default;
-  void AddDecl(DeclAST *decl) { seq.push_back(std::move(*decl)); }
-};
-
-class RExprFieldSeq {
-  std::vector<RExprField> seq;
-  friend class RecordExprAST;
-
-public:
-  RExprFieldSeq() = default;
-  void AddField(RExprField *field) {
-    seq.push_back(std::move(*field));
-    delete field;
-  }
-};
-
-class RTyFieldSeq {
-  std::vector<RTyField> seq;
-  friend class RecordTy;
-  friend class FundecTy;
-
-public:
-  RTyFieldSeq() = default;
-  void AddField(RTyField *field) {
-    seq.push_back(*field);
-    delete field;
-  }
-};
-// }}} Temporary classes for AST building convenience
-
 struct SimpleVarAST {
   Symbol id;
   Location pos;
 
-  SimpleVarAST(const char *id, Location pos) : id(id), pos(pos) {}
+  SimpleVarAST(Symbol id, Location pos) : id(id), pos(pos) {}
 };
 
 struct FieldVarAST {
@@ -125,174 +74,169 @@ struct FieldVarAST {
   Symbol field;
   Location pos;
 
-  FieldVarAST(VarAST *var, const char *field, Location pos)
-      : var(std::move(*var)), field(field), pos(pos) {}
+  FieldVarAST(VarAST *var, Symbol field, Location pos)
+      : var(*var), field(field), pos(pos) {}
 };
 
 struct IndexVarAST {
   VarAST var;
   ExprAST index;
+  // cleared by remove_bounds_checks() if index is known to be in range
+  bool checked{true};
   Location pos;
 
   IndexVarAST(VarAST *var, ExprAST *index, Location pos)
-      : var(std::move(*var)), index(std::move(*index)), pos(pos) {}
+      : var(*var), index(*index), pos(pos) {}
 };
 
-struct VarExprAST : ExprAST {
+struct VarExprAST {
   VarAST var;
 
-  VarExprAST(VarAST *var) : var(std::move(*var)) {}
+  VarExprAST(VarAST *var) : var(*var) {}
 };
 
-struct NilExprAST : ExprAST {};
+struct NilExprAST {};
 
-struct IntExprAST : ExprAST {
+struct IntExprAST {
   int val;
 
   IntExprAST(int val) : val(val) {}
 };
 
-struct StringExprAST : ExprAST {
-  Symbol val;
+struct StringExprAST {
+  literal::Literal val;
 
-  StringExprAST(const char *val) : val(val) {}
+  StringExprAST(literal::Literal val) : val(val) {}
 };
 
-struct CallExprAST : ExprAST {
+struct CallExprAST {
   Symbol func;
-  std::vector<ExprWithLoc> args;
+  Seq<ExprWithLoc> args;
+  // set by find_tail_calls() if nothing's left to do after the call
+  bool tail{false};
   Location pos;
 
-  CallExprAST(const char *fn, ExprSeq *args, Location pos)
-      : func(fn), args(std::move(args->seq)), pos(pos) {
-    delete args;
-  }
+  CallExprAST(Symbol fn, ExprSeq *args, Location pos)
+      : func(fn), args(args->Finish()), pos(pos) {}
 };
 
-struct OpExprAST : ExprAST {
+struct OpExprAST {
   ExprAST lhs, rhs;
   Op op;
+  // set by semant if the operands are strings, which compare by contents
+  bool strings{false};
   Location pos;
 
   OpExprAST(ExprAST *lhs, ExprAST *rhs, Op op, Location pos)
-      : lhs(std::move(*lhs)), rhs(std::move(*rhs)), op(op), pos(pos) {}
+      : lhs(*lhs), rhs(*rhs), op(op), pos(pos) {}
 };
 
-struct RecordExprAST : ExprAST {
+struct RecordExprAST {
   Symbol type_id;
-  std::vector<RExprField> fields;
+  Seq<RExprField> fields;
   Location pos;
 
-  RecordExprAST(const char *type_id, RExprFieldSeq *args, Location pos)
-      : type_id(type_id), fields(std::move(args->seq)), pos(pos) {
-    delete args;
-  }
+  RecordExprAST(Symbol type_id, RExprFieldSeq *args, Location pos)
+      : type_id(type_id), fields(args->Finish()), pos(pos) {}
 };
 
-struct ArrayExprAST : ExprAST {
+struct ArrayExprAST {
   Symbol type_id;
   ExprAST size, init;
   Location pos;
 
-  ArrayExprAST(const char *type_id, ExprAST *size, ExprAST *init, Location pos)
-      : type_id(type_id), size(std::move(*size)), init(std::move(*init)),
-        pos(pos) {}
+  ArrayExprAST(Symbol type_id, ExprAST *size, ExprAST *init, Location pos)
+      : type_id(type_id), size(*size), init(*init), pos(pos) {}
 };
 
-struct SeqExprAST : ExprAST {
-  std::vector<ExprWithLoc> exps;
+struct SeqExprAST {
+  Seq<ExprWithLoc> exps;
 
-  SeqExprAST(ExprSeq *exps) : exps(std::move(exps->seq)) { delete exps; }
+  SeqExprAST(ExprSeq *exps) : exps(exps->Finish()) {}
 };
 
-struct AssignExprAST : ExprAST {
+struct AssignExprAST {
   VarAST var;
   ExprAST exp;
   Location pos;
 
   AssignExprAST(VarAST *var, ExprAST *exp, Location pos)
-      : var(std::move(*var)), exp(std::move(*exp)), pos(pos) {}
+      : var(*var), exp(*exp), pos(pos) {}
 };
 
-struct IfExprAST : ExprAST {
+struct IfExprAST {
   ExprAST cond, then;
   std::optional<ExprAST> else_;
   Location pos;
 
   IfExprAST(ExprAST *cond, ExprAST *then, ExprAST *else_, Location pos)
-      : cond(std::move(*cond)), then(std::move(*then)),
-        else_(else_ ? std::move(*else_) : std::optional<ExprAST>{}), pos(pos) {}
+      : cond(*cond), then(*then),
+        else_(else_ ? *else_ : std::optional<ExprAST>{}), pos(pos) {}
 };
 
-struct WhileExprAST : ExprAST {
+struct WhileExprAST {
   ExprAST cond, body;
   Location pos;
 
   WhileExprAST(ExprAST *cond, ExprAST *body, Location pos)
-      : cond(std::move(*cond)), body(std::move(*body)), pos(pos) {}
+      : cond(*cond), body(*body), pos(pos) {}
 };
 
-struct ForExprAST : ExprAST {
+struct ForExprAST {
   Symbol var;
   ExprAST lo, hi, body;
   bool escape{true};
   Location pos;
 
-  ForExprAST(const char *var, ExprAST *lo, ExprAST *hi, ExprAST *body,
-             Location pos)
-      : var(var), lo(std::move(*lo)), hi(std::move(*hi)),
-        body(std::move(*body)), pos(pos) {}
+  ForExprAST(Symbol var, ExprAST *lo, ExprAST *hi, ExprAST *body, Location pos)
+      : var(var), lo(*lo), hi(*hi), body(*body), pos(pos) {}
 };
 
-struct BreakExprAST : ExprAST {
+struct BreakExprAST {
   Location pos;
 
   BreakExprAST(Location pos) : pos(pos) {}
 };
 
-struct LetExprAST : ExprAST {
-  std::vector<DeclAST> decs;
+struct LetExprAST {
+  Seq<DeclAST> decs;
   ExprAST body;
   Location pos;
 
   LetExprAST(DeclSeq *decs, ExprAST *exp, Location pos)
-      : decs(std::move(decs->seq)), body(std::move(*exp)), pos(pos) {
-    delete decs;
-  }
+      : decs(decs->Finish()), body(*exp), pos(pos) {}
 };
 
-struct UnitExprAST : ExprAST {};
+struct UnitExprAST {};
+
+// Stands in for an expression the parser skipped over after a syntax error,
+// which has already been reported
+struct ErrorExprAST {};
 
 struct NameTy {
   Symbol type_id;
   Location pos;
 
-  NameTy(const char *id, Location pos) : type_id(id), pos(pos) {}
+  NameTy(Symbol id, Location pos) : type_id(id), pos(pos) {}
 };
 
 struct RecordTy {
-  std::vector<RTyField> fields;
+  Seq<RTyField> fields;
 
-  RecordTy(RTyFieldSeq *fields) : fields(std::move(fields->seq)) {
-    delete fields;
-  }
+  RecordTy(RTyFieldSeq *fields) : fields(fields->Finish()) {}
 };
 
 struct ArrayTy {
   Symbol type_id;
   Location pos;
 
-  ArrayTy(const char *id, Location pos) : type_id(id), pos(pos) {}
+  ArrayTy(Symbol id, Location pos) : type_id(id), pos(pos) {}
 };
 
 struct TypeDeclAST {
-  std::vector<Type> types;
+  Seq<Type> types;
 
-  TypeDeclAST() = default;
-  void AddType(Type *type) {
-    types.push_back(std::move(*type));
-    delete type;
-  }
+  TypeDeclAST(TypeSeq *types) : types(types->Finish()) {}
 };
 
 struct VarDeclAST {
@@ -302,39 +246,33 @@ struct VarDeclAST {
   ExprAST init;
   Location pos;
 
-  VarDeclAST(const char *name, const char *type_id, Location pos_typ,
-             ExprAST *init, Location pos)
-      : name(name), type_id(type_id ? SymbolWithLoc{Symbol(type_id), pos_typ}
+  VarDeclAST(Symbol name, Symbol type_id, Location pos_typ, ExprAST *init,
+             Location pos)
+      : name(name), type_id(type_id ? SymbolWithLoc{type_id, pos_typ}
                                     : std::optional<SymbolWithLoc>{}),
-        init(std::move(*init)), pos(pos) {}
+        init(*init), pos(pos) {}
 };
 
 struct FundecTy {
   Symbol name;
-  std::vector<RTyField> params;
+  Seq<RTyField> params;
   std::optional<SymbolWithLoc> result;
   ExprAST body;
   Location pos;
 
-  FundecTy(const char *name, RTyFieldSeq *params, const char *result,
-           Location pos_res, ExprAST *body, Location pos)
-      : name(name), params(std::move(params->seq)),
-        result(result ? SymbolWithLoc{Symbol(result), pos_res}
+  FundecTy(Symbol name, RTyFieldSeq *params, Symbol result, Location pos_res,
+           ExprAST *body, Location pos)
+      : name(name), params(params->Finish()),
+        result(result ? SymbolWithLoc{result, pos_res}
                       : std::optional<SymbolWithLoc>{}),
-        body(std::move(*body)), pos(pos) {
-    delete params;
-  }
+        body(*body), pos(pos) {}
   void print(int indent);
 };
 
 struct FuncDeclAST {
-  std::vector<FundecTy> decls;
+  Seq<FundecTy> decls;
 
-  FuncDeclAST() = default;
-  void AddFunc(FundecTy *decl) {
-    decls.push_back(std::move(*decl));
-    delete decl;
-  }
+  FuncDeclAST(FundecSeq *decls) : decls(decls->Finish()) {}
 };
 
 } // namespace absyn
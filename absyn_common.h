@@ -1,8 +1,6 @@
 #ifndef ABSYN_COMMON_H
 #define ABSYN_COMMON_H
-#include <memory>
 #include <variant>
-template <typename T> using uptr = std::unique_ptr<T>;
 
 namespace symbol {
 class Symbol;
@@ -13,8 +11,7 @@ namespace absyn {
 struct SimpleVarAST;
 struct FieldVarAST;
 struct IndexVarAST;
-using VarAST =
-    std::variant<uptr<SimpleVarAST>, uptr<FieldVarAST>, uptr<IndexVarAST>>;
+using VarAST = std::variant<SimpleVarAST *, FieldVarAST *, IndexVarAST *>;
 
 struct VarExprAST;
 struct NilExprAST;
@@ -32,33 +29,39 @@ struct ForExprAST;
 struct BreakExprAST;
 struct LetExprAST;
 struct UnitExprAST;
+struct ErrorExprAST;
 
-using ExprAST = std::variant<
-    uptr<VarExprAST>, uptr<NilExprAST>, uptr<IntExprAST>, uptr<StringExprAST>,
-    uptr<CallExprAST>, uptr<OpExprAST>, uptr<RecordExprAST>, uptr<ArrayExprAST>,
-    uptr<SeqExprAST>, uptr<AssignExprAST>, uptr<IfExprAST>, uptr<WhileExprAST>,
-    uptr<ForExprAST>, uptr<BreakExprAST>, uptr<LetExprAST>, uptr<UnitExprAST>>;
+using ExprAST =
+    std::variant<VarExprAST *, NilExprAST *, IntExprAST *, StringExprAST *,
+                 CallExprAST *, OpExprAST *, RecordExprAST *, ArrayExprAST *,
+                 SeqExprAST *, AssignExprAST *, IfExprAST *, WhileExprAST *,
+                 ForExprAST *, BreakExprAST *, LetExprAST *, UnitExprAST *,
+                 ErrorExprAST *>;
 
 struct NameTy;
 struct RecordTy;
 struct ArrayTy;
-using Ty = std::variant<uptr<NameTy>, uptr<RecordTy>, uptr<ArrayTy>>;
+using Ty = std::variant<NameTy *, RecordTy *, ArrayTy *>;
 
 struct TypeDeclAST;
 struct VarDeclAST;
 struct FuncDeclAST;
-using DeclAST =
-    std::variant<uptr<TypeDeclAST>, uptr<VarDeclAST>, uptr<FuncDeclAST>>;
+using DeclAST = std::variant<TypeDeclAST *, VarDeclAST *, FuncDeclAST *>;
 
 struct RExprField;
 struct RTyField;
 struct Type;
 struct FundecTy;
 
-class ExprSeq;
-class DeclSeq;
-class RExprFieldSeq;
-class RTyFieldSeq;
+class Arena;
+template <typename T> class SeqBuilder;
+struct ExprWithLoc;
+using ExprSeq = SeqBuilder<ExprWithLoc>;
+using DeclSeq = SeqBuilder<DeclAST>;
+using RExprFieldSeq = SeqBuilder<RExprField>;
+using RTyFieldSeq = SeqBuilder<RTyField>;
+using TypeSeq = SeqBuilder<Type>;
+using FundecSeq = SeqBuilder<FundecTy>;
 
 } // namespace absyn
 #endif
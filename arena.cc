@@ -0,0 +1,32 @@
+#include "arena.h"
+#include <algorithm>
+#include <cstdlib>
+
+namespace absyn {
+
+Arena::~Arena() {
+  while (chunks_) {
+    Chunk *next = chunks_->next;
+    std::free(chunks_);
+    chunks_ = next;
+  }
+}
+
+uintptr_t Arena::Grow(size_t size, size_t align) {
+  // Oversized requests get a chunk of their own, so a huge literal array
+  // doesn't waste the tail of a regular chunk.
+  size_t need = sizeof(Chunk) + size + align;
+  size_t chunk_size = std::max(need, kChunkSize);
+  auto *chunk = static_cast<Chunk *>(std::malloc(chunk_size));
+  if (!chunk)
+    throw std::bad_alloc();
+  chunk->next = chunks_;
+  chunk->size = chunk_size;
+  chunks_ = chunk;
+  stats_.chunks++;
+  cur_ = reinterpret_cast<uintptr_t>(chunk + 1);
+  end_ = reinterpret_cast<uintptr_t>(chunk) + chunk_size;
+  return (cur_ + align - 1) & ~(uintptr_t)(align - 1);
+}
+
+} // namespace absyn
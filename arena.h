@@ -0,0 +1,112 @@
+#ifndef ARENA_H
+#define ARENA_H
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace absyn {
+
+// A bump allocator that owns every node of one AST. Nodes are never freed one
+// by one: destroying the arena releases all of its chunks at once, which is
+// why everything allocated here has to be trivially destructible.
+class Arena {
+public:
+  struct Stats {
+    size_t allocs;
+    size_t bytes;
+    size_t chunks;
+  };
+
+  Arena() = default;
+  Arena(const Arena &) = delete;
+  Arena &operator=(const Arena &) = delete;
+  ~Arena();
+
+  void *Allocate(size_t size, size_t align) {
+    uintptr_t p = (cur_ + align - 1) & ~(uintptr_t)(align - 1);
+    if (p + size > end_)
+      p = Grow(size, align);
+    cur_ = p + size;
+    stats_.allocs++;
+    stats_.bytes += size;
+    return reinterpret_cast<void *>(p);
+  }
+  template <typename T, typename... Args> T *New(Args &&...args) {
+    static_assert(std::is_trivially_destructible_v<T>,
+                  "arena-allocated objects are never destroyed");
+    return new (Allocate(sizeof(T), alignof(T)))
+        T(std::forward<Args>(args)...);
+  }
+  template <typename T> T *NewArray(size_t n) {
+    static_assert(std::is_trivially_destructible_v<T>,
+                  "arena-allocated objects are never destroyed");
+    return static_cast<T *>(Allocate(n * sizeof(T), alignof(T)));
+  }
+
+  const Stats &stats() const { return stats_; }
+
+private:
+  struct Chunk {
+    Chunk *next;
+    size_t size;
+  };
+  static constexpr size_t kChunkSize = 64 * 1024;
+
+  Chunk *chunks_{nullptr};
+  uintptr_t cur_{0}, end_{0};
+  Stats stats_{};
+
+  uintptr_t Grow(size_t size, size_t align);
+};
+
+// An immutable view of an array living in an Arena.
+template <typename T> class Seq {
+  T *data_{nullptr};
+  uint32_t size_{0};
+
+public:
+  Seq() = default;
+  Seq(T *data, uint32_t size) : data_(data), size_(size) {}
+  T *begin() const { return data_; }
+  T *end() const { return data_ + size_; }
+  T &operator[](size_t i) const { return data_[i]; }
+  T &back() const { return data_[size_ - 1]; }
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+};
+
+// Used by the parser to accumulate sequences of unknown length. The builder
+// itself lives in the arena; outgrown buffers are simply abandoned there.
+template <typename T> class SeqBuilder {
+  static_assert(std::is_trivially_copyable_v<T>);
+  Arena &arena_;
+  T *data_{nullptr};
+  uint32_t size_{0}, cap_{0};
+
+public:
+  explicit SeqBuilder(Arena &arena) : arena_(arena) {}
+  void Add(const T &v) {
+    if (size_ == cap_)
+      Reserve(cap_ ? cap_ * 2 : 4);
+    new (&data_[size_++]) T(v);
+  }
+  // Makes room for `cap` elements in all, so that a builder whose length is
+  // known up front allocates once
+  void Reserve(uint32_t cap) {
+    if (cap <= cap_)
+      return;
+    T *data = arena_.NewArray<T>(cap);
+    if (size_)
+      std::memcpy(static_cast<void *>(data), data_, size_ * sizeof(T));
+    data_ = data;
+    cap_ = cap;
+  }
+  Seq<T> Finish() const { return {data_, size_}; }
+  size_t size() const { return size_; }
+};
+
+} // namespace absyn
+#endif
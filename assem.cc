@@ -0,0 +1,41 @@
+#include "assem.h"
+#include "logging.h"
+
+namespace assem {
+
+std::string format(const Instr &instr,
+                   const std::function<std::string(temp::Temp)> &name) {
+  std::string out;
+  const std::string &s = instr.assem;
+  for (size_t i = 0; i < s.size(); i++) {
+    if (s[i] != '\'') {
+      out += s[i];
+      continue;
+    }
+    char kind = s[++i];
+    if (kind == '\'') {
+      out += '\'';
+      continue;
+    }
+    size_t n = s[++i] - '0';
+    switch (kind) {
+    case 's':
+      CHECK(n < instr.src.size()) << s;
+      out += name(instr.src[n]);
+      break;
+    case 'd':
+      CHECK(n < instr.dst.size()) << s;
+      out += name(instr.dst[n]);
+      break;
+    case 'j':
+      CHECK(n < instr.jumps.size()) << s;
+      out += instr.jumps[n].name();
+      break;
+    default:
+      LOG_FATAL << "bad operand in " << s;
+    }
+  }
+  return out;
+}
+
+} // namespace assem
@@ -0,0 +1,55 @@
+#ifndef ASSEM_H
+#define ASSEM_H
+#include "temp.h"
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Machine instructions over temps, as in Appel's Assem module. The text of
+// an instruction refers to its operands by position: 's0 is the first
+// source, 'd0 the first destination and 'j0 the first jump target.
+namespace assem {
+
+struct Instr {
+  enum class Kind : uint8_t { kOper, kLabel, kMove, kCall };
+  Kind kind;
+  std::string assem;
+  std::vector<temp::Temp> dst, src;
+  // Where an operation can go next, if it's a jump; otherwise it goes on to
+  // the next instruction. A conditional jump lists the label it falls
+  // through to as well.
+  std::vector<temp::Label> jumps;
+  // the label a kLabel defines, or the one a kCall returns to, which the
+  // allocator sets
+  temp::Label label;
+
+  static Instr oper(std::string assem, std::vector<temp::Temp> dst,
+                    std::vector<temp::Temp> src,
+                    std::vector<temp::Label> jumps = {}) {
+    return {Kind::kOper, std::move(assem), std::move(dst), std::move(src),
+            std::move(jumps), temp::Label()};
+  }
+  // a copy of one temp to another, which the allocator may coalesce
+  static Instr move(std::string assem, temp::Temp dst, temp::Temp src) {
+    return {Kind::kMove, std::move(assem), {dst}, {src}, {}, temp::Label()};
+  }
+  // a call to a function that may collect, whose frame has to say where
+  // the records and arrays live across it are
+  static Instr call(std::string assem, std::vector<temp::Temp> dst,
+                    std::vector<temp::Temp> src) {
+    return {Kind::kCall, std::move(assem), std::move(dst), std::move(src),
+            {}, temp::Label()};
+  }
+  static Instr label_at(std::string assem, temp::Label label) {
+    return {Kind::kLabel, std::move(assem), {}, {}, {}, label};
+  }
+};
+
+// The text of the instruction with its operands filled in, each temp named
+// by `name`
+std::string format(const Instr &instr,
+                   const std::function<std::string(temp::Temp)> &name);
+
+} // namespace assem
+#endif
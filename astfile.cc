@@ -0,0 +1,652 @@
+#include "astfile.h"
+#include "absyn.h"
+#include "compilation.h"
+#include "logging.h"
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <string_view>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <type_traits>
+#include <unistd.h>
+#include <variant>
+#include <vector>
+
+namespace astfile {
+
+namespace {
+using namespace absyn;
+
+constexpr char kMagic[8] = {'t', 'i', 'g', 'e', 'r', 'a', 's', 't'};
+constexpr uint32_t kNone = ~0u;
+// marks a Location that didn't fit in a word
+constexpr uint32_t kWide = 1u << 31;
+
+struct Header {
+  char magic[8];
+  uint32_t version;
+  uint32_t symbols, literals, words, root, chars, path;
+};
+
+// the tag of T's nodes: its alternative in the variant V
+template <typename V, typename T, size_t I = 0> constexpr uint32_t tag() {
+  if constexpr (std::is_same_v<std::variant_alternative_t<I, V>, T *>)
+    return I;
+  else
+    return tag<V, T, I + 1>();
+}
+
+// Writes the nodes in post-order, so that each child's record is written,
+// and its offset known, before its parent's
+class Encoder {
+public:
+  Encoder(const Compilation &comp)
+      : sym_index_(comp.symbols.size(), kNone),
+        lit_index_(comp.literals.size(), kNone) {
+    chars_ = comp.path;
+  }
+
+  uint32_t node(ExprAST &e) { return std::visit(*this, e); }
+  uint32_t node(VarAST &v) { return std::visit(*this, v); }
+  uint32_t node(Ty &t) { return std::visit(*this, t); }
+  uint32_t node(DeclAST &d) { return std::visit(*this, d); }
+
+  // the whole file, rooted at `root`
+  std::string finish(uint32_t root, size_t path_size) {
+    Header h;
+    std::memcpy(h.magic, kMagic, sizeof kMagic);
+    h.version = kVersion;
+    h.symbols = syms_.size() / 2;
+    h.literals = lits_.size() / 2;
+    h.words = words_.size();
+    h.root = root;
+    h.chars = chars_.size();
+    h.path = path_size;
+    std::string out(reinterpret_cast<const char *>(&h), sizeof h);
+    auto append = [&](const std::vector<uint32_t> &words) {
+      out.append(reinterpret_cast<const char *>(words.data()),
+                 words.size() * sizeof(uint32_t));
+    };
+    append(syms_);
+    append(lits_);
+    append(words_);
+    return out + chars_;
+  }
+
+  uint32_t operator()(SimpleVarAST *v) {
+    return record(tag<VarAST, SimpleVarAST>(), sym(v->id), v->pos);
+  }
+  uint32_t operator()(FieldVarAST *v) {
+    return record(tag<VarAST, FieldVarAST>(), node(v->var), sym(v->field),
+                  v->pos);
+  }
+  uint32_t operator()(IndexVarAST *v) {
+    return record(tag<VarAST, IndexVarAST>(), node(v->var), node(v->index),
+                  v->pos);
+  }
+
+  uint32_t operator()(VarExprAST *e) {
+    return record(tag<ExprAST, VarExprAST>(), node(e->var));
+  }
+  uint32_t operator()(NilExprAST *) {
+    return record(tag<ExprAST, NilExprAST>());
+  }
+  uint32_t operator()(IntExprAST *e) {
+    return record(tag<ExprAST, IntExprAST>(), (uint32_t)e->val);
+  }
+  uint32_t operator()(StringExprAST *e) {
+    return record(tag<ExprAST, StringExprAST>(), lit(e->val));
+  }
+  uint32_t operator()(CallExprAST *e) {
+    auto args = exps(e->args);
+    uint32_t off = record(tag<ExprAST, CallExprAST>(), sym(e->func), e->pos,
+                          (uint32_t)args.size());
+    for (size_t i = 0; i < args.size(); i++)
+      put(args[i], e->args[i].pos);
+    return off;
+  }
+  uint32_t operator()(OpExprAST *e) {
+    return record(tag<ExprAST, OpExprAST>(), node(e->lhs), node(e->rhs),
+                  (uint32_t)e->op, e->pos);
+  }
+  uint32_t operator()(RecordExprAST *e) {
+    std::vector<uint32_t> values;
+    for (auto &field : e->fields)
+      values.push_back(node(field.value));
+    uint32_t off = record(tag<ExprAST, RecordExprAST>(), sym(e->type_id),
+                          e->pos, (uint32_t)values.size());
+    for (size_t i = 0; i < values.size(); i++)
+      put(sym(e->fields[i].name), values[i], e->fields[i].pos);
+    return off;
+  }
+  uint32_t operator()(ArrayExprAST *e) {
+    return record(tag<ExprAST, ArrayExprAST>(), sym(e->type_id),
+                  node(e->size), node(e->init), e->pos);
+  }
+  uint32_t operator()(SeqExprAST *e) {
+    auto items = exps(e->exps);
+    uint32_t off =
+        record(tag<ExprAST, SeqExprAST>(), (uint32_t)items.size());
+    for (size_t i = 0; i < items.size(); i++)
+      put(items[i], e->exps[i].pos);
+    return off;
+  }
+  uint32_t operator()(AssignExprAST *e) {
+    return record(tag<ExprAST, AssignExprAST>(), node(e->var), node(e->exp),
+                  e->pos);
+  }
+  uint32_t operator()(IfExprAST *e) {
+    uint32_t cond = node(e->cond), then = node(e->then);
+    uint32_t else_ = e->else_ ? node(*e->else_) : kNone;
+    return record(tag<ExprAST, IfExprAST>(), cond, then, else_, e->pos);
+  }
+  uint32_t operator()(WhileExprAST *e) {
+    return record(tag<ExprAST, WhileExprAST>(), node(e->cond), node(e->body),
+                  e->pos);
+  }
+  uint32_t operator()(ForExprAST *e) {
+    uint32_t lo = node(e->lo), hi = node(e->hi), body = node(e->body);
+    return record(tag<ExprAST, ForExprAST>(), sym(e->var), lo, hi, body,
+                  e->pos);
+  }
+  uint32_t operator()(BreakExprAST *e) {
+    return record(tag<ExprAST, BreakExprAST>(), e->pos);
+  }
+  uint32_t operator()(LetExprAST *e) {
+    std::vector<uint32_t> decs;
+    for (auto &dec : e->decs)
+      decs.push_back(node(dec));
+    uint32_t body = node(e->body);
+    uint32_t off = record(tag<ExprAST, LetExprAST>(), body, e->pos,
+                          (uint32_t)decs.size());
+    for (auto dec : decs)
+      put(dec);
+    return off;
+  }
+  uint32_t operator()(UnitExprAST *) {
+    return record(tag<ExprAST, UnitExprAST>());
+  }
+  uint32_t operator()(ErrorExprAST *) {
+    return record(tag<ExprAST, ErrorExprAST>());
+  }
+
+  uint32_t operator()(NameTy *t) {
+    return record(tag<Ty, NameTy>(), sym(t->type_id), t->pos);
+  }
+  uint32_t operator()(RecordTy *t) {
+    uint32_t off = record(tag<Ty, RecordTy>());
+    fields(t->fields);
+    return off;
+  }
+  uint32_t operator()(ArrayTy *t) {
+    return record(tag<Ty, ArrayTy>(), sym(t->type_id), t->pos);
+  }
+
+  uint32_t operator()(TypeDeclAST *d) {
+    std::vector<uint32_t> tys;
+    for (auto &type : d->types)
+      tys.push_back(node(type.type));
+    uint32_t off =
+        record(tag<DeclAST, TypeDeclAST>(), (uint32_t)tys.size());
+    for (size_t i = 0; i < tys.size(); i++)
+      put(sym(d->types[i].name), tys[i], d->types[i].pos);
+    return off;
+  }
+  uint32_t operator()(VarDeclAST *d) {
+    uint32_t init = node(d->init);
+    uint32_t off = record(tag<DeclAST, VarDeclAST>(), sym(d->name), init,
+                          d->pos,
+                          d->type_id ? sym(d->type_id->sym) : kNone);
+    if (d->type_id)
+      put(d->type_id->pos);
+    return off;
+  }
+  uint32_t operator()(FuncDeclAST *d) {
+    std::vector<uint32_t> bodies;
+    for (auto &fundec : d->decls)
+      bodies.push_back(node(fundec.body));
+    uint32_t off =
+        record(tag<DeclAST, FuncDeclAST>(), (uint32_t)bodies.size());
+    for (size_t i = 0; i < bodies.size(); i++) {
+      auto &fundec = d->decls[i];
+      put(sym(fundec.name), bodies[i], fundec.pos,
+          fundec.result ? sym(fundec.result->sym) : kNone);
+      if (fundec.result)
+        put(fundec.result->pos);
+      fields(fundec.params);
+    }
+    return off;
+  }
+
+private:
+  std::vector<uint32_t> words_;
+  // (offset, length) pairs into chars_
+  std::vector<uint32_t> syms_, lits_;
+  std::string chars_;
+  // the index in the table of each symbol and literal, by ID
+  std::vector<uint32_t> sym_index_, lit_index_;
+
+  uint32_t sym(Symbol s) {
+    auto &index = sym_index_[s.id()];
+    if (index == kNone)
+      index = add_string(syms_, s.name());
+    return index;
+  }
+  uint32_t lit(literal::Literal l) {
+    auto &index = lit_index_[l.id()];
+    if (index == kNone)
+      index = add_string(lits_, l.value());
+    return index;
+  }
+  uint32_t add_string(std::vector<uint32_t> &table, std::string_view s) {
+    table.push_back(chars_.size());
+    table.push_back(s.size());
+    chars_ += s;
+    return table.size() / 2 - 1;
+  }
+
+  void put() {}
+  template <typename... Rest> void put(uint32_t word, Rest... rest) {
+    words_.push_back(word);
+    put(rest...);
+  }
+  template <typename... Rest> void put(Location pos, Rest... rest) {
+    auto line = (uint32_t)pos.line, column = (uint32_t)pos.column;
+    if (line < (1u << 19) && column < (1u << 12)) {
+      words_.push_back(line << 12 | column);
+    } else {
+      words_.push_back(kWide);
+      words_.push_back(line);
+      words_.push_back(column);
+    }
+    put(rest...);
+  }
+  // starts a record, returning its offset
+  template <typename... Fields> uint32_t record(uint32_t tag, Fields... f) {
+    auto off = (uint32_t)words_.size();
+    put(tag, f...);
+    return off;
+  }
+
+  std::vector<uint32_t> exps(Seq<ExprWithLoc> exps) {
+    std::vector<uint32_t> out;
+    for (auto &exp : exps)
+      out.push_back(node(exp.exp));
+    return out;
+  }
+  void fields(Seq<RTyField> fields) {
+    put((uint32_t)fields.size());
+    for (auto &field : fields)
+      put(sym(field.name), sym(field.type_id), field.pos);
+  }
+};
+
+// thrown on finding the data isn't what encode() writes
+struct Damaged {};
+
+// Reads each record where its parent says it is, after checking that it's
+// before the parent's, so that a damaged file can't make decoding loop
+class Decoder {
+public:
+  Decoder(Compilation &comp, const uint32_t *words, uint32_t size)
+      : arena_(comp.arena), words_(words), size_(size), used_(size) {}
+
+  std::vector<Symbol> syms;
+  std::vector<literal::Literal> lits;
+
+  ExprAST expr(uint32_t off) {
+    Cursor c{*this, off};
+    switch (c.word()) {
+    case tag<ExprAST, VarExprAST>(): {
+      VarAST v = var(c.child());
+      return make<VarExprAST>(&v);
+    }
+    case tag<ExprAST, NilExprAST>():
+      return make<NilExprAST>();
+    case tag<ExprAST, IntExprAST>():
+      return make<IntExprAST>((int)c.word());
+    case tag<ExprAST, StringExprAST>():
+      return make<StringExprAST>(c.lit());
+    case tag<ExprAST, CallExprAST>(): {
+      Symbol func = c.sym();
+      Location pos = c.pos();
+      ExprSeq args(arena_);
+      exps(c, args);
+      return make<CallExprAST>(func, &args, pos);
+    }
+    case tag<ExprAST, OpExprAST>(): {
+      ExprAST lhs = expr(c.child()), rhs = expr(c.child());
+      uint32_t op = c.word();
+      if (op > (uint32_t)Op::kOr)
+        throw Damaged();
+      return make<OpExprAST>(&lhs, &rhs, (Op)op, c.pos());
+    }
+    case tag<ExprAST, RecordExprAST>(): {
+      Symbol type_id = c.sym();
+      Location pos = c.pos();
+      RExprFieldSeq fields(arena_);
+      uint32_t n = c.count();
+      fields.Reserve(n);
+      for (uint32_t i = 0; i < n; i++) {
+        Symbol name = c.sym();
+        ExprAST value = expr(c.child());
+        fields.Add(RExprField(name, &value, c.pos()));
+      }
+      return make<RecordExprAST>(type_id, &fields, pos);
+    }
+    case tag<ExprAST, ArrayExprAST>(): {
+      Symbol type_id = c.sym();
+      ExprAST size = expr(c.child()), init = expr(c.child());
+      return make<ArrayExprAST>(type_id, &size, &init, c.pos());
+    }
+    case tag<ExprAST, SeqExprAST>(): {
+      ExprSeq items(arena_);
+      exps(c, items);
+      return make<SeqExprAST>(&items);
+    }
+    case tag<ExprAST, AssignExprAST>(): {
+      VarAST v = var(c.child());
+      ExprAST exp = expr(c.child());
+      return make<AssignExprAST>(&v, &exp, c.pos());
+    }
+    case tag<ExprAST, IfExprAST>(): {
+      ExprAST cond = expr(c.child()), then = expr(c.child());
+      uint32_t off = c.word();
+      std::optional<ExprAST> else_;
+      if (off != kNone)
+        else_ = expr(c.child(off));
+      return make<IfExprAST>(&cond, &then, else_ ? &*else_ : nullptr,
+                             c.pos());
+    }
+    case tag<ExprAST, WhileExprAST>(): {
+      ExprAST cond = expr(c.child()), body = expr(c.child());
+      return make<WhileExprAST>(&cond, &body, c.pos());
+    }
+    case tag<ExprAST, ForExprAST>(): {
+      Symbol v = c.sym();
+      ExprAST lo = expr(c.child()), hi = expr(c.child()),
+              body = expr(c.child());
+      return make<ForExprAST>(v, &lo, &hi, &body, c.pos());
+    }
+    case tag<ExprAST, BreakExprAST>():
+      return make<BreakExprAST>(c.pos());
+    case tag<ExprAST, LetExprAST>(): {
+      ExprAST body = expr(c.child());
+      Location pos = c.pos();
+      DeclSeq decs(arena_);
+      uint32_t n = c.count();
+      decs.Reserve(n);
+      for (uint32_t i = 0; i < n; i++)
+        decs.Add(decl(c.child()));
+      return make<LetExprAST>(&decs, &body, pos);
+    }
+    case tag<ExprAST, UnitExprAST>():
+      return make<UnitExprAST>();
+    case tag<ExprAST, ErrorExprAST>():
+      return make<ErrorExprAST>();
+    }
+    throw Damaged();
+  }
+
+private:
+  Arena &arena_;
+  const uint32_t *words_;
+  uint32_t size_;
+  // the records already read as a child, which can't be again: a tree that
+  // shared its nodes could take exponentially longer to read than the file
+  std::vector<bool> used_;
+
+  // Reads one record's fields in order
+  struct Cursor {
+    Decoder &d;
+    // the record's offset, which its children's must be less than
+    uint32_t self;
+    uint32_t at{self};
+
+    uint32_t word() {
+      if (at >= d.size_)
+        throw Damaged();
+      return d.words_[at++];
+    }
+    uint32_t child() { return child(word()); }
+    uint32_t child(uint32_t off) {
+      if (off >= self || d.used_[off])
+        throw Damaged();
+      d.used_[off] = true;
+      return off;
+    }
+    // a number of items, each of which takes at least a word
+    uint32_t count() {
+      uint32_t n = word();
+      if (n > d.size_ - at)
+        throw Damaged();
+      return n;
+    }
+    Symbol sym() {
+      uint32_t i = word();
+      if (i >= d.syms.size())
+        throw Damaged();
+      return d.syms[i];
+    }
+    // a symbol that might be absent
+    Symbol maybe_sym() {
+      if (peek() != kNone)
+        return sym();
+      at++;
+      return Symbol(nullptr);
+    }
+    literal::Literal lit() {
+      uint32_t i = word();
+      if (i >= d.lits.size())
+        throw Damaged();
+      return d.lits[i];
+    }
+    Location pos() {
+      uint32_t w = word();
+      if (!(w & kWide))
+        return {(int)(w >> 12), (int)(w & 0xfff)};
+      int line = (int)word();
+      return {line, (int)word()};
+    }
+    uint32_t peek() {
+      if (at >= d.size_)
+        throw Damaged();
+      return d.words_[at];
+    }
+  };
+
+  template <typename T, typename... Args> T *make(Args &&...args) {
+    return arena_.New<T>(std::forward<Args>(args)...);
+  }
+
+  void exps(Cursor &c, ExprSeq &out) {
+    uint32_t n = c.count();
+    out.Reserve(n);
+    for (uint32_t i = 0; i < n; i++) {
+      ExprAST exp = expr(c.child());
+      out.Add({exp, c.pos()});
+    }
+  }
+  RTyFieldSeq fields(Cursor &c) {
+    RTyFieldSeq out(arena_);
+    uint32_t n = c.count();
+    out.Reserve(n);
+    for (uint32_t i = 0; i < n; i++) {
+      Symbol name = c.sym(), type_id = c.sym();
+      out.Add(RTyField(name, type_id, c.pos()));
+    }
+    return out;
+  }
+
+  VarAST var(uint32_t off) {
+    Cursor c{*this, off};
+    switch (c.word()) {
+    case tag<VarAST, SimpleVarAST>(): {
+      Symbol id = c.sym();
+      return make<SimpleVarAST>(id, c.pos());
+    }
+    case tag<VarAST, FieldVarAST>(): {
+      VarAST v = var(c.child());
+      Symbol field = c.sym();
+      return make<FieldVarAST>(&v, field, c.pos());
+    }
+    case tag<VarAST, IndexVarAST>(): {
+      VarAST v = var(c.child());
+      ExprAST index = expr(c.child());
+      return make<IndexVarAST>(&v, &index, c.pos());
+    }
+    }
+    throw Damaged();
+  }
+
+  Ty ty(uint32_t off) {
+    Cursor c{*this, off};
+    switch (c.word()) {
+    case tag<Ty, NameTy>(): {
+      Symbol id = c.sym();
+      return make<NameTy>(id, c.pos());
+    }
+    case tag<Ty, RecordTy>(): {
+      auto f = fields(c);
+      return make<RecordTy>(&f);
+    }
+    case tag<Ty, ArrayTy>(): {
+      Symbol id = c.sym();
+      return make<ArrayTy>(id, c.pos());
+    }
+    }
+    throw Damaged();
+  }
+
+  DeclAST decl(uint32_t off) {
+    Cursor c{*this, off};
+    switch (c.word()) {
+    case tag<DeclAST, TypeDeclAST>(): {
+      TypeSeq types(arena_);
+      uint32_t n = c.count();
+      types.Reserve(n);
+      for (uint32_t i = 0; i < n; i++) {
+        Symbol name = c.sym();
+        Ty type = ty(c.child());
+        types.Add(Type(name, &type, c.pos()));
+      }
+      return make<TypeDeclAST>(&types);
+    }
+    case tag<DeclAST, VarDeclAST>(): {
+      Symbol name = c.sym();
+      ExprAST init = expr(c.child());
+      Location pos = c.pos();
+      Symbol type_id = c.maybe_sym();
+      Location pos_typ = type_id ? c.pos() : pos;
+      return make<VarDeclAST>(name, type_id, pos_typ, &init, pos);
+    }
+    case tag<DeclAST, FuncDeclAST>(): {
+      FundecSeq decls(arena_);
+      uint32_t n = c.count();
+      decls.Reserve(n);
+      for (uint32_t i = 0; i < n; i++) {
+        Symbol name = c.sym();
+        ExprAST body = expr(c.child());
+        Location pos = c.pos();
+        Symbol result = c.maybe_sym();
+        Location pos_res = result ? c.pos() : pos;
+        auto params = fields(c);
+        decls.Add(FundecTy(name, &params, result, pos_res, &body, pos));
+      }
+      return make<FuncDeclAST>(&decls);
+    }
+    }
+    throw Damaged();
+  }
+};
+} // namespace
+
+std::string encode(const Compilation &comp) {
+  Encoder encoder(comp);
+  uint32_t root = encoder.node(*comp.ast);
+  return encoder.finish(root, comp.path.size());
+}
+
+bool write(const char *path, const Compilation &comp) {
+  std::string data = encode(comp);
+  std::FILE *f = std::fopen(path, "wb");
+  if (!f)
+    return false;
+  bool ok = std::fwrite(data.data(), 1, data.size(), f) == data.size();
+  int err = errno;
+  ok = std::fclose(f) == 0 && ok;
+  if (!ok)
+    errno = err;
+  return ok;
+}
+
+bool decode(const void *data, size_t size, Compilation &comp) {
+  comp.ast = nullptr;
+  Header h;
+  if (size < sizeof h)
+    return false;
+  std::memcpy(&h, data, sizeof h);
+  if (std::memcmp(h.magic, kMagic, sizeof kMagic) != 0 ||
+      h.version != kVersion)
+    return false;
+  uint64_t table = 2 * ((uint64_t)h.symbols + h.literals);
+  if (size != sizeof h + 4 * (table + h.words) + h.chars || h.path > h.chars ||
+      h.root >= h.words)
+    return false;
+  // the header is a whole number of words, and the data is mapped at a page
+  // boundary or read into memory aligned for any type
+  auto *table_words =
+      reinterpret_cast<const uint32_t *>(static_cast<const char *>(data) +
+                                         sizeof h);
+  auto *words = table_words + table;
+  std::string_view chars(reinterpret_cast<const char *>(words + h.words),
+                         h.chars);
+  auto string = [&](const uint32_t *entry) {
+    if (entry[0] > chars.size() || entry[1] > chars.size() - entry[0])
+      throw Damaged();
+    return chars.substr(entry[0], entry[1]);
+  };
+  try {
+    Decoder decoder(comp, words, h.words);
+    decoder.syms.reserve(h.symbols);
+    for (uint32_t i = 0; i < h.symbols; i++)
+      decoder.syms.push_back(comp.symbols.intern(string(&table_words[2 * i])));
+    decoder.lits.reserve(h.literals);
+    for (uint32_t i = 0; i < h.literals; i++)
+      decoder.lits.push_back(comp.literals.intern(
+          string(&table_words[2 * ((uint64_t)h.symbols + i)])));
+    ExprAST root = decoder.expr(h.root);
+    comp.ast = comp.arena.New<ExprAST>(root);
+  } catch (const Damaged &) {
+    return false;
+  }
+  comp.path = std::string(chars.substr(0, h.path));
+  return true;
+}
+
+bool load(const char *path, Compilation &comp) {
+  int fd = open(path, O_RDONLY);
+  CHECK(fd >= 0) << path << ": " << std::strerror(errno);
+  struct stat st;
+  if (fstat(fd, &st) < 0) {
+    int err = errno;
+    close(fd);
+    LOG_FATAL << path << ": " << std::strerror(err);
+  }
+  size_t size = st.st_size;
+  if (size == 0) {
+    close(fd);
+    return false;
+  }
+  void *data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  int err = errno;
+  close(fd);
+  CHECK(data != MAP_FAILED) << path << ": " << std::strerror(err);
+  bool ok = decode(data, size, comp);
+  munmap(data, size);
+  return ok;
+}
+
+} // namespace astfile
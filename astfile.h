@@ -0,0 +1,56 @@
+#ifndef ASTFILE_H
+#define ASTFILE_H
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+struct Compilation;
+
+// A program's AST as the parser left it, in a binary file that can be
+// loaded in place of parsing the source again. The file starts with a
+// header, followed by a table of the symbols and literals in the AST, the
+// nodes, and the characters of the strings:
+//
+//   header   "tigerast", then 32-bit words: the version, the number of
+//            symbols, of literals and of node words, the root's offset, the
+//            number of characters and the length of the source's path
+//   strings  an (offset, length) pair of words for each symbol, then each
+//            literal, into the characters
+//   nodes    the records of the nodes, a word each for a tag, which is the
+//            node's alternative in ExprAST, VarAST, DeclAST or Ty, and each
+//            of its fields; children are addressed by the word offset of
+//            their record, always less than their parent's, and no record
+//            is the child of two; symbols and literals by their index in
+//            the table, and an absent symbol or child is ~0. A Location is
+//            packed into one word, line << 12 | column, unless it doesn't
+//            fit, when a word with the top bit set is followed by the line
+//            and the column.
+//   chars    the source's path, then the names and values
+//
+// Words are in the byte order of the machine that wrote them. Nothing the
+// passes after parsing set, such as escapes, is kept.
+namespace astfile {
+
+// changed whenever the layout above is, and the only version loaded
+constexpr uint32_t kVersion = 1;
+
+// The file of comp.ast, with comp.path as the source's path
+std::string encode(const Compilation &comp);
+
+// Writes encode(comp) to `path`, returning whether it could; errno says why
+// if not
+bool write(const char *path, const Compilation &comp);
+
+// Rebuilds the AST in `data` in comp's arena, interning its symbols and
+// literals in comp's, and sets comp.path to the source's path. The nodes are
+// allocated from the arena as they're read; nothing is copied from the data
+// but the strings. Returns false, leaving comp.ast null, if the data isn't
+// a whole file of this version.
+bool decode(const void *data, size_t size, Compilation &comp);
+
+// Maps the file at `path` and decodes it. A file that can't be read is an
+// internal error, like a source file that can't.
+bool load(const char *path, Compilation &comp);
+
+} // namespace astfile
+#endif
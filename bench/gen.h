@@ -0,0 +1,134 @@
+// Generates synthetic Tiger programs that stress one part of the frontend
+// each, at a size given by a scale factor. Every program is well-typed, so
+// all of it goes through semant.
+#ifndef BENCH_GEN_H
+#define BENCH_GEN_H
+#include <string>
+
+namespace gen {
+
+namespace detail {
+
+inline std::string num(long n) { return std::to_string(n); }
+
+// let var v0 := 0 in let var v1 := v0 + 1 in ... end end, `depth` deep
+inline std::string deep_let(int depth) {
+  std::string s;
+  for (int i = 0; i < depth; i++) {
+    s += "let var v" + num(i) + " := ";
+    s += i == 0 ? "0" : "v" + num(i - 1) + " + 1";
+    s += " in\n";
+  }
+  s += depth > 0 ? "v" + num(depth - 1) : "0";
+  for (int i = 0; i < depth; i++)
+    s += " end";
+  return s + "\n";
+}
+
+// one group of `n` mutually recursive functions, each calling the next
+inline std::string wide_funcs(int n) {
+  std::string s = "let\n";
+  for (int i = 0; i < n; i++) {
+    s += "  function f" + num(i) + "(x: int, y: string): int =\n";
+    s += "    if x <= 0 | y = \"" + num(i) + "\" then x else f" +
+         num((i + 1) % n) + "(x - 1, y) + x * 2\n";
+  }
+  return s + "in f0(10, \"\") end\n";
+}
+
+// one group of `n` mutually recursive record and array types, with a
+// function walking each
+inline std::string wide_types(int n) {
+  std::string s = "let\n";
+  for (int i = 0; i < n; i++) {
+    s += "  type r" + num(i) + " = {id: int, name: string, next: r" +
+         num((i + 1) % n) + ", all: a" + num(i) + "}\n";
+    s += "  type a" + num(i) + " = array of r" + num(i) + "\n";
+  }
+  for (int i = 0; i < n; i++) {
+    s += "  function get" + num(i) + "(r: r" + num(i) + "): int =\n";
+    s += "    if r = nil then 0 else r.id + r.all[0].next.id\n";
+  }
+  return s + "in get0(nil) end\n";
+}
+
+// `n` variables, each initialized by a left-associated chain of 1000 terms
+inline std::string long_chain(int n) {
+  static const char *ops[] = {" + ", " - ", " * ", " / "};
+  std::string s = "let\n  var x := 1\n";
+  for (int i = 0; i < n; i++) {
+    s += "  var c" + num(i) + " := x";
+    for (int j = 1; j < 1000; j++)
+      s += ops[j % 4] + num(j % 97 + 1);
+    s += "\n";
+  }
+  return s + "in x end\n";
+}
+
+// `n` 4KB string literals, half of them escape sequences, and as many
+// array creations
+inline std::string literals(int n) {
+  std::string s = "let\n  type ints = array of int\n";
+  for (int i = 0; i < n; i++) {
+    s += "  var s" + num(i) + " := \"";
+    for (int j = 0; j < 512; j++)
+      s += j % 2 ? "abcdefgh" : "\\n\\t\\\"\\065";
+    s += "\"\n  var a" + num(i) + " := ints [" + num(100000 + i) + "] of " +
+         num(i) + "\n";
+  }
+  return s + "in () end\n";
+}
+
+// `n` functions of the kind a person writes: loops, records, arrays and
+// nested lets
+inline std::string mixed(int n) {
+  std::string s = "let\n"
+                  "  type point = {x: int, y: int}\n"
+                  "  type points = array of point\n"
+                  "  type list = {head: point, tail: list}\n";
+  for (int i = 0; i < n; i++) {
+    std::string id = num(i);
+    s += "  function work" + id + "(n: int, l: list): int =\n"
+         "    let\n"
+         "      var ps := points [n] of nil\n"
+         "      var sum := 0\n"
+         "      function len(l: list): int =\n"
+         "        if l = nil then 0 else 1 + len(l.tail)\n"
+         "    in\n"
+         "      for i := 0 to n - 1 do\n"
+         "        ps[i] := point {x = i, y = i * " + id + "};\n"
+         "      while sum < n & l <> nil do\n"
+         "        (sum := sum + l.head.x + ps[sum].y;\n"
+         "         if sum > 1000 then break);\n"
+         "      if n > 0 then sum + len(l) + work" + num(i ? i - 1 : 0) +
+         "(n - 1, l) else sum\n"
+         "    end\n";
+  }
+  return s + "in work" + num(n ? n - 1 : 0) + "(10, nil) end\n";
+}
+
+} // namespace detail
+
+constexpr const char *kWorkloads[] = {"deep_let", "wide_funcs", "wide_types",
+                                      "long_chain", "literals", "mixed"};
+
+// The program for the named workload, or an empty string if there's no such
+// workload
+inline std::string generate(const std::string &name, int scale) {
+  if (name == "deep_let")
+    return detail::deep_let(scale);
+  if (name == "wide_funcs")
+    return detail::wide_funcs(scale);
+  if (name == "wide_types")
+    return detail::wide_types(scale);
+  if (name == "long_chain")
+    return detail::long_chain(scale);
+  if (name == "literals")
+    return detail::literals(scale);
+  if (name == "mixed")
+    return detail::mixed(scale);
+  return "";
+}
+
+} // namespace gen
+#endif
@@ -0,0 +1,139 @@
+// Times the lexer, the parser and semant separately on a generated workload,
+// and loading the AST from the file --emit-ast writes.
+//
+// Usage: bench_phases workload:scale [repetitions]
+//
+// The lexer is timed on its own by pulling every token through yylex. The
+// parser always drives the lexer, so its time is that of a full parse less
+// the lexer's. Loading is from the file's contents in memory, against which
+// the time of lexing and parsing together compares. Each phase reports its
+// best time over the repetitions. Peak RSS is the process's, so run one
+// workload per process.
+#include "astfile.h"
+#include "compilation.h"
+#include "count.h"
+#include "lexer.h"
+#include "semant.h"
+#include "token.h"
+#include "tiger.tab.hh"
+#include "gen.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <sys/resource.h>
+#include <vector>
+
+// defined in lex.yy.cc
+int yylex(Token *yylval, Location *yylloc, void *scanner);
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+double seconds_since(Clock::time_point start) {
+  return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// The scanner writes into its buffer, so each run gets a fresh copy, with
+// the two terminating NULs flex expects
+std::vector<char> scan_buffer(const std::string &src) {
+  std::vector<char> buf(src.begin(), src.end());
+  buf.resize(buf.size() + 2, '\0');
+  return buf;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  std::string spec = argc > 1 ? argv[1] : "";
+  auto colon = spec.find(':');
+  std::string name = spec.substr(0, colon);
+  int scale = colon == std::string::npos ? 0 : std::atoi(&spec[colon + 1]);
+  int reps = argc > 2 ? std::max(1, std::atoi(argv[2])) : 5;
+  std::string src = gen::generate(name, scale);
+  if (src.empty()) {
+    std::fprintf(stderr, "usage: bench_phases workload:scale [reps]\n");
+    return 1;
+  }
+
+  double lex = 1e30, parse = 1e30, load = 1e30, semant = 1e30;
+  size_t tokens = 0, nodes = 0, ast_size = 0;
+  for (int rep = 0; rep < reps; rep++) {
+    {
+      Compilation comp(spec);
+      auto buf = scan_buffer(src);
+      Lexer lexer(comp, buf.data(), buf.size());
+      Token tok;
+      Location loc;
+      size_t n = 0;
+      auto start = Clock::now();
+      while (yylex(&tok, &loc, lexer.scanner()) != 0)
+        n++;
+      lex = std::min(lex, seconds_since(start));
+      tokens = n;
+    }
+
+    Compilation comp(spec);
+    auto buf = scan_buffer(src);
+    {
+      Lexer lexer(comp, buf.data(), buf.size());
+      yy::parser parser(lexer.scanner(), comp);
+      auto start = Clock::now();
+      parser();
+      parse = std::min(parse, seconds_since(start));
+    }
+    if (!comp.ast || !comp.diags.empty()) {
+      for (auto &msg : comp.messages())
+        std::fprintf(stderr, "%s\n", msg.c_str());
+      return 1;
+    }
+    nodes = absyn::count_nodes(*comp.ast).total();
+
+    {
+      std::string ast = astfile::encode(comp);
+      ast_size = ast.size();
+      Compilation loaded(spec);
+      auto start = Clock::now();
+      bool ok = astfile::decode(ast.data(), ast.size(), loaded);
+      load = std::min(load, seconds_since(start));
+      if (!ok) {
+        std::fprintf(stderr, "%s: AST didn't load\n", spec.c_str());
+        return 1;
+      }
+    }
+
+    semant::BaseEnv base(comp.symbols, comp.types, comp.frags.arena());
+    semant::Venv venv(&base.venv);
+    semant::Tenv tenv(&base.tenv);
+    auto start = Clock::now();
+    semant::trans_exp(comp.types, venv, tenv, comp.diags, comp.frags,
+                      *comp.ast);
+    semant = std::min(semant, seconds_since(start));
+    if (!comp.diags.empty()) {
+      for (auto &msg : comp.messages())
+        std::fprintf(stderr, "%s\n", msg.c_str());
+      return 1;
+    }
+  }
+  double lex_parse = parse;
+  parse = std::max(parse - lex, 0.0);
+
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  double mb = src.size() / 1e6;
+  std::printf("%-18s %8.2f MB %9zu tokens %9zu nodes %8ld KB peak RSS\n",
+              spec.c_str(), mb, tokens, nodes, usage.ru_maxrss);
+  std::printf("  lex    %9.3f ms %9.1f MB/s %12.0f tokens/s\n", lex * 1e3,
+              mb / lex, tokens / lex);
+  std::printf("  parse  %9.3f ms %9.1f MB/s %12.0f nodes/s\n", parse * 1e3,
+              mb / parse, nodes / parse);
+  std::printf("  load   %9.3f ms %9.1f MB/s %12.0f nodes/s %6.1fx parsing, "
+              "%.2f MB AST\n",
+              load * 1e3, mb / load, nodes / load, lex_parse / load,
+              ast_size / 1e6);
+  std::printf("  semant %9.3f ms %9.1f MB/s %12.0f nodes/s\n", semant * 1e3,
+              mb / semant, nodes / semant);
+  return 0;
+}
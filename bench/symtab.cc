@@ -0,0 +1,132 @@
+// Compares symbol::Table against the forward_list-of-maps design it replaced,
+// for scope nesting depths from 10 to 10,000.
+#include "symbol.h"
+#include <chrono>
+#include <cstdio>
+#include <forward_list>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+
+// The previous implementation, kept verbatim as the baseline
+template <typename T> class LegacyTable {
+public:
+  using MapType =
+      std::unordered_map<symbol::Symbol, T, symbol::Hash, symbol::Pred>;
+  using value_type = typename MapType::value_type;
+  LegacyTable() { begin_scope(); }
+  bool enter(value_type &&v) {
+    return table_.front().insert(std::move(v)).second;
+  }
+  std::optional<T> look(symbol::Symbol s) {
+    for (auto env = table_.begin(); env != table_.end(); env++) {
+      auto it = env->find(s);
+      if (it != env->end())
+        return it->second;
+    }
+    return std::optional<T>{};
+  }
+  void begin_scope() { table_.push_front(MapType{}); }
+  void end_scope() { table_.pop_front(); }
+
+private:
+  std::forward_list<MapType> table_;
+};
+
+template <typename T> class LegacyScope {
+  LegacyTable<T> &ref_;
+
+public:
+  LegacyScope(LegacyTable<T> &ref) : ref_(ref) { ref_.begin_scope(); }
+  ~LegacyScope() { ref_.end_scope(); }
+};
+
+template <typename Table> struct Traits;
+template <> struct Traits<symbol::Table<int>> {
+  using Scope = symbol::Scope<int>;
+};
+template <> struct Traits<LegacyTable<int>> {
+  using Scope = LegacyScope<int>;
+};
+
+constexpr int kLookups = 1 << 20;
+constexpr int kRounds = 20;
+// symbols bound in each scope, mimicking a let with a few declarations
+constexpr int kPerScope = 4;
+
+std::vector<symbol::Symbol> syms;
+// shadowed at every level, like a common loop variable name
+symbol::Symbol *shared;
+
+double now() {
+  using namespace std::chrono;
+  return duration<double>(steady_clock::now().time_since_epoch()).count();
+}
+
+// Opens `depth` nested scopes, then calls f at the innermost one
+template <typename Table, typename F>
+void nest(Table &t, int level, int depth, F &&f) {
+  if (level == depth) {
+    f();
+    return;
+  }
+  typename Traits<Table>::Scope scope(t);
+  for (int i = 0; i < kPerScope; i++)
+    t.enter({syms[level * kPerScope + i], level});
+  t.enter({*shared, level});
+  nest(t, level + 1, depth, f);
+}
+
+struct Result {
+  double lookup_ns;
+  double scope_ns;
+};
+
+template <typename Table> Result run(int depth) {
+  Result r;
+  Table t;
+  long sink = 0;
+  nest(t, 0, depth, [&] {
+    // Identifiers mostly refer to outer declarations: types and functions
+    // from the top-level let, and the shadowed name at the innermost level.
+    uint32_t x = 12345;
+    double start = now();
+    for (int i = 0; i < kLookups; i++) {
+      x = x * 1103515245 + 12345;
+      int level = (x >> 8) % depth;
+      auto v = (i & 1) ? t.look(*shared)
+                       : t.look(syms[level * kPerScope + (x & 3)]);
+      sink += v.value();
+    }
+    r.lookup_ns = (now() - start) * 1e9 / kLookups;
+  });
+  double start = now();
+  for (int i = 0; i < kRounds; i++)
+    nest(t, 0, depth, [&] { sink++; });
+  r.scope_ns = (now() - start) * 1e9 / kRounds / depth;
+  if (sink == 42)
+    std::printf("\n");
+  return r;
+}
+
+} // namespace
+
+int main() {
+  const int depths[] = {10, 100, 1000, 10000};
+  symbol::Registry registry;
+  for (int i = 0; i < depths[3] * kPerScope; i++)
+    syms.push_back(registry.intern("v" + std::to_string(i)));
+  symbol::Symbol x = registry.intern("x");
+  shared = &x;
+
+  std::printf("%8s %14s %14s %16s %16s\n", "depth", "legacy look", "look",
+              "legacy scope", "scope");
+  for (int depth : depths) {
+    Result old = run<LegacyTable<int>>(depth);
+    Result cur = run<symbol::Table<int>>(depth);
+    std::printf("%8d %11.1f ns %11.1f ns %13.1f ns %13.1f ns\n", depth,
+                old.lookup_ns, cur.lookup_ns, old.scope_ns, cur.scope_ns);
+  }
+}
@@ -0,0 +1,19 @@
+// Usage: tiggen workload scale
+// Writes a synthetic Tiger program to stdout, for feeding to the compiler.
+#include "gen.h"
+#include <cstdio>
+#include <cstdlib>
+
+int main(int argc, char **argv) {
+  std::string prog =
+      argc == 3 ? gen::generate(argv[1], std::atoi(argv[2])) : "";
+  if (prog.empty()) {
+    std::fprintf(stderr, "usage: tiggen workload scale\nworkloads:");
+    for (auto *name : gen::kWorkloads)
+      std::fprintf(stderr, " %s", name);
+    std::fprintf(stderr, "\n");
+    return 1;
+  }
+  std::fwrite(prog.data(), 1, prog.size(), stdout);
+  return 0;
+}
@@ -0,0 +1,198 @@
+// Runs small Tiger programs on the VM, first as the baseline, with switch
+// dispatch and no superinstructions or inline caches, then adding threaded
+// dispatch, superinstructions and inline caches in turn.
+//
+// Usage: bench_vm [repetitions]
+//
+// Each configuration reports its best time over the repetitions, and its
+// speedup over the baseline. Every run's result is checked against the
+// program's known answer.
+#include "bytecode.h"
+#include "compilation.h"
+#include "escape.h"
+#include "lexer.h"
+#include "semant.h"
+#include "token.h"
+#include "vm.h"
+#include "tiger.tab.hh"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+double seconds_since(Clock::time_point start) {
+  return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+struct Program {
+  const char *name;
+  const char *source;
+  int64_t result;
+};
+
+const Program kPrograms[] = {
+    {"fib", R"(
+let
+  function fib(n: int): int =
+    if n < 2 then n else fib(n - 1) + fib(n - 2)
+in
+  fib(27)
+end
+)",
+     196418},
+    {"queens", R"(
+let
+  var N := 8
+  type intArray = array of int
+  var row := intArray [N] of 0
+  var col := intArray [N] of 0
+  var diag1 := intArray [N + N - 1] of 0
+  var diag2 := intArray [N + N - 1] of 0
+  var solutions := 0
+  function try(c: int) =
+    if c = N then solutions := solutions + 1
+    else for r := 0 to N - 1 do
+      if row[r] = 0 & diag1[r + c] = 0 & diag2[r + N - 1 - c] = 0 then
+        (row[r] := 1; diag1[r + c] := 1; diag2[r + N - 1 - c] := 1;
+         col[c] := r;
+         try(c + 1);
+         row[r] := 0; diag1[r + c] := 0; diag2[r + N - 1 - c] := 0)
+in
+  for i := 1 to 50 do try(0);
+  solutions
+end
+)",
+     4600},
+    {"mergesort", R"(
+let
+  type list = {head: int, tail: list}
+  var seed := 42
+  function random(): int =
+    (seed := seed * 75 + 74;
+     seed := seed - seed / 65537 * 65537;
+     seed)
+  function build(n: int): list =
+    let var l: list := nil
+    in for i := 1 to n do l := list {head = random(), tail = l}; l end
+  function merge(a: list, b: list): list =
+    if a = nil then b
+    else if b = nil then a
+    else if a.head <= b.head then list {head = a.head, tail = merge(a.tail, b)}
+    else list {head = b.head, tail = merge(a, b.tail)}
+  function take(l: list, n: int): list =
+    if n = 0 then nil else list {head = l.head, tail = take(l.tail, n - 1)}
+  function drop(l: list, n: int): list =
+    (for i := 1 to n do l := l.tail; l)
+  function sort(l: list, n: int): list =
+    if n <= 1 then l
+    else let var half := n / 2
+         in merge(sort(take(l, half), half), sort(drop(l, half), n - half))
+         end
+  function check(l: list): int =
+    let var ok := 1
+        var sum := 0
+    in while l <> nil do
+         (if l.tail <> nil then (if l.head > l.tail.head then ok := 0);
+          sum := sum + l.head;
+          l := l.tail);
+       if ok then sum else -1
+    end
+  var total := 0
+in
+  for i := 1 to 5 do total := total + check(sort(build(20000), 20000));
+  total
+end
+)",
+     3277144209},
+    {"strings", R"(
+let
+  function digits(n: int): string =
+    if n < 10 then chr(ord("0") + n)
+    else concat(digits(n / 10), chr(ord("0") + n - n / 10 * 10))
+  var s := ""
+  var total := 0
+in
+  for i := 1 to 50000 do
+    (s := concat(s, digits(i));
+     if size(s) > 200 then (total := total + size(s); s := ""));
+  total + size(s)
+end
+)",
+     238894},
+};
+
+struct Config {
+  const char *name;
+  vm::Options options;
+  vm::Dispatch dispatch;
+};
+
+const Config kConfigs[] = {
+    {"baseline", {false, false}, vm::Dispatch::kSwitch},
+    {"threaded", {false, false}, vm::Dispatch::kThreaded},
+    {"+super", {true, false}, vm::Dispatch::kThreaded},
+    {"+ic", {true, true}, vm::Dispatch::kThreaded},
+};
+
+} // namespace
+
+int main(int argc, char **argv) {
+  int reps = argc > 1 ? std::max(1, std::atoi(argv[1])) : 5;
+  for (auto &prog : kPrograms) {
+    Compilation comp(prog.name);
+    // with the two terminating NULs the scanner expects
+    std::string src = std::string(prog.source) + '\0' + '\0';
+    {
+      Lexer lexer(comp, src.data(), src.size());
+      yy::parser parser(lexer.scanner(), comp);
+      parser();
+    }
+    if (comp.ast) {
+      absyn::find_escapes(*comp.ast);
+      semant::BaseEnv base(comp.symbols, comp.types, comp.frags.arena());
+      semant::Venv venv(&base.venv);
+      semant::Tenv tenv(&base.tenv);
+      semant::trans_exp(comp.types, venv, tenv, comp.diags, comp.frags,
+                        *comp.ast);
+    }
+    if (!comp.ast || !comp.diags.empty()) {
+      for (auto &msg : comp.messages())
+        std::fprintf(stderr, "%s\n", msg.c_str());
+      return 1;
+    }
+
+    std::printf("%s\n", prog.name);
+    double baseline = 0;
+    for (auto &config : kConfigs) {
+      auto program = vm::compile(*comp.ast, comp.diags, config.options);
+      size_t words = 0;
+      for (auto &proc : program->procs)
+        words += proc.code.size();
+      double best = 1e30;
+      for (int rep = 0; rep < reps; rep++) {
+        vm::VM machine(*program, config.dispatch);
+        auto start = Clock::now();
+        bool ok = machine.run();
+        best = std::min(best, seconds_since(start));
+        if (!ok || machine.value().i != prog.result) {
+          std::fprintf(stderr, "%s (%s): %s\n", prog.name, config.name,
+                       ok ? ("got " + std::to_string(machine.value().i) +
+                             ", expected " + std::to_string(prog.result))
+                                .c_str()
+                          : machine.error().c_str());
+          return 1;
+        }
+      }
+      if (!baseline)
+        baseline = best;
+      std::printf("  %-10s %6zu words %9.3f ms %6.2fx\n", config.name, words,
+                  best * 1e3, baseline / best);
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,258 @@
+#ifndef BOUNDS_H
+#define BOUNDS_H
+#include "absyn.h"
+#include "symbol.h"
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <unordered_map>
+#include <unordered_set>
+#include <variant>
+
+namespace absyn {
+
+// The subscripts remove_bounds_checks() looked at, by whether they still
+// need their check
+struct BoundsCounts {
+  size_t eliminated{0};
+  size_t remaining{0};
+};
+
+// Clears IndexVarAST::checked on each subscript of a program that has been
+// checked whose index is known to be in range, as a[i] is in
+//
+//   let var a := intArray [n] of 0 in for i := 0 to n - 1 do a[i] := i end
+//
+// An index is known to be in range when it's a constant or a for loop's
+// variable plus a constant, the array is a variable made with a known size
+// that's never assigned, and the loop's bounds keep the index between 0 and
+// the size. Sizes and bounds are compared as a variable that's never
+// assigned, or a constant, plus a constant; a loop's variable can't be
+// assigned in its body.
+BoundsCounts remove_bounds_checks(ExprAST &e);
+
+namespace detail {
+
+class BoundsFinder {
+  // A value as the sum of a variable, by its declaration, and a constant; a
+  // null variable is 0
+  struct Affine {
+    const void *var;
+    int64_t offset;
+  };
+  // What's known of a variable that's never assigned
+  struct Fixed {
+    // its value in terms of another, if its initializer is one
+    std::optional<Affine> value;
+    // a loop variable's bounds
+    std::optional<Affine> lo, hi;
+    // an array's size
+    std::optional<Affine> size;
+  };
+
+  // The declaration each name in scope means: a VarDeclAST, RTyField or
+  // ForExprAST, or null for a function
+  symbol::Table<const void *> env_;
+  // in the first pass, the variables assigned anywhere
+  std::unordered_set<const void *> assigned_;
+  std::unordered_map<const void *, Fixed> fixed_;
+  bool analyzing_{false};
+  BoundsCounts &counts_;
+
+  // the declaration of a variable that's never assigned
+  const void *fixed_var(VarAST &v) {
+    auto *s = std::get_if<SimpleVarAST *>(&v);
+    if (!s)
+      return nullptr;
+    auto decl = env_.look((*s)->id);
+    if (!decl || !*decl || assigned_.count(*decl))
+      return nullptr;
+    return *decl;
+  }
+  Fixed *info(const void *var) {
+    auto it = fixed_.find(var);
+    return it == fixed_.end() ? nullptr : &it->second;
+  }
+
+  std::optional<Affine> affine(ExprAST &e) {
+    if (auto *i = std::get_if<IntExprAST *>(&e))
+      return Affine{nullptr, (*i)->val};
+    if (auto *seq = std::get_if<SeqExprAST *>(&e)) {
+      if ((*seq)->exps.size() == 1)
+        return affine((*seq)->exps[0].exp);
+      return {};
+    }
+    if (auto *v = std::get_if<VarExprAST *>(&e)) {
+      auto *var = fixed_var((*v)->var);
+      if (!var)
+        return {};
+      auto *f = info(var);
+      return f && f->value ? *f->value : Affine{var, 0};
+    }
+    auto *op = std::get_if<OpExprAST *>(&e);
+    if (!op || ((*op)->op != Op::kPlus && (*op)->op != Op::kMinus))
+      return {};
+    auto a = affine((*op)->lhs), b = affine((*op)->rhs);
+    if (!a || !b)
+      return {};
+    if ((*op)->op == Op::kPlus) {
+      if (a->var && b->var)
+        return {};
+      return Affine{a->var ? a->var : b->var, a->offset + b->offset};
+    }
+    // the same variable cancels out
+    if (b->var && b->var != a->var)
+      return {};
+    return Affine{b->var ? nullptr : a->var, a->offset - b->offset};
+  }
+
+  // the least x can be, if that's known
+  std::optional<int64_t> least(Affine x) {
+    if (!x.var)
+      return x.offset;
+    auto *f = info(x.var);
+    if (!f || !f->lo)
+      return {};
+    auto lo = least(*f->lo);
+    return lo ? std::optional<int64_t>(*lo + x.offset) : std::nullopt;
+  }
+  // whether x is always less than limit
+  bool below(Affine x, Affine limit) {
+    if (x.var == limit.var)
+      return x.offset < limit.offset;
+    auto *f = x.var ? info(x.var) : nullptr;
+    if (!f || !f->hi)
+      return false;
+    return below({f->hi->var, f->hi->offset + x.offset}, limit);
+  }
+
+  void check(IndexVarAST *v) {
+    auto *array = fixed_var(v->var);
+    auto *f = array ? info(array) : nullptr;
+    auto index = affine(v->index);
+    auto low = index ? least(*index) : std::nullopt;
+    if (f && f->size && low && *low >= 0 && below(*index, *f->size)) {
+      v->checked = false;
+      counts_.eliminated++;
+    } else {
+      counts_.remaining++;
+    }
+  }
+
+public:
+  explicit BoundsFinder(BoundsCounts &counts) : counts_(counts) {}
+  // the first pass finds what's assigned, the second what's in range
+  void run(ExprAST &e) {
+    find(e);
+    analyzing_ = true;
+    find(e);
+  }
+  void find(ExprAST &e) { std::visit(*this, e); }
+  void find(VarAST &v) { std::visit(*this, v); }
+  void find(DeclAST &d) { std::visit(*this, d); }
+
+  void operator()(SimpleVarAST *) {}
+  void operator()(FieldVarAST *v) { find(v->var); }
+  void operator()(IndexVarAST *v) {
+    find(v->var);
+    find(v->index);
+    if (analyzing_)
+      check(v);
+  }
+
+  void operator()(VarExprAST *e) { find(e->var); }
+  void operator()(NilExprAST *) {}
+  void operator()(IntExprAST *) {}
+  void operator()(StringExprAST *) {}
+  void operator()(CallExprAST *e) {
+    for (auto &arg : e->args)
+      find(arg.exp);
+  }
+  void operator()(OpExprAST *e) {
+    find(e->lhs);
+    find(e->rhs);
+  }
+  void operator()(RecordExprAST *e) {
+    for (auto &field : e->fields)
+      find(field.value);
+  }
+  void operator()(ArrayExprAST *e) {
+    find(e->size);
+    find(e->init);
+  }
+  void operator()(SeqExprAST *e) {
+    for (auto &exp : e->exps)
+      find(exp.exp);
+  }
+  void operator()(AssignExprAST *e) {
+    find(e->var);
+    find(e->exp);
+    if (auto *s = std::get_if<SimpleVarAST *>(&e->var)) {
+      if (auto decl = env_.look((*s)->id); decl && *decl)
+        assigned_.insert(*decl);
+    }
+  }
+  void operator()(IfExprAST *e) {
+    find(e->cond);
+    find(e->then);
+    if (e->else_)
+      find(*e->else_);
+  }
+  void operator()(WhileExprAST *e) {
+    find(e->cond);
+    find(e->body);
+  }
+  void operator()(ForExprAST *e) {
+    find(e->lo);
+    find(e->hi);
+    if (analyzing_)
+      fixed_[e] = {std::nullopt, affine(e->lo), affine(e->hi), std::nullopt};
+    symbol::Scope scope(env_);
+    env_.enter({e->var, e});
+    find(e->body);
+  }
+  void operator()(BreakExprAST *) {}
+  void operator()(LetExprAST *e) {
+    symbol::Scope scope(env_);
+    for (auto &dec : e->decs)
+      find(dec);
+    find(e->body);
+  }
+  void operator()(UnitExprAST *) {}
+  void operator()(ErrorExprAST *) {}
+
+  void operator()(TypeDeclAST *) {}
+  void operator()(VarDeclAST *d) {
+    // the initializer can't see the variable
+    find(d->init);
+    if (analyzing_ && !assigned_.count(d)) {
+      Fixed f;
+      f.value = affine(d->init);
+      if (auto *array = std::get_if<ArrayExprAST *>(&d->init))
+        f.size = affine((*array)->size);
+      fixed_[d] = f;
+    }
+    env_.enter({d->name, d});
+  }
+  void operator()(FuncDeclAST *d) {
+    for (auto &fundec : d->decls)
+      env_.enter({fundec.name, nullptr});
+    for (auto &fundec : d->decls) {
+      symbol::Scope scope(env_);
+      for (auto &param : fundec.params)
+        env_.enter({param.name, &param});
+      find(fundec.body);
+    }
+  }
+};
+
+} // namespace detail
+
+inline BoundsCounts remove_bounds_checks(ExprAST &e) {
+  BoundsCounts counts;
+  detail::BoundsFinder(counts).run(e);
+  return counts;
+}
+
+} // namespace absyn
+#endif
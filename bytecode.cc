@@ -0,0 +1,735 @@
+#include "bytecode.h"
+#include "logging.h"
+#include "vm.h"
+#include <algorithm>
+#include <climits>
+#include <cstdio>
+#include <initializer_list>
+#include <map>
+#include <variant>
+
+namespace vm {
+
+namespace {
+
+constexpr int kNumOperands[] = {
+#define VM_OP_OPERANDS(name, n) n,
+    VM_OPS(VM_OP_OPERANDS)
+#undef VM_OP_OPERANDS
+};
+constexpr const char *kOpNames[] = {
+#define VM_OP_NAME(name, n) #name,
+    VM_OPS(VM_OP_NAME)
+#undef VM_OP_NAME
+};
+
+// What a name is bound to: register `index` of the frame of the function at
+// nesting depth `depth`, or function `index`, declared in the function at
+// that depth
+struct Binding {
+  uint32_t depth;
+  int32_t index;
+  bool proc;
+};
+
+// Jumps whose targets are still to be filled in, by where they start
+using Patches = std::vector<uint32_t>;
+
+bool is_comparison(absyn::Op op) {
+  return op >= absyn::Op::kEq && op <= absyn::Op::kGe;
+}
+
+// the comparison that holds when op doesn't
+absyn::Op negate(absyn::Op op) {
+  switch (op) {
+  case absyn::Op::kEq:
+    return absyn::Op::kNeq;
+  case absyn::Op::kNeq:
+    return absyn::Op::kEq;
+  case absyn::Op::kLt:
+    return absyn::Op::kGe;
+  case absyn::Op::kLe:
+    return absyn::Op::kGt;
+  case absyn::Op::kGt:
+    return absyn::Op::kLe;
+  case absyn::Op::kGe:
+    return absyn::Op::kLt;
+  default:
+    return op;
+  }
+}
+
+// the comparison that holds with the operands swapped
+absyn::Op commute(absyn::Op op) {
+  switch (op) {
+  case absyn::Op::kLt:
+    return absyn::Op::kGt;
+  case absyn::Op::kLe:
+    return absyn::Op::kGe;
+  case absyn::Op::kGt:
+    return absyn::Op::kLt;
+  case absyn::Op::kGe:
+    return absyn::Op::kLe;
+  default:
+    return op;
+  }
+}
+
+// The instructions of a comparison, in the order of absyn::Op's
+Op compare_op(absyn::Op op) {
+  int i = static_cast<int>(op) - static_cast<int>(absyn::Op::kEq);
+  return static_cast<Op>(static_cast<int>(Op::kEq) + i);
+}
+Op jump_op(absyn::Op op, bool imm) {
+  int i = static_cast<int>(op) - static_cast<int>(absyn::Op::kEq);
+  return static_cast<Op>(static_cast<int>(imm ? Op::kJEqI : Op::kJEq) + i);
+}
+
+Op arith_op(absyn::Op op) {
+  switch (op) {
+  case absyn::Op::kPlus:
+    return Op::kAdd;
+  case absyn::Op::kMinus:
+    return Op::kSub;
+  case absyn::Op::kMul:
+    return Op::kMul;
+  default:
+    return Op::kDiv;
+  }
+}
+
+// Whether op jumps, to where its last operand says
+bool is_jump(Op op) {
+  return op == Op::kJmp || op == Op::kJt || op == Op::kJf ||
+         (op >= Op::kJEq && op <= Op::kForLoop);
+}
+
+const absyn::IntExprAST *as_int(const absyn::ExprAST &e) {
+  auto *i = std::get_if<absyn::IntExprAST *>(&e);
+  return i ? *i : nullptr;
+}
+
+// Whether evaluating e can't assign to a variable. Calls can, through
+// functions nested in the one declaring it.
+bool pure(absyn::ExprAST &e);
+bool pure(absyn::VarAST &v) {
+  if (auto *f = std::get_if<absyn::FieldVarAST *>(&v))
+    return pure((*f)->var);
+  if (auto *i = std::get_if<absyn::IndexVarAST *>(&v))
+    return pure((*i)->var) && pure((*i)->index);
+  return true;
+}
+bool pure(absyn::ExprAST &e) {
+  if (auto *v = std::get_if<absyn::VarExprAST *>(&e))
+    return pure((*v)->var);
+  if (auto *op = std::get_if<absyn::OpExprAST *>(&e))
+    return pure((*op)->lhs) && pure((*op)->rhs);
+  return std::holds_alternative<absyn::IntExprAST *>(e) ||
+         std::holds_alternative<absyn::StringExprAST *>(e) ||
+         std::holds_alternative<absyn::NilExprAST *>(e) ||
+         std::holds_alternative<absyn::UnitExprAST *>(e);
+}
+
+// Compiles a program function by function. Registers are handed out like a
+// stack: a variable keeps its register for its scope, and a temporary is
+// free again once the expression that needed it is done. Expressions leave
+// their value in a register chosen by whoever uses it, so that the value of
+// a variable can be computed straight into its register, and a variable
+// read in the current function is used from its own register.
+class Compiler {
+public:
+  Compiler(Program &program, Diagnostics &diags, Options options)
+      : program_(program), diags_(diags), options_(options) {}
+
+  void main(absyn::ExprAST &e) {
+    program_.procs.push_back({"tigermain"});
+    Function fn{0, 0};
+    fn_ = &fn;
+    // the main program has no static link, but keeps its register
+    fn.top = fn.num_regs = 1;
+    emit(Op::kRet, {exp(e)});
+    finish(fn);
+  }
+
+private:
+  // for an expression whose value isn't wanted
+  static constexpr int kNone = -1;
+
+  // The function being compiled
+  struct Function {
+    uint32_t depth;
+    int32_t proc;
+    std::vector<int32_t> code;
+    std::vector<std::pair<uint32_t, Location>> lines;
+    // the first free register, and the most the function has used
+    int top{0}, num_regs{0};
+    // the breaks out of each loop the code is in
+    std::vector<Patches> loops;
+  };
+
+  Program &program_;
+  Diagnostics &diags_;
+  Options options_;
+  symbol::Table<Binding> env_;
+  Function *fn_{nullptr};
+  // constants and names already in the program, by symbol ID
+  std::vector<int32_t> strings_, names_;
+  std::map<std::vector<uint32_t>, int32_t> layouts_;
+
+  uint32_t here() const { return fn_->code.size(); }
+  void emit(Op op, std::initializer_list<int32_t> operands) {
+    CHECK(operands.size() == (size_t)kNumOperands[static_cast<int>(op)])
+        << kOpNames[static_cast<int>(op)];
+    fn_->code.push_back(static_cast<int32_t>(op));
+    fn_->code.insert(fn_->code.end(), operands);
+  }
+  // Emits a jump to target, which is given as the jump's last operand.
+  // Targets are relative to the start of the jump.
+  void jump(Op op, std::initializer_list<int32_t> operands, uint32_t target) {
+    CHECK(operands.size() + 1 == (size_t)kNumOperands[static_cast<int>(op)])
+        << kOpNames[static_cast<int>(op)];
+    uint32_t start = here();
+    fn_->code.push_back(static_cast<int32_t>(op));
+    fn_->code.insert(fn_->code.end(), operands);
+    fn_->code.push_back(target - start);
+  }
+  // A forward jump, to be patched
+  uint32_t jump(Op op, std::initializer_list<int32_t> operands) {
+    uint32_t start = here();
+    jump(op, operands, start);
+    return start;
+  }
+  void patch(const Patches &jumps, uint32_t target) {
+    for (uint32_t start : jumps) {
+      int n = kNumOperands[fn_->code[start]];
+      fn_->code[start + n] = target - start;
+    }
+  }
+  static void append(Patches &to, const Patches &from) {
+    to.insert(to.end(), from.begin(), from.end());
+  }
+  // for runtime errors in the next instruction
+  void line(const Location &pos) { fn_->lines.push_back({here(), pos}); }
+
+  int temp() { return temps(1); }
+  // n consecutive registers
+  int temps(int n) {
+    int r = fn_->top;
+    fn_->top += n;
+    fn_->num_regs = std::max(fn_->num_regs, fn_->top);
+    return r;
+  }
+
+  Binding look(symbol::Symbol name) {
+    auto b = env_.look(name);
+    CHECK(b) << "unbound " << name.name();
+    return *b;
+  }
+  int32_t hops(const Binding &b) const { return fn_->depth - b.depth; }
+
+  int32_t string(literal::Literal s) {
+    if (s.id() >= strings_.size())
+      strings_.resize(s.id() + 1, -1);
+    if (strings_[s.id()] < 0) {
+      std::string_view value = s.value();
+      auto *str = static_cast<String *>(program_.arena.Allocate(
+          sizeof(String) + value.size(), alignof(String)));
+      str->size = value.size();
+      value.copy(str->chars(), value.size());
+      strings_[s.id()] = program_.strings.size();
+      program_.strings.push_back(str);
+    }
+    return strings_[s.id()];
+  }
+  int32_t name(symbol::Symbol s) {
+    if (s.id() >= names_.size())
+      names_.resize(s.id() + 1, -1);
+    if (names_[s.id()] < 0) {
+      names_[s.id()] = program_.names.size();
+      program_.names.push_back(s);
+    }
+    return names_[s.id()];
+  }
+  int32_t layout(const absyn::Seq<absyn::RExprField> &fields) {
+    std::vector<uint32_t> key;
+    for (auto &f : fields)
+      key.push_back(f.name.id());
+    auto [it, added] = layouts_.try_emplace(key, program_.layouts.size());
+    if (added) {
+      auto l = std::make_unique<Layout>();
+      for (auto &f : fields)
+        l->fields.push_back(f.name);
+      program_.layouts.push_back(std::move(l));
+    }
+    return it->second;
+  }
+
+  void finish(Function &fn) {
+    auto &proc = program_.procs[fn.proc];
+    proc.num_regs = fn.num_regs;
+    proc.code = std::move(fn.code);
+    proc.lines = std::move(fn.lines);
+  }
+
+  // The register holding v's value: its own, if it's a variable of this
+  // function, or else a new temporary
+  int var(absyn::VarAST &v) {
+    if (auto *s = std::get_if<absyn::SimpleVarAST *>(&v)) {
+      auto b = look((*s)->id);
+      if (b.depth == fn_->depth)
+        return b.index;
+    }
+    int r = temp();
+    var_to(v, r);
+    return r;
+  }
+  int exp(absyn::ExprAST &e) {
+    if (auto *v = std::get_if<absyn::VarExprAST *>(&e))
+      return var((*v)->var);
+    int r = temp();
+    exp_to(e, r);
+    return r;
+  }
+  // The register of e's value, copied to a temporary if it's a variable's
+  // and what's evaluated before the value is used might assign to it
+  int operand(absyn::ExprAST &e, bool later_pure) {
+    int top = fn_->top;
+    int r = exp(e);
+    if (r >= top || later_pure)
+      return r;
+    int t = temp();
+    emit(Op::kMov, {t, r});
+    return t;
+  }
+  int operand(absyn::VarAST &v, bool later_pure) {
+    int top = fn_->top;
+    int r = var(v);
+    if (r >= top || later_pure)
+      return r;
+    int t = temp();
+    emit(Op::kMov, {t, r});
+    return t;
+  }
+
+  void var_to(absyn::VarAST &v, int dst) {
+    int top = fn_->top;
+    if (auto *s = std::get_if<absyn::SimpleVarAST *>(&v)) {
+      auto b = look((*s)->id);
+      if (b.depth != fn_->depth)
+        emit(Op::kGetUp, {dst, hops(b), b.index});
+      else if (b.index != dst)
+        emit(Op::kMov, {dst, b.index});
+    } else if (auto *f = std::get_if<absyn::FieldVarAST *>(&v)) {
+      int rec = var((*f)->var);
+      line((*f)->pos);
+      if (options_.inline_caches)
+        emit(Op::kGetFieldIC, {dst, rec, name((*f)->field), cache()});
+      else
+        emit(Op::kGetField, {dst, rec, name((*f)->field)});
+    } else {
+      auto *i = std::get<absyn::IndexVarAST *>(v);
+      int array = operand(i->var, pure(i->index));
+      int index = exp(i->index);
+      line(i->pos);
+      emit(Op::kGetElem, {dst, array, index});
+    }
+    fn_->top = top;
+  }
+  int32_t cache() { return program_.num_caches++; }
+
+  // Compiles e to leave its value in dst, or only for its effects if dst is
+  // kNone. Nothing in e reads dst after writing it, so dst can be the
+  // register of a variable e uses.
+  void exp_to(absyn::ExprAST &e, int dst) {
+    int top = fn_->top;
+    std::visit(ExpVisitor(*this, dst), e);
+    fn_->top = top;
+  }
+
+  // Compiles a jump to where the returned patches say for when cond is
+  // `when`, falling through otherwise
+  Patches branch(absyn::ExprAST &cond, bool when) {
+    int top = fn_->top;
+    Patches out;
+    auto *op = std::get_if<absyn::OpExprAST *>(&cond);
+    if (op && ((*op)->op == absyn::Op::kAnd || (*op)->op == absyn::Op::kOr)) {
+      // the value of the left side that decides the result by itself
+      bool decides = (*op)->op == absyn::Op::kOr;
+      if (when == decides) {
+        out = branch((*op)->lhs, when);
+        append(out, branch((*op)->rhs, when));
+      } else {
+        Patches skip = branch((*op)->lhs, !when);
+        out = branch((*op)->rhs, when);
+        patch(skip, here());
+      }
+    } else if (op && is_comparison((*op)->op)) {
+      auto c = comparison(*op);
+      if (options_.superinstructions) {
+        out.push_back(jump(jump_op(when ? c.op : negate(c.op), c.imm),
+                           {c.lhs, c.rhs}));
+      } else {
+        int t = temp();
+        emit(compare_op(c.op), {t, c.lhs, c.imm ? constant(c.rhs) : c.rhs});
+        out.push_back(jump(when ? Op::kJt : Op::kJf, {t}));
+      }
+    } else {
+      out.push_back(jump(when ? Op::kJt : Op::kJf, {exp(cond)}));
+    }
+    fn_->top = top;
+    return out;
+  }
+
+  // A comparison, down to registers: lhs against rhs, which is an
+  // immediate if imm is set
+  struct Comparison {
+    absyn::Op op;
+    int32_t lhs, rhs;
+    bool imm;
+  };
+  Comparison comparison(absyn::OpExprAST *e) {
+    if (e->strings) {
+      int lhs = operand(e->lhs, pure(e->rhs));
+      int rhs = exp(e->rhs);
+      int t = temp();
+      if (e->op == absyn::Op::kEq || e->op == absyn::Op::kNeq) {
+        emit(Op::kStrEq, {t, lhs, rhs});
+        return {negate(e->op), t, 0, true};
+      }
+      emit(Op::kStrCmp, {t, lhs, rhs});
+      return {e->op, t, 0, true};
+    }
+    if (options_.superinstructions) {
+      if (auto *i = as_int(e->rhs))
+        return {e->op, exp(e->lhs), i->val, true};
+      if (auto *i = as_int(e->lhs))
+        return {commute(e->op), exp(e->rhs), i->val, true};
+    }
+    int lhs = operand(e->lhs, pure(e->rhs));
+    return {e->op, lhs, exp(e->rhs), false};
+  }
+  int constant(int32_t value) {
+    int r = temp();
+    emit(Op::kInt, {r, value});
+    return r;
+  }
+
+  void op_to(absyn::OpExprAST *e, int dst) {
+    int d = dst != kNone ? dst : temp();
+    if (e->op == absyn::Op::kAnd || e->op == absyn::Op::kOr) {
+      // 1 or 0, by which way the condition goes
+      absyn::ExprAST cond = e;
+      Patches f = branch(cond, false);
+      emit(Op::kInt, {d, 1});
+      Patches end = {jump(Op::kJmp, {})};
+      patch(f, here());
+      emit(Op::kInt, {d, 0});
+      patch(end, here());
+      return;
+    }
+    if (e->strings && e->op == absyn::Op::kEq) {
+      int lhs = operand(e->lhs, pure(e->rhs));
+      emit(Op::kStrEq, {d, lhs, exp(e->rhs)});
+      return;
+    }
+    if (is_comparison(e->op)) {
+      auto c = comparison(e);
+      emit(compare_op(c.op), {d, c.lhs, c.imm ? constant(c.rhs) : c.rhs});
+      return;
+    }
+    auto *imm = as_int(e->rhs);
+    if (options_.superinstructions && imm &&
+        (e->op == absyn::Op::kPlus ||
+         (e->op == absyn::Op::kMinus && imm->val != INT_MIN))) {
+      int lhs = exp(e->lhs);
+      emit(Op::kAddI,
+           {d, lhs, e->op == absyn::Op::kPlus ? imm->val : -imm->val});
+      return;
+    }
+    int lhs = operand(e->lhs, pure(e->rhs));
+    int rhs = exp(e->rhs);
+    if (e->op == absyn::Op::kDiv)
+      line(e->pos);
+    emit(arith_op(e->op), {d, lhs, rhs});
+  }
+
+  void call_to(absyn::CallExprAST *e, int dst) {
+    int d = dst != kNone ? dst : temp();
+    auto b = env_.look(e->func);
+    int n = e->args.size();
+    if (b && b->proc) {
+      // the callee's frame starts at the static link
+      int base = temps(1 + n);
+      emit(Op::kLink, {base, hops(*b)});
+      for (int i = 0; i < n; i++)
+        exp_to(e->args[i].exp, base + 1 + i);
+      line(e->pos);
+      // the callee's frame can take the place of this one, unless it's
+      // nested in it and so links to it
+      if (e->tail && hops(*b) > 0)
+        emit(Op::kTailCall, {b->index, base, 1 + n});
+      else
+        emit(Op::kCall, {d, b->index, base});
+      return;
+    }
+    int fn = runtime_function(e->func.name());
+    if (fn < 0) {
+      diags_.error(e->pos, std::string("No runtime function '") +
+                               e->func.name() + "'");
+      return;
+    }
+    int base = temps(n);
+    for (int i = 0; i < n; i++)
+      exp_to(e->args[i].exp, base + i);
+    line(e->pos);
+    emit(Op::kCallRt, {d, fn, base, n});
+  }
+
+  void assign(absyn::AssignExprAST *e) {
+    if (auto *s = std::get_if<absyn::SimpleVarAST *>(&e->var)) {
+      auto b = look((*s)->id);
+      if (b.depth == fn_->depth)
+        exp_to(e->exp, b.index);
+      else
+        emit(Op::kSetUp, {hops(b), b.index, exp(e->exp)});
+    } else if (auto *f = std::get_if<absyn::FieldVarAST *>(&e->var)) {
+      int rec = operand((*f)->var, pure(e->exp));
+      int value = exp(e->exp);
+      line((*f)->pos);
+      if (options_.inline_caches)
+        emit(Op::kSetFieldIC, {rec, name((*f)->field), value, cache()});
+      else
+        emit(Op::kSetField, {rec, name((*f)->field), value});
+    } else {
+      auto *i = std::get<absyn::IndexVarAST *>(e->var);
+      int array = operand(i->var, pure(i->index) && pure(e->exp));
+      int index = operand(i->index, pure(e->exp));
+      int value = exp(e->exp);
+      line(i->pos);
+      emit(Op::kSetElem, {array, index, value});
+    }
+  }
+
+  void if_to(absyn::IfExprAST *e, int dst) {
+    Patches f = branch(e->cond, false);
+    if (!e->else_) {
+      exp_to(e->then, kNone);
+      patch(f, here());
+      if (dst != kNone)
+        emit(Op::kInt, {dst, 0});
+      return;
+    }
+    exp_to(e->then, dst);
+    Patches end = {jump(Op::kJmp, {})};
+    patch(f, here());
+    exp_to(*e->else_, dst);
+    patch(end, here());
+  }
+
+  void while_loop(absyn::WhileExprAST *e) {
+    uint32_t test = here();
+    Patches exits = branch(e->cond, false);
+    fn_->loops.emplace_back();
+    exp_to(e->body, kNone);
+    jump(Op::kJmp, {}, test);
+    append(exits, fn_->loops.back());
+    fn_->loops.pop_back();
+    patch(exits, here());
+  }
+
+  // The bound is kept in a register of its own, and the variable is only
+  // incremented after comparing it to the bound, so it can't overflow
+  void for_loop(absyn::ForExprAST *e) {
+    int var = temp(), hi = temp();
+    exp_to(e->lo, var);
+    exp_to(e->hi, hi);
+    symbol::Scope scope(env_);
+    env_.enter({e->var, {fn_->depth, var, false}});
+    Patches exits;
+    bool fused = options_.superinstructions;
+    if (fused) {
+      exits.push_back(jump(Op::kJGt, {var, hi}));
+    } else {
+      int t = temp();
+      emit(Op::kGt, {t, var, hi});
+      exits.push_back(jump(Op::kJt, {t}));
+    }
+    uint32_t body = here();
+    fn_->loops.emplace_back();
+    exp_to(e->body, kNone);
+    if (fused) {
+      jump(Op::kForLoop, {var, hi}, body);
+    } else {
+      int t = temp();
+      emit(Op::kLt, {t, var, hi});
+      exits.push_back(jump(Op::kJf, {t}));
+      emit(Op::kInt, {t, 1});
+      emit(Op::kAdd, {var, var, t});
+      jump(Op::kJmp, {}, body);
+    }
+    append(exits, fn_->loops.back());
+    fn_->loops.pop_back();
+    patch(exits, here());
+  }
+
+  void let(absyn::LetExprAST *e, int dst) {
+    symbol::Scope scope(env_);
+    for (auto &dec : e->decs) {
+      if (auto *var = std::get_if<absyn::VarDeclAST *>(&dec)) {
+        // the initializer can't see the variable
+        int r = temp();
+        exp_to((*var)->init, r);
+        env_.enter({(*var)->name, {fn_->depth, r, false}});
+      } else if (auto *funcs = std::get_if<absyn::FuncDeclAST *>(&dec)) {
+        functions(**funcs);
+      }
+    }
+    exp_to(e->body, dst);
+  }
+
+  // A group of functions, which can call each other, so all of them are
+  // bound before any is compiled
+  void functions(absyn::FuncDeclAST &decs) {
+    int32_t first = program_.procs.size();
+    for (auto &dec : decs.decls) {
+      std::string name = dec.name.name();
+      if (fn_->depth > 0)
+        name = program_.procs[fn_->proc].name + "." + name;
+      int32_t proc = program_.procs.size();
+      env_.enter({dec.name, {fn_->depth, proc, true}});
+      program_.procs.push_back({std::move(name)});
+    }
+    for (size_t i = 0; i < decs.decls.size(); i++) {
+      auto &dec = decs.decls[i];
+      Function fn{fn_->depth + 1, first + (int32_t)i};
+      Function *outer = fn_;
+      fn_ = &fn;
+      symbol::Scope scope(env_);
+      // the static link is register 0
+      int n = dec.params.size();
+      fn.top = fn.num_regs = 1 + n;
+      for (int j = 0; j < n; j++)
+        env_.enter({dec.params[j].name, {fn.depth, 1 + j, false}});
+      emit(Op::kRet, {exp(dec.body)});
+      finish(fn);
+      fn_ = outer;
+    }
+  }
+
+  class ExpVisitor {
+    Compiler &c_;
+    int dst_;
+
+    // an expression with no value, in case one is wanted anyway
+    void no_value() {
+      if (dst_ != kNone)
+        c_.emit(Op::kInt, {dst_, 0});
+    }
+
+  public:
+    ExpVisitor(Compiler &c, int dst) : c_(c), dst_(dst) {}
+    void operator()(absyn::VarExprAST *e) {
+      c_.var_to(e->var, dst_ != kNone ? dst_ : c_.temp());
+    }
+    void operator()(absyn::NilExprAST *) { no_value(); }
+    void operator()(absyn::IntExprAST *e) {
+      if (dst_ != kNone)
+        c_.emit(Op::kInt, {dst_, e->val});
+    }
+    void operator()(absyn::StringExprAST *e) {
+      if (dst_ != kNone)
+        c_.emit(Op::kStr, {dst_, c_.string(e->val)});
+    }
+    void operator()(absyn::CallExprAST *e) { c_.call_to(e, dst_); }
+    void operator()(absyn::OpExprAST *e) { c_.op_to(e, dst_); }
+    void operator()(absyn::RecordExprAST *e) {
+      int d = dst_ != kNone ? dst_ : c_.temp();
+      int base = c_.temps(e->fields.size());
+      for (size_t i = 0; i < e->fields.size(); i++)
+        c_.exp_to(e->fields[i].value, base + i);
+      c_.emit(Op::kRecord, {d, c_.layout(e->fields), base});
+    }
+    void operator()(absyn::ArrayExprAST *e) {
+      int d = dst_ != kNone ? dst_ : c_.temp();
+      int size = c_.operand(e->size, pure(e->init));
+      int init = c_.exp(e->init);
+      c_.line(e->pos);
+      c_.emit(Op::kArray, {d, size, init});
+    }
+    void operator()(absyn::SeqExprAST *e) {
+      if (e->exps.empty())
+        return no_value();
+      for (size_t i = 0; i + 1 < e->exps.size(); i++)
+        c_.exp_to(e->exps[i].exp, kNone);
+      c_.exp_to(e->exps.back().exp, dst_);
+    }
+    void operator()(absyn::AssignExprAST *e) {
+      c_.assign(e);
+      no_value();
+    }
+    void operator()(absyn::IfExprAST *e) { c_.if_to(e, dst_); }
+    void operator()(absyn::WhileExprAST *e) {
+      c_.while_loop(e);
+      no_value();
+    }
+    void operator()(absyn::ForExprAST *e) {
+      c_.for_loop(e);
+      no_value();
+    }
+    void operator()(absyn::BreakExprAST *) {
+      c_.fn_->loops.back().push_back(c_.jump(Op::kJmp, {}));
+    }
+    void operator()(absyn::LetExprAST *e) { c_.let(e, dst_); }
+    void operator()(absyn::UnitExprAST *) { no_value(); }
+    void operator()(absyn::ErrorExprAST *) {
+      LOG_FATAL << "compiling a program with errors";
+    }
+  };
+};
+
+} // namespace
+
+std::unique_ptr<Program> compile(absyn::ExprAST &e, Diagnostics &diags,
+                                 Options options) {
+  auto program = std::make_unique<Program>();
+  Compiler(*program, diags, options).main(e);
+  return program;
+}
+
+void print(const Program &program) {
+  for (auto &proc : program.procs) {
+    std::printf("%s: %u registers\n", proc.name.c_str(), proc.num_regs);
+    for (size_t pc = 0; pc < proc.code.size();) {
+      int op = proc.code[pc];
+      int n = kNumOperands[op];
+      std::printf("  %5zu  %-10s", pc, kOpNames[op]);
+      for (int i = 1; i <= n; i++)
+        std::printf("%s%d", i == 1 ? " " : ", ", proc.code[pc + i]);
+      switch (static_cast<Op>(op)) {
+      case Op::kStr: {
+        auto *s = program.strings[proc.code[pc + 2]];
+        std::printf("  \"%.*s\"", (int)s->size, s->chars());
+        break;
+      }
+      case Op::kCall:
+        std::printf("  %s", program.procs[proc.code[pc + 2]].name.c_str());
+        break;
+      case Op::kGetField:
+      case Op::kGetFieldIC:
+        std::printf("  .%s", program.names[proc.code[pc + 3]].name());
+        break;
+      case Op::kSetField:
+      case Op::kSetFieldIC:
+        std::printf("  .%s", program.names[proc.code[pc + 2]].name());
+        break;
+      default:
+        if (is_jump(static_cast<Op>(op)))
+          std::printf("  -> %zu", pc + proc.code[pc + n]);
+      }
+      std::printf("\n");
+      pc += 1 + n;
+    }
+  }
+}
+
+} // namespace vm
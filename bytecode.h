@@ -0,0 +1,163 @@
+#ifndef BYTECODE_H
+#define BYTECODE_H
+#include "absyn.h"
+#include "arena.h"
+#include "diagnostics.h"
+#include "location.h"
+#include "symbol.h"
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+// A register bytecode for running checked programs directly. Each function
+// has a window of registers on the VM's stack: register 0 holds the static
+// link, the formals follow it, then the locals and temporaries. Instructions
+// are an opcode followed by its operands, all 32-bit words.
+namespace vm {
+
+struct Record;
+struct Array;
+struct String;
+
+// A word of Tiger data. Which member is meant depends on the type of the
+// expression it holds a value of, which only the compiler knows; nil is a
+// null record or array.
+union Value {
+  int64_t i;
+  Record *rec;
+  Array *arr;
+  const String *str;
+  // a static link
+  Value *frame;
+};
+
+// The field names of a record, in order. Records with the same names share
+// one layout.
+struct Layout {
+  std::vector<symbol::Symbol> fields;
+
+  int index(symbol::Symbol name) const {
+    for (size_t i = 0; i < fields.size(); i++) {
+      if (fields[i] == name)
+        return i;
+    }
+    return -1;
+  }
+};
+
+// Objects are headers followed by their contents, in one allocation
+struct Record {
+  const Layout *layout;
+  Value *fields() { return reinterpret_cast<Value *>(this + 1); }
+};
+struct Array {
+  int64_t size;
+  Value *elems() { return reinterpret_cast<Value *>(this + 1); }
+};
+struct String {
+  int64_t size;
+  const char *chars() const { return reinterpret_cast<const char *>(this + 1); }
+  char *chars() { return reinterpret_cast<char *>(this + 1); }
+};
+
+// X(name, operands). Operands a to d are registers unless said otherwise.
+// A jump's target is its last operand, relative to the start of the jump.
+#define VM_OPS(X)                                                              \
+  X(Mov, 2)         /* a = b */                                                \
+  X(Int, 2)         /* a = immediate b */                                      \
+  X(Str, 2)         /* a = string constant b */                                \
+  X(Link, 2)        /* a = the frame b static links out */                     \
+  X(GetUp, 3)       /* a = register c of the frame b links out */              \
+  X(SetUp, 3)       /* register b of the frame a links out = c */              \
+  X(Add, 3)         /* a = b + c */                                            \
+  X(Sub, 3)         /* a = b - c */                                            \
+  X(Mul, 3)         /* a = b * c */                                            \
+  X(Div, 3)         /* a = b / c */                                            \
+  X(Eq, 3)          /* a = b == c */                                           \
+  X(Ne, 3)          /* a = b != c */                                           \
+  X(Lt, 3)          /* a = b < c */                                            \
+  X(Le, 3)          /* a = b <= c */                                           \
+  X(Gt, 3)          /* a = b > c */                                            \
+  X(Ge, 3)          /* a = b >= c */                                           \
+  X(StrEq, 3)       /* a = strings b and c are equal */                        \
+  X(StrCmp, 3)      /* a = the sign of string b compared to c */               \
+  X(Jmp, 1)         /* go to a */                                              \
+  X(Jt, 2)          /* go to b if a != 0 */                                    \
+  X(Jf, 2)          /* go to b if a == 0 */                                    \
+  X(Record, 3)      /* a = record of layout b, fields from c on */             \
+  X(GetField, 3)    /* a = field named c of record b */                        \
+  X(SetField, 3)    /* field named b of record a = c */                        \
+  X(Array, 3)       /* a = array of b elements, each c */                      \
+  X(GetElem, 3)     /* a = b[c] */                                             \
+  X(SetElem, 3)     /* a[b] = c */                                             \
+  X(Call, 3)        /* a = function b, its frame from c on */                  \
+  X(TailCall, 3)    /* return function a of the c values from b on */          \
+  X(CallRt, 4)      /* a = runtime function b of the d args from c on */       \
+  X(Ret, 1)         /* return a */                                             \
+  /* superinstructions, which the baseline does without */                     \
+  X(AddI, 3)        /* a = b + immediate c */                                  \
+  X(JEq, 3)         /* go to c if a == b */                                    \
+  X(JNe, 3)                                                                    \
+  X(JLt, 3)                                                                    \
+  X(JLe, 3)                                                                    \
+  X(JGt, 3)                                                                    \
+  X(JGe, 3)                                                                    \
+  X(JEqI, 3)        /* go to c if a == immediate b */                          \
+  X(JNeI, 3)                                                                   \
+  X(JLtI, 3)                                                                   \
+  X(JLeI, 3)                                                                   \
+  X(JGtI, 3)                                                                   \
+  X(JGeI, 3)                                                                   \
+  X(ForLoop, 3)     /* if a < b, increment a and go to c */                    \
+  X(GetFieldIC, 4)  /* GetField, with inline cache d */                        \
+  X(SetFieldIC, 4)  /* SetField, with inline cache d */
+
+enum class Op : int32_t {
+#define VM_OP_ENUM(name, n) k##name,
+  VM_OPS(VM_OP_ENUM)
+#undef VM_OP_ENUM
+};
+
+// One function's code, entered at the start
+struct Proc {
+  std::string name;
+  // registers the frame needs, including the static link and formals
+  uint32_t num_regs;
+  std::vector<int32_t> code;
+  // where the instructions that can fail came from, by offset into code
+  std::vector<std::pair<uint32_t, Location>> lines;
+};
+
+struct Program {
+  // the main program is the first
+  std::vector<Proc> procs;
+  std::vector<std::unique_ptr<Layout>> layouts;
+  std::vector<const String *> strings;
+  // the field names GetField and SetField look up
+  std::vector<symbol::Symbol> names;
+  // how many inline caches the code uses
+  uint32_t num_caches{0};
+  // where the string constants live
+  absyn::Arena arena;
+};
+
+// Which optimizations the compiler applies. With neither, the code only
+// uses the plain instructions above the superinstructions.
+struct Options {
+  bool superinstructions{true};
+  bool inline_caches{true};
+};
+
+// Compiles a program that has been checked without errors, which semant
+// has annotated with what the compiler can't tell from the AST. A call to a
+// function the VM doesn't provide is reported to the diagnostics.
+std::unique_ptr<Program> compile(absyn::ExprAST &e, Diagnostics &diags,
+                                 Options options = {});
+
+// Prints the code of every function, one instruction per line
+void print(const Program &program);
+
+} // namespace vm
+#endif
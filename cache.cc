@@ -0,0 +1,119 @@
+#include "cache.h"
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace cache {
+
+namespace {
+// at the start of every entry, and changed whenever what the compiler
+// stores changes, so that entries of another version are never read
+constexpr std::string_view kMagic = "tiger-cache 1\n";
+
+bool write_all(int fd, std::string_view data) {
+  while (!data.empty()) {
+    ssize_t n = write(fd, data.data(), data.size());
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return false;
+    data.remove_prefix(n);
+  }
+  return true;
+}
+} // namespace
+
+void Hasher::add(const void *data, size_t size) {
+  constexpr unsigned __int128 kPrime =
+      ((unsigned __int128)1 << 88) | ((unsigned __int128)1 << 8) | 0x3b;
+  auto *p = static_cast<const unsigned char *>(data);
+  for (size_t i = 0; i < size; i++) {
+    h_ ^= p[i];
+    h_ *= kPrime;
+  }
+}
+
+std::string Hasher::key() const {
+  char buf[33];
+  std::snprintf(buf, sizeof buf, "%016llx%016llx",
+                (unsigned long long)(h_ >> 64), (unsigned long long)h_);
+  return buf;
+}
+
+bool Reader::get(std::string &s) {
+  uint64_t size;
+  if (!get(size) || size > data_.size())
+    return ok_ = false;
+  s.assign(data_.data(), size);
+  data_.remove_prefix(size);
+  return true;
+}
+
+bool Reader::get(void *p, size_t size) {
+  if (!ok_ || size > data_.size())
+    return ok_ = false;
+  std::memcpy(p, data_.data(), size);
+  data_.remove_prefix(size);
+  return true;
+}
+
+bool make_dirs(const std::string &dir) {
+  for (size_t i = 1; i <= dir.size(); i++) {
+    if (i < dir.size() && dir[i] != '/')
+      continue;
+    std::string prefix = dir.substr(0, i);
+    if (mkdir(prefix.c_str(), 0777) < 0 && errno != EEXIST)
+      return false;
+  }
+  struct stat st;
+  if (stat(dir.c_str(), &st) < 0)
+    return false;
+  if (!S_ISDIR(st.st_mode)) {
+    errno = ENOTDIR;
+    return false;
+  }
+  return true;
+}
+
+std::optional<std::string> Cache::load(const std::string &key) const {
+  int fd = open(path(key).c_str(), O_RDONLY);
+  if (fd < 0)
+    return std::nullopt;
+  std::string data;
+  char buf[1 << 16];
+  ssize_t n;
+  while ((n = read(fd, buf, sizeof buf)) != 0) {
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n < 0)
+      break;
+    data.append(buf, n);
+  }
+  close(fd);
+  if (n < 0 || data.compare(0, kMagic.size(), kMagic) != 0)
+    return std::nullopt;
+  return data.substr(kMagic.size());
+}
+
+void Cache::store(const std::string &key, std::string_view data) const {
+  std::string dst = path(key);
+  mkdir((dir_ + "/" + key.substr(0, 2)).c_str(), 0777);
+  // unique to the process and the store, so that concurrent writers never
+  // share a temporary file
+  static std::atomic<unsigned> stores{0};
+  std::string tmp = dst + ".tmp." + std::to_string(getpid()) + "." +
+                    std::to_string(stores++);
+  int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0666);
+  if (fd < 0)
+    return;
+  bool ok = write_all(fd, kMagic) && write_all(fd, data);
+  ok = close(fd) == 0 && ok;
+  if (!ok || rename(tmp.c_str(), dst.c_str()) < 0)
+    unlink(tmp.c_str());
+}
+
+} // namespace cache
@@ -0,0 +1,104 @@
+#ifndef CACHE_H
+#define CACHE_H
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+
+// An on-disk store of what earlier compilations worked out, addressed by a
+// hash of everything it was worked out from, so that an entry never has to
+// be invalidated: a change to what it depends on just makes a different key.
+// Any number of tiger processes on the machine can share a directory. Each
+// entry is written to a file of its own under a temporary name and renamed
+// into place, so a reader sees all of an entry or none of it, and two
+// writers of the same key write the same thing.
+namespace cache {
+
+// How many lookups found an entry, and how many didn't
+struct Counts {
+  size_t hits{0}, misses{0};
+};
+
+// FNV-1a over 128 bits, which keys are made with
+class Hasher {
+public:
+  void add(const void *data, size_t size);
+  void add(uint64_t n) { add(&n, sizeof n); }
+  // the length first, so that no two sequences of strings hash alike by
+  // running together
+  void add(std::string_view s) {
+    add((uint64_t)s.size());
+    add(s.data(), s.size());
+  }
+  // the hash in hex, which names the entry
+  std::string key() const;
+
+private:
+  unsigned __int128 h_{((unsigned __int128)0x6c62272e07bb0142 << 64) |
+                       0x62b821756295c58d};
+};
+
+// Builds an entry from integers and strings, which Reader reads back in
+// the same order
+class Writer {
+public:
+  void put(uint64_t n) { put(&n, sizeof n); }
+  void put(std::string_view s) {
+    put((uint64_t)s.size());
+    put(s.data(), s.size());
+  }
+  const std::string &data() const { return data_; }
+
+private:
+  std::string data_;
+  void put(const void *p, size_t size) {
+    data_.append(static_cast<const char *>(p), size);
+  }
+};
+
+// Reads an entry; once a read runs past the end, it and every read after it
+// fail, so a damaged entry is only found out once
+class Reader {
+public:
+  explicit Reader(std::string_view data) : data_(data) {}
+  bool get(uint64_t &n) { return get(&n, sizeof n); }
+  bool get(std::string &s);
+  bool at_end() const { return ok_ && data_.empty(); }
+
+private:
+  std::string_view data_;
+  bool ok_{true};
+  bool get(void *p, size_t size);
+};
+
+// Creates the directory and any of its parents that are missing, returning
+// whether it exists afterwards; errno says why if not
+bool make_dirs(const std::string &dir);
+
+// The entries in one directory, which make_dirs() has created. `salt` is
+// hashed into every key, for whatever changes what's stored other than the
+// program, such as the optimizations asked for.
+class Cache {
+public:
+  Cache(std::string dir, std::string salt)
+      : dir_(std::move(dir)), salt_(std::move(salt)) {}
+
+  const std::string &salt() const { return salt_; }
+  // The entry stored under the key, if there's a whole one
+  std::optional<std::string> load(const std::string &key) const;
+  // Stores the entry, if it can; the cache only saves work, so a failure to
+  // write it isn't an error
+  void store(const std::string &key, std::string_view data) const;
+
+private:
+  std::string dir_, salt_;
+  // entries are spread over directories named by the key's first two
+  // digits
+  std::string path(const std::string &key) const {
+    return dir_ + "/" + key.substr(0, 2) + "/" + key.substr(2);
+  }
+};
+
+} // namespace cache
+#endif
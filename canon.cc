@@ -0,0 +1,295 @@
+#include "canon.h"
+#include <unordered_map>
+#include <utility>
+
+namespace canon {
+
+namespace {
+using namespace tree;
+
+bool is_nop(Stm s) {
+  auto *e = std::get_if<ExpStm *>(&s);
+  return e && std::holds_alternative<ConstExp *>((*e)->exp);
+}
+
+// Whether evaluating s can't change the value of e, as far as is cheap to
+// tell
+bool commutes(Stm s, Exp e) {
+  return is_nop(s) || std::holds_alternative<ConstExp *>(e) ||
+         std::holds_alternative<NameExp *>(e);
+}
+
+class Linearizer {
+  Arena &arena_;
+  frame::Frame &frame_;
+
+  // Whether e's value is a record or array, which has to be held in a temp
+  // the collector can find if a call that collects comes before its use
+  bool is_pointer(Exp e) const {
+    if (auto *t = std::get_if<TempExp *>(&e))
+      return frame_.is_pointer((*t)->temp);
+    if (auto *m = std::get_if<MemExp *>(&e))
+      return (*m)->pointer;
+    if (auto *c = std::get_if<CallExp *>(&e))
+      return (*c)->pointer;
+    if (auto *es = std::get_if<EseqExp *>(&e))
+      return is_pointer((*es)->exp);
+    return false;
+  }
+
+  // The operands of the sums an address is made of, left to right. Only the
+  // leftmost can be a record or array, and the sum of it and an offset is a
+  // pointer into it the collector can't update, so it's never held in a
+  // temp across a call.
+  static void terms(Exp e, std::vector<Exp> &out) {
+    auto *b = std::get_if<BinopExp *>(&e);
+    if (b && (*b)->op == BinOp::kPlus) {
+      terms((*b)->left, out);
+      terms((*b)->right, out);
+    } else {
+      out.push_back(e);
+    }
+  }
+  // e with the operands of its sums replaced by those at `next` on
+  Exp rebuild(Exp e, const std::vector<Exp> &with, size_t &next) {
+    auto *b = std::get_if<BinopExp *>(&e);
+    if (b && (*b)->op == BinOp::kPlus) {
+      Exp left = rebuild((*b)->left, with, next);
+      return Binop(arena_, BinOp::kPlus, left,
+                   rebuild((*b)->right, with, next));
+    }
+    return with[next++];
+  }
+
+public:
+  Linearizer(Arena &arena, frame::Frame &frame)
+      : arena_(arena), frame_(frame) {}
+
+  Stm nop() { return ExpS(arena_, Const(arena_, 0)); }
+  Stm seq(Stm a, Stm b) {
+    if (is_nop(a))
+      return b;
+    if (is_nop(b))
+      return a;
+    return SeqS(arena_, a, b);
+  }
+
+  // Pulls the side effects out of the expressions, in order, into the
+  // statement returned, leaving expressions without any in their place. An
+  // expression whose value a later one's effects could change is saved in a
+  // temp first.
+  Stm reorder(std::vector<Exp> &exps, size_t from = 0) {
+    if (from == exps.size())
+      return nop();
+    Exp &e = exps[from];
+    if (auto *c = std::get_if<CallExp *>(&e)) {
+      // so that a call's result isn't clobbered by the next one's
+      auto t = frame_.new_temp((*c)->pointer);
+      e = Eseq(arena_, Move(arena_, TempE(arena_, t), e), TempE(arena_, t));
+      return reorder(exps, from);
+    }
+    auto [s, value] = do_exp(e);
+    Stm rest = reorder(exps, from + 1);
+    if (commutes(rest, value)) {
+      e = value;
+      return seq(s, rest);
+    }
+    auto t = frame_.new_temp(is_pointer(value));
+    e = TempE(arena_, t);
+    return seq(seq(s, Move(arena_, TempE(arena_, t), value)), rest);
+  }
+
+  // the call with its function and arguments free of side effects, which
+  // are returned with it
+  std::pair<Stm, Exp> do_call(CallExp *call) {
+    std::vector<Exp> exps{call->func};
+    exps.insert(exps.end(), call->args.begin(), call->args.end());
+    Stm s = reorder(exps);
+    std::vector<Exp> args(exps.begin() + 1, exps.end());
+    // a copy, keeping what's known of the call
+    auto *c = arena_.New<CallExp>(*call);
+    c->func = exps[0];
+    c->args = make_seq(arena_, args);
+    return {s, c};
+  }
+
+  std::pair<Stm, Exp> do_exp(Exp e) {
+    if (auto *b = std::get_if<BinopExp *>(&e)) {
+      std::vector<Exp> exps{(*b)->left, (*b)->right};
+      Stm s = reorder(exps);
+      return {s, Binop(arena_, (*b)->op, exps[0], exps[1])};
+    }
+    if (auto *m = std::get_if<MemExp *>(&e)) {
+      std::vector<Exp> exps{(*m)->addr};
+      Stm s = reorder(exps);
+      auto *mem = arena_.New<MemExp>(**m);
+      mem->addr = exps[0];
+      return {s, mem};
+    }
+    if (auto *es = std::get_if<EseqExp *>(&e)) {
+      Stm s = do_stm((*es)->stm);
+      auto [s2, value] = do_exp((*es)->exp);
+      return {seq(s, s2), value};
+    }
+    if (auto *c = std::get_if<CallExp *>(&e))
+      return do_call(*c);
+    return {nop(), e};
+  }
+
+  Stm do_stm(Stm s) {
+    if (auto *sq = std::get_if<SeqStm *>(&s))
+      return seq(do_stm((*sq)->left), do_stm((*sq)->right));
+    if (auto *cj = std::get_if<CjumpStm *>(&s)) {
+      auto *c = *cj;
+      std::vector<Exp> exps{c->left, c->right};
+      Stm pre = reorder(exps);
+      return seq(pre, Cjump(arena_, c->op, exps[0], exps[1], c->t, c->f));
+    }
+    if (auto *mv = std::get_if<MoveStm *>(&s)) {
+      auto *m = *mv;
+      if (auto *es = std::get_if<EseqExp *>(&m->dst))
+        return do_stm(SeqS(arena_, (*es)->stm,
+                           Move(arena_, (*es)->exp, m->src)));
+      if (std::holds_alternative<TempExp *>(m->dst)) {
+        if (auto *call = std::get_if<CallExp *>(&m->src)) {
+          auto [pre, value] = do_call(*call);
+          return seq(pre, Move(arena_, m->dst, value));
+        }
+        std::vector<Exp> exps{m->src};
+        Stm pre = reorder(exps);
+        return seq(pre, Move(arena_, m->dst, exps[0]));
+      }
+      auto *mem = std::get<MemExp *>(m->dst);
+      std::vector<Exp> exps;
+      terms(mem->addr, exps);
+      exps.push_back(m->src);
+      Stm pre = reorder(exps);
+      size_t next = 0;
+      Exp addr = rebuild(mem->addr, exps, next);
+      return seq(pre, Move(arena_, Mem(arena_, addr), exps.back()));
+    }
+    if (auto *ex = std::get_if<ExpStm *>(&s)) {
+      if (auto *call = std::get_if<CallExp *>(&(*ex)->exp)) {
+        auto [pre, value] = do_call(*call);
+        return seq(pre, ExpS(arena_, value));
+      }
+      std::vector<Exp> exps{(*ex)->exp};
+      Stm pre = reorder(exps);
+      return seq(pre, ExpS(arena_, exps[0]));
+    }
+    return s;
+  }
+};
+
+void flatten(Stm s, std::vector<Stm> &out) {
+  if (auto *sq = std::get_if<SeqStm *>(&s)) {
+    flatten((*sq)->left, out);
+    flatten((*sq)->right, out);
+  } else if (!is_nop(s)) {
+    out.push_back(s);
+  }
+}
+
+bool is_jump(Stm s) {
+  return std::holds_alternative<JumpStm *>(s) ||
+         std::holds_alternative<CjumpStm *>(s);
+}
+} // namespace
+
+std::vector<tree::Stm> linearize(absyn::Arena &arena, frame::Frame &frame,
+                                 tree::Stm body) {
+  std::vector<Stm> out;
+  flatten(Linearizer(arena, frame).do_stm(body), out);
+  return out;
+}
+
+Blocks basic_blocks(absyn::Arena &arena, frame::Frame &frame,
+                    const std::vector<tree::Stm> &stms) {
+  Blocks result{{}, frame.new_label(arena)};
+  std::vector<Stm> block;
+  for (auto s : stms) {
+    if (auto *l = std::get_if<LabelStm *>(&s)) {
+      if (!block.empty()) {
+        block.push_back(Jump(arena, (*l)->label));
+        result.blocks.push_back(std::move(block));
+        block.clear();
+      }
+    } else if (block.empty()) {
+      block.push_back(LabelS(arena, frame.new_label(arena)));
+    }
+    block.push_back(s);
+    if (is_jump(s)) {
+      result.blocks.push_back(std::move(block));
+      block.clear();
+    }
+  }
+  if (!block.empty()) {
+    block.push_back(Jump(arena, result.done));
+    result.blocks.push_back(std::move(block));
+  }
+  return result;
+}
+
+std::vector<tree::Stm> trace_schedule(absyn::Arena &arena, frame::Frame &frame,
+                                      const Blocks &blocks) {
+  auto label_of = [&](size_t b) {
+    return std::get<LabelStm *>(blocks.blocks[b].front())->label;
+  };
+  std::unordered_map<temp::Label, size_t> index;
+  for (size_t b = 0; b < blocks.blocks.size(); b++)
+    index[label_of(b)] = b;
+  auto unmarked = [&](std::vector<bool> &marked, temp::Label l) -> int {
+    auto it = index.find(l);
+    return it != index.end() && !marked[it->second] ? it->second : -1;
+  };
+
+  // Each trace follows jumps to blocks not yet placed, preferring a
+  // conditional jump's false label
+  std::vector<size_t> order;
+  std::vector<bool> marked(blocks.blocks.size());
+  for (size_t start = 0; start < blocks.blocks.size(); start++) {
+    int b = marked[start] ? -1 : start;
+    while (b >= 0) {
+      marked[b] = true;
+      order.push_back(b);
+      Stm last = blocks.blocks[b].back();
+      if (auto *j = std::get_if<JumpStm *>(&last)) {
+        b = unmarked(marked, (*j)->target);
+      } else {
+        auto *c = std::get<CjumpStm *>(last);
+        b = unmarked(marked, c->f);
+        if (b < 0)
+          b = unmarked(marked, c->t);
+      }
+    }
+  }
+
+  std::vector<Stm> out;
+  for (size_t i = 0; i < order.size(); i++) {
+    auto &block = blocks.blocks[order[i]];
+    temp::Label next =
+        i + 1 < order.size() ? label_of(order[i + 1]) : blocks.done;
+    out.insert(out.end(), block.begin(), block.end() - 1);
+    Stm last = block.back();
+    if (auto *j = std::get_if<JumpStm *>(&last)) {
+      if ((*j)->target != next)
+        out.push_back(last);
+      continue;
+    }
+    auto *c = std::get<CjumpStm *>(last);
+    if (c->f == next) {
+      out.push_back(last);
+    } else if (c->t == next) {
+      out.push_back(Cjump(arena, negate(c->op), c->left, c->right, c->f, c->t));
+    } else {
+      auto f = frame.new_label(arena);
+      out.push_back(Cjump(arena, c->op, c->left, c->right, c->t, f));
+      out.push_back(LabelS(arena, f));
+      out.push_back(Jump(arena, c->f));
+    }
+  }
+  out.push_back(LabelS(arena, blocks.done));
+  return out;
+}
+
+} // namespace canon
@@ -0,0 +1,36 @@
+#ifndef CANON_H
+#define CANON_H
+#include "arena.h"
+#include "frame.h"
+#include "temp.h"
+#include "tree.h"
+#include <vector>
+
+// Puts the IR of a function body into the form instruction selection
+// expects, as in Appel's chapter 8. The temps and labels this introduces
+// come from the function's frame, and new nodes from the arena.
+namespace canon {
+
+// Flattens the body into a list of statements without SEQ or ESEQ, in which
+// every CALL is all of an EXP or the source of a MOVE to a temp
+std::vector<tree::Stm> linearize(absyn::Arena &arena, frame::Frame &frame,
+                                 tree::Stm body);
+
+struct Blocks {
+  // Each starts with a LABEL and ends with a JUMP or CJUMP, and has no other
+  // labels or jumps
+  std::vector<std::vector<tree::Stm>> blocks;
+  // where the last block jumps to leave the function
+  temp::Label done;
+};
+Blocks basic_blocks(absyn::Arena &arena, frame::Frame &frame,
+                    const std::vector<tree::Stm> &stms);
+
+// Orders the blocks so that every CJUMP is followed by its false label and
+// as many JUMPs as possible by their target, which are then left out. The
+// result ends with the `done` label.
+std::vector<tree::Stm> trace_schedule(absyn::Arena &arena, frame::Frame &frame,
+                                      const Blocks &blocks);
+
+} // namespace canon
+#endif
@@ -0,0 +1,94 @@
+#include "codegen.h"
+#include "canon.h"
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+
+namespace codegen {
+
+void emit(std::FILE *out, translate::Fragments &frags,
+          const ssa::Options &options, std::vector<regalloc::Stats> *stats,
+          ssa::Stats *ssa_stats, const cache::Cache *cache) {
+  auto &arena = frags.arena();
+  // Each distinct string is emitted once, however many literals have its
+  // value, between tig_literals and tig_literals_end. The runtime takes two
+  // strings there at different addresses to differ without comparing them.
+  std::vector<std::pair<std::string_view, std::vector<temp::Label>>> strings;
+  std::unordered_map<std::string_view, size_t> seen;
+  for (auto &frag : frags.strings()) {
+    auto [it, added] = seen.emplace(frag.value, strings.size());
+    if (added)
+      strings.emplace_back(frag.value, std::vector<temp::Label>());
+    strings[it->second].second.push_back(frag.label);
+  }
+  std::fputs("\t.section .rodata\n\t.p2align 3\n"
+             "\t.globl tig_literals\ntig_literals:\n",
+             out);
+  for (auto &[value, labels] : strings)
+    std::fputs(frame::string_literal(labels, value).c_str(), out);
+  std::fputs("\t.globl tig_literals_end\ntig_literals_end:\n", out);
+  for (auto &frag : frags.layouts())
+    std::fputs(frame::record_layout(frag.label, frag.pointers).c_str(), out);
+  std::string maps;
+  size_t num_maps = 0;
+  std::fputs("\t.text\n\t.globl tigermain\n", out);
+  // each function's code, kept for the cache
+  std::vector<frame::CodeFrag> compiled;
+  for (auto &frag : frags.procs()) {
+    auto &frame = *frag.frame;
+    auto stms = canon::linearize(arena, frame, frag.body);
+    auto blocks = ssa::optimize(arena, frame,
+                                canon::basic_blocks(arena, frame, stms),
+                                options, ssa_stats);
+    stms = canon::trace_schedule(arena, frame, blocks);
+    auto instrs = select(frame, stms);
+    frame.entry_exit2(instrs);
+    regalloc::Stats s;
+    instrs = regalloc::allocate(arena, frame, std::move(instrs), &s);
+    if (stats)
+      stats->push_back(std::move(s));
+    frame::CodeFrag code{frame.prologue(), "", 0};
+    auto name = [&](temp::Temp t) {
+      return std::string("%") + frame.register_name(t);
+    };
+    for (auto &instr : instrs) {
+      auto text = assem::format(instr, name);
+      if (text.empty())
+        continue;
+      if (instr.kind != assem::Instr::Kind::kLabel)
+        code.text += '\t';
+      code.text += text;
+      code.text += '\n';
+      // where the call returns to, which its pointer map is found by
+      if (instr.kind == assem::Instr::Kind::kCall)
+        code.text += std::string(instr.label.name()) + ":\n";
+    }
+    code.text += frame.epilogue();
+    code.maps = frame::frame_maps(frame, &code.num_maps);
+    std::fputs(code.text.c_str(), out);
+    maps += code.maps;
+    num_maps += code.num_maps;
+    if (cache)
+      compiled.push_back(std::move(code));
+  }
+  for (auto &code : frags.code()) {
+    std::fputs(code.text.c_str(), out);
+    maps += code.maps;
+    num_maps += code.num_maps;
+  }
+  if (cache) {
+    for (auto &group : frags.groups())
+      cache->store(group.key, frags.save(group, compiled));
+  }
+  // the collector's table of call sites, which the runtime reads
+  std::fprintf(out,
+               "\t.section .data.rel.ro\n\t.p2align 3\n"
+               "\t.globl tig_frame_maps\ntig_frame_maps:\n\t.quad %zu\n",
+               num_maps);
+  std::fputs(maps.c_str(), out);
+  // the stack needn't be executable
+  std::fputs("\t.section .note.GNU-stack,\"\",@progbits\n", out);
+}
+
+} // namespace codegen
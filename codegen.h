@@ -0,0 +1,36 @@
+#ifndef CODEGEN_H
+#define CODEGEN_H
+#include "assem.h"
+#include "cache.h"
+#include "frame.h"
+#include "regalloc.h"
+#include "ssa.h"
+#include "translate.h"
+#include "tree.h"
+#include <cstdio>
+#include <vector>
+
+namespace codegen {
+
+// Selects instructions for the statements of a function body, as canon
+// leaves them, by maximal munch: each tree is covered top-down by the
+// largest tile that matches it. The instructions use the function's temps;
+// machine registers are only named where the target requires them.
+std::vector<assem::Instr> select(frame::Frame &frame,
+                                 const std::vector<tree::Stm> &stms);
+
+// Compiles every fragment to GNU assembler, written to `out`. The program
+// starts at tigermain, which the runtime calls. Each function is optimized
+// by the SSA passes `options` says. What register allocation took for each
+// function is appended to `stats`, and what the passes did added to
+// `ssa_stats`, if they're given. The code fragments, compiled before, are
+// emitted as they are, and with a cache, the code of each group the
+// fragments mark is stored in it.
+void emit(std::FILE *out, translate::Fragments &frags,
+          const ssa::Options &options = {},
+          std::vector<regalloc::Stats> *stats = nullptr,
+          ssa::Stats *ssa_stats = nullptr,
+          const cache::Cache *cache = nullptr);
+
+} // namespace codegen
+#endif
@@ -0,0 +1,53 @@
+#ifndef COMPILATION_H
+#define COMPILATION_H
+#include "absyn_common.h"
+#include "arena.h"
+#include "diagnostics.h"
+#include "literal.h"
+#include "location.h"
+#include "symbol.h"
+#include "translate.h"
+#include "types.h"
+#include <algorithm>
+#include <string>
+#include <vector>
+
+// Everything one compilation owns: its symbols, literals, AST and types, and
+// the messages reported about it. Nothing is shared between instances, so
+// separate compilations can run concurrently on separate threads.
+struct Compilation {
+  std::string path;
+  symbol::Registry symbols;
+  literal::Pool literals;
+  absyn::Arena arena;
+  types::Context types;
+  // result of the parse, or null if the parser couldn't recover
+  absyn::ExprAST *ast{nullptr};
+  Diagnostics diags;
+  // the translation of the program, if it checked
+  translate::Fragments frags;
+
+  explicit Compilation(std::string path) : path(std::move(path)) {}
+  // The errors and warnings reported so far, as "path:line:column: message"
+  // in source order, with "warning: " before the message of a warning
+  std::vector<std::string> messages() const {
+    std::vector<const Diagnostics::Diagnostic *> sorted;
+    for (auto &d : diags)
+      sorted.push_back(&d);
+    for (auto &d : diags.warnings())
+      sorted.push_back(&d);
+    std::stable_sort(sorted.begin(), sorted.end(), [](auto *a, auto *b) {
+      return a->pos.line != b->pos.line ? a->pos.line < b->pos.line
+                                        : a->pos.column < b->pos.column;
+    });
+    std::vector<std::string> out;
+    for (auto *d : sorted) {
+      std::ostringstream os;
+      os << path << ":" << d->pos << ": " << (d->warning ? "warning: " : "")
+         << d->msg;
+      out.push_back(os.str());
+    }
+    return out;
+  }
+};
+#endif
@@ -0,0 +1,148 @@
+#ifndef COUNT_H
+#define COUNT_H
+#include "absyn.h"
+#include <cstddef>
+#include <iterator>
+#include <variant>
+
+namespace absyn {
+
+// Number of AST nodes of each kind, indexed by the node's alternative in
+// ExprAST, VarAST, DeclAST or Ty
+struct NodeCounts {
+  size_t exprs[std::variant_size_v<ExprAST>]{};
+  size_t vars[std::variant_size_v<VarAST>]{};
+  size_t decls[std::variant_size_v<DeclAST>]{};
+  size_t tys[std::variant_size_v<Ty>]{};
+
+  size_t total() const {
+    size_t n = 0;
+    for (auto c : exprs)
+      n += c;
+    for (auto c : vars)
+      n += c;
+    for (auto c : decls)
+      n += c;
+    for (auto c : tys)
+      n += c;
+    return n;
+  }
+};
+
+NodeCounts count_nodes(ExprAST &e);
+
+// names of the node kinds, in the order NodeCounts counts them
+constexpr const char *kExprNames[] = {
+    "VarExpr",   "NilExpr",    "IntExpr",   "StringExpr", "CallExpr",
+    "OpExpr",    "RecordExpr", "ArrayExpr", "SeqExpr",    "AssignExpr",
+    "IfExpr",    "WhileExpr",  "ForExpr",   "BreakExpr",  "LetExpr",
+    "UnitExpr",  "ErrorExpr"};
+constexpr const char *kVarNames[] = {"SimpleVar", "FieldVar", "IndexVar"};
+constexpr const char *kDeclNames[] = {"TypeDecl", "VarDecl", "FuncDecl"};
+constexpr const char *kTyNames[] = {"NameTy", "RecordTy", "ArrayTy"};
+static_assert(std::size(kExprNames) == std::variant_size_v<ExprAST>);
+static_assert(std::size(kVarNames) == std::variant_size_v<VarAST>);
+static_assert(std::size(kDeclNames) == std::variant_size_v<DeclAST>);
+static_assert(std::size(kTyNames) == std::variant_size_v<Ty>);
+
+namespace detail {
+
+class NodeCounter {
+  NodeCounts &counts_;
+
+public:
+  NodeCounter(NodeCounts &counts) : counts_(counts) {}
+  void count(ExprAST &e) {
+    counts_.exprs[e.index()]++;
+    std::visit(*this, e);
+  }
+  void count(VarAST &v) {
+    counts_.vars[v.index()]++;
+    std::visit(*this, v);
+  }
+  void count(DeclAST &d) {
+    counts_.decls[d.index()]++;
+    std::visit(*this, d);
+  }
+  void count(Ty &ty) { counts_.tys[ty.index()]++; }
+
+  void operator()(SimpleVarAST *) {}
+  void operator()(FieldVarAST *v) { count(v->var); }
+  void operator()(IndexVarAST *v) {
+    count(v->var);
+    count(v->index);
+  }
+
+  void operator()(VarExprAST *e) { count(e->var); }
+  void operator()(NilExprAST *) {}
+  void operator()(IntExprAST *) {}
+  void operator()(StringExprAST *) {}
+  void operator()(CallExprAST *e) {
+    for (auto &arg : e->args)
+      count(arg.exp);
+  }
+  void operator()(OpExprAST *e) {
+    count(e->lhs);
+    count(e->rhs);
+  }
+  void operator()(RecordExprAST *e) {
+    for (auto &field : e->fields)
+      count(field.value);
+  }
+  void operator()(ArrayExprAST *e) {
+    count(e->size);
+    count(e->init);
+  }
+  void operator()(SeqExprAST *e) {
+    for (auto &exp : e->exps)
+      count(exp.exp);
+  }
+  void operator()(AssignExprAST *e) {
+    count(e->var);
+    count(e->exp);
+  }
+  void operator()(IfExprAST *e) {
+    count(e->cond);
+    count(e->then);
+    if (e->else_)
+      count(*e->else_);
+  }
+  void operator()(WhileExprAST *e) {
+    count(e->cond);
+    count(e->body);
+  }
+  void operator()(ForExprAST *e) {
+    count(e->lo);
+    count(e->hi);
+    count(e->body);
+  }
+  void operator()(BreakExprAST *) {}
+  void operator()(LetExprAST *e) {
+    for (auto &dec : e->decs)
+      count(dec);
+    count(e->body);
+  }
+  void operator()(UnitExprAST *) {}
+  void operator()(ErrorExprAST *) {}
+
+  void operator()(TypeDeclAST *d) {
+    for (auto &type : d->types)
+      count(type.type);
+  }
+  void operator()(VarDeclAST *d) { count(d->init); }
+  void operator()(FuncDeclAST *d) {
+    for (auto &fundec : d->decls)
+      count(fundec.body);
+  }
+};
+
+} // namespace detail
+
+inline NodeCounts count_nodes(ExprAST &e) {
+  NodeCounts counts;
+  detail::NodeCounter(counts).count(e);
+  return counts;
+}
+
+} // namespace absyn
+#endif
@@ -0,0 +1,45 @@
+#ifndef DIAGNOSTICS_H
+#define DIAGNOSTICS_H
+#include "location.h"
+#include <string>
+#include <utility>
+#include <vector>
+
+// Collects the errors found in one compilation, or in one part of it that's
+// checked on its own, such as a function body checked on another thread.
+// Reporting an error only records it, so every phase can carry on and find
+// the next one. Warnings are kept apart, and don't fail the compilation.
+class Diagnostics {
+public:
+  struct Diagnostic {
+    Location pos;
+    std::string msg;
+    bool warning{false};
+  };
+
+  void error(const Location &pos, std::string msg) {
+    diags_.push_back({pos, std::move(msg)});
+  }
+  void warning(const Location &pos, std::string msg) {
+    warnings_.push_back({pos, std::move(msg), true});
+  }
+  // moves the other's errors and warnings after this one's
+  void append(Diagnostics &&other) {
+    for (auto &d : other.diags_)
+      diags_.push_back(std::move(d));
+    for (auto &d : other.warnings_)
+      warnings_.push_back(std::move(d));
+    other.diags_.clear();
+    other.warnings_.clear();
+  }
+
+  bool empty() const { return diags_.empty(); }
+  size_t size() const { return diags_.size(); }
+  auto begin() const { return diags_.begin(); }
+  auto end() const { return diags_.end(); }
+  const std::vector<Diagnostic> &warnings() const { return warnings_; }
+
+private:
+  std::vector<Diagnostic> diags_, warnings_;
+};
+#endif
@@ -0,0 +1,179 @@
+#ifndef DIGEST_H
+#define DIGEST_H
+#include "absyn.h"
+#include "cache.h"
+#include "symbol.h"
+#include <string_view>
+#include <variant>
+#include <vector>
+
+namespace absyn {
+
+// What digest() found in a group of functions besides its hash
+struct Digest {
+  // every name the group refers to, once each, in the order first referred
+  // to; those declared in the group are included, which at worst keys it to
+  // something it doesn't depend on
+  std::vector<Symbol> names;
+  // the comparisons, in order, whose OpExprAST::strings semant sets
+  std::vector<OpExprAST *> comparisons;
+};
+
+// Adds to `h` all of the group that checking and translating it depends on:
+// its structure, names and literals, and the flags the passes before semant
+// set, but not where anything is in the source, so that moving a group
+// leaves its hash as it was.
+Digest digest(FuncDeclAST &group, cache::Hasher &h);
+
+namespace detail {
+
+class Digester {
+  cache::Hasher &h_;
+  Digest &out_;
+  symbol::Set seen_;
+
+  void name(Symbol s) {
+    h_.add(std::string_view(s.name()));
+    if (seen_.insert(s))
+      out_.names.push_back(s);
+  }
+  void flag(bool b) { h_.add((uint64_t)b); }
+
+public:
+  Digester(cache::Hasher &h, Digest &out) : h_(h), out_(out) {}
+  template <typename T> void add(T &node) {
+    h_.add((uint64_t)node.index());
+    std::visit(*this, node);
+  }
+
+  void operator()(SimpleVarAST *v) { name(v->id); }
+  void operator()(FieldVarAST *v) {
+    add(v->var);
+    h_.add(std::string_view(v->field.name()));
+  }
+  void operator()(IndexVarAST *v) {
+    add(v->var);
+    add(v->index);
+    flag(v->checked);
+  }
+
+  void operator()(VarExprAST *e) { add(e->var); }
+  void operator()(NilExprAST *) {}
+  void operator()(IntExprAST *e) { h_.add((uint64_t)e->val); }
+  void operator()(StringExprAST *e) { h_.add(e->val.value()); }
+  void operator()(CallExprAST *e) {
+    name(e->func);
+    h_.add((uint64_t)e->args.size());
+    for (auto &arg : e->args)
+      add(arg.exp);
+    flag(e->tail);
+  }
+  void operator()(OpExprAST *e) {
+    h_.add((uint64_t)e->op);
+    add(e->lhs);
+    add(e->rhs);
+    if (e->op >= Op::kEq && e->op <= Op::kGe)
+      out_.comparisons.push_back(e);
+  }
+  void operator()(RecordExprAST *e) {
+    name(e->type_id);
+    h_.add((uint64_t)e->fields.size());
+    for (auto &field : e->fields) {
+      h_.add(std::string_view(field.name.name()));
+      add(field.value);
+    }
+  }
+  void operator()(ArrayExprAST *e) {
+    name(e->type_id);
+    add(e->size);
+    add(e->init);
+  }
+  void operator()(SeqExprAST *e) {
+    h_.add((uint64_t)e->exps.size());
+    for (auto &exp : e->exps)
+      add(exp.exp);
+  }
+  void operator()(AssignExprAST *e) {
+    add(e->var);
+    add(e->exp);
+  }
+  void operator()(IfExprAST *e) {
+    add(e->cond);
+    add(e->then);
+    flag(e->else_.has_value());
+    if (e->else_)
+      add(*e->else_);
+  }
+  void operator()(WhileExprAST *e) {
+    add(e->cond);
+    add(e->body);
+  }
+  void operator()(ForExprAST *e) {
+    name(e->var);
+    flag(e->escape);
+    add(e->lo);
+    add(e->hi);
+    add(e->body);
+  }
+  void operator()(BreakExprAST *) {}
+  void operator()(LetExprAST *e) {
+    h_.add((uint64_t)e->decs.size());
+    for (auto &dec : e->decs)
+      add(dec);
+    add(e->body);
+  }
+  void operator()(UnitExprAST *) {}
+  void operator()(ErrorExprAST *) {}
+
+  void operator()(NameTy *t) { name(t->type_id); }
+  void operator()(RecordTy *t) { fields(t->fields); }
+  void operator()(ArrayTy *t) { name(t->type_id); }
+
+  void operator()(TypeDeclAST *d) {
+    h_.add((uint64_t)d->types.size());
+    for (auto &type : d->types) {
+      name(type.name);
+      add(type.type);
+    }
+  }
+  void operator()(VarDeclAST *d) {
+    name(d->name);
+    flag(d->type_id.has_value());
+    if (d->type_id)
+      name(d->type_id->sym);
+    flag(d->escape);
+    add(d->init);
+  }
+  void operator()(FuncDeclAST *d) {
+    h_.add((uint64_t)d->decls.size());
+    for (auto &fundec : d->decls) {
+      name(fundec.name);
+      fields(fundec.params);
+      flag(fundec.result.has_value());
+      if (fundec.result)
+        name(fundec.result->sym);
+      add(fundec.body);
+    }
+  }
+
+private:
+  void fields(Seq<RTyField> fields) {
+    h_.add((uint64_t)fields.size());
+    for (auto &field : fields) {
+      name(field.name);
+      name(field.type_id);
+      flag(field.escape);
+    }
+  }
+};
+
+} // namespace detail
+
+inline Digest digest(FuncDeclAST &group, cache::Hasher &h) {
+  Digest out;
+  detail::Digester(h, out)(&group);
+  return out;
+}
+
+} // namespace absyn
+#endif
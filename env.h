@@ -1,14 +1,25 @@
 #ifndef ENV_H
 #define ENV_H
+#include "temp.h"
+#include "translate.h"
 #include "types.h"
 #include <variant>
 namespace env {
+// A for loop's variable can't be assigned
 struct VarEntry {
   types::Ty ty;
+  translate::Access access;
+  bool loop{false};
 };
+// A function declared in the program has the level of its body; a function
+// of the runtime has none, and is called without a static link, unless it's
+// an intrinsic, which isn't called at all
 struct FunEntry {
-  std::vector<types::Ty> formals;
+  types::TyList formals;
   types::Ty result;
+  translate::Level *level;
+  temp::Label label;
+  translate::Intrinsic intrinsic{translate::Intrinsic::kNone};
 };
 using EnvEntry = std::variant<VarEntry, FunEntry>;
 using types::as;
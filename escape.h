@@ -0,0 +1,147 @@
+#ifndef ESCAPE_H
+#define ESCAPE_H
+#include "absyn.h"
+#include "symbol.h"
+#include <cstddef>
+#include <cstdint>
+#include <variant>
+
+namespace absyn {
+
+// Number of variables (let-bound, parameters and for loop variables) and of
+// those that escape
+struct EscapeCounts {
+  size_t vars{0}, escaping{0};
+};
+
+// Sets the escape flag of every variable declared in e to whether the
+// variable is used in a function nested inside the one declaring it. Those
+// that don't escape can live in registers. Runs on the AST as parsed,
+// before semant, so it resolves names by the same scoping rules but doesn't
+// rely on the program being well typed.
+EscapeCounts find_escapes(ExprAST &e);
+
+namespace detail {
+
+class EscapeFinder {
+  // The function nesting depth a variable was declared at. Functions are
+  // entered too, with no flag, since they shadow variables of the same name.
+  struct Entry {
+    uint32_t depth;
+    bool *escape;
+  };
+  symbol::Table<Entry> env_;
+  uint32_t depth_{0};
+  EscapeCounts &counts_;
+
+  void declare(Symbol name, bool &escape) {
+    escape = false;
+    counts_.vars++;
+    // a duplicate is an error semant will report; the first one stays bound
+    env_.enter({name, {depth_, &escape}});
+  }
+
+public:
+  EscapeFinder(EscapeCounts &counts) : counts_(counts) {}
+  void find(ExprAST &e) { std::visit(*this, e); }
+  void find(VarAST &v) { std::visit(*this, v); }
+  void find(DeclAST &d) { std::visit(*this, d); }
+
+  void operator()(SimpleVarAST *v) {
+    auto entry = env_.look(v->id);
+    if (entry && entry->escape && entry->depth < depth_ && !*entry->escape) {
+      *entry->escape = true;
+      counts_.escaping++;
+    }
+  }
+  void operator()(FieldVarAST *v) { find(v->var); }
+  void operator()(IndexVarAST *v) {
+    find(v->var);
+    find(v->index);
+  }
+
+  void operator()(VarExprAST *e) { find(e->var); }
+  void operator()(NilExprAST *) {}
+  void operator()(IntExprAST *) {}
+  void operator()(StringExprAST *) {}
+  void operator()(CallExprAST *e) {
+    for (auto &arg : e->args)
+      find(arg.exp);
+  }
+  void operator()(OpExprAST *e) {
+    find(e->lhs);
+    find(e->rhs);
+  }
+  void operator()(RecordExprAST *e) {
+    for (auto &field : e->fields)
+      find(field.value);
+  }
+  void operator()(ArrayExprAST *e) {
+    find(e->size);
+    find(e->init);
+  }
+  void operator()(SeqExprAST *e) {
+    for (auto &exp : e->exps)
+      find(exp.exp);
+  }
+  void operator()(AssignExprAST *e) {
+    find(e->var);
+    find(e->exp);
+  }
+  void operator()(IfExprAST *e) {
+    find(e->cond);
+    find(e->then);
+    if (e->else_)
+      find(*e->else_);
+  }
+  void operator()(WhileExprAST *e) {
+    find(e->cond);
+    find(e->body);
+  }
+  void operator()(ForExprAST *e) {
+    find(e->lo);
+    find(e->hi);
+    symbol::Scope scope(env_);
+    declare(e->var, e->escape);
+    find(e->body);
+  }
+  void operator()(BreakExprAST *) {}
+  void operator()(LetExprAST *e) {
+    symbol::Scope scope(env_);
+    for (auto &dec : e->decs)
+      find(dec);
+    find(e->body);
+  }
+  void operator()(UnitExprAST *) {}
+  void operator()(ErrorExprAST *) {}
+
+  void operator()(TypeDeclAST *) {}
+  void operator()(VarDeclAST *d) {
+    // the initializer can't see the variable
+    find(d->init);
+    declare(d->name, d->escape);
+  }
+  void operator()(FuncDeclAST *d) {
+    for (auto &fundec : d->decls)
+      env_.enter({fundec.name, {depth_, nullptr}});
+    depth_++;
+    for (auto &fundec : d->decls) {
+      symbol::Scope scope(env_);
+      for (auto &param : fundec.params)
+        declare(param.name, param.escape);
+      find(fundec.body);
+    }
+    depth_--;
+  }
+};
+
+} // namespace detail
+
+inline EscapeCounts find_escapes(ExprAST &e) {
+  EscapeCounts counts;
+  detail::EscapeFinder(counts).find(e);
+  return counts;
+}
+
+} // namespace absyn
+#endif
@@ -0,0 +1,344 @@
+#ifndef FOLD_H
+#define FOLD_H
+#include "absyn.h"
+#include "arena.h"
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <variant>
+
+namespace absyn {
+
+// The rewrites simplify() made, by kind
+struct FoldCounts {
+  // operations on constants replaced by their value
+  size_t constants{0};
+  // operations replaced by an operand or a cheaper operation
+  size_t identities{0};
+  // ifs and whiles with a constant condition replaced by what they run
+  size_t branches{0};
+
+  size_t total() const { return constants + identities + branches; }
+};
+
+// Folds constant integer operations, comparisons of string literals and ifs
+// and whiles with constant conditions in a program that has been checked,
+// and applies algebraic identities such as x + 0 = x and x * 2 = x + x. The
+// program behaves the same afterwards, down to which runtime errors it
+// reports: a division is only folded if it can't fail, an operand is only
+// dropped if evaluating it can't do anything, and a result is only folded
+// if it fits in a literal. Needs semant's OpExprAST::strings.
+FoldCounts simplify(Arena &arena, ExprAST &e);
+
+namespace detail {
+
+class Folder {
+  Arena &arena_;
+  FoldCounts &counts_;
+
+  static IntExprAST *as_int(ExprAST &e) {
+    auto *i = std::get_if<IntExprAST *>(&e);
+    return i ? *i : nullptr;
+  }
+  static SimpleVarAST *as_simple_var(ExprAST &e) {
+    auto *v = std::get_if<VarExprAST *>(&e);
+    if (!v)
+      return nullptr;
+    auto *s = std::get_if<SimpleVarAST *>(&(*v)->var);
+    return s ? *s : nullptr;
+  }
+  // Whether two expressions are the same variable. Scoping is the same on
+  // both sides of an operator, so the same name is the same variable.
+  static bool same_var(ExprAST &a, ExprAST &b) {
+    auto *x = as_simple_var(a), *y = as_simple_var(b);
+    return x && y && x->id == y->id;
+  }
+  // Whether evaluating e can't do anything but produce its value: no call,
+  // assignment or division, and no field or element that might not be there
+  static bool pure(ExprAST &e) {
+    if (as_simple_var(e))
+      return true;
+    if (auto *op = std::get_if<OpExprAST *>(&e))
+      return (*op)->op != Op::kDiv && pure((*op)->lhs) && pure((*op)->rhs);
+    return std::holds_alternative<IntExprAST *>(e) ||
+           std::holds_alternative<StringExprAST *>(e) ||
+           std::holds_alternative<NilExprAST *>(e);
+  }
+  static bool is_comparison(Op op) { return op >= Op::kEq && op <= Op::kGe; }
+  // whether e's value is always 0 or 1, as a comparison's, & or | is
+  static bool is_boolean(ExprAST &e) {
+    if (auto *i = as_int(e))
+      return i->val == 0 || i->val == 1;
+    auto *op = std::get_if<OpExprAST *>(&e);
+    return op && (*op)->op >= Op::kEq;
+  }
+  // Whether e is nil, which is typed by what it's used as. An if of nil and
+  // a record is a record, so can't be replaced by its nil branch.
+  static bool is_nil(ExprAST &e) {
+    if (std::holds_alternative<NilExprAST *>(e))
+      return true;
+    if (auto *seq = std::get_if<SeqExprAST *>(&e))
+      return !(*seq)->exps.empty() && is_nil((*seq)->exps.back().exp);
+    if (auto *let = std::get_if<LetExprAST *>(&e))
+      return is_nil((*let)->body);
+    if (auto *i = std::get_if<IfExprAST *>(&e))
+      return is_nil((*i)->then) && (*i)->else_ && is_nil(*(*i)->else_);
+    return false;
+  }
+  ExprAST constant(int64_t val) {
+    counts_.constants++;
+    return arena_.New<IntExprAST>(val);
+  }
+  ExprAST identity(ExprAST e) {
+    counts_.identities++;
+    return e;
+  }
+  ExprAST copy_var(SimpleVarAST *v) {
+    VarAST var = arena_.New<SimpleVarAST>(v->id, v->pos);
+    return arena_.New<VarExprAST>(&var);
+  }
+
+  ExprAST arith(OpExprAST *e) {
+    auto *a = as_int(e->lhs), *b = as_int(e->rhs);
+    if (a && b) {
+      int64_t x = a->val, y = b->val, r;
+      switch (e->op) {
+      case Op::kPlus:
+        r = x + y;
+        break;
+      case Op::kMinus:
+        r = x - y;
+        break;
+      case Op::kMul:
+        r = x * y;
+        break;
+      default:
+        // dividing by zero is a runtime error
+        if (y == 0)
+          return e;
+        r = x / y;
+      }
+      return r >= INT_MIN && r <= INT_MAX ? constant(r) : e;
+    }
+    switch (e->op) {
+    case Op::kPlus:
+      if (a && a->val == 0)
+        return identity(e->rhs);
+      if (b && b->val == 0)
+        return identity(e->lhs);
+      break;
+    case Op::kMinus:
+      if (b && b->val == 0)
+        return identity(e->lhs);
+      if (same_var(e->lhs, e->rhs))
+        return constant(0);
+      // 0 - (0 - x), which is how --x parses
+      if (a && a->val == 0) {
+        auto *neg = std::get_if<OpExprAST *>(&e->rhs);
+        if (neg && (*neg)->op == Op::kMinus) {
+          auto *zero = as_int((*neg)->lhs);
+          if (zero && zero->val == 0)
+            return identity((*neg)->rhs);
+        }
+      }
+      break;
+    case Op::kMul:
+      if (a && a->val == 1)
+        return identity(e->rhs);
+      if (b && b->val == 1)
+        return identity(e->lhs);
+      if ((a && a->val == 0 && pure(e->rhs)) ||
+          (b && b->val == 0 && pure(e->lhs)))
+        return constant(0);
+      // x * k, for a constant k other than 0 and 1, is left
+      if (auto *k = b ? b : a) {
+        ExprAST x = b ? e->lhs : e->rhs;
+        if (k->val == -1) {
+          counts_.identities++;
+          e->op = Op::kMinus;
+          e->lhs = arena_.New<IntExprAST>(0);
+          e->rhs = x;
+        } else if (auto *v = as_simple_var(x); v && k->val == 2) {
+          counts_.identities++;
+          e->op = Op::kPlus;
+          e->lhs = x;
+          e->rhs = copy_var(v);
+        }
+      }
+      break;
+    default:
+      if (b && b->val == 1)
+        return identity(e->lhs);
+    }
+    return e;
+  }
+
+  ExprAST compare(OpExprAST *e) {
+    auto *a = as_int(e->lhs), *b = as_int(e->rhs);
+    if (a && b) {
+      int x = a->val, y = b->val;
+      switch (e->op) {
+      case Op::kEq:
+        return constant(x == y);
+      case Op::kNeq:
+        return constant(x != y);
+      case Op::kLt:
+        return constant(x < y);
+      case Op::kLe:
+        return constant(x <= y);
+      case Op::kGt:
+        return constant(x > y);
+      default:
+        return constant(x >= y);
+      }
+    }
+    auto *s = std::get_if<StringExprAST *>(&e->lhs);
+    auto *t = std::get_if<StringExprAST *>(&e->rhs);
+    if (e->strings && s && t && (e->op == Op::kEq || e->op == Op::kNeq))
+      // equal literals are the same one in the pool
+      return constant(((*s)->val == (*t)->val) == (e->op == Op::kEq));
+    // Anything is equal to itself, strings by contents and records and
+    // arrays by identity
+    if (same_var(e->lhs, e->rhs)) {
+      bool equal = e->op == Op::kEq || e->op == Op::kLe || e->op == Op::kGe;
+      return constant(equal);
+    }
+    return e;
+  }
+
+  // & and | are 1 or 0, by whether both or either operand is nonzero, and
+  // the right isn't evaluated if the left decides
+  ExprAST logical(OpExprAST *e) {
+    bool is_and = e->op == Op::kAnd;
+    if (auto *a = as_int(e->lhs)) {
+      if ((a->val != 0) != is_and)
+        return constant(!is_and);
+      if (is_boolean(e->rhs))
+        return identity(e->rhs);
+    } else if (auto *b = as_int(e->rhs)) {
+      if ((b->val != 0) == is_and && is_boolean(e->lhs))
+        return identity(e->lhs);
+      if ((b->val != 0) != is_and && pure(e->lhs))
+        return constant(!is_and);
+    }
+    return e;
+  }
+
+public:
+  Folder(Arena &arena, FoldCounts &counts) : arena_(arena), counts_(counts) {}
+  void fold(ExprAST &e) { e = std::visit(*this, e); }
+  void fold(VarAST &v) { std::visit(*this, v); }
+  void fold(DeclAST &d) { std::visit(*this, d); }
+
+  void operator()(SimpleVarAST *) {}
+  void operator()(FieldVarAST *v) { fold(v->var); }
+  void operator()(IndexVarAST *v) {
+    fold(v->var);
+    fold(v->index);
+  }
+
+  // each returns what replaces the expression
+  ExprAST operator()(VarExprAST *e) {
+    fold(e->var);
+    return e;
+  }
+  ExprAST operator()(NilExprAST *e) { return e; }
+  ExprAST operator()(IntExprAST *e) { return e; }
+  ExprAST operator()(StringExprAST *e) { return e; }
+  ExprAST operator()(CallExprAST *e) {
+    for (auto &arg : e->args)
+      fold(arg.exp);
+    return e;
+  }
+  ExprAST operator()(OpExprAST *e) {
+    fold(e->lhs);
+    fold(e->rhs);
+    if (e->op == Op::kAnd || e->op == Op::kOr)
+      return logical(e);
+    if (is_comparison(e->op))
+      return compare(e);
+    return arith(e);
+  }
+  ExprAST operator()(RecordExprAST *e) {
+    for (auto &field : e->fields)
+      fold(field.value);
+    return e;
+  }
+  ExprAST operator()(ArrayExprAST *e) {
+    fold(e->size);
+    fold(e->init);
+    return e;
+  }
+  ExprAST operator()(SeqExprAST *e) {
+    for (auto &exp : e->exps)
+      fold(exp.exp);
+    return e;
+  }
+  ExprAST operator()(AssignExprAST *e) {
+    fold(e->var);
+    fold(e->exp);
+    return e;
+  }
+  // the branch not taken isn't folded, since it's dropped
+  ExprAST operator()(IfExprAST *e) {
+    fold(e->cond);
+    if (auto *c = as_int(e->cond)) {
+      auto *taken = c->val ? &e->then : e->else_ ? &*e->else_ : nullptr;
+      if (!taken) {
+        counts_.branches++;
+        return arena_.New<UnitExprAST>();
+      }
+      if (!is_nil(*taken)) {
+        counts_.branches++;
+        fold(*taken);
+        return *taken;
+      }
+    }
+    fold(e->then);
+    if (e->else_)
+      fold(*e->else_);
+    return e;
+  }
+  ExprAST operator()(WhileExprAST *e) {
+    fold(e->cond);
+    if (auto *c = as_int(e->cond); c && !c->val) {
+      counts_.branches++;
+      return arena_.New<UnitExprAST>();
+    }
+    fold(e->body);
+    return e;
+  }
+  ExprAST operator()(ForExprAST *e) {
+    fold(e->lo);
+    fold(e->hi);
+    fold(e->body);
+    return e;
+  }
+  ExprAST operator()(BreakExprAST *e) { return e; }
+  ExprAST operator()(LetExprAST *e) {
+    for (auto &dec : e->decs)
+      fold(dec);
+    fold(e->body);
+    return e;
+  }
+  ExprAST operator()(UnitExprAST *e) { return e; }
+  ExprAST operator()(ErrorExprAST *e) { return e; }
+
+  void operator()(TypeDeclAST *) {}
+  void operator()(VarDeclAST *d) { fold(d->init); }
+  void operator()(FuncDeclAST *d) {
+    for (auto &fundec : d->decls)
+      fold(fundec.body);
+  }
+};
+
+} // namespace detail
+
+inline FoldCounts simplify(Arena &arena, ExprAST &e) {
+  FoldCounts counts;
+  detail::Folder(arena, counts).fold(e);
+  return counts;
+}
+
+} // namespace absyn
+#endif
@@ -0,0 +1,21 @@
+#include "frame.h"
+#include <cstring>
+
+namespace frame {
+
+temp::Label named_label(absyn::Arena &arena, std::string_view name) {
+  char *s = arena.NewArray<char>(name.size() + 1);
+  std::memcpy(s, name.data(), name.size());
+  s[name.size()] = '\0';
+  return temp::Label(s);
+}
+
+// Local labels are named after the function, which keeps them unique, and
+// start with .L, which no function's label does and which keeps them out of
+// the object file's symbols
+temp::Label Frame::new_label(absyn::Arena &arena) {
+  return named_label(arena, ".L" + std::string(name_.name()) + "." +
+                                std::to_string(next_label_++));
+}
+
+} // namespace frame
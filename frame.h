@@ -0,0 +1,171 @@
+#ifndef FRAME_H
+#define FRAME_H
+#include "arena.h"
+#include "assem.h"
+#include "temp.h"
+#include "tree.h"
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace frame {
+
+// Where a formal or local lives: in a slot at an offset from the frame
+// pointer, or in a temp
+struct Access {
+  enum class Kind : uint8_t { kFrame, kReg };
+  Kind kind;
+  // whether it's a record or array, which the collector has to find
+  bool pointer;
+  int32_t offset;
+  temp::Temp reg;
+
+  static Access in_frame(int32_t offset, bool pointer = false) {
+    return {Kind::kFrame, pointer, offset, temp::Temp()};
+  }
+  static Access in_reg(temp::Temp reg, bool pointer = false) {
+    return {Kind::kReg, pointer, 0, reg};
+  }
+};
+
+// A call during which the garbage collector can run, by the label of its
+// return address, and the slots of the caller's frame, by offset from the
+// frame pointer, that hold records and arrays live across it besides the
+// frame's pointer_slots(). The collector finds the frames on the stack by
+// their return addresses, and updates the pointers in those slots when it
+// moves what they point to.
+struct CallSite {
+  temp::Label ret;
+  std::vector<int32_t> slots;
+};
+
+// Makes a label with the given name, which must be unique in the compilation
+temp::Label named_label(absyn::Arena &arena, std::string_view name);
+
+// The activation record of one function, as the target lays it out. The
+// frame also numbers the function's temps and local labels, so that
+// functions can be translated independently of each other.
+class Frame {
+public:
+  virtual ~Frame() = default;
+  Frame(const Frame &) = delete;
+  Frame &operator=(const Frame &) = delete;
+
+  temp::Label name() const { return name_; }
+  // where the function sees its formals once the view shift is done
+  const std::vector<Access> &formals() const { return formals_; }
+  // `pointer` says whether the local is a record or array
+  virtual Access alloc_local(bool escape, bool pointer = false) = 0;
+  // bytes of locals allocated so far
+  virtual int32_t locals_size() const = 0;
+
+  temp::Temp new_temp(bool pointer = false) {
+    if (pointer) {
+      pointers_.resize(next_temp_ + 1);
+      pointers_[next_temp_] = true;
+    }
+    return temp::Temp(next_temp_++);
+  }
+  // one more than the highest temp handed out
+  uint32_t num_temps() const { return next_temp_; }
+  // whether the temp was made to hold a record or array
+  bool is_pointer(temp::Temp t) const {
+    return t.id() < pointers_.size() && pointers_[t.id()];
+  }
+  // The slots of formals and escaping locals that are records or arrays,
+  // which hold one, or nil, whenever the function makes a call
+  const std::vector<int32_t> &pointer_slots() const { return pointer_slots_; }
+  const std::vector<CallSite> &call_sites() const { return call_sites_; }
+  void add_call_site(CallSite site) { call_sites_.push_back(std::move(site)); }
+  temp::Label new_label(absyn::Arena &arena);
+
+  virtual int word_size() const = 0;
+  virtual temp::Temp fp() const = 0;
+  // the register a function's result is returned in
+  virtual temp::Temp rv() const = 0;
+  // the name of the machine register, or null if the temp isn't one
+  virtual const char *register_name(temp::Temp t) const = 0;
+  // The value at `access`, given the address of the frame it's in. That is
+  // this frame's frame pointer unless it's reached through static links.
+  virtual tree::Exp exp(absyn::Arena &arena, Access access,
+                        tree::Exp frame_ptr) const = 0;
+  // A call to a function of the runtime, which takes no static link
+  virtual tree::Exp external_call(absyn::Arena &arena, std::string_view name,
+                                  tree::Seq<tree::Exp> args) const = 0;
+  // Wraps the body in the moves of the incoming arguments to where the
+  // function sees them, and the saving and restoring of callee-saved
+  // registers
+  virtual tree::Stm entry_exit1(absyn::Arena &arena, tree::Stm body) = 0;
+  // Ends the body's instructions with one that uses the registers live when
+  // the function returns, so that they stay live until then
+  virtual void entry_exit2(std::vector<assem::Instr> &body) const = 0;
+  // Adds to the body a tail call to `callee`, whose arguments are in the
+  // registers `args`: the callee-saved registers are restored and the frame
+  // torn down, then the callee jumped to, to return to this function's
+  // caller
+  virtual void tail_exit(std::vector<assem::Instr> &body, temp::Label callee,
+                         std::vector<temp::Temp> args) const = 0;
+  // The assembly that sets up the frame for the locals allocated so far, and
+  // that tears it down and returns
+  virtual std::string prologue() const = 0;
+  virtual std::string epilogue() const = 0;
+  // the registers the allocator can give temps
+  virtual const std::vector<temp::Temp> &registers() const = 0;
+
+protected:
+  Frame(temp::Label name, uint32_t first_temp)
+      : name_(name), next_temp_(first_temp) {}
+  temp::Label name_;
+  std::vector<Access> formals_;
+  std::vector<int32_t> pointer_slots_;
+  std::vector<CallSite> call_sites_;
+  uint32_t next_temp_;
+  uint32_t next_label_{0};
+
+private:
+  std::vector<bool> pointers_;
+};
+
+// A frame for the target the compiler was built for. `escapes` says which
+// formals must live in memory, and `pointers` which are records or arrays.
+std::unique_ptr<Frame> new_frame(temp::Label name,
+                                 const std::vector<bool> &escapes,
+                                 const std::vector<bool> &pointers = {});
+
+// The assembly defining a string literal, at each of `labels`
+std::string string_literal(const std::vector<temp::Label> &labels,
+                           std::string_view value);
+
+// The assembly defining the layout of a record type at `label`, for the
+// collector: the number of fields and which of them are records or arrays
+std::string record_layout(temp::Label label, const std::vector<bool> &pointers);
+
+// The assembly of the pointer maps of a function's call sites, which are
+// counted in *count. The runtime finds them at tig_frame_maps.
+std::string frame_maps(const Frame &frame, size_t *count);
+
+// The code of one function, or the literal value of one string
+struct ProcFrag {
+  tree::Stm body;
+  Frame *frame;
+};
+struct StringFrag {
+  temp::Label label;
+  std::string value;
+};
+// The layout of a record type, which record_layout() says
+struct LayoutFrag {
+  temp::Label label;
+  std::vector<bool> pointers;
+};
+// A function as an earlier compilation emitted it: its assembly, and that
+// of the pointer maps of its call sites, `num_maps` of them
+struct CodeFrag {
+  std::string text, maps;
+  size_t num_maps;
+};
+
+} // namespace frame
+#endif
@@ -0,0 +1,706 @@
+#include "inliner.h"
+#include "count.h"
+#include <algorithm>
+#include <string>
+#include <unordered_map>
+#include <variant>
+#include <vector>
+
+namespace absyn {
+
+namespace {
+
+// A name a function's body uses from outside it, and the declaration it
+// means there: a VarDeclAST, RTyField, ForExprAST, FundecTy or Type, or
+// null for one of the builtins, declared in `depth` functions
+struct FreeName {
+  Symbol name;
+  bool type;
+  const void *decl;
+  int depth;
+
+  bool operator==(const FreeName &n) const {
+    return name == n.name && type == n.type && decl == n.decl;
+  }
+};
+
+struct FunInfo {
+  FundecTy *decl;
+  // the number of functions it's nested in
+  int depth{0};
+  // including those of the functions it calls, which come with their bodies
+  // if they're inlined into its own
+  std::vector<FreeName> free;
+  // the functions it calls, including from functions nested in it
+  std::vector<FunInfo *> callees;
+  bool recursive{false};
+  enum class State : uint8_t { kTodo, kBusy, kDone } state{State::kTodo};
+  // of the body, once the calls in it have been inlined
+  size_t size{0};
+  bool inlined{false};
+  // for finding the cycles of the call graph
+  int index{-1}, low{0};
+  bool on_stack{false};
+};
+
+using Funs = std::unordered_map<const void *, FunInfo>;
+using Calls = std::unordered_map<CallExprAST *, FunInfo *>;
+
+// Whether e is nil, which is typed by what it's used as: a function
+// returning a record whose body is nil can't be replaced by its body
+bool is_nil(ExprAST &e) {
+  if (std::holds_alternative<NilExprAST *>(e))
+    return true;
+  if (auto *seq = std::get_if<SeqExprAST *>(&e))
+    return !(*seq)->exps.empty() && is_nil((*seq)->exps.back().exp);
+  if (auto *let = std::get_if<LetExprAST *>(&e))
+    return is_nil((*let)->body);
+  return false;
+}
+
+// Finds the names a function uses that aren't declared in it
+class FreeNames {
+  // the names declared in the function so far, in scope
+  symbol::Table<bool> vars_, types_;
+  std::vector<std::pair<Symbol, bool>> &out_;
+
+  void use(Symbol name, bool type) {
+    if (!(type ? types_ : vars_).look(name))
+      out_.push_back({name, type});
+  }
+  void find(ExprAST &e) { std::visit(*this, e); }
+  void find(VarAST &v) { std::visit(*this, v); }
+  void find(DeclAST &d) { std::visit(*this, d); }
+
+public:
+  explicit FreeNames(std::vector<std::pair<Symbol, bool>> &out) : out_(out) {}
+
+  void function(FundecTy &f) {
+    symbol::Scope scope(vars_);
+    for (auto &param : f.params) {
+      use(param.type_id, true);
+      vars_.enter({param.name, true});
+    }
+    if (f.result)
+      use(f.result->sym, true);
+    find(f.body);
+  }
+
+  void operator()(SimpleVarAST *v) { use(v->id, false); }
+  void operator()(FieldVarAST *v) { find(v->var); }
+  void operator()(IndexVarAST *v) {
+    find(v->var);
+    find(v->index);
+  }
+
+  void operator()(VarExprAST *e) { find(e->var); }
+  void operator()(NilExprAST *) {}
+  void operator()(IntExprAST *) {}
+  void operator()(StringExprAST *) {}
+  void operator()(CallExprAST *e) {
+    use(e->func, false);
+    for (auto &arg : e->args)
+      find(arg.exp);
+  }
+  void operator()(OpExprAST *e) {
+    find(e->lhs);
+    find(e->rhs);
+  }
+  void operator()(RecordExprAST *e) {
+    use(e->type_id, true);
+    for (auto &field : e->fields)
+      find(field.value);
+  }
+  void operator()(ArrayExprAST *e) {
+    use(e->type_id, true);
+    find(e->size);
+    find(e->init);
+  }
+  void operator()(SeqExprAST *e) {
+    for (auto &exp : e->exps)
+      find(exp.exp);
+  }
+  void operator()(AssignExprAST *e) {
+    find(e->var);
+    find(e->exp);
+  }
+  void operator()(IfExprAST *e) {
+    find(e->cond);
+    find(e->then);
+    if (e->else_)
+      find(*e->else_);
+  }
+  void operator()(WhileExprAST *e) {
+    find(e->cond);
+    find(e->body);
+  }
+  void operator()(ForExprAST *e) {
+    find(e->lo);
+    find(e->hi);
+    symbol::Scope scope(vars_);
+    vars_.enter({e->var, true});
+    find(e->body);
+  }
+  void operator()(BreakExprAST *) {}
+  void operator()(LetExprAST *e) {
+    symbol::Scope vars(vars_);
+    symbol::Scope types(types_);
+    for (auto &dec : e->decs)
+      find(dec);
+    find(e->body);
+  }
+  void operator()(UnitExprAST *) {}
+  void operator()(ErrorExprAST *) {}
+
+  void operator()(TypeDeclAST *d) {
+    for (auto &type : d->types)
+      types_.enter({type.name, true});
+    for (auto &type : d->types) {
+      if (auto *name = std::get_if<NameTy *>(&type.type))
+        use((*name)->type_id, true);
+      else if (auto *array = std::get_if<ArrayTy *>(&type.type))
+        use((*array)->type_id, true);
+      else
+        for (auto &field : std::get<RecordTy *>(type.type)->fields)
+          use(field.type_id, true);
+    }
+  }
+  void operator()(VarDeclAST *d) {
+    if (d->type_id)
+      use(d->type_id->sym, true);
+    find(d->init);
+    vars_.enter({d->name, true});
+  }
+  void operator()(FuncDeclAST *d) {
+    for (auto &fundec : d->decls)
+      vars_.enter({fundec.name, true});
+    for (auto &fundec : d->decls)
+      function(fundec);
+  }
+};
+
+// Resolves each name to its declaration, to find the functions, what they
+// call and which calls could be inlined without changing what a name means.
+// The first run finds the functions, and the second, once each function's
+// free names include those of its callees, the calls.
+class Analyzer {
+  // each name's declaration and the number of functions it's nested in
+  struct Decl {
+    const void *decl;
+    int depth;
+  };
+  symbol::Table<Decl> vars_, types_;
+  Funs &funs_;
+  Calls &calls_;
+  bool find_calls_;
+  // the functions the expression being analyzed is nested in
+  std::vector<FunInfo *> enclosing_;
+
+  Decl look(Symbol name, bool type) const {
+    return (type ? types_ : vars_).look(name).value_or(Decl{nullptr, 0});
+  }
+  void declare(symbol::Table<Decl> &table, Symbol name, const void *decl) {
+    table.enter({name, {decl, (int)enclosing_.size()}});
+  }
+  void analyze(ExprAST &e) { std::visit(*this, e); }
+  void analyze(VarAST &v) { std::visit(*this, v); }
+  void analyze(DeclAST &d) { std::visit(*this, d); }
+
+public:
+  Analyzer(Funs &funs, Calls &calls, bool find_calls)
+      : funs_(funs), calls_(calls), find_calls_(find_calls) {}
+  void run(ExprAST &e) { analyze(e); }
+
+  void operator()(SimpleVarAST *) {}
+  void operator()(FieldVarAST *v) { analyze(v->var); }
+  void operator()(IndexVarAST *v) {
+    analyze(v->var);
+    analyze(v->index);
+  }
+
+  void operator()(VarExprAST *e) { analyze(e->var); }
+  void operator()(NilExprAST *) {}
+  void operator()(IntExprAST *) {}
+  void operator()(StringExprAST *) {}
+  void operator()(CallExprAST *e) {
+    for (auto &arg : e->args)
+      analyze(arg.exp);
+    auto it = funs_.find(look(e->func, false).decl);
+    if (it == funs_.end())
+      return;
+    auto &callee = it->second;
+    if (!find_calls_) {
+      for (auto *f : enclosing_)
+        f->callees.push_back(&callee);
+      return;
+    }
+    bool same = std::all_of(
+        callee.free.begin(), callee.free.end(), [&](const FreeName &n) {
+          return look(n.name, n.type).decl == n.decl;
+        });
+    if (same)
+      calls_[e] = &callee;
+  }
+  void operator()(OpExprAST *e) {
+    analyze(e->lhs);
+    analyze(e->rhs);
+  }
+  void operator()(RecordExprAST *e) {
+    for (auto &field : e->fields)
+      analyze(field.value);
+  }
+  void operator()(ArrayExprAST *e) {
+    analyze(e->size);
+    analyze(e->init);
+  }
+  void operator()(SeqExprAST *e) {
+    for (auto &exp : e->exps)
+      analyze(exp.exp);
+  }
+  void operator()(AssignExprAST *e) {
+    analyze(e->var);
+    analyze(e->exp);
+  }
+  void operator()(IfExprAST *e) {
+    analyze(e->cond);
+    analyze(e->then);
+    if (e->else_)
+      analyze(*e->else_);
+  }
+  void operator()(WhileExprAST *e) {
+    analyze(e->cond);
+    analyze(e->body);
+  }
+  void operator()(ForExprAST *e) {
+    analyze(e->lo);
+    analyze(e->hi);
+    symbol::Scope scope(vars_);
+    declare(vars_, e->var, e);
+    analyze(e->body);
+  }
+  void operator()(BreakExprAST *) {}
+  void operator()(LetExprAST *e) {
+    symbol::Scope vars(vars_);
+    symbol::Scope types(types_);
+    for (auto &dec : e->decs)
+      analyze(dec);
+    analyze(e->body);
+  }
+  void operator()(UnitExprAST *) {}
+  void operator()(ErrorExprAST *) {}
+
+  void operator()(TypeDeclAST *d) {
+    for (auto &type : d->types)
+      declare(types_, type.name, &type);
+  }
+  void operator()(VarDeclAST *d) {
+    analyze(d->init);
+    declare(vars_, d->name, d);
+  }
+  void operator()(FuncDeclAST *d) {
+    for (auto &fundec : d->decls)
+      declare(vars_, fundec.name, &fundec);
+    std::vector<std::pair<Symbol, bool>> names;
+    for (auto &fundec : d->decls) {
+      if (find_calls_)
+        break;
+      auto &info = funs_[&fundec];
+      info.decl = &fundec;
+      info.depth = enclosing_.size();
+      names.clear();
+      FreeNames(names).function(fundec);
+      for (auto [name, type] : names) {
+        auto [decl, depth] = look(name, type);
+        info.free.push_back({name, type, decl, depth});
+      }
+    }
+    for (auto &fundec : d->decls) {
+      enclosing_.push_back(&funs_[&fundec]);
+      symbol::Scope scope(vars_);
+      for (auto &param : fundec.params)
+        declare(vars_, param.name, &param);
+      analyze(fundec.body);
+      enclosing_.pop_back();
+    }
+  }
+};
+
+// Marks the functions on cycles of the call graph, by Tarjan's algorithm
+class Cycles {
+  std::vector<FunInfo *> stack_;
+  int next_{0};
+
+public:
+  void visit(FunInfo &f) {
+    f.index = f.low = next_++;
+    stack_.push_back(&f);
+    f.on_stack = true;
+    for (auto *g : f.callees) {
+      if (g == &f)
+        f.recursive = true;
+      if (g->index < 0) {
+        visit(*g);
+        f.low = std::min(f.low, g->low);
+      } else if (g->on_stack) {
+        f.low = std::min(f.low, g->index);
+      }
+    }
+    if (f.low != f.index)
+      return;
+    // f is the root of a strongly connected component
+    FunInfo *g;
+    bool cycle = stack_.back() != &f;
+    do {
+      g = stack_.back();
+      stack_.pop_back();
+      g->on_stack = false;
+      g->recursive |= cycle;
+    } while (g != &f);
+  }
+};
+
+// Copies a function's body, renaming its parameters
+class Cloner {
+  Arena &arena_;
+  // what each name in scope is renamed to, itself unless it's a parameter
+  symbol::Table<Symbol> names_;
+
+  template <typename T, typename... Args> T *make(Args &&...args) {
+    return arena_.New<T>(std::forward<Args>(args)...);
+  }
+  Symbol name(Symbol s) const { return names_.look(s).value_or(s); }
+  void declare(Symbol s) { names_.enter({s, s}); }
+
+  RTyFieldSeq fields(const Seq<RTyField> &fields) {
+    RTyFieldSeq out(arena_);
+    for (auto &f : fields) {
+      RTyField field(f.name, f.type_id, f.pos);
+      field.escape = f.escape;
+      out.Add(field);
+    }
+    return out;
+  }
+  Ty ty(Ty &t) {
+    if (auto *name = std::get_if<NameTy *>(&t))
+      return make<NameTy>((*name)->type_id, (*name)->pos);
+    if (auto *array = std::get_if<ArrayTy *>(&t))
+      return make<ArrayTy>((*array)->type_id, (*array)->pos);
+    auto record = fields(std::get<RecordTy *>(t)->fields);
+    return make<RecordTy>(&record);
+  }
+
+public:
+  explicit Cloner(Arena &arena) : arena_(arena) {}
+  void rename(Symbol from, Symbol to) { names_.enter({from, to}); }
+
+  ExprAST clone(ExprAST &e) { return std::visit(*this, e); }
+  VarAST clone(VarAST &v) { return std::visit(*this, v); }
+  DeclAST clone(DeclAST &d) { return std::visit(*this, d); }
+
+  VarAST operator()(SimpleVarAST *v) {
+    return make<SimpleVarAST>(name(v->id), v->pos);
+  }
+  VarAST operator()(FieldVarAST *v) {
+    VarAST var = clone(v->var);
+    return make<FieldVarAST>(&var, v->field, v->pos);
+  }
+  VarAST operator()(IndexVarAST *v) {
+    VarAST var = clone(v->var);
+    ExprAST index = clone(v->index);
+    return make<IndexVarAST>(&var, &index, v->pos);
+  }
+
+  ExprAST operator()(VarExprAST *e) {
+    VarAST var = clone(e->var);
+    return make<VarExprAST>(&var);
+  }
+  ExprAST operator()(NilExprAST *) { return make<NilExprAST>(); }
+  ExprAST operator()(IntExprAST *e) { return make<IntExprAST>(e->val); }
+  ExprAST operator()(StringExprAST *e) { return make<StringExprAST>(e->val); }
+  ExprAST operator()(CallExprAST *e) {
+    ExprSeq args(arena_);
+    for (auto &arg : e->args)
+      args.Add({clone(arg.exp), arg.pos});
+    return make<CallExprAST>(name(e->func), &args, e->pos);
+  }
+  ExprAST operator()(OpExprAST *e) {
+    ExprAST lhs = clone(e->lhs), rhs = clone(e->rhs);
+    auto *op = make<OpExprAST>(&lhs, &rhs, e->op, e->pos);
+    op->strings = e->strings;
+    return op;
+  }
+  ExprAST operator()(RecordExprAST *e) {
+    RExprFieldSeq fields(arena_);
+    for (auto &field : e->fields) {
+      ExprAST value = clone(field.value);
+      fields.Add(RExprField(field.name, &value, field.pos));
+    }
+    return make<RecordExprAST>(e->type_id, &fields, e->pos);
+  }
+  ExprAST operator()(ArrayExprAST *e) {
+    ExprAST size = clone(e->size), init = clone(e->init);
+    return make<ArrayExprAST>(e->type_id, &size, &init, e->pos);
+  }
+  ExprAST operator()(SeqExprAST *e) {
+    ExprSeq exps(arena_);
+    for (auto &exp : e->exps)
+      exps.Add({clone(exp.exp), exp.pos});
+    return make<SeqExprAST>(&exps);
+  }
+  ExprAST operator()(AssignExprAST *e) {
+    VarAST var = clone(e->var);
+    ExprAST exp = clone(e->exp);
+    return make<AssignExprAST>(&var, &exp, e->pos);
+  }
+  ExprAST operator()(IfExprAST *e) {
+    ExprAST cond = clone(e->cond), then = clone(e->then), else_;
+    if (e->else_)
+      else_ = clone(*e->else_);
+    return make<IfExprAST>(&cond, &then, e->else_ ? &else_ : nullptr,
+                           e->pos);
+  }
+  ExprAST operator()(WhileExprAST *e) {
+    ExprAST cond = clone(e->cond), body = clone(e->body);
+    return make<WhileExprAST>(&cond, &body, e->pos);
+  }
+  ExprAST operator()(ForExprAST *e) {
+    ExprAST lo = clone(e->lo), hi = clone(e->hi);
+    symbol::Scope scope(names_);
+    declare(e->var);
+    ExprAST body = clone(e->body);
+    auto *loop = make<ForExprAST>(e->var, &lo, &hi, &body, e->pos);
+    loop->escape = e->escape;
+    return loop;
+  }
+  ExprAST operator()(BreakExprAST *e) { return make<BreakExprAST>(e->pos); }
+  ExprAST operator()(LetExprAST *e) {
+    symbol::Scope scope(names_);
+    DeclSeq decs(arena_);
+    for (auto &dec : e->decs)
+      decs.Add(clone(dec));
+    ExprAST body = clone(e->body);
+    return make<LetExprAST>(&decs, &body, e->pos);
+  }
+  ExprAST operator()(UnitExprAST *) { return make<UnitExprAST>(); }
+  ExprAST operator()(ErrorExprAST *) { return make<ErrorExprAST>(); }
+
+  DeclAST operator()(TypeDeclAST *d) {
+    TypeSeq types(arena_);
+    for (auto &type : d->types) {
+      Ty t = ty(type.type);
+      types.Add(Type(type.name, &t, type.pos));
+    }
+    return make<TypeDeclAST>(&types);
+  }
+  DeclAST operator()(VarDeclAST *d) {
+    ExprAST init = clone(d->init);
+    declare(d->name);
+    auto *var = make<VarDeclAST>(
+        d->name, d->type_id ? d->type_id->sym : Symbol(nullptr),
+        d->type_id ? d->type_id->pos : d->pos, &init, d->pos);
+    var->escape = d->escape;
+    return var;
+  }
+  DeclAST operator()(FuncDeclAST *d) {
+    for (auto &fundec : d->decls)
+      declare(fundec.name);
+    FundecSeq decls(arena_);
+    for (auto &fundec : d->decls) {
+      symbol::Scope scope(names_);
+      for (auto &param : fundec.params)
+        declare(param.name);
+      ExprAST body = clone(fundec.body);
+      auto params = fields(fundec.params);
+      FundecTy copy(fundec.name, &params,
+                    fundec.result ? fundec.result->sym : Symbol(nullptr),
+                    fundec.result ? fundec.result->pos : fundec.pos, &body,
+                    fundec.pos);
+      decls.Add(copy);
+    }
+    return make<FuncDeclAST>(&decls);
+  }
+};
+
+// Inlines the calls the analysis found could be, bottom up: a function's
+// body has the calls in it inlined before it's copied anywhere
+class Rewriter {
+  Arena &arena_;
+  symbol::Registry &symbols_;
+  Funs &funs_;
+  Calls &calls_;
+  InlineCounts &counts_;
+  uint32_t next_name_{0};
+
+  void process(FunInfo &f) {
+    if (f.state != FunInfo::State::kTodo)
+      return;
+    f.state = FunInfo::State::kBusy;
+    rewrite(f.decl->body);
+    f.size = count_nodes(f.decl->body).total();
+    f.state = FunInfo::State::kDone;
+  }
+
+  // let var p.n: t := arg ... in body end, for each parameter p of type t
+  ExprAST expand(CallExprAST *call, FunInfo &f) {
+    if (!f.inlined) {
+      f.inlined = true;
+      counts_.functions++;
+    }
+    counts_.calls++;
+    Cloner cloner(arena_);
+    DeclSeq decs(arena_);
+    for (size_t i = 0; i < f.decl->params.size(); i++) {
+      auto &param = f.decl->params[i];
+      // no identifier has a '.' in it
+      auto name = symbols_.intern(std::string(param.name.name()) + "." +
+                                  std::to_string(++next_name_));
+      cloner.rename(param.name, name);
+      auto *var = arena_.New<VarDeclAST>(name, param.type_id, param.pos,
+                                         &call->args[i].exp, call->pos);
+      var->escape = param.escape;
+      decs.Add(var);
+    }
+    ExprAST body = cloner.clone(f.decl->body);
+    if (!decs.size())
+      return body;
+    return arena_.New<LetExprAST>(&decs, &body, call->pos);
+  }
+
+  void rewrite(ExprAST &e) { e = std::visit(*this, e); }
+  void rewrite(VarAST &v) { std::visit(*this, v); }
+  void rewrite(DeclAST &d) { std::visit(*this, d); }
+
+public:
+  Rewriter(Arena &arena, symbol::Registry &symbols, Funs &funs, Calls &calls,
+           InlineCounts &counts)
+      : arena_(arena), symbols_(symbols), funs_(funs), calls_(calls),
+        counts_(counts) {}
+  void run(ExprAST &e) { rewrite(e); }
+
+  void operator()(SimpleVarAST *) {}
+  void operator()(FieldVarAST *v) { rewrite(v->var); }
+  void operator()(IndexVarAST *v) {
+    rewrite(v->var);
+    rewrite(v->index);
+  }
+
+  // each returns what replaces the expression
+  ExprAST operator()(VarExprAST *e) {
+    rewrite(e->var);
+    return e;
+  }
+  ExprAST operator()(NilExprAST *e) { return e; }
+  ExprAST operator()(IntExprAST *e) { return e; }
+  ExprAST operator()(StringExprAST *e) { return e; }
+  ExprAST operator()(CallExprAST *e) {
+    for (auto &arg : e->args)
+      rewrite(arg.exp);
+    auto it = calls_.find(e);
+    if (it == calls_.end() || it->second->recursive)
+      return e;
+    auto &f = *it->second;
+    process(f);
+    if (f.state != FunInfo::State::kDone || f.size > kMaxInlineSize ||
+        is_nil(f.decl->body))
+      return e;
+    return expand(e, f);
+  }
+  ExprAST operator()(OpExprAST *e) {
+    rewrite(e->lhs);
+    rewrite(e->rhs);
+    return e;
+  }
+  ExprAST operator()(RecordExprAST *e) {
+    for (auto &field : e->fields)
+      rewrite(field.value);
+    return e;
+  }
+  ExprAST operator()(ArrayExprAST *e) {
+    rewrite(e->size);
+    rewrite(e->init);
+    return e;
+  }
+  ExprAST operator()(SeqExprAST *e) {
+    for (auto &exp : e->exps)
+      rewrite(exp.exp);
+    return e;
+  }
+  ExprAST operator()(AssignExprAST *e) {
+    rewrite(e->var);
+    rewrite(e->exp);
+    return e;
+  }
+  ExprAST operator()(IfExprAST *e) {
+    rewrite(e->cond);
+    rewrite(e->then);
+    if (e->else_)
+      rewrite(*e->else_);
+    return e;
+  }
+  ExprAST operator()(WhileExprAST *e) {
+    rewrite(e->cond);
+    rewrite(e->body);
+    return e;
+  }
+  ExprAST operator()(ForExprAST *e) {
+    rewrite(e->lo);
+    rewrite(e->hi);
+    rewrite(e->body);
+    return e;
+  }
+  ExprAST operator()(BreakExprAST *e) { return e; }
+  ExprAST operator()(LetExprAST *e) {
+    for (auto &dec : e->decs)
+      rewrite(dec);
+    rewrite(e->body);
+    return e;
+  }
+  ExprAST operator()(UnitExprAST *e) { return e; }
+  ExprAST operator()(ErrorExprAST *e) { return e; }
+
+  void operator()(TypeDeclAST *) {}
+  void operator()(VarDeclAST *d) { rewrite(d->init); }
+  void operator()(FuncDeclAST *d) {
+    for (auto &fundec : d->decls)
+      process(funs_.at(&fundec));
+  }
+};
+
+// Adds to each function's free names those of the functions it calls that
+// are declared outside it, until there are no more to add
+void add_callees_free_names(Funs &funs) {
+  for (bool changed = true; changed;) {
+    changed = false;
+    for (auto &[decl, f] : funs)
+      for (auto *g : f.callees)
+        for (size_t i = 0; i < g->free.size(); i++) {
+          auto n = g->free[i];
+          if (n.depth > f.depth ||
+              std::find(f.free.begin(), f.free.end(), n) != f.free.end())
+            continue;
+          f.free.push_back(n);
+          changed = true;
+        }
+  }
+}
+
+} // namespace
+
+InlineCounts inline_calls(Arena &arena, symbol::Registry &symbols,
+                          ExprAST &e) {
+  Funs funs;
+  Calls calls;
+  Analyzer(funs, calls, false).run(e);
+  add_callees_free_names(funs);
+  Analyzer(funs, calls, true).run(e);
+  Cycles cycles;
+  for (auto &[decl, f] : funs) {
+    if (f.index < 0)
+      cycles.visit(f);
+  }
+  InlineCounts counts;
+  Rewriter(arena, symbols, funs, calls, counts).run(e);
+  return counts;
+}
+
+} // namespace absyn
@@ -0,0 +1,37 @@
+#ifndef INLINER_H
+#define INLINER_H
+#include "absyn.h"
+#include "arena.h"
+#include "symbol.h"
+#include <cstddef>
+
+namespace absyn {
+
+// What inline_calls() did
+struct InlineCounts {
+  // the calls replaced by the body of the function called
+  size_t calls{0};
+  // the functions called that were
+  size_t functions{0};
+};
+
+// Replaces calls to small functions in a program that has been checked by
+// the bodies of the functions, as
+//
+//   let var a.1: int := x var b.2: string := y in body end
+//
+// for f(x, y) with parameters a and b. A function is small if its body,
+// with the calls in it inlined first, has at most kMaxInlineSize nodes. A
+// function that can call itself, directly or through others, isn't
+// inlined, nor is a call where a name the body uses from outside it, or
+// the body of a function it calls does, means something else. The
+// parameters are renamed to names no identifier can have, so the arguments
+// can't capture each other's names; whether they escape has to be found
+// again afterwards.
+InlineCounts inline_calls(Arena &arena, symbol::Registry &symbols,
+                          ExprAST &e);
+
+constexpr size_t kMaxInlineSize = 32;
+
+} // namespace absyn
+#endif
@@ -0,0 +1,31 @@
+#ifndef LEXER_H
+#define LEXER_H
+#include <cstddef>
+
+struct Compilation;
+
+// Per-scanner state, reachable as yyextra in the rules of tiger.l
+struct LexState {
+  Compilation &comp;
+  int line{1}, column{1};
+};
+
+// A reentrant scanner over one source; implemented in tiger.l
+class Lexer {
+  LexState state_;
+  void *scanner_;
+
+public:
+  // Reads the program from stdin
+  explicit Lexer(Compilation &);
+  // Scans the buffer in place instead. Its last two bytes must be NUL, and
+  // it must outlive every token scanned from it.
+  Lexer(Compilation &, char *base, size_t size);
+  Lexer(const Lexer &) = delete;
+  Lexer &operator=(const Lexer &) = delete;
+  ~Lexer();
+
+  // the flex yyscan_t to hand to the parser
+  void *scanner() const { return scanner_; }
+};
+#endif
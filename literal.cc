@@ -0,0 +1,72 @@
+#include "literal.h"
+#include <cstdio>
+#include <cstring>
+
+namespace literal {
+
+Literal Pool::intern(std::string_view value) {
+  auto it = index_.find(value);
+  if (it != index_.end())
+    return Literal(it->second);
+  char *chars = chars_.NewArray<char>(value.size() + 1);
+  std::memcpy(chars, value.data(), value.size());
+  chars[value.size()] = '\0';
+  auto id = static_cast<uint32_t>(entries_.size());
+  auto &e = entries_.emplace_back(
+      Literal::Entry{std::string_view(chars, value.size()), id});
+  index_.emplace(e.value, &e);
+  return Literal(&e);
+}
+
+bool decode(std::string_view lexeme, std::string *value) {
+  bool ok = true;
+  value->clear();
+  // less the quotes; the lexer only matches complete escapes
+  for (size_t i = 1; i + 1 < lexeme.size(); i++) {
+    char c = lexeme[i];
+    if (c != '\\') {
+      value->push_back(c);
+      continue;
+    }
+    c = lexeme[++i];
+    if (c == 'n') {
+      value->push_back('\n');
+    } else if (c == 't') {
+      value->push_back('\t');
+    } else if (c >= '0' && c <= '9') {
+      int code = (c - '0') * 100 + (lexeme[i + 1] - '0') * 10 +
+                 (lexeme[i + 2] - '0');
+      i += 2;
+      if (code > 255)
+        ok = false;
+      else
+        value->push_back(static_cast<char>(code));
+    } else {
+      value->push_back(c);
+    }
+  }
+  return ok;
+}
+
+std::string quote(std::string_view value) {
+  std::string s = "\"";
+  for (unsigned char c : value) {
+    if (c == '"' || c == '\\') {
+      s += '\\';
+      s += c;
+    } else if (c == '\n') {
+      s += "\\n";
+    } else if (c == '\t') {
+      s += "\\t";
+    } else if (c >= ' ' && c < 0x7f) {
+      s += c;
+    } else {
+      char code[5];
+      std::snprintf(code, sizeof code, "\\%03d", c);
+      s += code;
+    }
+  }
+  return s + '"';
+}
+
+} // namespace literal
@@ -0,0 +1,65 @@
+#ifndef LITERAL_H
+#define LITERAL_H
+#include "arena.h"
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+// String literals, kept apart from the identifiers in symbol::Registry.
+// The lexer decodes a literal's escapes once, and the pool keeps one copy of
+// each distinct value, so equal literals are the same Literal.
+namespace literal {
+
+class Literal {
+public:
+  // One per distinct value, owned by the pool
+  struct Entry {
+    std::string_view value;
+    uint32_t id;
+  };
+
+  // Left uninitialized; only for slots that are assigned before use, such
+  // as the parser's semantic values
+  Literal() = default;
+  bool operator==(const Literal &other) const { return entry_ == other.entry_; }
+  bool operator!=(const Literal &other) const { return entry_ != other.entry_; }
+
+  // the characters, escapes decoded; invalid once the pool is destroyed
+  std::string_view value() const { return entry_->value; }
+  // dense index in [0, Pool::size()), usable as a key into flat side tables
+  uint32_t id() const { return entry_->id; }
+
+private:
+  const Entry *entry_;
+  explicit Literal(const Entry *entry) : entry_(entry) {}
+  friend class Pool;
+};
+
+class Pool {
+public:
+  Pool() = default;
+  Pool(const Pool &) = delete;
+  Pool &operator=(const Pool &) = delete;
+
+  Literal intern(std::string_view value);
+  // number of distinct literals interned so far
+  uint32_t size() const { return entries_.size(); }
+
+private:
+  std::deque<Literal::Entry> entries_;
+  std::unordered_map<std::string_view, const Literal::Entry *> index_;
+  absyn::Arena chars_;
+};
+
+// Decodes the escapes of a literal's lexeme, quotes included, into *value:
+// \n, \t, \", \\ and \ddd, a character by its decimal code. Returns false if
+// a code is over 255, which is left out.
+bool decode(std::string_view lexeme, std::string *value);
+
+// The value as it would be written in Tiger, in quotes, for printing
+std::string quote(std::string_view value);
+
+} // namespace literal
+#endif
@@ -0,0 +1,209 @@
+#include "liveness.h"
+#include "sorted_set.h"
+#include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace liveness {
+
+namespace {
+using namespace sorted_set;
+
+// A set of temps, such as those live at a point during the walk back
+// through a block, which can be added, removed, looked up and listed in
+// constant time each
+class LiveSet {
+  std::vector<int32_t> pos_;
+  std::vector<uint32_t> items_;
+
+public:
+  explicit LiveSet(uint32_t num_temps) : pos_(num_temps, -1) {}
+  const std::vector<uint32_t> &items() const { return items_; }
+  bool contains(uint32_t t) const { return pos_[t] >= 0; }
+  void add(uint32_t t) {
+    if (pos_[t] < 0) {
+      pos_[t] = items_.size();
+      items_.push_back(t);
+    }
+  }
+  void remove(uint32_t t) {
+    if (pos_[t] < 0)
+      return;
+    uint32_t last = items_.back();
+    items_[pos_[t]] = last;
+    pos_[last] = pos_[t];
+    items_.pop_back();
+    pos_[t] = -1;
+  }
+  void clear() {
+    for (auto t : items_)
+      pos_[t] = -1;
+    items_.clear();
+  }
+};
+} // namespace
+
+FlowGraph flow_graph(const std::vector<assem::Instr> &instrs) {
+  uint32_t n = instrs.size();
+  FlowGraph g{std::vector<std::vector<uint32_t>>(n),
+              std::vector<uint32_t>(n)};
+  std::unordered_map<temp::Label, uint32_t> at;
+  for (uint32_t i = 0; i < n; i++) {
+    if (instrs[i].kind == assem::Instr::Kind::kLabel)
+      at[instrs[i].label] = i;
+  }
+  // the last jump back to each loop's first instruction
+  std::unordered_map<uint32_t, uint32_t> loops;
+  for (uint32_t i = 0; i < n; i++) {
+    if (instrs[i].jumps.empty()) {
+      if (i + 1 < n)
+        g.succ[i].push_back(i + 1);
+      continue;
+    }
+    for (auto label : instrs[i].jumps) {
+      auto it = at.find(label);
+      if (it == at.end())
+        continue;
+      g.succ[i].push_back(it->second);
+      if (it->second <= i)
+        loops[it->second] = std::max(loops[it->second], i);
+    }
+  }
+  std::vector<int32_t> delta(n + 1);
+  for (auto [head, end] : loops) {
+    delta[head]++;
+    delta[end + 1]--;
+  }
+  int32_t depth = 0;
+  for (uint32_t i = 0; i < n; i++)
+    g.loop_depth[i] = depth += delta[i];
+  return g;
+}
+
+namespace {
+// The basic blocks of a function, with the temps live out of each
+struct Blocks {
+  // where each block starts, then the number of instructions
+  std::vector<uint32_t> starts;
+  std::vector<Set> out;
+};
+
+Blocks live_out(const std::vector<assem::Instr> &instrs,
+                const FlowGraph &flow, uint32_t num_temps) {
+  uint32_t n = instrs.size();
+  std::vector<uint32_t> starts, block_of(n);
+  for (uint32_t i = 0; i < n; i++) {
+    if (i == 0 || instrs[i].kind == assem::Instr::Kind::kLabel ||
+        !instrs[i - 1].jumps.empty())
+      starts.push_back(i);
+    block_of[i] = starts.size() - 1;
+  }
+  uint32_t num_blocks = starts.size();
+  starts.push_back(n);
+
+  std::vector<Set> use(num_blocks), def(num_blocks), in(num_blocks),
+      out(num_blocks);
+  std::vector<std::vector<uint32_t>> succ(num_blocks);
+  // the temps defined so far in the block
+  LiveSet defined(num_temps);
+  for (uint32_t b = 0; b < num_blocks; b++) {
+    Set u;
+    defined.clear();
+    for (uint32_t i = starts[b]; i < starts[b + 1]; i++) {
+      for (auto t : instrs[i].src) {
+        if (!defined.contains(t.id()))
+          u.push_back(t.id());
+      }
+      for (auto t : instrs[i].dst)
+        defined.add(t.id());
+    }
+    use[b] = make_set(std::move(u));
+    def[b] = make_set(defined.items());
+    in[b] = use[b];
+    if (starts[b + 1] > starts[b]) {
+      for (auto s : flow.succ[starts[b + 1] - 1])
+        succ[b].push_back(block_of[s]);
+    }
+  }
+  // the blocks are mostly in order, so going backwards converges quickly
+  Set live_out_only, scratch;
+  for (bool changed = true; changed;) {
+    changed = false;
+    for (uint32_t b = num_blocks; b-- > 0;) {
+      for (auto s : succ[b])
+        merge(out[b], in[s], scratch);
+      subtract(out[b], def[b], live_out_only);
+      changed |= merge(in[b], live_out_only, scratch);
+    }
+  }
+  return {std::move(starts), std::move(out)};
+}
+} // namespace
+
+// Liveness is solved over basic blocks, then each block is walked back from
+// its end to find what's live at each definition in it
+InterferenceGraph interference(const std::vector<assem::Instr> &instrs,
+                               const FlowGraph &flow, uint32_t num_temps) {
+  auto [starts, out] = live_out(instrs, flow, num_temps);
+  uint32_t num_blocks = out.size();
+
+  InterferenceGraph g{std::vector<std::vector<uint32_t>>(num_temps), {}};
+  std::unordered_set<uint64_t> edges;
+  auto add_edge = [&](uint32_t a, uint32_t b) {
+    if (a == b)
+      return;
+    uint64_t key = a < b ? (uint64_t)a << 32 | b : (uint64_t)b << 32 | a;
+    if (!edges.insert(key).second)
+      return;
+    g.adj[a].push_back(b);
+    g.adj[b].push_back(a);
+  };
+  LiveSet live(num_temps);
+  for (uint32_t b = 0; b < num_blocks; b++) {
+    live.clear();
+    for (auto t : out[b])
+      live.add(t);
+    for (uint32_t i = starts[b + 1]; i-- > starts[b];) {
+      auto &instr = instrs[i];
+      bool is_move = instr.kind == assem::Instr::Kind::kMove;
+      if (is_move) {
+        g.moves.push_back(i);
+        live.remove(instr.src[0].id());
+      }
+      for (auto d : instr.dst) {
+        for (auto t : live.items())
+          add_edge(d.id(), t);
+      }
+      for (auto d : instr.dst)
+        live.remove(d.id());
+      for (auto s : instr.src)
+        live.add(s.id());
+    }
+  }
+  return g;
+}
+
+std::vector<std::vector<uint32_t>>
+live_across_calls(const std::vector<assem::Instr> &instrs,
+                  const FlowGraph &flow, uint32_t num_temps) {
+  auto [starts, out] = live_out(instrs, flow, num_temps);
+  std::vector<std::vector<uint32_t>> across(instrs.size());
+  LiveSet live(num_temps);
+  for (uint32_t b = 0; b < out.size(); b++) {
+    live.clear();
+    for (auto t : out[b])
+      live.add(t);
+    for (uint32_t i = starts[b + 1]; i-- > starts[b];) {
+      auto &instr = instrs[i];
+      for (auto d : instr.dst)
+        live.remove(d.id());
+      if (instr.kind == assem::Instr::Kind::kCall)
+        across[i].assign(live.items().begin(), live.items().end());
+      for (auto s : instr.src)
+        live.add(s.id());
+    }
+  }
+  return across;
+}
+
+} // namespace liveness
@@ -0,0 +1,42 @@
+#ifndef LIVENESS_H
+#define LIVENESS_H
+#include "assem.h"
+#include <cstdint>
+#include <vector>
+
+// Liveness analysis of a function's instructions, for the register
+// allocator: which temps are live at once, and so can't share a register.
+// Temps are referred to by id throughout.
+namespace liveness {
+
+// The control flow between instructions
+struct FlowGraph {
+  // where each instruction can go next
+  std::vector<std::vector<uint32_t>> succ;
+  // How many loops each instruction is in. The code is laid out in trace
+  // order, so a loop is a jump back to an earlier instruction, and the ones
+  // from there to the jump are in it.
+  std::vector<uint32_t> loop_depth;
+};
+FlowGraph flow_graph(const std::vector<assem::Instr> &instrs);
+
+// A temp interferes with every other live where it's defined, except the
+// source of the move defining it, since the two can share a register
+struct InterferenceGraph {
+  // the temps each one interferes with, once each
+  std::vector<std::vector<uint32_t>> adj;
+  // the instructions that are moves from one temp to another
+  std::vector<uint32_t> moves;
+};
+// Temps are numbered below num_temps
+InterferenceGraph interference(const std::vector<assem::Instr> &instrs,
+                               const FlowGraph &flow, uint32_t num_temps);
+
+// For each call that may collect, the temps live across it, which it
+// neither defines nor ends the life of; nothing for other instructions
+std::vector<std::vector<uint32_t>>
+live_across_calls(const std::vector<assem::Instr> &instrs,
+                  const FlowGraph &flow, uint32_t num_temps);
+
+} // namespace liveness
+#endif
@@ -1,30 +1,518 @@
+#include "astfile.h"
+#include "bounds.h"
+#include "bytecode.h"
+#include "cache.h"
+#include "codegen.h"
+#include "compilation.h"
+#include "count.h"
+#include "escape.h"
+#include "fold.h"
+#include "inliner.h"
+#include "lexer.h"
 #include "location.h"
+#include "logging.h"
+#include "pool.h"
 #include "print.h"
+#include "report.h"
 #include "semant.h"
+#include "source.h"
+#include "ssa.h"
+#include "tail.h"
 #include "token.h"
+#include "tree_print.h"
 #include "tiger.tab.hh"
 #include "types.h"
+#include "vm.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
 #include <cstring>
-// defined in lex.yy.cc
-int yylex_destroy();
-// defined in tiger.tab.cc
-extern uptr<absyn::ExprAST> parse_result;
+#include <memory>
+#include <optional>
+#include <string>
+#include <sys/stat.h>
+#include <thread>
+#include <vector>
 
-int main() {
-  yy::parser parser;
+namespace {
+// What --time-report, --mem-report and --stats asked for
+struct ReportOptions {
+  bool time{false}, mem{false}, stats{false};
+  Report::Format format{Report::Format::kText};
+  bool enabled() const { return time || mem || stats; }
+};
+
+// What to do with a program that checks
+enum class Action { kCheck, kRun, kAssemble };
+
+// Checks the program in the base environment and translates it to `frags`,
+// counting lookups in `looks` if given, and using the cache as `cache` says
+// if given
+void check(Compilation &comp, const semant::BaseEnv &base, ThreadPool &pool,
+           translate::Fragments &frags, symbol::LookStats *looks,
+           semant::CacheUse *cache = nullptr) {
+  semant::Venv venv(&base.venv);
+  semant::Tenv tenv(&base.tenv);
+  if (looks) {
+    venv.set_stats(looks);
+    tenv.set_stats(looks);
+  }
+  semant::trans_exp(comp.types, venv, tenv, comp.diags, frags, *comp.ast,
+                    &pool, cache);
+}
+
+// Adds what the lookups in `use` found to the report's counts
+void count(Report *report, const semant::CacheUse &use) {
+  if (!report)
+    return;
+  if (!report->cache)
+    report->cache.emplace();
+  report->cache->hits += use.hits;
+  report->cache->misses += use.misses;
+}
+
+// Parses whatever the lexer has been set up to read into comp.ast, and if it
+// parsed without errors and `ast_path` is given, writes the AST there (to
+// stdout if it's "-")
+void parse(Compilation &comp, Lexer &lexer, Report *report,
+           const char *ast_path) {
+  yy::parser parser(lexer.scanner(), comp);
+  if (report)
+    report->begin("parse");
   parser();
-  // since we're done with the input, we don't need the lexer any more
-  yylex_destroy();
-  if (parse_result) {
+  if (report)
+    report->end();
+  if (!ast_path || !comp.ast || !comp.diags.empty())
+    return;
+  if (std::strcmp(ast_path, "-") == 0) {
+    std::string data = astfile::encode(comp);
+    std::fwrite(data.data(), 1, data.size(), stdout);
+    return;
+  }
+  CHECK(astfile::write(ast_path, comp))
+      << ast_path << ": " << std::strerror(errno);
+}
+
+// Checks comp.ast, and if it checked, compiles it to bytecode or writes its
+// assembly to `asm_path` (stdout if null), as `action` says, optimized as
+// `ssa_options` says, and with what's in the cache if there is one. Problems
+// are reported to comp.diags, along with recursive calls not in tail
+// position if `warn_recursion`; phases are recorded in report if there is
+// one. Returns the bytecode, for run(), if there's a program to run.
+std::unique_ptr<vm::Program>
+compile(Compilation &comp, ThreadPool &pool, Report *report, Action action,
+        bool warn_recursion, const ssa::Options &ssa_options,
+        const cache::Cache *cache, const char *asm_path = nullptr) {
+  if (!comp.ast)
+    return nullptr;
+  auto escapes = absyn::find_escapes(*comp.ast);
+  absyn::find_tail_calls(*comp.ast, warn_recursion ? &comp.diags : nullptr);
+  if (report) {
+    report->nodes = absyn::count_nodes(*comp.ast);
+    report->escapes = escapes;
+  }
 #ifdef PRINT_AST
-    absyn::print(0, *parse_result);
-    std::printf("\n");
+  if (report)
+    report->begin("print");
+  absyn::print(0, *comp.ast);
+  std::printf("\n");
+  if (report)
+    report->end();
 #endif
-    semant::Venv venv;
-    semant::Tenv tenv;
-    tenv.enter({symbol::Symbol(strdup("int")), types::IntTy()});
-    tenv.enter({symbol::Symbol(strdup("string")), types::StringTy()});
-    semant::trans_exp(venv, tenv, *parse_result);
+  if (report)
+    report->begin("semant");
+  semant::BaseEnv base(comp.symbols, comp.types, comp.frags.arena());
+  std::optional<semant::CacheUse> checked;
+  if (cache)
+    checked.emplace(*cache);
+  check(comp, base, pool, comp.frags, report ? &report->looks : nullptr,
+        checked ? &*checked : nullptr);
+  if (report)
+    report->end();
+  if (checked)
+    count(report, *checked);
+#ifdef PRINT_IR
+  if (comp.diags.empty()) {
+    for (auto &frag : comp.frags.strings())
+      tree::print(frag);
+    for (auto &frag : comp.frags.procs())
+      tree::print(frag);
+  }
+#endif
+  if (action == Action::kCheck || !comp.diags.empty())
+    return nullptr;
+  if (report)
+    report->begin("inline");
+  auto inlines = absyn::inline_calls(comp.arena, comp.symbols, *comp.ast);
+  // the inlined parameters are new variables, and some that escaped in a
+  // function might not where it's inlined
+  if (inlines.calls)
+    absyn::find_escapes(*comp.ast);
+  if (report) {
+    report->end();
+    report->inlines = inlines;
+    report->begin("simplify");
+  }
+  size_t inlined_nodes = report ? absyn::count_nodes(*comp.ast).total() : 0;
+  auto folds = absyn::simplify(comp.arena, *comp.ast);
+  if (report) {
+    report->end();
+    report->folds = folds;
+    report->nodes_removed = (int64_t)inlined_nodes -
+                            (int64_t)absyn::count_nodes(*comp.ast).total();
+  }
+  if (action == Action::kAssemble) {
+    // an inlined body's calls are no longer in tail position in it, and a
+    // call where it's inlined may now be
+    if (inlines.calls)
+      absyn::find_tail_calls(*comp.ast);
+    if (report)
+      report->begin("bounds");
+    auto bounds = absyn::remove_bounds_checks(*comp.ast);
+    if (report) {
+      report->end();
+      report->bounds = bounds;
+    }
+    // The fragments are of the program before it was simplified, so it's
+    // translated again if that changed anything. With a cache, they're
+    // missing the groups found in it, and the code of the others is wanted
+    // for it, so it's translated again regardless.
+    translate::Fragments simplified;
+    auto *frags = &comp.frags;
+    if (inlines.calls || folds.total() || bounds.eliminated || cache) {
+      if (report)
+        report->begin("translate");
+      std::optional<semant::CacheUse> compiled;
+      if (cache)
+        compiled.emplace(*cache, true);
+      check(comp, base, pool, simplified, nullptr,
+            compiled ? &*compiled : nullptr);
+      if (report)
+        report->end();
+      if (compiled)
+        count(report, *compiled);
+      frags = &simplified;
+    }
+    std::FILE *out = asm_path ? std::fopen(asm_path, "w") : stdout;
+    CHECK(out) << asm_path << ": " << std::strerror(errno);
+    if (report)
+      report->begin("codegen");
+    if (report)
+      report->ssa.emplace();
+    codegen::emit(out, *frags, ssa_options,
+                  report ? &report->regalloc : nullptr,
+                  report ? &*report->ssa : nullptr, cache);
+    if (report)
+      report->end();
+    if (out != stdout)
+      std::fclose(out);
+    return nullptr;
+  }
+  if (report)
+    report->begin("bytecode");
+  auto program = vm::compile(*comp.ast, comp.diags);
+  if (report)
+    report->end();
+  if (!comp.diags.empty())
+    return nullptr;
+#ifdef PRINT_BYTECODE
+  vm::print(*program);
+#endif
+  return program;
+}
+
+// Runs the program compile() made of comp, reporting a runtime error to
+// comp.diags. Returns the status the program exited with.
+int run(Compilation &comp, const vm::Program &program, Report *report) {
+  vm::VM machine(program);
+  if (report)
+    report->begin("run");
+  bool ok = machine.run();
+  std::fflush(stdout);
+  if (report)
+    report->end();
+  if (!ok)
+    comp.diags.error(machine.error_pos(), "runtime error: " + machine.error());
+  return machine.status();
+}
+
+struct FileResult {
+  // the errors and warnings, and whether there were errors
+  std::vector<std::string> messages;
+  bool failed{false};
+  std::string report;
+  int status{0};
+  // With --run, the program, which runs once every file has compiled, so
+  // that programs don't share stdin and stdout, and what's kept of the
+  // file until then
+  std::unique_ptr<vm::Program> program;
+  std::unique_ptr<Compilation> comp;
+  std::unique_ptr<Report> recorded;
+};
+
+// Fills in what went wrong with the file and the report on it, once it's
+// done with
+void finish(FileResult &result, const Compilation &comp, Report *report,
+            const ReportOptions &opts) {
+  result.messages = comp.messages();
+  result.failed = !comp.diags.empty();
+  if (report)
+    result.report = report->format(opts.format, opts.time, opts.mem);
+}
+
+// Runs the program compile_file() left in the result, then finishes it
+void run_file(FileResult &result, const ReportOptions &opts) {
+  Report *r = opts.enabled() ? result.recorded.get() : nullptr;
+  result.status = run(*result.comp, *result.program, r);
+  finish(result, *result.comp, r, opts);
+  result.program.reset();
+  result.recorded.reset();
+  result.comp.reset();
+}
+
+bool has_ext(const std::string &path, const std::string &ext) {
+  return path.size() > ext.size() &&
+         path.compare(path.size() - ext.size(), ext.size(), ext) == 0;
+}
+
+// The file named like `path` with `ext` for .tig or .tast
+std::string with_ext(const std::string &path, const char *ext) {
+  for (std::string old : {".tig", ".tast"})
+    if (has_ext(path, old))
+      return path.substr(0, path.size() - old.size()) + ext;
+  return path + ext;
+}
+
+// Compiles the file, or the AST in it if it's a .tast file, and returns what
+// went wrong, if anything, and the report on it if one was asked for, or
+// with --run, the program for run_file(). The AST of a source file is
+// written next to it if `emit_ast`.
+FileResult compile_file(const char *path, ThreadPool &pool,
+                        const ReportOptions &opts, Action action,
+                        bool warn_recursion, bool emit_ast,
+                        const ssa::Options &ssa_options,
+                        const cache::Cache *cache) {
+  auto owned = std::make_unique<Compilation>(path);
+  auto report = std::make_unique<Report>(*owned);
+  Compilation &comp = *owned;
+  Report *r = opts.enabled() ? report.get() : nullptr;
+  FileResult result;
+  try {
+    if (has_ext(path, ".tast")) {
+      if (r)
+        r->begin("load");
+      bool loaded = astfile::load(path, comp);
+      if (r)
+        r->end();
+      if (!loaded) {
+        result.messages.push_back(
+            std::string(path) + ": damaged, or not an AST file of version " +
+            std::to_string(astfile::kVersion));
+        result.failed = true;
+        return result;
+      }
+    } else {
+      SourceFile src(path);
+      Lexer lexer(comp, src.buffer(), src.buffer_size());
+      parse(comp, lexer, r,
+            emit_ast ? with_ext(path, ".tast").c_str() : nullptr);
+    }
+    result.program = compile(comp, pool, r, action, warn_recursion,
+                             ssa_options, cache, with_ext(path, ".s").c_str());
+  } catch (const runtime::InternalError &e) {
+    result.messages = comp.messages();
+    result.messages.push_back(e.what());
+    result.failed = true;
+    return result;
+  }
+  if (result.program) {
+    result.comp = std::move(owned);
+    result.recorded = std::move(report);
+    return result;
+  }
+  finish(result, comp, r, opts);
+  return result;
+}
+
+// What the cache's keys depend on besides the program: the compiler itself,
+// by its size and when it was built, and the options that change its output
+std::string cache_salt(const ssa::Options &options) {
+  std::string salt;
+  struct stat st;
+  if (stat("/proc/self/exe", &st) == 0)
+    salt = std::to_string(st.st_size) + " " + std::to_string(st.st_mtime);
+  for (bool pass : {options.sccp, options.gvn, options.licm, options.dce})
+    salt += pass ? " 1" : " 0";
+  return salt;
+}
+} // namespace
+
+// Usage: tiger [-j jobs] [--run | -S] [--warn-recursion] [--emit-ast]
+//              [--time-report] [--mem-report] [--stats]
+//              [--report-format=text|json] [--no-sccp] [--no-gvn]
+//              [--no-licm] [--no-dce] [--cache-dir=dir] [file...]
+// Each file is memory-mapped and scanned in place. Files, and the function
+// bodies within them, are checked on a pool of `jobs` threads (one per CPU
+// with -j0). Errors are printed in the order the files were given. With no
+// files, the program is read from stdin.
+//
+// --emit-ast writes the AST of each file that parses to the file named like
+// it with .tast for .tig, or to stdout for stdin. A .tast file given in
+// place of a source is loaded rather than parsed, and errors in it are
+// reported against the source it was written from.
+//
+// A program that checks is simplified before it's run or compiled: calls to
+// small functions are inlined, constant expressions are folded and dead
+// branches dropped.
+//
+// --run runs each program that checks, compiled to bytecode for the VM. The
+// programs run one at a time, in the order the files were given, once all
+// of them have compiled. A runtime error fails the file; otherwise the exit
+// status is that of the first program to exit with one.
+//
+// -S writes each program that checks as x86-64 GNU assembler, to the file
+// named like it with .s for .tig, or to stdout for stdin. Link it with
+// runtime/runtime.c. Subscripts known to be in range, such as a[i] in a for
+// loop over the array, aren't checked. A call in tail position in a
+// function's body jumps to the function called, reusing the caller's frame,
+// if its arguments, with the static link, fit in registers.
+//
+// Each function is then optimized in SSA form: temps found to be constant
+// are propagated and the branches on them folded, values computed already
+// are reused, loop-invariant expressions such as an array's length are
+// computed once before the loop, and assignments nothing uses are dropped.
+// --no-sccp, --no-gvn, --no-licm and --no-dce turn each of these off.
+//
+// --cache-dir keeps, in the directory, what checking and compiling each group
+// of functions found, by a hash of the group and of what the names in it
+// refer to, so that a later compilation only checks and compiles again the
+// groups that changed, or that something they refer to changed under.
+// Processes can share the directory.
+//
+// --warn-recursion warns of each call to a function that can call the
+// caller back, made where it can't be a tail call.
+//
+// --time-report and --mem-report print, for each file, the time taken by and
+// the memory allocated in each phase, and counts of AST nodes, symbols and
+// symbol table lookups, to stdout. Times and heap allocations are those of
+// the whole process, so use -j1 to attribute them to a single file. The
+// fraction of variables that escape is included too, as are the calls
+// inlined and rewrites simplifying made and, with -S, the bounds checks
+// removed, what the SSA passes did and the temps register allocation
+// spilled in each function. --stats prints just the counts.
+int main(int argc, char **argv) {
+  int jobs = 1;
+  Action action = Action::kCheck;
+  bool warn_recursion = false, emit_ast = false;
+  ReportOptions report;
+  ssa::Options ssa_options;
+  const char *cache_dir = nullptr;
+  std::vector<const char *> paths;
+  for (int i = 1; i < argc; i++) {
+    if (std::strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+      jobs = std::atoi(argv[++i]);
+    } else if (std::strncmp(argv[i], "-j", 2) == 0) {
+      jobs = std::atoi(argv[i] + 2);
+    } else if (std::strcmp(argv[i], "--run") == 0) {
+      action = Action::kRun;
+    } else if (std::strcmp(argv[i], "-S") == 0) {
+      action = Action::kAssemble;
+    } else if (std::strcmp(argv[i], "--warn-recursion") == 0) {
+      warn_recursion = true;
+    } else if (std::strcmp(argv[i], "--emit-ast") == 0) {
+      emit_ast = true;
+    } else if (std::strcmp(argv[i], "--time-report") == 0) {
+      report.time = true;
+    } else if (std::strcmp(argv[i], "--mem-report") == 0) {
+      report.mem = true;
+    } else if (std::strcmp(argv[i], "--stats") == 0) {
+      report.stats = true;
+    } else if (std::strcmp(argv[i], "--no-sccp") == 0) {
+      ssa_options.sccp = false;
+    } else if (std::strcmp(argv[i], "--no-gvn") == 0) {
+      ssa_options.gvn = false;
+    } else if (std::strcmp(argv[i], "--no-licm") == 0) {
+      ssa_options.licm = false;
+    } else if (std::strcmp(argv[i], "--no-dce") == 0) {
+      ssa_options.dce = false;
+    } else if (std::strncmp(argv[i], "--cache-dir=", 12) == 0) {
+      cache_dir = argv[i] + 12;
+    } else if (std::strcmp(argv[i], "--report-format=json") == 0) {
+      report.format = Report::Format::kJson;
+    } else if (std::strcmp(argv[i], "--report-format=text") == 0) {
+      report.format = Report::Format::kText;
+    } else if (std::strncmp(argv[i], "--", 2) == 0) {
+      std::fprintf(stderr, "tiger: unknown option %s\n", argv[i]);
+      return 2;
+    } else {
+      paths.push_back(argv[i]);
+    }
+  }
+  if (jobs <= 0)
+    jobs = std::max(1U, std::thread::hardware_concurrency());
+  std::optional<cache::Cache> cache;
+  if (cache_dir) {
+    if (!cache::make_dirs(cache_dir)) {
+      std::fprintf(stderr, "tiger: %s: %s\n", cache_dir, std::strerror(errno));
+      return 2;
+    }
+    cache.emplace(cache_dir, cache_salt(ssa_options));
+  }
+  if (report.enabled())
+    Report::count_heap();
+  ThreadPool pool(jobs);
+
+  if (paths.empty() && emit_ast && action == Action::kAssemble) {
+    std::fprintf(stderr, "tiger: -S and --emit-ast both write to stdout\n");
+    return 2;
+  }
+  if (paths.empty()) {
+    Compilation comp("<stdin>");
+    Report r(comp);
+    int status;
+    {
+      Lexer lexer(comp);
+      parse(comp, lexer, report.enabled() ? &r : nullptr,
+            emit_ast ? "-" : nullptr);
+      auto program =
+          compile(comp, pool, report.enabled() ? &r : nullptr, action,
+                  warn_recursion, ssa_options, cache ? &*cache : nullptr);
+      status = program
+                   ? run(comp, *program, report.enabled() ? &r : nullptr)
+                   : 0;
+    }
+    for (auto &msg : comp.messages())
+      std::fprintf(stderr, "%s\n", msg.c_str());
+    if (report.enabled())
+      std::fputs(r.format(report.format, report.time, report.mem).c_str(),
+                 stdout);
+    return comp.diags.empty() ? status : 1;
+  }
+
+  std::vector<FileResult> results(paths.size());
+  {
+    TaskGroup group(pool);
+    for (size_t i = 0; i < paths.size(); i++)
+      group.run([&, i] {
+        results[i] = compile_file(paths[i], pool, report, action,
+                                  warn_recursion, emit_ast, ssa_options,
+                                  cache ? &*cache : nullptr);
+      });
+  }
+  for (auto &result : results)
+    if (result.program)
+      run_file(result, report);
+  int failed = 0, status = 0;
+  for (auto &result : results) {
+    for (auto &msg : result.messages)
+      std::fprintf(stderr, "%s\n", msg.c_str());
+    std::fputs(result.report.c_str(), stdout);
+    failed += result.failed;
+    if (!status)
+      status = result.status;
   }
-  symbol::Symbol::FreeAll();
+  if (paths.size() > 1 && failed)
+    std::fprintf(stderr, "%d of %zu files failed\n", failed, paths.size());
+  return failed ? 1 : status;
 }
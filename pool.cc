@@ -0,0 +1,108 @@
+#include "pool.h"
+#include <chrono>
+
+namespace {
+// index of the current thread's queue in its pool, or -1 outside any pool
+thread_local int worker_index = -1;
+thread_local const ThreadPool *worker_pool = nullptr;
+} // namespace
+
+ThreadPool::ThreadPool(int threads) {
+  int workers = threads > 1 ? threads - 1 : 0;
+  for (int i = 0; i <= workers; i++)
+    queues_.push_back(std::make_unique<Queue>());
+  for (int i = 0; i < workers; i++)
+    workers_.emplace_back([this, i] { worker(i); });
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(sleep_mu_);
+    stop_ = true;
+  }
+  sleep_cv_.notify_all();
+  for (auto &t : workers_)
+    t.join();
+}
+
+void ThreadPool::submit(Task task) {
+  int self = worker_pool == this ? worker_index : queues_.size() - 1;
+  {
+    std::lock_guard<std::mutex> lock(queues_[self]->mu);
+    queues_[self]->tasks.push_back(std::move(task));
+  }
+  queued_++;
+  if (!workers_.empty()) {
+    std::lock_guard<std::mutex> lock(sleep_mu_);
+    sleep_cv_.notify_one();
+  }
+}
+
+// Runs one task, preferring the thread's own queue; returns false if there
+// was nothing to do
+bool ThreadPool::run_one(int self) {
+  Task task;
+  int n = queues_.size();
+  if (self >= 0) {
+    auto &q = *queues_[self];
+    std::lock_guard<std::mutex> lock(q.mu);
+    if (!q.tasks.empty()) {
+      task = std::move(q.tasks.back());
+      q.tasks.pop_back();
+    }
+  }
+  // steal, starting with the shared queue
+  for (int i = 0; !task && i < n; i++) {
+    auto &q = *queues_[(n - 1 + i) % n];
+    std::lock_guard<std::mutex> lock(q.mu);
+    if (!q.tasks.empty()) {
+      task = std::move(q.tasks.front());
+      q.tasks.pop_front();
+    }
+  }
+  if (!task)
+    return false;
+  queued_--;
+  task();
+  return true;
+}
+
+void ThreadPool::worker(int self) {
+  worker_index = self;
+  worker_pool = this;
+  while (true) {
+    if (run_one(self))
+      continue;
+    std::unique_lock<std::mutex> lock(sleep_mu_);
+    sleep_cv_.wait(lock, [this] { return stop_ || queued_ > 0; });
+    if (stop_)
+      return;
+  }
+}
+
+void TaskGroup::run(std::function<void()> f) {
+  pending_++;
+  pool_.submit([this, f = std::move(f)] {
+    f();
+    // The group may be destroyed as soon as wait() sees the count reach
+    // zero, so that has to happen under the lock wait() takes last
+    std::lock_guard<std::mutex> lock(mu_);
+    if (--pending_ == 0)
+      done_.notify_all();
+  });
+}
+
+void TaskGroup::wait() {
+  int self = worker_pool == &pool_ ? worker_index : -1;
+  while (pending_ > 0) {
+    if (pool_.run_one(self))
+      continue;
+    // Everything left is running elsewhere. Check back now and then in
+    // case one of those tasks forks more work we could help with.
+    std::unique_lock<std::mutex> lock(mu_);
+    done_.wait_for(lock, std::chrono::milliseconds(1),
+                   [this] { return pending_ == 0; });
+  }
+  // wait for the last task to be done with the lock
+  std::lock_guard<std::mutex> lock(mu_);
+}
@@ -0,0 +1,70 @@
+#ifndef POOL_H
+#define POOL_H
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A fork-join thread pool with work stealing. Each worker keeps its own deque
+// of tasks: it pushes and pops at the back, so it works depth-first on what it
+// forked most recently, while idle workers steal from the front, taking the
+// oldest and usually largest pieces of work. Threads outside the pool submit
+// to a shared queue. A thread waiting on a TaskGroup runs tasks itself until
+// the group is done, so nested fork-join never deadlocks and the caller
+// counts as one of the pool's threads.
+class ThreadPool {
+public:
+  // A pool that, together with the thread waiting on it, runs `threads`
+  // tasks at a time
+  explicit ThreadPool(int threads);
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+  ~ThreadPool();
+
+  // number of threads that can run tasks, counting the waiting caller
+  int size() const { return workers_.size() + 1; }
+
+private:
+  using Task = std::function<void()>;
+  struct Queue {
+    std::mutex mu;
+    std::deque<Task> tasks;
+  };
+
+  // one per worker, then the shared queue for outside threads
+  std::vector<std::unique_ptr<Queue>> queues_;
+  std::vector<std::thread> workers_;
+  std::atomic<int> queued_{0};
+  std::atomic<bool> stop_{false};
+  std::mutex sleep_mu_;
+  std::condition_variable sleep_cv_;
+
+  void submit(Task task);
+  bool run_one(int self);
+  void worker(int self);
+  friend class TaskGroup;
+};
+
+// A set of tasks forked together and joined with wait()
+class TaskGroup {
+public:
+  explicit TaskGroup(ThreadPool &pool) : pool_(pool) {}
+  TaskGroup(const TaskGroup &) = delete;
+  TaskGroup &operator=(const TaskGroup &) = delete;
+  ~TaskGroup() { wait(); }
+
+  // The task must not throw
+  void run(std::function<void()> f);
+  void wait();
+
+private:
+  ThreadPool &pool_;
+  std::atomic<int> pending_{0};
+  std::mutex mu_;
+  std::condition_variable done_;
+};
+#endif
@@ -23,14 +23,14 @@ class VarASTPrintVisitor {
 
 public:
   VarASTPrintVisitor(int indent) : indent_(indent) {}
-  void operator()(uptr<SimpleVarAST> &var) {
+  void operator()(SimpleVarAST *var) {
     std::printf("%s", var->id.name());
   }
-  void operator()(uptr<FieldVarAST> &var) {
+  void operator()(FieldVarAST *var) {
     print(indent_, var->var);
     std::printf(".%s", var->field.name());
   }
-  void operator()(uptr<IndexVarAST> &var);
+  void operator()(IndexVarAST *var);
 };
 
 class ExprASTPrintVisitor {
@@ -40,11 +40,13 @@ class ExprASTPrintVisitor {
 public:
   ExprASTPrintVisitor(int indent, bool is_let_body = false)
       : indent_(indent), is_let_body(is_let_body) {}
-  void operator()(uptr<VarExprAST> &e) { print(indent_, e->var); }
-  void operator()(uptr<NilExprAST> &) { std::printf("nil"); }
-  void operator()(uptr<IntExprAST> &e) { std::printf("%d", e->val); }
-  void operator()(uptr<StringExprAST> &e) { std::printf("%s", e->val.name()); }
-  void operator()(uptr<CallExprAST> &e) {
+  void operator()(VarExprAST *e) { print(indent_, e->var); }
+  void operator()(NilExprAST *) { std::printf("nil"); }
+  void operator()(IntExprAST *e) { std::printf("%d", e->val); }
+  void operator()(StringExprAST *e) {
+    std::printf("%s", literal::quote(e->val.value()).c_str());
+  }
+  void operator()(CallExprAST *e) {
     std::printf("%s(", e->func.name());
     const char *sep = "";
     for (auto &arg : e->args) {
@@ -54,7 +56,7 @@ public:
     }
     std::printf(")");
   }
-  void operator()(uptr<OpExprAST> &e) {
+  void operator()(OpExprAST *e) {
     const char *op_str[] = {
         "+", "-", "*", "/", "=", "<>", "<", "<=", ">", ">=", "&", "|",
     };
@@ -64,7 +66,7 @@ public:
     print(indent_ + 2, e->rhs);
     std::printf(" )");
   }
-  void operator()(uptr<RecordExprAST> &e) {
+  void operator()(RecordExprAST *e) {
     std::printf("%s {", e->type_id.name());
     const char *sep = "";
     for (auto &field : e->fields) {
@@ -74,14 +76,14 @@ public:
     }
     std::printf("}");
   }
-  void operator()(uptr<ArrayExprAST> &e) {
+  void operator()(ArrayExprAST *e) {
     std::printf("%s [", e->type_id.name());
     print(indent_, e->size);
     std::printf("]");
     std::printf(" of ");
     print(indent_, e->init);
   }
-  void operator()(uptr<SeqExprAST> &e) {
+  void operator()(SeqExprAST *e) {
     std::printf(is_let_body ? "" : "(");
     const char *sep = is_let_body ? ";\n" : "; ";
     bool needs_sep = false;
@@ -96,12 +98,12 @@ public:
     }
     std::printf(is_let_body ? "" : ")");
   }
-  void operator()(uptr<AssignExprAST> &e) {
+  void operator()(AssignExprAST *e) {
     print(indent_, e->var);
     std::printf(" := ");
     print(indent_, e->exp);
   }
-  void operator()(uptr<IfExprAST> &e) {
+  void operator()(IfExprAST *e) {
     std::printf("if ");
     print(indent_, e->cond);
     std::printf(" then ");
@@ -111,13 +113,13 @@ public:
       print(indent_, e->else_.value());
     }
   }
-  void operator()(uptr<WhileExprAST> &e) {
+  void operator()(WhileExprAST *e) {
     std::printf("while ");
     print(indent_, e->cond);
     std::printf(" do ");
     print(indent_, e->body);
   }
-  void operator()(uptr<ForExprAST> &e) {
+  void operator()(ForExprAST *e) {
     std::printf("for %s := ", e->var.name());
     print(indent_, e->lo);
     std::printf(" to ");
@@ -125,12 +127,13 @@ public:
     std::printf(" do ");
     print(indent_, e->body);
   }
-  void operator()(uptr<BreakExprAST> &) { std::printf("break"); }
-  void operator()(uptr<LetExprAST> &e);
-  void operator()(uptr<UnitExprAST> &e) { std::printf("()"); }
+  void operator()(BreakExprAST *) { std::printf("break"); }
+  void operator()(LetExprAST *e);
+  void operator()(UnitExprAST *e) { std::printf("()"); }
+  void operator()(ErrorExprAST *e) { std::printf("<error>"); }
 };
 
-inline void VarASTPrintVisitor::operator()(uptr<IndexVarAST> &var) {
+inline void VarASTPrintVisitor::operator()(IndexVarAST *var) {
   print(indent_, var->var);
   std::printf("[");
   print(indent_, var->index);
@@ -142,8 +145,8 @@ class TyPrintVisitor {
 
 public:
   TyPrintVisitor(int indent) : indent_(indent) {}
-  void operator()(uptr<NameTy> &ty) { std::printf("%s", ty->type_id.name()); }
-  void operator()(uptr<RecordTy> &ty) {
+  void operator()(NameTy *ty) { std::printf("%s", ty->type_id.name()); }
+  void operator()(RecordTy *ty) {
     std::printf("{");
     const char *sep = "";
     for (const auto &field : ty->fields) {
@@ -152,7 +155,7 @@ public:
     }
     std::printf("}");
   }
-  void operator()(uptr<ArrayTy> &ty) {
+  void operator()(ArrayTy *ty) {
     std::printf("array of %s", ty->type_id.name());
   }
 };
@@ -162,7 +165,7 @@ class DeclASTPrintVisitor {
 
 public:
   DeclASTPrintVisitor(int indent) : indent_(indent) {}
-  void operator()(uptr<TypeDeclAST> &decl) {
+  void operator()(TypeDeclAST *decl) {
     bool needs_indent = false;
     for (auto &type : decl->types) {
       if (needs_indent) {
@@ -174,14 +177,14 @@ public:
       needs_indent = true;
     }
   }
-  void operator()(uptr<VarDeclAST> &decl) {
+  void operator()(VarDeclAST *decl) {
     std::printf("var %s", decl->name.name());
     if (decl->type_id)
       std::printf(" : %s", decl->type_id->sym.name());
     std::printf(" := ");
     print(indent_, decl->init);
   }
-  void operator()(uptr<FuncDeclAST> &decl) {
+  void operator()(FuncDeclAST *decl) {
     bool needs_indent = false;
     for (auto &decl_ : decl->decls) {
       if (needs_indent) {
@@ -194,7 +197,7 @@ public:
   }
 };
 
-inline void ExprASTPrintVisitor::operator()(uptr<LetExprAST> &e) {
+inline void ExprASTPrintVisitor::operator()(LetExprAST *e) {
   std::printf("let ");
   bool needs_indent = false;
   for (auto &dec : e->decs) {
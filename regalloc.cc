@@ -0,0 +1,538 @@
+#include "regalloc.h"
+#include "codegen.h"
+#include "liveness.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace regalloc {
+
+namespace {
+// One round of coloring, in the terms of Appel's chapter 11. Worklists are
+// stacks which may hold nodes and moves that have since left them; a node's
+// state says which list it's really on, and the rest are skipped when
+// popped.
+class Coloring {
+public:
+  enum class State : uint8_t {
+    kUnused,
+    kPrecolored,
+    kInitial,
+    kSimplify,
+    kFreeze,
+    kSpill,
+    kSpilled,
+    kCoalesced,
+    kColored,
+    kOnStack,
+  };
+
+  Coloring(const frame::Frame &frame, const std::vector<assem::Instr> &instrs,
+           const std::vector<bool> &no_spill);
+  // returns the temps that have to be spilled, if any
+  std::vector<uint32_t> run();
+  // the register a temp was given, once run() spilled nothing
+  temp::Temp color(temp::Temp t) { return temp::Temp(color_[alias(t.id())]); }
+
+private:
+  enum class MoveState : uint8_t {
+    kWorklist,
+    kActive,
+    kCoalesced,
+    kConstrained,
+    kFrozen,
+  };
+  static constexpr uint32_t kInfinite = std::numeric_limits<uint32_t>::max();
+
+  const std::vector<assem::Instr> &instrs_;
+  std::vector<temp::Temp> registers_;
+  uint32_t k_;
+  std::vector<State> state_;
+  std::vector<uint32_t> degree_, alias_, color_;
+  std::vector<std::vector<uint32_t>> adj_, move_list_;
+  std::unordered_set<uint64_t> adj_set_;
+  std::vector<double> cost_;
+  // the instructions of the moves, and the state of each
+  std::vector<uint32_t> moves_;
+  std::vector<MoveState> move_state_;
+  std::vector<uint32_t> simplify_, freeze_, spill_, select_, worklist_moves_;
+  // marks nodes already seen in briggs()
+  std::vector<uint32_t> seen_;
+  uint32_t stamp_{0};
+
+  static uint64_t key(uint32_t u, uint32_t v) {
+    return u < v ? (uint64_t)u << 32 | v : (uint64_t)v << 32 | u;
+  }
+  bool precolored(uint32_t n) const { return state_[n] == State::kPrecolored; }
+  bool adjacent(uint32_t u, uint32_t v) const {
+    return adj_set_.count(key(u, v));
+  }
+  uint32_t alias(uint32_t n) {
+    while (state_[n] == State::kCoalesced)
+      n = alias_[n];
+    return n;
+  }
+  uint32_t move_dst(uint32_t m) const {
+    return instrs_[moves_[m]].dst[0].id();
+  }
+  uint32_t move_src(uint32_t m) const {
+    return instrs_[moves_[m]].src[0].id();
+  }
+  bool move_live(uint32_t m) const {
+    return move_state_[m] == MoveState::kWorklist ||
+           move_state_[m] == MoveState::kActive;
+  }
+  bool move_related(uint32_t n) const {
+    for (auto m : move_list_[n]) {
+      if (move_live(m))
+        return true;
+    }
+    return false;
+  }
+  // the neighbours not yet removed from the graph
+  template <typename F> void for_adjacent(uint32_t n, F f) const {
+    for (auto m : adj_[n]) {
+      if (state_[m] != State::kOnStack && state_[m] != State::kCoalesced)
+        f(m);
+    }
+  }
+  void push(uint32_t n, State s) {
+    state_[n] = s;
+    (s == State::kSimplify ? simplify_ : s == State::kFreeze ? freeze_ : spill_)
+        .push_back(n);
+  }
+
+  void add_edge(uint32_t u, uint32_t v);
+  void make_worklists();
+  void simplify(uint32_t n);
+  void decrement_degree(uint32_t m);
+  void enable_moves(uint32_t n);
+  void coalesce(uint32_t m);
+  void add_worklist(uint32_t u);
+  bool george(uint32_t r, uint32_t v) const;
+  bool briggs(uint32_t u, uint32_t v);
+  void combine(uint32_t u, uint32_t v);
+  void freeze_moves(uint32_t u);
+  uint32_t select_spill();
+  std::vector<uint32_t> assign_colors();
+};
+
+Coloring::Coloring(const frame::Frame &frame,
+                   const std::vector<assem::Instr> &instrs,
+                   const std::vector<bool> &no_spill)
+    : instrs_(instrs), registers_(frame.registers()), k_(registers_.size()) {
+  uint32_t n = frame.num_temps();
+  state_.assign(n, State::kUnused);
+  degree_.assign(n, 0);
+  alias_.assign(n, 0);
+  color_.assign(n, 0);
+  adj_.resize(n);
+  move_list_.resize(n);
+  cost_.assign(n, 0);
+  seen_.assign(n, 0);
+
+  auto flow = liveness::flow_graph(instrs);
+  auto graph = liveness::interference(instrs, flow, n);
+  // A use or definition in a loop counts ten times one outside it. Temps
+  // spilling made live only from a load or to a store, so spilling them
+  // again would gain nothing.
+  for (uint32_t i = 0; i < instrs.size(); i++) {
+    double weight = std::pow(10.0, std::min(flow.loop_depth[i], 8U));
+    for (auto *temps : {&instrs[i].src, &instrs[i].dst}) {
+      for (auto t : *temps) {
+        state_[t.id()] = State::kInitial;
+        cost_[t.id()] += weight;
+      }
+    }
+  }
+  for (uint32_t t = 0; t < n; t++) {
+    if (frame.register_name(temp::Temp(t))) {
+      state_[t] = State::kPrecolored;
+      degree_[t] = kInfinite;
+      color_[t] = t;
+    } else if (t < no_spill.size() && no_spill[t]) {
+      cost_[t] = std::numeric_limits<double>::infinity();
+    }
+  }
+  for (uint32_t u = 0; u < n; u++) {
+    for (auto v : graph.adj[u]) {
+      if (u < v)
+        add_edge(u, v);
+    }
+  }
+  for (auto i : graph.moves) {
+    uint32_t m = moves_.size();
+    moves_.push_back(i);
+    move_state_.push_back(MoveState::kWorklist);
+    worklist_moves_.push_back(m);
+    move_list_[move_dst(m)].push_back(m);
+    if (move_src(m) != move_dst(m))
+      move_list_[move_src(m)].push_back(m);
+  }
+}
+
+void Coloring::add_edge(uint32_t u, uint32_t v) {
+  if (u == v || !adj_set_.insert(key(u, v)).second)
+    return;
+  if (!precolored(u)) {
+    adj_[u].push_back(v);
+    degree_[u]++;
+  }
+  if (!precolored(v)) {
+    adj_[v].push_back(u);
+    degree_[v]++;
+  }
+}
+
+std::vector<uint32_t> Coloring::run() {
+  make_worklists();
+  for (;;) {
+    if (!simplify_.empty()) {
+      auto n = simplify_.back();
+      simplify_.pop_back();
+      if (state_[n] == State::kSimplify)
+        simplify(n);
+    } else if (!worklist_moves_.empty()) {
+      auto m = worklist_moves_.back();
+      worklist_moves_.pop_back();
+      if (move_state_[m] == MoveState::kWorklist)
+        coalesce(m);
+    } else if (!freeze_.empty()) {
+      auto u = freeze_.back();
+      freeze_.pop_back();
+      if (state_[u] == State::kFreeze) {
+        push(u, State::kSimplify);
+        freeze_moves(u);
+      }
+    } else if (auto m = select_spill(); m != kInfinite) {
+      push(m, State::kSimplify);
+      freeze_moves(m);
+    } else {
+      break;
+    }
+  }
+  return assign_colors();
+}
+
+void Coloring::make_worklists() {
+  for (uint32_t n = 0; n < state_.size(); n++) {
+    if (state_[n] != State::kInitial)
+      continue;
+    if (degree_[n] >= k_)
+      push(n, State::kSpill);
+    else if (move_related(n))
+      push(n, State::kFreeze);
+    else
+      push(n, State::kSimplify);
+  }
+}
+
+void Coloring::simplify(uint32_t n) {
+  state_[n] = State::kOnStack;
+  select_.push_back(n);
+  for_adjacent(n, [&](uint32_t m) { decrement_degree(m); });
+}
+
+void Coloring::decrement_degree(uint32_t m) {
+  if (precolored(m) || degree_[m]-- != k_)
+    return;
+  enable_moves(m);
+  for_adjacent(m, [&](uint32_t n) { enable_moves(n); });
+  if (state_[m] == State::kSpill)
+    push(m, move_related(m) ? State::kFreeze : State::kSimplify);
+}
+
+void Coloring::enable_moves(uint32_t n) {
+  for (auto m : move_list_[n]) {
+    if (move_state_[m] == MoveState::kActive) {
+      move_state_[m] = MoveState::kWorklist;
+      worklist_moves_.push_back(m);
+    }
+  }
+}
+
+void Coloring::coalesce(uint32_t m) {
+  uint32_t u = alias(move_dst(m)), v = alias(move_src(m));
+  if (precolored(v))
+    std::swap(u, v);
+  if (u == v) {
+    move_state_[m] = MoveState::kCoalesced;
+    add_worklist(u);
+  } else if (precolored(v) || adjacent(u, v)) {
+    move_state_[m] = MoveState::kConstrained;
+    add_worklist(u);
+    add_worklist(v);
+  } else if (precolored(u) ? george(u, v) : briggs(u, v)) {
+    move_state_[m] = MoveState::kCoalesced;
+    combine(u, v);
+    add_worklist(u);
+  } else {
+    move_state_[m] = MoveState::kActive;
+  }
+}
+
+void Coloring::add_worklist(uint32_t u) {
+  if (!precolored(u) && !move_related(u) && degree_[u] < k_ &&
+      state_[u] == State::kFreeze)
+    push(u, State::kSimplify);
+}
+
+// George's test, for coalescing v into register r: every neighbour of v
+// already interferes with r or is of low degree
+bool Coloring::george(uint32_t r, uint32_t v) const {
+  bool ok = true;
+  for_adjacent(v, [&](uint32_t t) {
+    ok = ok && (degree_[t] < k_ || precolored(t) || adjacent(t, r));
+  });
+  return ok;
+}
+
+// Briggs's test: the combined node has fewer than K neighbours of
+// significant degree
+bool Coloring::briggs(uint32_t u, uint32_t v) {
+  stamp_++;
+  uint32_t k = 0;
+  auto count = [&](uint32_t n) {
+    if (seen_[n] == stamp_)
+      return;
+    seen_[n] = stamp_;
+    k += degree_[n] >= k_;
+  };
+  for_adjacent(u, count);
+  for_adjacent(v, count);
+  return k < k_;
+}
+
+void Coloring::combine(uint32_t u, uint32_t v) {
+  state_[v] = State::kCoalesced;
+  alias_[v] = u;
+  move_list_[u].insert(move_list_[u].end(), move_list_[v].begin(),
+                       move_list_[v].end());
+  enable_moves(v);
+  for_adjacent(v, [&](uint32_t t) {
+    add_edge(t, u);
+    decrement_degree(t);
+  });
+  if (degree_[u] >= k_ && state_[u] == State::kFreeze)
+    push(u, State::kSpill);
+}
+
+void Coloring::freeze_moves(uint32_t u) {
+  for (auto m : move_list_[u]) {
+    if (!move_live(m))
+      continue;
+    uint32_t x = alias(move_dst(m)), y = alias(move_src(m));
+    uint32_t v = y == alias(u) ? x : y;
+    move_state_[m] = MoveState::kFrozen;
+    if (state_[v] == State::kFreeze && !move_related(v) && degree_[v] < k_)
+      push(v, State::kSimplify);
+  }
+}
+
+// The node that's cheapest to spill for each neighbour it takes out of the
+// graph, or kInfinite if there are none to spill
+uint32_t Coloring::select_spill() {
+  uint32_t best = kInfinite;
+  double best_cost = 0;
+  size_t kept = 0;
+  for (auto n : spill_) {
+    if (state_[n] != State::kSpill)
+      continue;
+    spill_[kept++] = n;
+    double cost = cost_[n] / degree_[n];
+    if (best == kInfinite || cost < best_cost) {
+      best = n;
+      best_cost = cost;
+    }
+  }
+  spill_.resize(kept);
+  return best;
+}
+
+std::vector<uint32_t> Coloring::assign_colors() {
+  std::vector<uint32_t> spilled;
+  std::vector<bool> taken(state_.size());
+  while (!select_.empty()) {
+    auto n = select_.back();
+    select_.pop_back();
+    for (auto w : adj_[n]) {
+      auto a = alias(w);
+      if (state_[a] == State::kColored || precolored(a))
+        taken[color_[a]] = true;
+    }
+    state_[n] = State::kSpilled;
+    for (auto r : registers_) {
+      if (!taken[r.id()]) {
+        state_[n] = State::kColored;
+        color_[n] = r.id();
+        break;
+      }
+    }
+    if (state_[n] == State::kSpilled)
+      spilled.push_back(n);
+    for (auto w : adj_[n])
+      taken[color_[alias(w)]] = false;
+  }
+  for (uint32_t n = 0; n < state_.size(); n++) {
+    if (state_[n] == State::kCoalesced)
+      color_[n] = color_[alias(n)];
+  }
+  return spilled;
+}
+
+// Gives each spilled temp a slot in the frame, and each instruction using or
+// defining one a new temp of its own, loaded from the slot before it and
+// stored to it after. The new temps are added to no_spill. The offset of
+// each temp's slot goes in offsets, if given.
+std::vector<assem::Instr>
+rewrite(absyn::Arena &arena, frame::Frame &frame,
+        std::vector<assem::Instr> instrs, const std::vector<uint32_t> &spilled,
+        std::vector<bool> &no_spill,
+        std::unordered_map<uint32_t, int32_t> *offsets = nullptr) {
+  uint32_t first_new = frame.num_temps();
+  std::unordered_map<uint32_t, tree::Exp> slots;
+  for (auto t : spilled) {
+    auto access = frame.alloc_local(true);
+    slots.emplace(t, frame.exp(arena, access, tree::TempE(arena, frame.fp())));
+    if (offsets)
+      (*offsets)[t] = access.offset;
+  }
+  std::vector<assem::Instr> out;
+  std::vector<std::pair<uint32_t, temp::Temp>> renamed;
+  auto emit = [&](tree::Stm move) {
+    for (auto &i : codegen::select(frame, {move}))
+      out.push_back(std::move(i));
+  };
+  for (auto &instr : instrs) {
+    renamed.clear();
+    // a temp both used and defined keeps one new temp for both
+    auto rename = [&](temp::Temp &t, bool load) {
+      auto slot = slots.find(t.id());
+      if (slot == slots.end())
+        return;
+      for (auto &[old, fresh] : renamed) {
+        if (old == t.id()) {
+          t = fresh;
+          return;
+        }
+      }
+      auto fresh = frame.new_temp();
+      renamed.push_back({t.id(), fresh});
+      if (load)
+        emit(tree::Move(arena, tree::TempE(arena, fresh), slot->second));
+      t = fresh;
+    };
+    for (auto &t : instr.src)
+      rename(t, true);
+    for (auto &t : instr.dst)
+      rename(t, false);
+    auto defined = instr.dst;
+    out.push_back(std::move(instr));
+    for (auto &[old, fresh] : renamed) {
+      if (std::count(defined.begin(), defined.end(), fresh))
+        emit(tree::Move(arena, slots.at(old), tree::TempE(arena, fresh)));
+    }
+  }
+  no_spill.resize(frame.num_temps());
+  for (uint32_t t = first_new; t < frame.num_temps(); t++)
+    no_spill[t] = true;
+  return out;
+}
+
+// The records and arrays live across a call that may collect are kept in
+// the frame rather than registers, where the collector can find and update
+// them. Each such call gets a label for its return address, and the frame
+// records which slots are live there. Returns how many temps were spilled.
+uint32_t spill_roots(absyn::Arena &arena, frame::Frame &frame,
+                     std::vector<assem::Instr> &instrs,
+                     std::vector<bool> &no_spill) {
+  auto flow = liveness::flow_graph(instrs);
+  auto across = liveness::live_across_calls(instrs, flow, frame.num_temps());
+  std::vector<uint32_t> roots;
+  for (auto &temps : across) {
+    for (auto t : temps) {
+      if (frame.is_pointer(temp::Temp(t)))
+        roots.push_back(t);
+    }
+  }
+  std::sort(roots.begin(), roots.end());
+  roots.erase(std::unique(roots.begin(), roots.end()), roots.end());
+  // the calls, in order, with the roots live across each
+  std::vector<std::vector<uint32_t>> live;
+  for (uint32_t i = 0; i < instrs.size(); i++) {
+    if (instrs[i].kind != assem::Instr::Kind::kCall)
+      continue;
+    live.emplace_back();
+    for (auto t : across[i]) {
+      if (frame.is_pointer(temp::Temp(t)))
+        live.back().push_back(t);
+    }
+  }
+  std::unordered_map<uint32_t, int32_t> offsets;
+  if (!roots.empty())
+    instrs = rewrite(arena, frame, std::move(instrs), roots, no_spill,
+                     &offsets);
+  size_t next = 0;
+  for (auto &instr : instrs) {
+    if (instr.kind != assem::Instr::Kind::kCall)
+      continue;
+    instr.label = frame.new_label(arena);
+    frame::CallSite site{instr.label, {}};
+    for (auto t : live[next++])
+      site.slots.push_back(offsets.at(t));
+    frame.add_call_site(std::move(site));
+  }
+  return roots.size();
+}
+} // namespace
+
+std::vector<assem::Instr> allocate(absyn::Arena &arena, frame::Frame &frame,
+                                   std::vector<assem::Instr> instrs,
+                                   Stats *stats) {
+  Stats s{frame.name().name(), 0, 0, 0, 0};
+  {
+    std::vector<bool> counted(frame.num_temps());
+    for (auto &instr : instrs) {
+      for (auto *temps : {&instr.src, &instr.dst}) {
+        for (auto t : *temps) {
+          if (!frame.register_name(t) && !counted[t.id()]) {
+            counted[t.id()] = true;
+            s.temps++;
+          }
+        }
+      }
+    }
+  }
+  std::vector<bool> no_spill;
+  s.spilled += spill_roots(arena, frame, instrs, no_spill);
+  for (;;) {
+    s.rounds++;
+    Coloring coloring(frame, instrs, no_spill);
+    auto spilled = coloring.run();
+    if (!spilled.empty()) {
+      s.spilled += spilled.size();
+      instrs = rewrite(arena, frame, std::move(instrs), spilled, no_spill);
+      continue;
+    }
+    std::vector<assem::Instr> out;
+    for (auto &instr : instrs) {
+      for (auto *temps : {&instr.src, &instr.dst}) {
+        for (auto &t : *temps)
+          t = coloring.color(t);
+      }
+      if (instr.kind == assem::Instr::Kind::kMove &&
+          instr.dst[0] == instr.src[0]) {
+        s.coalesced++;
+        continue;
+      }
+      out.push_back(std::move(instr));
+    }
+    if (stats)
+      *stats = std::move(s);
+    return out;
+  }
+}
+
+} // namespace regalloc
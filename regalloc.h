@@ -0,0 +1,37 @@
+#ifndef REGALLOC_H
+#define REGALLOC_H
+#include "arena.h"
+#include "assem.h"
+#include "frame.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace regalloc {
+
+// What allocating one function's registers took, for tuning the allocator
+struct Stats {
+  std::string function;
+  // the temps that needed a register, not counting those spilling made
+  uint32_t temps;
+  // the temps given a slot in the frame instead
+  uint32_t spilled;
+  // the moves that went away because both ends got the same register
+  uint32_t coalesced;
+  // how many times the graph was colored, one more than the times it spilled
+  uint32_t rounds;
+};
+
+// Rewrites a function's instructions to use machine registers only, by
+// iterated register coalescing (George and Appel): the interference graph
+// is simplified, coalescing the ends of moves where that can't make it
+// uncolorable, and colored with the frame's registers. A temp that doesn't
+// get one is spilled to a slot in the frame, and the rewritten function
+// colored again. Temps used in loops are the last to be spilled. Moves left
+// copying a register to itself are dropped.
+std::vector<assem::Instr> allocate(absyn::Arena &arena, frame::Frame &frame,
+                                   std::vector<assem::Instr> instrs,
+                                   Stats *stats = nullptr);
+
+} // namespace regalloc
+#endif
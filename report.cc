@@ -0,0 +1,288 @@
+#include "report.h"
+#include "compilation.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdarg>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <new>
+
+namespace {
+bool counting_heap = false;
+std::atomic<size_t> heap_allocs{0}, heap_bytes{0};
+
+double cpu_ms() {
+  timespec ts;
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+  return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+double wall_ms() {
+  using namespace std::chrono;
+  return duration<double, std::milli>(steady_clock::now().time_since_epoch())
+      .count();
+}
+
+void appendf(std::string &out, const char *fmt, ...)
+    __attribute__((format(printf, 2, 3)));
+void appendf(std::string &out, const char *fmt, ...) {
+  char buf[256];
+  va_list args;
+  va_start(args, fmt);
+  int n = std::vsnprintf(buf, sizeof(buf), fmt, args);
+  va_end(args);
+  out.append(buf, std::min<size_t>(n, sizeof(buf) - 1));
+}
+
+std::string json_string(const std::string &s) {
+  std::string out = "\"";
+  for (char c : s) {
+    if (c == '"' || c == '\\')
+      out += '\\';
+    if ((unsigned char)c < 0x20)
+      appendf(out, "\\u%04x", c);
+    else
+      out += c;
+  }
+  return out + "\"";
+}
+
+// The counts of one kind of node, skipping those with none
+template <size_t N>
+void for_each_kind(const size_t (&counts)[N], const char *const (&names)[N],
+                   std::vector<std::pair<const char *, size_t>> &out) {
+  for (size_t i = 0; i < N; i++) {
+    if (counts[i])
+      out.emplace_back(names[i], counts[i]);
+  }
+}
+
+double escape_percent(const absyn::EscapeCounts &c) {
+  return c.vars ? 100.0 * c.escaping / c.vars : 0.0;
+}
+
+std::vector<std::pair<const char *, size_t>>
+node_kinds(const absyn::NodeCounts &c) {
+  std::vector<std::pair<const char *, size_t>> out;
+  for_each_kind(c.exprs, absyn::kExprNames, out);
+  for_each_kind(c.vars, absyn::kVarNames, out);
+  for_each_kind(c.decls, absyn::kDeclNames, out);
+  for_each_kind(c.tys, absyn::kTyNames, out);
+  return out;
+}
+} // namespace
+
+// Counts every allocation made through new while a report is wanted. The
+// arena gets its memory from malloc, so its chunks aren't counted twice.
+void *operator new(size_t size) {
+  if (counting_heap) {
+    heap_allocs.fetch_add(1, std::memory_order_relaxed);
+    heap_bytes.fetch_add(size, std::memory_order_relaxed);
+  }
+  if (void *p = std::malloc(size ? size : 1))
+    return p;
+  throw std::bad_alloc();
+}
+void *operator new[](size_t size) { return operator new(size); }
+void *operator new(size_t size, const std::nothrow_t &) noexcept {
+  try {
+    return operator new(size);
+  } catch (const std::bad_alloc &) {
+    return nullptr;
+  }
+}
+void *operator new[](size_t size, const std::nothrow_t &tag) noexcept {
+  return operator new(size, tag);
+}
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete(void *p, size_t) noexcept { std::free(p); }
+void operator delete[](void *p) noexcept { std::free(p); }
+void operator delete[](void *p, size_t) noexcept { std::free(p); }
+void operator delete(void *p, const std::nothrow_t &) noexcept {
+  std::free(p);
+}
+void operator delete[](void *p, const std::nothrow_t &) noexcept {
+  std::free(p);
+}
+
+void Report::count_heap() { counting_heap = true; }
+
+void Report::snapshot(Phase &p) const {
+  p.wall_ms = wall_ms();
+  p.cpu_ms = cpu_ms();
+  p.heap_allocs = heap_allocs.load(std::memory_order_relaxed);
+  p.heap_bytes = heap_bytes.load(std::memory_order_relaxed);
+  p.arena_allocs = comp_.arena.stats().allocs;
+  p.arena_bytes = comp_.arena.stats().bytes;
+}
+
+void Report::begin(const char *phase) {
+  start_.name = phase;
+  snapshot(start_);
+}
+
+void Report::end() {
+  Phase now;
+  snapshot(now);
+  phases_.push_back({start_.name, now.wall_ms - start_.wall_ms,
+                     now.cpu_ms - start_.cpu_ms,
+                     now.heap_allocs - start_.heap_allocs,
+                     now.heap_bytes - start_.heap_bytes,
+                     now.arena_allocs - start_.arena_allocs,
+                     now.arena_bytes - start_.arena_bytes});
+}
+
+std::string Report::format(Format format, bool time, bool mem) const {
+  return format == Format::kJson ? json(time, mem) : text(time, mem);
+}
+
+std::string Report::text(bool time, bool mem) const {
+  std::string out = comp_.path + ":\n";
+  if (time || mem)
+    out += "  phase   ";
+  if (time)
+    out += "   wall ms    cpu ms";
+  if (mem)
+    out += "  heap allocs   heap bytes arena allocs  arena bytes";
+  if (time || mem)
+    out += "\n";
+  Phase total{"total"};
+  auto row = [&](const Phase &p) {
+    appendf(out, "  %-8s", p.name);
+    if (time)
+      appendf(out, "%10.3f%10.3f", p.wall_ms, p.cpu_ms);
+    if (mem)
+      appendf(out, "%13zu%13zu%13zu%13zu", p.heap_allocs, p.heap_bytes,
+              p.arena_allocs, p.arena_bytes);
+    out += "\n";
+  };
+  for (auto &p : phases_) {
+    if (time || mem)
+      row(p);
+    total.wall_ms += p.wall_ms;
+    total.cpu_ms += p.cpu_ms;
+    total.heap_allocs += p.heap_allocs;
+    total.heap_bytes += p.heap_bytes;
+    total.arena_allocs += p.arena_allocs;
+    total.arena_bytes += p.arena_bytes;
+  }
+  if (time || mem)
+    row(total);
+
+  appendf(out, "  AST nodes: %zu\n", nodes.total());
+  for (auto &[name, n] : node_kinds(nodes))
+    appendf(out, "    %-12s %10zu\n", name, n);
+  appendf(out, "  symbols interned: %u\n", comp_.symbols.size());
+  appendf(out, "  variables: %zu, %zu escaping (%.1f%%)\n", escapes.vars,
+          escapes.escaping, escape_percent(escapes));
+  uint64_t calls = looks.looks.load(), scopes = looks.scopes.load();
+  appendf(out, "  Table::look: %llu calls, %.2f scopes deep on average\n",
+          (unsigned long long)calls, calls ? (double)scopes / calls : 0.0);
+  if (inlines)
+    appendf(out, "  inlined: %zu calls to %zu functions\n", inlines->calls,
+            inlines->functions);
+  if (folds)
+    appendf(out,
+            "  simplified: %zu constants, %zu identities, %zu branches, "
+            "%lld nodes removed\n",
+            folds->constants, folds->identities, folds->branches,
+            (long long)nodes_removed);
+  if (cache)
+    appendf(out, "  cache: %zu groups found, %zu missed\n", cache->hits,
+            cache->misses);
+  if (bounds)
+    appendf(out, "  bounds checks: %zu eliminated, %zu remaining\n",
+            bounds->eliminated, bounds->remaining);
+  if (ssa)
+    appendf(out,
+            "  ssa: %zu constants, %zu branches folded, %zu redundant, %zu "
+            "hoisted, %zu dead\n",
+            ssa->constants, ssa->branches, ssa->redundant, ssa->hoisted,
+            ssa->dead);
+  if (!regalloc.empty()) {
+    size_t temps = 0, spilled = 0, coalesced = 0;
+    for (auto &s : regalloc) {
+      temps += s.temps;
+      spilled += s.spilled;
+      coalesced += s.coalesced;
+    }
+    appendf(out,
+            "  registers: %zu functions, %zu temps, %zu spilled, %zu moves "
+            "coalesced\n",
+            regalloc.size(), temps, spilled, coalesced);
+    for (auto &s : regalloc) {
+      if (s.spilled)
+        appendf(out, "    %-24s %u of %u temps spilled in %u rounds\n",
+                s.function.c_str(), s.spilled, s.temps, s.rounds);
+    }
+  }
+  return out;
+}
+
+// One object per compilation, on one line
+std::string Report::json(bool time, bool mem) const {
+  std::string out = "{\"file\": " + json_string(comp_.path) + ", \"phases\": [";
+  const char *sep = "";
+  for (auto &p : phases_) {
+    appendf(out, "%s{\"name\": \"%s\"", sep, p.name);
+    if (time)
+      appendf(out, ", \"wall_ms\": %.3f, \"cpu_ms\": %.3f", p.wall_ms,
+              p.cpu_ms);
+    if (mem)
+      appendf(out,
+              ", \"heap_allocs\": %zu, \"heap_bytes\": %zu, "
+              "\"arena_allocs\": %zu, \"arena_bytes\": %zu",
+              p.heap_allocs, p.heap_bytes, p.arena_allocs, p.arena_bytes);
+    out += "}";
+    sep = ", ";
+  }
+  appendf(out, "], \"nodes\": {\"total\": %zu", nodes.total());
+  for (auto &[name, n] : node_kinds(nodes))
+    appendf(out, ", \"%s\": %zu", name, n);
+  uint64_t calls = looks.looks.load(), scopes = looks.scopes.load();
+  appendf(out,
+          "}, \"symbols\": %u, \"variables\": {\"count\": %zu, "
+          "\"escaping\": %zu}, \"lookups\": {\"calls\": %llu, "
+          "\"avg_depth\": %.3f}",
+          comp_.symbols.size(), escapes.vars, escapes.escaping,
+          (unsigned long long)calls, calls ? (double)scopes / calls : 0.0);
+  if (inlines)
+    appendf(out, ", \"inlined\": {\"calls\": %zu, \"functions\": %zu}",
+            inlines->calls, inlines->functions);
+  if (folds)
+    appendf(out,
+            ", \"simplified\": {\"constants\": %zu, \"identities\": %zu, "
+            "\"branches\": %zu, \"nodes_removed\": %lld}",
+            folds->constants, folds->identities, folds->branches,
+            (long long)nodes_removed);
+  if (cache)
+    appendf(out, ", \"cache\": {\"hits\": %zu, \"misses\": %zu}",
+            cache->hits, cache->misses);
+  if (bounds)
+    appendf(out, ", \"bounds_checks\": {\"eliminated\": %zu, "
+                 "\"remaining\": %zu}",
+            bounds->eliminated, bounds->remaining);
+  if (ssa)
+    appendf(out,
+            ", \"ssa\": {\"constants\": %zu, \"branches\": %zu, "
+            "\"redundant\": %zu, \"hoisted\": %zu, \"dead\": %zu}",
+            ssa->constants, ssa->branches, ssa->redundant, ssa->hoisted,
+            ssa->dead);
+  if (!regalloc.empty()) {
+    out += ", \"regalloc\": [";
+    sep = "";
+    for (auto &s : regalloc) {
+      appendf(out,
+              "%s{\"function\": %s, \"temps\": %u, \"spilled\": %u, "
+              "\"coalesced\": %u, \"rounds\": %u}",
+              sep, json_string(s.function).c_str(), s.temps, s.spilled,
+              s.coalesced, s.rounds);
+      sep = ", ";
+    }
+    out += "]";
+  }
+  out += "}\n";
+  return out;
+}
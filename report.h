@@ -0,0 +1,77 @@
+#ifndef REPORT_H
+#define REPORT_H
+#include "bounds.h"
+#include "cache.h"
+#include "count.h"
+#include "escape.h"
+#include "fold.h"
+#include "inliner.h"
+#include "regalloc.h"
+#include "ssa.h"
+#include "symbol.h"
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+struct Compilation;
+
+// What --time-report and --mem-report show about one compilation: the wall
+// and CPU time of each phase and the allocations made during it, and counts
+// of what the compilation built and looked up, of its escaping variables, of
+// the rewrites simplifying made, of the groups of functions found in the
+// cache, of the bounds checks removed, of what the SSA passes did and of the
+// temps spilled by register allocation. --stats asks for the counts alone.
+// Times and heap allocations are the process's, so with more than one file
+// they only belong to the file being reported when files are compiled one at
+// a time (-j1).
+class Report {
+public:
+  struct Phase {
+    const char *name;
+    double wall_ms, cpu_ms;
+    size_t heap_allocs, heap_bytes;
+    size_t arena_allocs, arena_bytes;
+  };
+  enum class Format { kText, kJson };
+
+  // Starts counting heap allocations; call before starting any threads
+  static void count_heap();
+
+  explicit Report(const Compilation &comp) : comp_(comp) {}
+  Report(const Report &) = delete;
+  Report &operator=(const Report &) = delete;
+
+  // brackets a phase; phases don't nest
+  void begin(const char *phase);
+  void end();
+
+  absyn::NodeCounts nodes;
+  absyn::EscapeCounts escapes;
+  // shared by the compilation's venv and tenv
+  symbol::LookStats looks;
+  // what simplifying the program did, if it was simplified
+  std::optional<absyn::InlineCounts> inlines;
+  std::optional<absyn::FoldCounts> folds;
+  int64_t nodes_removed{0};
+  // the groups of functions found in the cache and not, if there is one
+  std::optional<cache::Counts> cache;
+  // the subscripts left checked and not, when assembly is written
+  std::optional<absyn::BoundsCounts> bounds;
+  // what the SSA passes did over all the functions, and register allocation
+  // in each, when assembly is written
+  std::optional<ssa::Stats> ssa;
+  std::vector<regalloc::Stats> regalloc;
+
+  std::string format(Format format, bool time, bool mem) const;
+
+private:
+  const Compilation &comp_;
+  std::vector<Phase> phases_;
+  Phase start_;
+
+  void snapshot(Phase &p) const;
+  std::string text(bool time, bool mem) const;
+  std::string json(bool time, bool mem) const;
+};
+#endif
@@ -0,0 +1,525 @@
+/* The runtime of programs compiled with tiger -S: the standard library,
+ * allocation, and the checks compiled code calls out to. Link it with the
+ * assembly:
+ *
+ *   tiger -S prog.tig && cc -o prog prog.s runtime/runtime.c
+ *
+ * Values are 64-bit words. A string is a pointer to its length followed by
+ * its characters, an array a pointer to its length followed by its
+ * elements, and a record a pointer to its fields. Records and arrays are
+ * garbage collected; strings are never freed.
+ */
+/* for sigaction and sigaltstack */
+#define _XOPEN_SOURCE 700
+#include <errno.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+struct string {
+  int64_t size;
+  char chars[];
+};
+
+int64_t tigermain(void);
+
+/* What print writes, which is written out when it fills, when the program
+ * flushes, reads, exits or fails, and after each line if stdout is a
+ * terminal, so that a print costs a copy rather than a system call */
+static struct {
+  char buf[1 << 16];
+  size_t len;
+  int tty;
+} out;
+
+/* Only call write, so a signal handler can too. What can't be written is
+ * dropped, as stdio would. */
+static void write_all(const char *p, size_t size) {
+  while (size > 0) {
+    ssize_t n = write(1, p, size);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return;
+    p += n;
+    size -= n;
+  }
+}
+
+static void flush_output(void) {
+  write_all(out.buf, out.len);
+  out.len = 0;
+}
+
+static void fail(const char *fmt, ...) {
+  va_list args;
+  va_start(args, fmt);
+  flush_output();
+  fputs("runtime error: ", stderr);
+  vfprintf(stderr, fmt, args);
+  fputc('\n', stderr);
+  va_end(args);
+  exit(1);
+}
+
+static void *checked(void *p, size_t bytes) {
+  if (!p)
+    fail("out of memory allocating %zu bytes", bytes);
+  return p;
+}
+
+static struct string *new_string(int64_t size) {
+  size_t bytes = sizeof(struct string) + size;
+  struct string *s = checked(calloc(1, bytes), bytes);
+  s->size = size;
+  return s;
+}
+
+/* the one-character strings, which chr and getchar share; compiled code
+ * indexes it for chr */
+struct string *tig_chars[256];
+
+static struct string empty;
+
+/* Records and arrays are moved by a generational copying collector. They
+ * are made in the nursery, and the ones still live when it fills are copied
+ * to the old space; when that fills too, everything live is copied to a new
+ * old space.
+ *
+ * Each object has a header in the word before it. A record's is its layout,
+ * which the compiler emits for each record expression: the number of fields
+ * and a bitmap of those that are records or arrays. An array's is ARRAY, and
+ * POINTER_ELEMENTS if its elements are records or arrays. The header of an
+ * object that has been copied is its new address, with FORWARDED set.
+ *
+ * The compiler keeps every record and array live across a call that can
+ * collect in its frame, and emits a map of where they are for each such
+ * call, at tig_frame_maps, found by the call's return address. Frames are
+ * walked by their saved rbp until a return address that has no map, which
+ * is the call of tigermain. Compiled code checks for stores of a pointer to
+ * a young object into an old one, and passes the old one to tig_remember,
+ * so that a minor collection need only scan the old objects remembered. */
+#ifndef TIG_NURSERY_SIZE
+#define TIG_NURSERY_SIZE (4 << 20)
+#endif
+
+enum {
+  FORWARDED = 1,
+  ARRAY = 2,
+  REMEMBERED = 4,
+  FLAGS = 7,
+  POINTER_ELEMENTS = 8,
+};
+
+struct layout {
+  int64_t fields;
+  uint64_t pointers[];
+};
+
+/* read by the write barrier in compiled code */
+char *tig_nursery;
+int64_t tig_nursery_size;
+
+static char *young_top;
+
+static struct space {
+  char *start, *top, *end;
+} old;
+
+/* the objects tig_remember was passed since the last collection */
+static struct {
+  int64_t **items;
+  size_t size, cap;
+} remembered;
+
+/* values the runtime itself holds across a collection */
+static int64_t *roots[4];
+static size_t num_roots;
+
+/* counted when TIG_GC_STATS is set */
+static struct {
+  size_t minor, major, allocated, copied;
+} stats;
+
+/* the call sites, hashed by return address */
+struct frame_map {
+  const void *ret;
+  int64_t size;
+  int64_t offsets[];
+};
+extern const int64_t tig_frame_maps[];
+static const struct frame_map **maps;
+static size_t maps_mask;
+
+static size_t hash(const void *ret) {
+  return ((uintptr_t)ret >> 3) * 0x9E3779B97F4A7C15u >> 16;
+}
+
+static void build_maps(void) {
+  int64_t n = tig_frame_maps[0];
+  size_t cap = 16;
+  while (cap < 2 * (size_t)n)
+    cap *= 2;
+  maps = checked(calloc(cap, sizeof *maps), cap * sizeof *maps);
+  maps_mask = cap - 1;
+  const int64_t *p = tig_frame_maps + 1;
+  for (int64_t i = 0; i < n; i++) {
+    const struct frame_map *m = (const struct frame_map *)p;
+    size_t h = hash(m->ret) & maps_mask;
+    while (maps[h])
+      h = (h + 1) & maps_mask;
+    maps[h] = m;
+    p += 2 + m->size;
+  }
+}
+
+static const struct frame_map *find_map(const void *ret) {
+  for (size_t h = hash(ret) & maps_mask; maps[h]; h = (h + 1) & maps_mask) {
+    if (maps[h]->ret == ret)
+      return maps[h];
+  }
+  return NULL;
+}
+
+static int young(const int64_t *p) {
+  uintptr_t offset = (const char *)p - tig_nursery;
+  return offset < (uintptr_t)tig_nursery_size;
+}
+
+/* The words of a record of the layout, less its header. One without
+ * fields still takes a word, so that it points into its own space. */
+static int64_t record_words(const struct layout *layout) {
+  return layout->fields ? layout->fields : 1;
+}
+
+/* the words of an object, less its header */
+static int64_t payload(const int64_t *p) {
+  int64_t h = p[-1];
+  if (h & ARRAY)
+    return 1 + p[0];
+  return record_words((const struct layout *)(h & ~FLAGS));
+}
+
+/* What a collection moves objects from, and to */
+static struct {
+  char *from, *from_end, *top;
+} gc;
+
+static int moving(const int64_t *p) {
+  const char *c = (const char *)p;
+  return young(p) || (c >= gc.from && c < gc.from_end);
+}
+
+/* Moves what *slot points to, if it's in the space being collected, and
+ * points the slot at where it went */
+static void forward(int64_t *slot) {
+  int64_t *p = (int64_t *)*slot;
+  if (!p || !moving(p))
+    return;
+  int64_t h = p[-1];
+  if (h & FORWARDED) {
+    *slot = h & ~FLAGS;
+    return;
+  }
+  int64_t words = 1 + payload(p);
+  int64_t *copy = (int64_t *)gc.top + 1;
+  memcpy(copy - 1, p - 1, words * sizeof(int64_t));
+  copy[-1] &= ~REMEMBERED;
+  gc.top += words * sizeof(int64_t);
+  stats.copied += words * sizeof(int64_t);
+  p[-1] = (int64_t)copy | FORWARDED;
+  *slot = (int64_t)copy;
+}
+
+/* the slots of an object holding records or arrays */
+static void forward_fields(int64_t *p) {
+  int64_t h = p[-1];
+  if (h & ARRAY) {
+    if (h & POINTER_ELEMENTS) {
+      for (int64_t i = 1; i <= p[0]; i++)
+        forward(&p[i]);
+    }
+    return;
+  }
+  const struct layout *l = (const struct layout *)(h & ~FLAGS);
+  for (int64_t i = 0; i < l->fields; i++) {
+    if (l->pointers[i / 64] >> (i % 64) & 1)
+      forward(&p[i]);
+  }
+}
+
+static void forward_stack(const void *ret, int64_t *fp) {
+  if (!maps)
+    build_maps();
+  for (const struct frame_map *m; (m = find_map(ret));) {
+    for (int64_t i = 0; i < m->size; i++)
+      forward((int64_t *)((char *)fp + m->offsets[i]));
+    ret = (const void *)fp[1];
+    fp = (int64_t *)fp[0];
+  }
+}
+
+/* Copies everything reachable from the roots into to, from where gc.top
+ * starts */
+static void copy_live(const void *ret, int64_t *fp, char *scan) {
+  forward_stack(ret, fp);
+  for (size_t i = 0; i < num_roots; i++)
+    forward(roots[i]);
+  while (scan < gc.top) {
+    int64_t *p = (int64_t *)scan + 1;
+    forward_fields(p);
+    scan += (1 + payload(p)) * sizeof(int64_t);
+  }
+}
+
+/* Collects so that `bytes` more fit in the old space: the nursery into the
+ * old space if that's enough, and everything into a new old space if not */
+static void collect(const void *ret, int64_t *fp, size_t bytes) {
+  size_t used = young_top - tig_nursery;
+  if ((size_t)(old.end - old.top) >= used + bytes) {
+    stats.minor++;
+    gc.from = gc.from_end = NULL;
+    gc.top = old.top;
+    /* the remembered objects are old, so not moved, but may point to
+     * young ones */
+    for (size_t i = 0; i < remembered.size; i++) {
+      remembered.items[i][-1] &= ~REMEMBERED;
+      forward_fields(remembered.items[i]);
+    }
+    copy_live(ret, fp, old.top);
+    old.top = gc.top;
+  } else {
+    stats.major++;
+    size_t size = 2 * (old.top - old.start + used + bytes) + tig_nursery_size;
+    char *to = checked(malloc(size), size);
+    gc.from = old.start;
+    gc.from_end = old.top;
+    gc.top = to;
+    copy_live(ret, fp, to);
+    free(old.start);
+    old.start = to;
+    old.top = gc.top;
+    old.end = to + size;
+  }
+  remembered.size = 0;
+  young_top = tig_nursery;
+}
+
+/* A new object of `words` words after its header. Those that would take
+ * more than a quarter of the nursery are made in the old space. */
+static int64_t *new_object(size_t words, int64_t header, const void *ret,
+                           int64_t *fp) {
+  size_t bytes = (words + 1) * sizeof(int64_t);
+  stats.allocated += bytes;
+  int64_t *p;
+  if (bytes > (size_t)tig_nursery_size / 4) {
+    if ((size_t)(old.end - old.top) < bytes)
+      collect(ret, fp, bytes);
+    p = (int64_t *)old.top;
+    old.top += bytes;
+  } else {
+    if ((size_t)(tig_nursery + tig_nursery_size - young_top) < bytes)
+      collect(ret, fp, 0);
+    p = (int64_t *)young_top;
+    young_top += bytes;
+  }
+  memset(p, 0, bytes);
+  p[0] = header;
+  return p + 1;
+}
+
+void tig_remember(int64_t *object) {
+  if (object[-1] & REMEMBERED)
+    return;
+  object[-1] |= REMEMBERED;
+  if (remembered.size == remembered.cap) {
+    remembered.cap = remembered.cap ? 2 * remembered.cap : 64;
+    size_t bytes = remembered.cap * sizeof *remembered.items;
+    remembered.items = checked(realloc(remembered.items, bytes), bytes);
+  }
+  remembered.items[remembered.size++] = object;
+}
+
+/* Compiled code stores the fields without the write barrier, so a record
+ * made in the old space is remembered in case they're young */
+int64_t *tig_alloc_record(const struct layout *layout, int64_t *fp) {
+  int64_t *r = new_object(record_words(layout), (int64_t)layout,
+                          __builtin_return_address(0), fp);
+  if (!young(r))
+    tig_remember(r);
+  return r;
+}
+
+int64_t *tig_init_array(int64_t size, int64_t init, int64_t pointers,
+                        int64_t *fp) {
+  if (size < 0)
+    fail("negative array size %lld", (long long)size);
+  /* the elements may be records or arrays, which can move */
+  if (pointers)
+    roots[num_roots++] = &init;
+  int64_t *a = new_object(size + 1, ARRAY | (pointers ? POINTER_ELEMENTS : 0),
+                          __builtin_return_address(0), fp);
+  if (pointers)
+    num_roots--;
+  a[0] = size;
+  for (int64_t i = 1; i <= size; i++)
+    a[i] = init;
+  if (pointers && init && !young(a) && young((int64_t *)init))
+    tig_remember(a);
+  return a;
+}
+
+static void print_stats(void) {
+  fprintf(stderr,
+          "gc: %zu minor and %zu major collections, %zu bytes allocated, "
+          "%zu copied\n",
+          stats.minor, stats.major, stats.allocated, stats.copied);
+}
+
+static void init_heap(void) {
+  tig_nursery_size = TIG_NURSERY_SIZE;
+  tig_nursery = checked(malloc(tig_nursery_size), tig_nursery_size);
+  young_top = tig_nursery;
+  size_t size = 2 * (size_t)tig_nursery_size;
+  old.start = old.top = checked(malloc(size), size);
+  old.end = old.start + size;
+  if (getenv("TIG_GC_STATS"))
+    atexit(print_stats);
+}
+
+void tig_index_error(int64_t index) {
+  fail("index %lld is out of range", (long long)index);
+}
+
+void tig_nil_error(void) { fail("field of nil record"); }
+
+/* The string literals, which the compiler emits once for each value, so
+ * two of them at different addresses differ */
+extern const char tig_literals[], tig_literals_end[];
+
+static int is_literal(const struct string *s) {
+  const char *p = (const char *)s;
+  return p >= tig_literals && p < tig_literals_end;
+}
+
+int64_t tig_string_equal(const struct string *a, const struct string *b) {
+  if (a == b)
+    return 1;
+  if (a->size != b->size || (is_literal(a) && is_literal(b)))
+    return 0;
+  return memcmp(a->chars, b->chars, a->size) == 0;
+}
+
+int64_t tig_string_compare(const struct string *a, const struct string *b) {
+  if (a == b)
+    return 0;
+  int c = memcmp(a->chars, b->chars, a->size < b->size ? a->size : b->size);
+  if (c == 0)
+    return a->size < b->size ? -1 : a->size > b->size;
+  return c < 0 ? -1 : 1;
+}
+
+/* The standard library, less size, ord, chr and not, which are compiled
+ * in place */
+
+void tig_print(const struct string *s) {
+  if ((size_t)s->size > sizeof out.buf - out.len) {
+    flush_output();
+    /* too big to be worth copying */
+    if ((size_t)s->size >= sizeof out.buf) {
+      write_all(s->chars, s->size);
+      return;
+    }
+  }
+  memcpy(out.buf + out.len, s->chars, s->size);
+  out.len += s->size;
+  if (out.tty && memchr(s->chars, '\n', s->size))
+    flush_output();
+}
+
+void tig_flush(void) { flush_output(); }
+
+/* a prompt printed on the terminal is shown before the program waits for
+ * the answer */
+const struct string *tig_getchar(void) {
+  if (out.tty)
+    flush_output();
+  int c = getchar();
+  return c == EOF ? &empty : tig_chars[c];
+}
+
+/* compiled code only calls this with i out of range, to report it */
+void tig_chr(int64_t i) { fail("chr(%lld) is out of range", (long long)i); }
+
+const struct string *tig_substring(const struct string *s, int64_t first,
+                                   int64_t n) {
+  if (first < 0 || n < 0 || first > s->size - n)
+    fail("substring(%lld, %lld) is out of range for a string of size %lld",
+         (long long)first, (long long)n, (long long)s->size);
+  if (n == 1)
+    return tig_chars[(unsigned char)s->chars[first]];
+  struct string *sub = new_string(n);
+  memcpy(sub->chars, s->chars + first, n);
+  return sub;
+}
+
+const struct string *tig_concat(const struct string *a,
+                                const struct string *b) {
+  if (a->size == 0)
+    return b;
+  if (b->size == 0)
+    return a;
+  struct string *s = new_string(a->size + b->size);
+  memcpy(s->chars, a->chars, a->size);
+  memcpy(s->chars + a->size, b->chars, b->size);
+  return s;
+}
+
+void tig_exit(int64_t status) {
+  flush_output();
+  exit(status);
+}
+
+/* Compiled code divides with idiv, which traps on a zero divisor and on the
+ * one quotient that overflows */
+static void on_fpe(int sig) {
+  static const char msg[] = "runtime error: division by zero or overflow\n";
+  (void)sig;
+  flush_output();
+  if (write(2, msg, sizeof msg - 1) < 0)
+    _exit(2);
+  _exit(1);
+}
+
+/* Any other crash, such as running out of stack, still writes out what was
+ * printed, then ends the program as the signal would have. The handler runs
+ * on a stack of its own, as the program's may be used up. */
+static void on_crash(int sig) {
+  flush_output();
+  raise(sig);
+}
+
+static char crash_stack[1 << 16];
+
+int main(void) {
+  for (int c = 0; c < 256; c++) {
+    tig_chars[c] = new_string(1);
+    tig_chars[c]->chars[0] = c;
+  }
+  out.tty = isatty(1);
+  signal(SIGFPE, on_fpe);
+  stack_t stack = {.ss_sp = crash_stack, .ss_size = sizeof crash_stack};
+  sigaltstack(&stack, NULL);
+  struct sigaction crash = {.sa_handler = on_crash,
+                            .sa_flags = SA_ONSTACK | SA_RESETHAND};
+  sigaction(SIGSEGV, &crash, NULL);
+  sigaction(SIGBUS, &crash, NULL);
+  init_heap();
+  tigermain();
+  flush_output();
+  return 0;
+}
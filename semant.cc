@@ -2,380 +2,799 @@
 #include "absyn.h"
 #include "absyn_common.h"
 #include "box.h"
+#include "diagnostics.h"
+#include "digest.h"
 #include "env.h"
 #include "location.h"
-#include "logging.h"
+#include "pool.h"
 #include "types.h"
 #include <algorithm>
-#include <unordered_set>
+#include <forward_list>
+#include <string>
+#include <unordered_map>
 #include <variant>
+#include <vector>
 
-namespace {
+namespace semant {
+
+namespace detail {
+
+// The loops enclosing the expression being checked, by the label a break
+// jumps to, kept separately for each function being checked so that break
+// can't escape a function body
 class LoopManager {
 public:
-  using Entry = std::variant<absyn::ForExprAST *, absyn::WhileExprAST *>;
-  static LoopManager &Get() {
-    static LoopManager g;
-    return g;
-  }
-  void EnterFun() { loops_.push_front(std::forward_list<Entry>{}); }
+  LoopManager() : loops_(1) {}
+  void EnterFun() { loops_.push_front(std::forward_list<temp::Label>{}); }
   void ExitFun() { loops_.pop_front(); }
-  void EnterLoop(absyn::ForExprAST *e) { loops_.front().push_front(e); }
-  void EnterLoop(absyn::WhileExprAST *e) { loops_.front().push_front(e); }
+  void EnterLoop(temp::Label done) { loops_.front().push_front(done); }
   void ExitLoop() { loops_.front().pop_front(); }
   bool IsLoop() const { return !loops_.empty() && !loops_.front().empty(); }
+  temp::Label Done() const { return loops_.front().front(); }
 
 private:
-  std::forward_list<std::forward_list<Entry>> loops_;
-  LoopManager() : loops_(1) {}
+  std::forward_list<std::forward_list<temp::Label>> loops_;
 };
-} // namespace
 
-namespace semant {
+class TransExp;
+void trans_dec(TransExp &, absyn::DeclAST &,
+               std::vector<translate::Exp> &inits);
+types::Ty trans_ty(TransExp &, absyn::Ty &);
 
-namespace detail {
+// Function groups smaller than this are checked on the calling thread
+constexpr size_t kParallelFunctions = 4;
 
-void trans_dec(Venv &, Tenv &, absyn::DeclAST &);
-types::Ty trans_ty(Tenv &, absyn::Ty &);
+bool is_int(const Expty &et) { return et.ty == types::kIntTy; }
+bool is_str(const Expty &et) { return et.ty == types::kStringTy; }
+bool is_nil(const Expty &et) { return et.ty == types::kNilTy; }
+bool is_unit(const Expty &et) { return et.ty == types::kUnitTy; }
+bool is_error(const Expty &et) { return et.ty == types::kErrorTy; }
 
-bool is_int(const Expty &et) { return types::is<types::IntTy>(et.ty); }
-bool is_str(const Expty &et) { return types::is<types::StringTy>(et.ty); }
-bool is_record(const Expty &et) { return types::is<types::RecordTyRef>(et.ty); }
-bool is_array(const Expty &et) { return types::is<types::ArrayTyRef>(et.ty); }
-bool is_nil(const Expty &et) { return types::is<types::NilTy>(et.ty); }
-bool is_unit(const Expty &et) { return types::is<types::UnitTy>(et.ty); }
+std::string quote(symbol::Symbol s) {
+  return std::string("'") + s.name() + "'";
+}
+
+// Whether a declaration before this one in the group has the same name, in
+// which case check_dup has reported it already
+template <typename D> bool declared_earlier(absyn::Seq<D> group, const D &d) {
+  const D *begin = group.begin();
+  return std::any_of(begin, &d, [&](auto &e) { return e.name == d.name; });
+}
 
 template <typename C, typename F>
-void check_dup(const C &c, F &&f, const char *msg) {
-  std::unordered_set<const char *> names;
+void check_dup(Diagnostics &diags, const C &c, F &&f, const char *msg) {
+  thread_local symbol::Set names;
+  names.clear();
   for (auto &e : c) {
-    CHECK_EQ(names.count(f(e)), 0U)
-        << e.pos << ": Duplicate name '" << f(e) << "' in " << msg;
-    names.insert(f(e));
+    if (!names.insert(f(e)))
+      diags.error(e.pos, "Duplicate name " + quote(f(e)) + " in " + msg);
   }
 }
 
+// Checks an expression and everything in it, reporting each error found to
+// the diagnostics. Whatever fails to check gets kErrorTy, which passes every
+// later check, so each mistake is reported once, where it's made. Messages
+// are only built once there's something to report.
 class TransExp {
+  types::Context &types;
   Venv &venv;
   Tenv &tenv;
+  Diagnostics &diags;
+  ThreadPool *pool;
+  CacheUse *cache;
+  translate::Translator &tr;
+  LoopManager loops;
+  friend class DeclVisitor;
+  friend class TypeVisitor;
+  bool is_record(const Expty &et) const { return types.is_record(et.ty); }
+  bool is_array(const Expty &et) const { return types.is_array(et.ty); }
+  void error(const Location &pos, std::string msg) {
+    diags.error(pos, std::move(msg));
+  }
+  // reports `what` unless a value of type `actual` can be used as `expected`
+  void expect(types::Ty actual, types::Ty expected, const Location &pos,
+              const char *what) {
+    if (!types.is_compatible(actual, expected))
+      error(pos, std::string(what) + ": expected " + types.describe(expected) +
+                     ", got " + types.describe(actual));
+  }
+  // the actual type bound to the name, or kErrorTy after reporting it
+  types::Ty look_type(symbol::Symbol name, const Location &pos) {
+    auto entry = tenv.look(name);
+    if (!entry) {
+      error(pos, "Undefined type " + quote(name));
+      return types::kErrorTy;
+    }
+    return types.actual_ty(entry.value());
+  }
   class ExprVisitor {
     TransExp &e_;
 
   public:
     ExprVisitor(TransExp &enclosing) : e_(enclosing) {}
-    Expty operator()(uptr<absyn::VarExprAST> &e) { return e_.trvar(e->var); }
-    Expty operator()(uptr<absyn::NilExprAST> &e) { return {types::NilTy()}; }
-    Expty operator()(uptr<absyn::IntExprAST> &e) { return {types::IntTy()}; }
-    Expty operator()(uptr<absyn::StringExprAST> &e) {
-      return {types::StringTy()};
+    Expty operator()(absyn::VarExprAST *e) { return e_.trvar(e->var); }
+    Expty operator()(absyn::NilExprAST *e) {
+      return {types::kNilTy, e_.tr.nil_exp()};
+    }
+    Expty operator()(absyn::IntExprAST *e) {
+      return {types::kIntTy, e_.tr.int_exp(e->val)};
+    }
+    Expty operator()(absyn::StringExprAST *e) {
+      return {types::kStringTy,
+              e_.tr.string_exp(std::string(e->val.value()))};
     }
-    Expty operator()(uptr<absyn::CallExprAST> &e) {
+    Expty operator()(absyn::CallExprAST *e) {
       auto entry = e_.venv.look(e->func);
-      CHECK(entry) << e->pos << ": Undefined symbol '" << e->func.name() << "'";
-      CHECK(env::is<env::FunEntry>(entry.value()))
-          << e->pos << ": '" << e->func.name() << "' is not a function";
+      if (!entry || !env::is<env::FunEntry>(entry.value())) {
+        e_.error(e->pos, entry ? quote(e->func) + " is not a function"
+                               : "Undefined function " + quote(e->func));
+        for (auto &arg : e->args)
+          e_.trexp(arg.exp);
+        return {types::kErrorTy};
+      }
       auto &func = env::as<env::FunEntry>(entry.value());
-      CHECK_EQ(e->args.size(), func.formals.size()) << e->pos;
+      if (e->args.size() != func.formals.size)
+        e_.error(e->pos, quote(e->func) + " takes " +
+                             std::to_string(func.formals.size) +
+                             " arguments, got " +
+                             std::to_string(e->args.size()));
+      std::vector<translate::Exp> args;
       for (int i = 0; i < (int)e->args.size(); i++) {
         auto et = e_.trexp(e->args[i].exp);
-        CHECK(types::is_compatible(et.ty, func.formals[i])) << e->args[i].pos;
+        if (i < (int)func.formals.size)
+          e_.expect(et.ty, e_.types.at(func.formals, i), e->args[i].pos,
+                    "Wrong type of argument");
+        args.push_back(et.exp);
       }
-      return {func.result};
+      if (func.intrinsic != translate::Intrinsic::kNone &&
+          args.size() == func.formals.size)
+        return {func.result, e_.tr.intrinsic(func.intrinsic, args)};
+      return {func.result,
+              e_.tr.call_exp(func.level, func.label, args,
+                             e_.types.is_pointer(func.result), e->tail)};
     }
-    Expty operator()(uptr<absyn::OpExprAST> &e) {
+    Expty operator()(absyn::OpExprAST *e) {
       auto lhs = e_.trexp(e->lhs);
       auto rhs = e_.trexp(e->rhs);
+      if (is_error(lhs) || is_error(rhs))
+        return {types::kIntTy};
       switch (e->op) {
       case absyn::Op::kEq:
       case absyn::Op::kNeq:
-        if (is_int(lhs) || is_str(lhs) || is_array(lhs)) {
-          CHECK(lhs.ty == rhs.ty) << e->pos;
-        } else if (is_record(lhs)) {
-          CHECK(is_nil(rhs) || lhs.ty == rhs.ty) << e->pos;
-        } else if (is_nil(lhs)) {
-          CHECK(is_record(rhs)) << e->pos;
+        if (is_int(lhs) || is_str(lhs) || e_.is_array(lhs) ||
+            e_.is_record(lhs) || is_nil(lhs)) {
+          if (!e_.types.is_compatible(rhs.ty, lhs.ty) &&
+              !e_.types.is_compatible(lhs.ty, rhs.ty))
+            e_.error(e->pos, std::string("Can't compare ") +
+                                 e_.types.describe(lhs.ty) + " with " +
+                                 e_.types.describe(rhs.ty));
         } else {
-          LOG_FATAL << e->pos << ": Wrong types to op";
+          e_.error(e->pos, std::string("Can't compare values of type ") +
+                               e_.types.describe(lhs.ty));
         }
         break;
       case absyn::Op::kLt:
       case absyn::Op::kGt:
       case absyn::Op::kLe:
       case absyn::Op::kGe:
-        CHECK(is_int(lhs) || is_str(lhs)) << e->pos;
-        CHECK(lhs.ty == rhs.ty) << e->pos;
+        if (!is_int(lhs) && !is_str(lhs))
+          e_.error(e->pos, std::string("Can't order values of type ") +
+                               e_.types.describe(lhs.ty));
+        else
+          e_.expect(rhs.ty, lhs.ty, e->pos, "Wrong type of operand");
         break;
       default:
-        CHECK(is_int(lhs)) << e->pos;
-        CHECK(is_int(rhs)) << e->pos;
+        e_.expect(lhs.ty, types::kIntTy, e->pos, "Wrong type of operand");
+        e_.expect(rhs.ty, types::kIntTy, e->pos, "Wrong type of operand");
+      }
+      switch (e->op) {
+      case absyn::Op::kPlus:
+      case absyn::Op::kMinus:
+      case absyn::Op::kMul:
+      case absyn::Op::kDiv:
+        return {types::kIntTy, e_.tr.arith(e->op, lhs.exp, rhs.exp)};
+      case absyn::Op::kAnd:
+      case absyn::Op::kOr:
+        return {types::kIntTy, e_.tr.logical(e->op, lhs.exp, rhs.exp)};
+      default:
+        e->strings = is_str(lhs);
+        if (e->strings)
+          return {types::kIntTy,
+                  e_.tr.string_compare(e->op, lhs.exp, rhs.exp)};
+        return {types::kIntTy, e_.tr.compare(e->op, lhs.exp, rhs.exp)};
+      }
+    }
+    Expty operator()(absyn::RecordExprAST *e) {
+      auto ty = e_.look_type(e->type_id, e->pos);
+      if (ty != types::kErrorTy && !e_.types.is_record(ty)) {
+        e_.error(e->pos, quote(e->type_id) + " is not a record type");
+        ty = types::kErrorTy;
+      }
+      int n = 0;
+      if (ty != types::kErrorTy) {
+        n = std::min<int>(e->fields.size(), e_.types.num_fields(ty));
+        if (e->fields.size() != e_.types.num_fields(ty))
+          e_.error(e->pos, quote(e->type_id) + " has " +
+                               std::to_string(e_.types.num_fields(ty)) +
+                               " fields, got " +
+                               std::to_string(e->fields.size()));
       }
-      return {types::IntTy()};
-    }
-    Expty operator()(uptr<absyn::RecordExprAST> &e) {
-      auto entry = e_.tenv.look(e->type_id);
-      CHECK(entry) << e->pos << ": Undefined symbol '" << e->type_id.name()
-                   << "'";
-      auto aty = types::actual_ty(entry.value());
-      CHECK(types::is<types::RecordTyRef>(aty))
-          << e->pos << ": '" << e->type_id.name() << "' is not a record";
-      auto &ty = types::as<types::RecordTyRef>(aty);
-      CHECK_EQ(e->fields.size(), ty->fields.size()) << e->pos;
+      std::vector<translate::Exp> fields;
+      std::vector<bool> pointers;
       for (int i = 0; i < (int)e->fields.size(); i++) {
-        auto &[name, ty_] = ty->fields[i];
-        CHECK_EQ(e->fields[i].name, name) << e->fields[i].pos;
         auto et = e_.trexp(e->fields[i].value);
-        CHECK(types::is_compatible(et.ty, ty_)) << e->fields[i].pos;
+        fields.push_back(et.exp);
+        pointers.push_back(i < n &&
+                           e_.types.is_pointer(e_.types.field(ty, i).ty));
+        if (i >= n)
+          continue;
+        auto &[name, ty_] = e_.types.field(ty, i);
+        if (e->fields[i].name != name)
+          e_.error(e->fields[i].pos, "Expected field " + quote(name) +
+                                         ", got " + quote(e->fields[i].name));
+        else
+          e_.expect(et.ty, ty_, e->fields[i].pos, "Wrong type of field");
       }
-      return {ty};
-    }
-    Expty operator()(uptr<absyn::ArrayExprAST> &e) {
-      auto entry = e_.tenv.look(e->type_id);
-      CHECK(entry) << e->pos << ": Undefined symbol '" << e->type_id.name()
-                   << "'";
-      auto aty = types::actual_ty(entry.value());
-      CHECK(types::is<types::ArrayTyRef>(aty))
-          << e->pos << ": '" << e->type_id.name() << "' is not an array";
-      auto &ty = types::as<types::ArrayTyRef>(aty);
-      CHECK(is_int(e_.trexp(e->size))) << e->pos;
-      CHECK(types::is_compatible(e_.trexp(e->init).ty, ty->base_type))
-          << e->pos;
-      return {ty};
-    }
-    Expty operator()(uptr<absyn::SeqExprAST> &e) {
-      for (int i = 0; i < (int)e->exps.size() - 1; i++) {
-        e_.trexp(e->exps[i].exp);
+      return {ty, e_.tr.record_exp(fields, pointers)};
+    }
+    Expty operator()(absyn::ArrayExprAST *e) {
+      auto ty = e_.look_type(e->type_id, e->pos);
+      if (ty != types::kErrorTy && !e_.types.is_array(ty)) {
+        e_.error(e->pos, quote(e->type_id) + " is not an array type");
+        ty = types::kErrorTy;
       }
-      return {e_.trexp(e->exps.back().exp)};
+      auto size = e_.trexp(e->size);
+      e_.expect(size.ty, types::kIntTy, e->pos, "Wrong type of array size");
+      auto init = e_.trexp(e->init);
+      if (ty != types::kErrorTy)
+        e_.expect(init.ty, e_.types.element(ty), e->pos,
+                  "Wrong type of array initializer");
+      bool pointer =
+          ty != types::kErrorTy && e_.types.is_pointer(e_.types.element(ty));
+      return {ty, e_.tr.array_exp(size.exp, init.exp, pointer)};
     }
-    Expty operator()(uptr<absyn::AssignExprAST> &e) {
+    Expty operator()(absyn::SeqExprAST *e) {
+      std::vector<translate::Exp> exps;
+      types::Ty ty = types::kUnitTy;
+      for (auto &exp : e->exps) {
+        auto et = e_.trexp(exp.exp);
+        exps.push_back(et.exp);
+        ty = et.ty;
+      }
+      return {ty, e_.tr.seq_exp(exps)};
+    }
+    Expty operator()(absyn::AssignExprAST *e) {
       auto dst_et = e_.trvar(e->var);
       auto src_et = e_.trexp(e->exp);
-      CHECK(!is_unit(src_et)) << e->pos;
-      CHECK(is_compatible(src_et.ty, dst_et.ty)) << e->pos;
-      return {types::UnitTy()};
+      e_.expect(src_et.ty, dst_et.ty, e->pos, "Wrong type in assignment");
+      if (auto *v = std::get_if<absyn::SimpleVarAST *>(&e->var)) {
+        auto entry = e_.venv.look((*v)->id);
+        if (entry && env::is<env::VarEntry>(entry.value()) &&
+            env::as<env::VarEntry>(entry.value()).loop)
+          e_.error(e->pos, "Can't assign to loop variable " + quote((*v)->id));
+      }
+      // a store into a record or array that might be older than what's
+      // stored has to be seen by the collector
+      bool barrier = !std::holds_alternative<absyn::SimpleVarAST *>(e->var) &&
+                     e_.types.is_pointer(dst_et.ty);
+      return {types::kUnitTy, e_.tr.assign(dst_et.exp, src_et.exp, barrier)};
     }
-    Expty operator()(uptr<absyn::IfExprAST> &e) {
-      CHECK(is_int(e_.trexp(e->cond))) << e->pos;
+    Expty operator()(absyn::IfExprAST *e) {
+      auto cond = e_.trexp(e->cond);
+      e_.expect(cond.ty, types::kIntTy, e->pos, "Wrong type of condition");
       auto et1 = e_.trexp(e->then);
       if (!e->else_) {
-        CHECK(et1.ty == types::UnitTy()) << e->pos;
-        return {types::UnitTy()};
-      } else {
-        auto et2 = e_.trexp(e->else_.value());
-        if (is_nil(et1)) {
-          CHECK(is_record(et2)) << e->pos;
-          return {et2};
-        } else if (is_nil(et2)) {
-          CHECK(is_record(et1)) << e->pos;
-          return {et1};
-        } else {
-          CHECK(et1.ty == et2.ty) << e->pos;
-          return {et1};
-        }
+        e_.expect(et1.ty, types::kUnitTy, e->pos,
+                  "if-then without else must not produce a value");
+        return {types::kUnitTy,
+                e_.tr.if_exp(cond.exp, et1.exp, nullptr, false)};
       }
+      auto et2 = e_.trexp(e->else_.value());
+      auto ty = is_error(et1) || is_nil(et1) ? et2.ty : et1.ty;
+      if (!e_.types.is_compatible(et2.ty, ty)) {
+        e_.error(e->pos, std::string("Branches of if have different types: ") +
+                             e_.types.describe(et1.ty) + " and " +
+                             e_.types.describe(et2.ty));
+        return {types::kErrorTy};
+      }
+      return {ty, e_.tr.if_exp(cond.exp, et1.exp, &et2.exp,
+                               ty != types::kUnitTy,
+                               e_.types.is_pointer(ty))};
     }
-    Expty operator()(uptr<absyn::WhileExprAST> &e) {
-      CHECK(is_int(e_.trexp(e->cond))) << e->pos;
+    Expty operator()(absyn::WhileExprAST *e) {
+      auto cond = e_.trexp(e->cond);
+      e_.expect(cond.ty, types::kIntTy, e->pos, "Wrong type of condition");
+      auto done = e_.tr.new_label();
       // We could skip this check to allow value-producing expressions in the
       // loop body, which we could simply ignore
-      LoopManager::Get().EnterLoop(e.get());
-      CHECK(e_.trexp(e->body).ty == types::UnitTy()) << e->pos;
-      LoopManager::Get().ExitLoop();
-      return {types::UnitTy()};
-    }
-    Expty operator()(uptr<absyn::ForExprAST> &e) {
-      CHECK(is_int(e_.trexp(e->lo))) << e->pos;
-      CHECK(is_int(e_.trexp(e->hi))) << e->pos;
-      symbol::Scope scope(e_.tenv);
-      e_.tenv.enter({e->var, types::IntTy()});
+      e_.loops.EnterLoop(done);
+      auto body = e_.trexp(e->body);
+      e_.expect(body.ty, types::kUnitTy, e->pos,
+                "Loop body must not produce a value");
+      e_.loops.ExitLoop();
+      return {types::kUnitTy, e_.tr.while_exp(cond.exp, body.exp, done)};
+    }
+    Expty operator()(absyn::ForExprAST *e) {
+      auto lo = e_.trexp(e->lo);
+      e_.expect(lo.ty, types::kIntTy, e->pos, "Wrong type of lower bound");
+      auto hi = e_.trexp(e->hi);
+      e_.expect(hi.ty, types::kIntTy, e->pos, "Wrong type of upper bound");
+      symbol::Scope scope(e_.venv);
+      translate::Access var{e_.tr.level(),
+                            e_.tr.level()->frame().alloc_local(e->escape)};
+      e_.venv.enter({e->var, env::VarEntry{types::kIntTy, var, true}});
+      auto done = e_.tr.new_label();
       // We could skip this check to allow value-producing expressions in the
       // loop body, which we could simply ignore
-      LoopManager::Get().EnterLoop(e.get());
-      // XXX: Check that e->var isn't assigned to in the body
-      CHECK(e_.trexp(e->body).ty == types::UnitTy()) << e->pos;
-      LoopManager::Get().ExitLoop();
-      return {types::UnitTy()};
+      e_.loops.EnterLoop(done);
+      auto body = e_.trexp(e->body);
+      e_.expect(body.ty, types::kUnitTy, e->pos,
+                "Loop body must not produce a value");
+      e_.loops.ExitLoop();
+      return {types::kUnitTy,
+              e_.tr.for_exp(var, lo.exp, hi.exp, body.exp, done)};
     }
-    Expty operator()(uptr<absyn::BreakExprAST> &e) {
-      CHECK(LoopManager::Get().IsLoop()) << e->pos;
-      return {types::UnitTy()};
+    Expty operator()(absyn::BreakExprAST *e) {
+      if (!e_.loops.IsLoop()) {
+        e_.error(e->pos, "break outside a loop");
+        return {types::kUnitTy};
+      }
+      return {types::kUnitTy, e_.tr.break_exp(e_.loops.Done())};
     }
-    Expty operator()(uptr<absyn::LetExprAST> &e) {
+    Expty operator()(absyn::LetExprAST *e) {
       symbol::Scope vscope(e_.venv);
       symbol::Scope tscope(e_.tenv);
+      std::vector<translate::Exp> inits;
       for (auto &dec : e->decs) {
-        trans_dec(e_.venv, e_.tenv, dec);
+        trans_dec(e_, dec, inits);
       }
-      return trans_exp(e_.venv, e_.tenv, e->body);
+      auto body = e_.trexp(e->body);
+      return {body.ty, e_.tr.let_exp(inits, body.exp)};
     }
-    Expty operator()(uptr<absyn::UnitExprAST> &e) { return {types::UnitTy()}; }
+    Expty operator()(absyn::UnitExprAST *e) {
+      return {types::kUnitTy, e_.tr.unit_exp()};
+    }
+    // already reported by the parser
+    Expty operator()(absyn::ErrorExprAST *e) { return {types::kErrorTy}; }
   };
   class VarVisitor {
     TransExp &e_;
 
   public:
     VarVisitor(TransExp &enclosing) : e_(enclosing) {}
-    Expty operator()(uptr<absyn::SimpleVarAST> &v) {
+    Expty operator()(absyn::SimpleVarAST *v) {
       auto entry = e_.venv.look(v->id);
-      CHECK(entry) << v->pos << ": Undefined symbol '" << v->id.name() << "'";
-      CHECK(env::is<env::VarEntry>(entry.value()))
-          << v->pos << ": '" << v->id.name() << "' is not a variable";
-      auto &ventry = env::as<env::VarEntry>(entry.value());
-      return {types::actual_ty(ventry.ty)};
+      if (!entry || !env::is<env::VarEntry>(entry.value())) {
+        e_.error(v->pos, entry ? quote(v->id) + " is not a variable"
+                               : "Undefined variable " + quote(v->id));
+        return {types::kErrorTy};
+      }
+      auto &var = env::as<env::VarEntry>(entry.value());
+      return {var.ty, e_.tr.simple_var(var.access)};
     }
-    Expty operator()(uptr<absyn::FieldVarAST> &v) {
+    Expty operator()(absyn::FieldVarAST *v) {
       Expty et = e_.trvar(v->var);
-      CHECK(is_record(et)) << v->pos;
-      auto &r = types::as<types::RecordTyRef>(et.ty);
-      for (auto &[name, ty] : r->fields) {
-        if (name == v->field)
-          return {types::actual_ty(ty)};
+      if (is_error(et))
+        return et;
+      if (!e_.is_record(et)) {
+        e_.error(v->pos, "Can't take field " + quote(v->field) + " of " +
+                             e_.types.describe(et.ty));
+        return {types::kErrorTy};
+      }
+      int i = e_.types.field_index(et.ty, v->field);
+      if (i < 0) {
+        e_.error(v->pos, "No field " + quote(v->field));
+        return {types::kErrorTy};
       }
-      LOG_FATAL << v->pos << ": No field '" << v->field.name() << "'";
-      // dummy return
-      return {types::UnitTy()};
+      auto ty = e_.types.field(et.ty, i).ty;
+      return {ty, e_.tr.field_var(et.exp, i, e_.types.is_pointer(ty))};
     }
-    Expty operator()(uptr<absyn::IndexVarAST> &v) {
+    Expty operator()(absyn::IndexVarAST *v) {
       Expty et = e_.trvar(v->var);
-      CHECK(is_array(et)) << v->pos;
-      CHECK(is_int(e_.trexp(v->index))) << v->pos;
-      auto a = types::as<types::ArrayTyRef>(et.ty);
-      return {types::actual_ty(a->base_type)};
+      auto index = e_.trexp(v->index);
+      e_.expect(index.ty, types::kIntTy, v->pos, "Wrong type of index");
+      if (is_error(et))
+        return et;
+      if (!e_.is_array(et)) {
+        e_.error(v->pos,
+                 std::string("Can't index ") + e_.types.describe(et.ty));
+        return {types::kErrorTy};
+      }
+      auto ty = e_.types.element(et.ty);
+      return {ty, e_.tr.subscript_var(et.exp, index.exp,
+                                      e_.types.is_pointer(ty), v->checked)};
     }
   };
 
 public:
   Expty trexp(absyn::ExprAST &e) { return std::visit(ExprVisitor(*this), e); }
   Expty trvar(absyn::VarAST &v) { return std::visit(VarVisitor(*this), v); }
-  TransExp(Venv &venv, Tenv &tenv) : venv(venv), tenv(tenv) {}
+  TransExp(types::Context &types, Venv &venv, Tenv &tenv, Diagnostics &diags,
+           ThreadPool *pool, CacheUse *cache, translate::Translator &tr)
+      : types(types), venv(venv), tenv(tenv), diags(diags), pool(pool),
+        cache(cache), tr(tr) {}
+};
+
+// Adds to a cache key what the environments say about a name: a type's
+// structure, a variable's type and where it lives, and a function's
+// signature, label and the level its static link points to. Records and
+// arrays are numbered in the order they're reached rather than by handle,
+// which tells apart those declared apart without depending on how many
+// types were made before.
+class KeyHasher {
+  const types::Context &types_;
+  cache::Hasher &h_;
+  std::unordered_map<uint32_t, uint64_t> numbers_;
+
+  void level(const translate::Level *level) {
+    h_.add(std::string_view(level ? level->frame().name().name() : ""));
+  }
+
+public:
+  KeyHasher(const types::Context &types, cache::Hasher &h)
+      : types_(types), h_(h) {}
+
+  void type(types::Ty ty) {
+    ty = types_.actual_ty(ty);
+    auto kind = types_.kind(ty);
+    h_.add((uint64_t)kind);
+    if (kind != types::Kind::kRecord && kind != types::Kind::kArray)
+      return;
+    auto [it, added] = numbers_.emplace(ty.id(), numbers_.size());
+    h_.add(it->second);
+    if (!added)
+      return;
+    if (kind == types::Kind::kArray) {
+      type(types_.element(ty));
+      return;
+    }
+    h_.add((uint64_t)types_.num_fields(ty));
+    for (uint32_t i = 0; i < types_.num_fields(ty); i++) {
+      auto &field = types_.field(ty, i);
+      h_.add(std::string_view(field.name.name()));
+      type(field.ty);
+    }
+  }
+  void fun(const env::FunEntry &fun) {
+    h_.add((uint64_t)fun.formals.size);
+    for (uint32_t i = 0; i < fun.formals.size; i++)
+      type(types_.at(fun.formals, i));
+    type(fun.result);
+    h_.add(std::string_view(fun.label.name()));
+    level(fun.level ? fun.level->parent() : nullptr);
+    h_.add((uint64_t)fun.intrinsic);
+  }
+  void entry(const env::EnvEntry &entry) {
+    h_.add((uint64_t)entry.index());
+    if (!env::is<env::VarEntry>(entry)) {
+      fun(env::as<env::FunEntry>(entry));
+      return;
+    }
+    auto &var = env::as<env::VarEntry>(entry);
+    type(var.ty);
+    level(var.access.level);
+    auto &access = var.access.access;
+    h_.add((uint64_t)access.kind);
+    h_.add((uint64_t)access.pointer);
+    h_.add((uint64_t)access.offset);
+    h_.add((uint64_t)access.reg.id());
+    h_.add((uint64_t)var.loop);
+  }
 };
 
 class DeclVisitor {
+  TransExp &e_;
+  types::Context &types;
   Venv &venv;
   Tenv &tenv;
+  // the initializations of the variables declared, in order
+  std::vector<translate::Exp> &inits;
+
+  void redeclared(const Location &pos, symbol::Symbol name) {
+    e_.error(pos, "Redeclaration of " + quote(name) + " in same scope");
+  }
 
 public:
-  DeclVisitor(Venv &venv, Tenv &tenv) : venv(venv), tenv(tenv) {}
-  void operator()(uptr<absyn::VarDeclAST> &var) {
-    Expty et = trans_exp(venv, tenv, var->init);
+  DeclVisitor(TransExp &e, std::vector<translate::Exp> &inits)
+      : e_(e), types(e.types), venv(e.venv), tenv(e.tenv), inits(inits) {}
+  void operator()(absyn::VarDeclAST *var) {
+    Expty et = e_.trexp(var->init);
     auto res_ty = et.ty;
-    if (types::is<types::NilTy>(et.ty)) {
-      CHECK(var->type_id) << var->pos;
-    }
     if (var->type_id) {
-      auto entry = tenv.look(var->type_id->sym);
-      CHECK(entry) << var->type_id->pos;
-      CHECK(is_compatible(et.ty, entry.value())) << var->type_id->pos;
-      res_ty = types::actual_ty(entry.value());
-    } else {
-      CHECK(!(res_ty == types::UnitTy())) << var->pos;
-    }
-    bool not_redec = venv.enter({var->name, env::VarEntry{res_ty}});
-    CHECK(not_redec) << var->pos << ": Redeclaration of symbol '"
-                     << var->name.name() << "' in same scope";
+      res_ty = e_.look_type(var->type_id->sym, var->type_id->pos);
+      e_.expect(et.ty, res_ty, var->type_id->pos,
+                "Wrong type of initializer");
+    } else if (is_nil(et)) {
+      e_.error(var->pos, "Variable " + quote(var->name) +
+                             " initialized with nil needs a record type");
+      res_ty = types::kErrorTy;
+    } else if (is_unit(et)) {
+      e_.error(var->pos, "Variable " + quote(var->name) +
+                             " initialized with no value");
+      res_ty = types::kErrorTy;
+    }
+    translate::Access access{e_.tr.level(),
+                             e_.tr.level()->frame().alloc_local(
+                                 var->escape, types.is_pointer(res_ty))};
+    if (!venv.enter({var->name, env::VarEntry{res_ty, access}}))
+      redeclared(var->pos, var->name);
+    inits.push_back(e_.tr.assign(e_.tr.simple_var(access), et.exp));
   }
-  void operator()(uptr<absyn::TypeDeclAST> &decs) {
+  void operator()(absyn::TypeDeclAST *decs) {
     check_dup(
-        decs->types, [](auto &e) { return e.name.name(); },
+        e_.diags, decs->types, [](auto &e) { return e.name; },
         "a sequence of mutually recursive types");
+    uint32_t mark = types.mark();
+    // Every name made here has to be bound, even if it couldn't be entered
+    thread_local std::vector<types::Ty> names;
+    names.clear();
     for (auto &dec : decs->types) {
-      auto &[name, type, pos] = dec;
-      auto ty = types::make_name(name);
-      bool not_redec = tenv.enter({name, ty});
-      CHECK(not_redec) << dec.pos << ": Redeclaration of symbol '"
-                       << dec.name.name() << "' in same scope";
+      auto ty = types.make_name(dec.name);
+      names.push_back(ty);
+      if (!tenv.enter({dec.name, ty}) && !declared_earlier(decs->types, dec))
+        redeclared(dec.pos, dec.name);
     }
-    for (auto &dec : decs->types) {
-      auto &[name, type, pos] = dec;
-      auto ty = types::as<types::NameTyRef>(tenv.look(name).value());
-      ty->ty.emplace(trans_ty(tenv, type));
+    for (size_t i = 0; i < decs->types.size(); i++)
+      types.bind_name(names[i], trans_ty(e_, decs->types[i].type));
+    for (auto cycle : types.resolve_names(mark)) {
+      auto dec = std::find_if(decs->types.begin(), decs->types.end(),
+                              [&](auto &dec) { return dec.name == cycle; });
+      e_.error(dec->pos,
+               "Type " + quote(cycle) + " is defined in terms of itself");
     }
   }
-  void operator()(uptr<absyn::FuncDeclAST> &decs) {
+  void operator()(absyn::FuncDeclAST *decs) {
     check_dup(
-        decs->decls, [](auto &e) { return e.name.name(); },
+        e_.diags, decs->decls, [](auto &e) { return e.name; },
         "a sequence of mutually recursive functions");
+    // The bodies are checked against these rather than what's in venv,
+    // which holds only the first of any duplicates
+    std::vector<env::FunEntry> headers;
+    headers.reserve(decs->decls.size());
     for (auto &dec : decs->decls) {
-      types::Ty result_ty = types::UnitTy{};
-      if (dec.result) {
-        auto tentry = tenv.look(dec.result->sym);
-        CHECK(tentry) << dec.result->pos << ": Undefined type '"
-                      << dec.result->sym.name() << "'";
-        result_ty = types::actual_ty(tentry.value());
-      }
-      std::vector<types::Ty> formals;
+      types::Ty result_ty = types::kUnitTy;
+      if (dec.result)
+        result_ty = e_.look_type(dec.result->sym, dec.result->pos);
+      thread_local std::vector<types::Ty> formals;
+      thread_local std::vector<bool> escapes, pointers;
+      formals.clear();
+      escapes.clear();
+      pointers.clear();
       for (auto &p : dec.params) {
-        auto tentry = tenv.look(p.type_id);
-        CHECK(tentry) << p.pos << ": Undefined type '" << p.name.name() << "'";
-        auto ty = types::actual_ty(tentry.value());
-        formals.push_back(ty);
+        formals.push_back(e_.look_type(p.type_id, p.pos));
+        escapes.push_back(p.escape);
+        pointers.push_back(types.is_pointer(formals.back()));
       }
-      bool not_redec =
-          venv.enter({dec.name, env::FunEntry{formals, result_ty}});
-      CHECK(not_redec) << dec.pos << ": Redeclaration of symbol '"
-                       << dec.name.name() << "' in same scope";
+      auto *level = e_.tr.frags().new_level(e_.tr.level(), dec.name.name(),
+                                            escapes, pointers);
+      headers.push_back({types.make_list(formals), result_ty, level,
+                         level->frame().name()});
+      if (!venv.enter({dec.name, headers.back()}) &&
+          !declared_earlier(decs->decls, dec))
+        redeclared(dec.pos, dec.name);
     }
-    for (auto &dec : decs->decls) {
-      check_dup(
-          dec.params, [](auto &e) { return e.name.name(); },
-          "function parameter list");
-      symbol::Scope scope(venv);
-      auto fty = env::as<env::FunEntry>(venv.look(dec.name).value());
-      for (int i = 0; i < (int)dec.params.size(); i++) {
-        // No need to check for duplicate here, since we just created a scope
-        // and we know all the parameter names are unique, so they won't clash
-        venv.enter({dec.params[i].name, env::VarEntry{fty.formals[i]}});
+    // a group found in the cache isn't checked again
+    std::optional<translate::Fragments::Group> group;
+    absyn::Digest digest;
+    size_t errors = e_.diags.size();
+    if (e_.cache) {
+      auto key = group_key(decs, headers, digest);
+      auto entry = e_.cache->cache.load(key);
+      if (entry && restore(*entry, digest)) {
+        e_.cache->hits++;
+        return;
+      }
+      e_.cache->misses++;
+      group = e_.tr.frags().start_group(std::move(key));
+    }
+    check_bodies(decs, headers);
+    // only a group without errors is cached, so that finding it in the
+    // cache means there are none to report
+    if (!group || e_.diags.size() != errors)
+      return;
+    if (e_.cache->code) {
+      e_.tr.frags().end_group(std::move(*group));
+      return;
+    }
+    std::string strings;
+    for (auto *op : digest.comparisons)
+      strings += op->strings ? '1' : '0';
+    e_.cache->cache.store(group->key, strings);
+  }
+
+private:
+  // The key of a group whose headers have been entered, whose digest is
+  // left in `digest`
+  std::string group_key(absyn::FuncDeclAST *decs,
+                        const std::vector<env::FunEntry> &headers,
+                        absyn::Digest &digest) {
+    cache::Hasher h;
+    h.add(e_.cache->code ? "code" : "check");
+    h.add(e_.cache->cache.salt());
+    digest = absyn::digest(*decs, h);
+    KeyHasher key(types, h);
+    for (auto &header : headers)
+      key.fun(header);
+    for (auto name : digest.names) {
+      auto entry = venv.look(name);
+      h.add((uint64_t)entry.has_value());
+      if (entry)
+        key.entry(*entry);
+      auto ty = tenv.look(name);
+      h.add((uint64_t)ty.has_value());
+      if (ty)
+        key.type(*ty);
+    }
+    return h.key();
+  }
+
+  // Restores what checking the group would have, from its entry, returning
+  // false if the entry is damaged
+  bool restore(const std::string &entry, const absyn::Digest &digest) {
+    if (e_.cache->code)
+      return e_.tr.frags().load(entry);
+    if (entry.size() != digest.comparisons.size())
+      return false;
+    for (size_t i = 0; i < entry.size(); i++)
+      digest.comparisons[i]->strings = entry[i] == '1';
+    return true;
+  }
+
+  void check_bodies(absyn::FuncDeclAST *decs,
+                    const std::vector<env::FunEntry> &headers) {
+    // The headers are all in, so the bodies only read the environments
+    // from here on, apart from the scopes they open themselves. That lets
+    // each body be checked in its own layer over them, concurrently with
+    // the others.
+    if (!e_.pool || e_.pool->size() == 1 ||
+        decs->decls.size() < kParallelFunctions) {
+      for (size_t i = 0; i < decs->decls.size(); i++)
+        check_body(e_, decs->decls[i], headers[i]);
+      return;
+    }
+    std::vector<Diagnostics> diags(decs->decls.size());
+    std::vector<translate::Fragments> frags(decs->decls.size());
+    {
+      TaskGroup group(*e_.pool);
+      for (size_t i = 0; i < decs->decls.size(); i++) {
+        group.run([&, i] {
+          types::Context body_types(&types);
+          Venv body_venv(&venv);
+          Tenv body_tenv(&tenv);
+          translate::Translator body_tr(frags[i], e_.tr.level());
+          TransExp body(body_types, body_venv, body_tenv, diags[i], e_.pool,
+                        e_.cache, body_tr);
+          check_body(body, decs->decls[i], headers[i]);
+        });
       }
-      LoopManager::Get().EnterFun();
-      Expty et = trans_exp(venv, tenv, dec.body);
-      LoopManager::Get().ExitFun();
-      CHECK(types::is_compatible(et.ty, fty.result))
-          << dec.pos << ": Function body incompatible with declared "
-          << "return type";
     }
+    // in the order checking them one by one would have found them
+    for (size_t i = 0; i < decs->decls.size(); i++) {
+      e_.diags.append(std::move(diags[i]));
+      e_.tr.frags().append(std::move(frags[i]));
+    }
+  }
+
+  static void check_body(TransExp &e, absyn::FundecTy &dec,
+                         const env::FunEntry &fty) {
+    check_dup(
+        e.diags, dec.params, [](auto &e) { return e.name; },
+        "function parameter list");
+    symbol::Scope scope(e.venv);
+    auto *outer = e.tr.set_level(fty.level);
+    auto &formals = fty.level->frame().formals();
+    for (int i = 0; i < (int)dec.params.size(); i++) {
+      // Duplicates have been reported already, so whether they're entered
+      // doesn't matter. The static link comes before the formals.
+      translate::Access access{fty.level, formals[i + 1]};
+      e.venv.enter({dec.params[i].name,
+                    env::VarEntry{e.types.at(fty.formals, i), access}});
+    }
+    e.loops.EnterFun();
+    Expty et = e.trexp(dec.body);
+    e.loops.ExitFun();
+    e.expect(et.ty, fty.result, dec.pos,
+             "Function body incompatible with declared return type");
+    e.tr.proc_entry_exit(et.exp, fty.result != types::kUnitTy);
+    e.tr.set_level(outer);
   }
 };
 
 class TypeVisitor {
-  Tenv &tenv;
+  TransExp &e_;
 
 public:
-  TypeVisitor(Tenv &tenv) : tenv(tenv) {}
-  types::Ty operator()(uptr<absyn::NameTy> &ty) {
-    auto tentry = tenv.look(ty->type_id);
-    CHECK(tentry) << ty->pos;
+  TypeVisitor(TransExp &e) : e_(e) {}
+  types::Ty operator()(absyn::NameTy *ty) {
+    auto tentry = e_.tenv.look(ty->type_id);
+    if (!tentry) {
+      e_.error(ty->pos, "Undefined type " + quote(ty->type_id));
+      return types::kErrorTy;
+    }
     return tentry.value();
   }
-  types::Ty operator()(uptr<absyn::RecordTy> &ty) {
+  types::Ty operator()(absyn::RecordTy *ty) {
     check_dup(
-        ty->fields, [](auto &e) { return e.name.name(); },
+        e_.diags, ty->fields, [](auto &e) { return e.name; },
         "record declaration");
     std::vector<types::RTyField> out;
     for (auto &field : ty->fields) {
-      auto tentry = tenv.look(field.type_id);
-      CHECK(tentry) << field.pos;
-      out.emplace_back(field.name, tentry.value());
+      auto tentry = e_.tenv.look(field.type_id);
+      if (!tentry)
+        e_.error(field.pos, "Undefined type " + quote(field.type_id));
+      out.push_back({field.name, tentry ? tentry.value() : types::kErrorTy});
     }
-    return types::make_record(std::move(out));
+    return e_.types.make_record(out);
   }
-  types::Ty operator()(uptr<absyn::ArrayTy> &ty) {
-    auto tentry = tenv.look(ty->type_id);
-    CHECK(tentry) << ty->pos;
-    return types::make_array(tentry.value());
+  types::Ty operator()(absyn::ArrayTy *ty) {
+    auto tentry = e_.tenv.look(ty->type_id);
+    if (!tentry) {
+      e_.error(ty->pos, "Undefined type " + quote(ty->type_id));
+      return types::kErrorTy;
+    }
+    return e_.types.make_array(tentry.value());
   }
 };
 
-void trans_dec(Venv &venv, Tenv &tenv, absyn::DeclAST &decl) {
-  std::visit(detail::DeclVisitor(venv, tenv), decl);
+void trans_dec(TransExp &e, absyn::DeclAST &decl,
+               std::vector<translate::Exp> &inits) {
+  std::visit(detail::DeclVisitor(e, inits), decl);
 }
-types::Ty trans_ty(Tenv &tenv, absyn::Ty &ty) {
-  return std::visit(detail::TypeVisitor(tenv), ty);
+types::Ty trans_ty(TransExp &e, absyn::Ty &ty) {
+  return std::visit(detail::TypeVisitor(e), ty);
 }
 
 } // namespace detail
 
-Expty trans_exp(Venv &venv, Tenv &tenv, absyn::ExprAST &e) {
-  return detail::TransExp(venv, tenv).trexp(e);
+namespace {
+using translate::Intrinsic;
+
+struct LibraryFunction {
+  const char *name;
+  std::vector<types::Ty> formals;
+  types::Ty result;
+  Intrinsic intrinsic;
+};
+const LibraryFunction kLibrary[] = {
+    {"print", {types::kStringTy}, types::kUnitTy, Intrinsic::kNone},
+    {"flush", {}, types::kUnitTy, Intrinsic::kNone},
+    {"getchar", {}, types::kStringTy, Intrinsic::kNone},
+    {"ord", {types::kStringTy}, types::kIntTy, Intrinsic::kOrd},
+    {"chr", {types::kIntTy}, types::kStringTy, Intrinsic::kChr},
+    {"size", {types::kStringTy}, types::kIntTy, Intrinsic::kSize},
+    {"substring",
+     {types::kStringTy, types::kIntTy, types::kIntTy},
+     types::kStringTy,
+     Intrinsic::kNone},
+    {"concat",
+     {types::kStringTy, types::kStringTy},
+     types::kStringTy,
+     Intrinsic::kNone},
+    {"not", {types::kIntTy}, types::kIntTy, Intrinsic::kNot},
+    {"exit", {types::kIntTy}, types::kUnitTy, Intrinsic::kNone},
+};
+} // namespace
+
+BaseEnv::BaseEnv(symbol::Registry &symbols, types::Context &types,
+                 absyn::Arena &arena) {
+  tenv.enter({symbols.intern("int"), types::kIntTy});
+  tenv.enter({symbols.intern("string"), types::kStringTy});
+  for (auto &fn : kLibrary)
+    venv.enter({symbols.intern(fn.name),
+                env::FunEntry{types.make_list(fn.formals), fn.result, nullptr,
+                              frame::named_label(arena, fn.name),
+                              fn.intrinsic}});
+}
+
+Expty trans_exp(types::Context &types, Venv &venv, Tenv &tenv,
+                Diagnostics &diags, translate::Fragments &frags,
+                absyn::ExprAST &e, ThreadPool *pool, CacheUse *cache) {
+  translate::Translator tr(frags, frags.outermost());
+  auto et =
+      detail::TransExp(types, venv, tenv, diags, pool, cache, tr).trexp(e);
+  // the program's value, if it has one, is discarded
+  tr.proc_entry_exit(et.exp, false);
+  return et;
 }
 
 } // namespace semant
@@ -1,16 +1,59 @@
 #ifndef SEMANT_H
 #define SEMANT_H
 #include "absyn.h"
+#include "cache.h"
+#include "diagnostics.h"
 #include "env.h"
 #include "symbol.h"
+#include "translate.h"
 #include "types.h"
+#include <atomic>
+class ThreadPool;
 namespace semant {
 using Venv = symbol::Table<env::EnvEntry>;
 using Tenv = symbol::Table<types::Ty>;
 struct Expty {
   types::Ty ty;
+  translate::Exp exp;
 };
 
-Expty trans_exp(Venv &, Tenv &, absyn::ExprAST &);
+// How trans_exp() uses a cache. A group of functions is keyed by its
+// digest, the labels of its functions and what the environments say about
+// each name in it. Without `code`, a group found in the cache is known to
+// check, and isn't checked again; the flags checking would have set in it
+// are set from the entry. With `code`, a group found isn't translated, and
+// the assembly the entry has for it is added to the fragments instead; each
+// group that's translated is marked in the fragments, for codegen to store.
+struct CacheUse {
+  explicit CacheUse(const cache::Cache &cache, bool code = false)
+      : cache(cache), code(code) {}
+  const cache::Cache &cache;
+  const bool code;
+  std::atomic<size_t> hits{0}, misses{0};
+};
+
+// The environment every program is checked in: the types int and string,
+// and the standard library, whose size, ord, chr and not are intrinsics
+// and whose other functions are the runtime's. Symbols and types are the
+// compilation's, so it's built once for each, and the tables each check
+// makes are layered over it. Nothing changes it afterwards, so every check
+// and every thread can read it at once.
+struct BaseEnv {
+  Venv venv;
+  Tenv tenv;
+
+  // `arena` holds the labels of the library's functions
+  BaseEnv(symbol::Registry &symbols, types::Context &types,
+          absyn::Arena &arena);
+};
+
+// Reports every type error in the program to the diagnostics, and
+// translates it to fragments: one for the main program, "tigermain", and one
+// for each function and string literal. The translation is only meaningful
+// if there were no errors. With a pool, the bodies of large groups of
+// mutually recursive functions are checked in parallel on it.
+Expty trans_exp(types::Context &, Venv &, Tenv &, Diagnostics &,
+                translate::Fragments &, absyn::ExprAST &,
+                ThreadPool *pool = nullptr, CacheUse *cache = nullptr);
 } // namespace semant
 #endif
@@ -0,0 +1,43 @@
+#ifndef SORTED_SET_H
+#define SORTED_SET_H
+#include <algorithm>
+#include <cstdint>
+#include <iterator>
+#include <vector>
+
+// Sets of temps or blocks as sorted lists, for the dataflow analyses,
+// which merge them far more often than they look anything up
+namespace sorted_set {
+
+using Set = std::vector<uint32_t>;
+
+inline Set make_set(Set s) {
+  std::sort(s.begin(), s.end());
+  s.erase(std::unique(s.begin(), s.end()), s.end());
+  return s;
+}
+
+inline bool contains(const Set &s, uint32_t x) {
+  return std::binary_search(s.begin(), s.end(), x);
+}
+
+// a - b, in out
+inline void subtract(const Set &a, const Set &b, Set &out) {
+  out.clear();
+  std::set_difference(a.begin(), a.end(), b.begin(), b.end(),
+                      std::back_inserter(out));
+}
+
+// adds b to a, returning whether a grew
+inline bool merge(Set &a, const Set &b, Set &scratch) {
+  scratch.clear();
+  std::set_union(a.begin(), a.end(), b.begin(), b.end(),
+                 std::back_inserter(scratch));
+  if (scratch.size() == a.size())
+    return false;
+  a.swap(scratch);
+  return true;
+}
+
+} // namespace sorted_set
+#endif
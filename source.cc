@@ -0,0 +1,39 @@
+#include "source.h"
+#include "logging.h"
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+SourceFile::SourceFile(const char *path) {
+  int fd = open(path, O_RDONLY);
+  CHECK(fd >= 0) << path << ": " << std::strerror(errno);
+  struct stat st;
+  if (fstat(fd, &st) < 0) {
+    int err = errno;
+    close(fd);
+    LOG_FATAL << path << ": " << std::strerror(err);
+  }
+  size_ = st.st_size;
+  // Reserve room for the file and its terminator with zero-filled anonymous
+  // memory, then map the file over the start of it. The bytes past the end
+  // of the file are zero whether they fall in its last page or in the
+  // anonymous page after it.
+  mapped_ = size_ + 2;
+  void *base = mmap(nullptr, mapped_, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (base != MAP_FAILED && size_ > 0 &&
+      mmap(base, size_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd,
+           0) == MAP_FAILED) {
+    munmap(base, mapped_);
+    base = MAP_FAILED;
+  }
+  int err = errno;
+  close(fd);
+  CHECK(base != MAP_FAILED) << path << ": " << std::strerror(err);
+  base_ = static_cast<char *>(base);
+}
+
+SourceFile::~SourceFile() { munmap(base_, mapped_); }
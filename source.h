@@ -0,0 +1,25 @@
+#ifndef SOURCE_H
+#define SOURCE_H
+#include <cstddef>
+
+// A source file mapped into memory so the lexer can scan it in place. The
+// mapping is private and writable (flex briefly NUL-terminates each token in
+// the buffer), and is followed by the two NUL bytes flex expects at the end
+// of a buffer it doesn't own.
+class SourceFile {
+  char *base_;
+  size_t size_;
+  size_t mapped_;
+
+public:
+  explicit SourceFile(const char *path);
+  SourceFile(const SourceFile &) = delete;
+  SourceFile &operator=(const SourceFile &) = delete;
+  ~SourceFile();
+
+  // including the trailing NULs
+  char *buffer() { return base_; }
+  size_t buffer_size() const { return size_ + 2; }
+  size_t size() const { return size_; }
+};
+#endif
@@ -0,0 +1,1492 @@
+#include "ssa.h"
+#include "logging.h"
+#include "sorted_set.h"
+#include "tree.h"
+#include <algorithm>
+#include <cstdint>
+#include <iterator>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <variant>
+#include <vector>
+
+namespace ssa {
+
+namespace {
+using namespace tree;
+using namespace sorted_set;
+
+constexpr uint32_t kNone = UINT32_MAX;
+
+// A phi function: dst is given the value of the argument for the block
+// control came from
+struct Phi {
+  Temp dst;
+  // the temp it joins the names of
+  Temp var;
+  std::vector<std::pair<Label, Exp>> args;
+};
+
+struct Block {
+  Label label;
+  std::vector<Phi> phis;
+  // without the label; the last is the JUMP or CJUMP
+  std::vector<Stm> stms;
+  std::vector<uint32_t> preds, succs;
+};
+
+// the temp s moves a value to, if it moves one to a temp
+TempExp *def_of(Stm s) {
+  auto *m = std::get_if<MoveStm *>(&s);
+  if (!m)
+    return nullptr;
+  auto *t = std::get_if<TempExp *>(&(*m)->dst);
+  return t ? *t : nullptr;
+}
+
+Exp src_of(Stm s) { return std::get<MoveStm *>(s)->src; }
+
+// Calls f on each temp e uses
+template <typename F> void for_each_use(Exp e, F &f) {
+  if (auto *t = std::get_if<TempExp *>(&e)) {
+    f((*t)->temp);
+  } else if (auto *b = std::get_if<BinopExp *>(&e)) {
+    for_each_use((*b)->left, f);
+    for_each_use((*b)->right, f);
+  } else if (auto *m = std::get_if<MemExp *>(&e)) {
+    for_each_use((*m)->addr, f);
+  } else if (auto *c = std::get_if<CallExp *>(&e)) {
+    for_each_use((*c)->func, f);
+    for (auto &arg : (*c)->args)
+      for_each_use(arg, f);
+  }
+}
+// ... and on each s uses, which doesn't include the temp a MOVE defines
+template <typename F> void for_each_use(Stm s, F &f) {
+  if (auto *m = std::get_if<MoveStm *>(&s)) {
+    if (auto *mem = std::get_if<MemExp *>(&(*m)->dst))
+      for_each_use((*mem)->addr, f);
+    for_each_use((*m)->src, f);
+  } else if (auto *e = std::get_if<ExpStm *>(&s)) {
+    for_each_use((*e)->exp, f);
+  } else if (auto *c = std::get_if<CjumpStm *>(&s)) {
+    for_each_use((*c)->left, f);
+    for_each_use((*c)->right, f);
+  }
+}
+
+// e with each of its temps t replaced by f(t), sharing the nodes that don't
+// change; nodes are never changed in place, since canon can share them
+template <typename F> Exp map(Arena &arena, Exp e, F &f) {
+  if (auto *t = std::get_if<TempExp *>(&e))
+    return f(*t);
+  if (auto *b = std::get_if<BinopExp *>(&e)) {
+    Exp left = map(arena, (*b)->left, f), right = map(arena, (*b)->right, f);
+    if (left == (*b)->left && right == (*b)->right)
+      return e;
+    return Binop(arena, (*b)->op, left, right);
+  }
+  if (auto *m = std::get_if<MemExp *>(&e)) {
+    Exp addr = map(arena, (*m)->addr, f);
+    if (addr == (*m)->addr)
+      return e;
+    auto *mem = arena.New<MemExp>(**m);
+    mem->addr = addr;
+    return mem;
+  }
+  if (auto *c = std::get_if<CallExp *>(&e)) {
+    Exp func = map(arena, (*c)->func, f);
+    bool changed = func != (*c)->func;
+    std::vector<Exp> args;
+    for (auto &arg : (*c)->args) {
+      args.push_back(map(arena, arg, f));
+      changed |= args.back() != arg;
+    }
+    if (!changed)
+      return e;
+    auto *call = arena.New<CallExp>(**c);
+    call->func = func;
+    call->args = make_seq(arena, args);
+    return call;
+  }
+  return e;
+}
+// ... and the same for the expressions of s, but not the temp a MOVE defines
+template <typename F> Stm map(Arena &arena, Stm s, F &f) {
+  if (auto *m = std::get_if<MoveStm *>(&s)) {
+    Exp dst = (*m)->dst;
+    if (auto *mem = std::get_if<MemExp *>(&dst))
+      dst = map(arena, dst, f);
+    Exp src = map(arena, (*m)->src, f);
+    if (dst == (*m)->dst && src == (*m)->src)
+      return s;
+    return Move(arena, dst, src);
+  }
+  if (auto *e = std::get_if<ExpStm *>(&s)) {
+    Exp exp = map(arena, (*e)->exp, f);
+    return exp == (*e)->exp ? s : ExpS(arena, exp);
+  }
+  if (auto *c = std::get_if<CjumpStm *>(&s)) {
+    Exp left = map(arena, (*c)->left, f), right = map(arena, (*c)->right, f);
+    if (left == (*c)->left && right == (*c)->right)
+      return s;
+    return Cjump(arena, (*c)->op, left, right, (*c)->t, (*c)->f);
+  }
+  return s;
+}
+
+bool has_call(Exp e) {
+  if (std::holds_alternative<CallExp *>(e))
+    return true;
+  if (auto *b = std::get_if<BinopExp *>(&e))
+    return has_call((*b)->left) || has_call((*b)->right);
+  if (auto *m = std::get_if<MemExp *>(&e))
+    return has_call((*m)->addr);
+  return false;
+}
+
+// the call s makes, if it makes one; canon leaves it all of an EXP or the
+// source of a MOVE
+CallExp *call_of(Stm s) {
+  Exp e;
+  if (auto *m = std::get_if<MoveStm *>(&s))
+    e = (*m)->src;
+  else if (auto *x = std::get_if<ExpStm *>(&s))
+    e = (*x)->exp;
+  else
+    return nullptr;
+  auto *c = std::get_if<CallExp *>(&e);
+  return c ? *c : nullptr;
+}
+
+// whether s can store to a record, array or frame that already exists
+bool stores(Stm s) {
+  auto *m = std::get_if<MoveStm *>(&s);
+  if (m && std::holds_alternative<MemExp *>((*m)->dst))
+    return true;
+  auto *c = call_of(s);
+  return c && c->stores;
+}
+
+// Whether dividing by e can trap: it can unless e is a constant other than
+// 0, or -1, which overflows dividing the least integer
+bool safe_divisor(Exp e) {
+  auto *c = std::get_if<ConstExp *>(&e);
+  return c && (*c)->value != 0 && (*c)->value != -1;
+}
+
+// Whether a load from addr can't fault: it's from a global the runtime
+// defines, or a slot of the frame
+bool safe_address(Exp addr, Temp fp) {
+  if (std::holds_alternative<NameExp *>(addr))
+    return true;
+  auto *b = std::get_if<BinopExp *>(&addr);
+  if (!b || (*b)->op != BinOp::kPlus)
+    return false;
+  auto *t = std::get_if<TempExp *>(&(*b)->left);
+  return t && (*t)->temp == fp &&
+         std::holds_alternative<ConstExp *>((*b)->right);
+}
+
+// whether evaluating e can fault
+bool may_trap(Exp e, Temp fp) {
+  if (auto *b = std::get_if<BinopExp *>(&e))
+    return ((*b)->op == BinOp::kDiv && !safe_divisor((*b)->right)) ||
+           may_trap((*b)->left, fp) || may_trap((*b)->right, fp);
+  if (auto *m = std::get_if<MemExp *>(&e))
+    return !safe_address((*m)->addr, fp) || may_trap((*m)->addr, fp);
+  return std::holds_alternative<CallExp *>(e);
+}
+
+// Computes a op b as the target does, if it's defined
+bool fold(BinOp op, int64_t a, int64_t b, int64_t &out) {
+  uint64_t x = a, y = b;
+  switch (op) {
+  case BinOp::kPlus:
+    out = x + y;
+    return true;
+  case BinOp::kMinus:
+    out = x - y;
+    return true;
+  case BinOp::kMul:
+    out = x * y;
+    return true;
+  case BinOp::kDiv:
+    if (b == 0 || (a == INT64_MIN && b == -1))
+      return false;
+    out = a / b;
+    return true;
+  case BinOp::kAnd:
+    out = a & b;
+    return true;
+  case BinOp::kOr:
+    out = a | b;
+    return true;
+  case BinOp::kXor:
+    out = a ^ b;
+    return true;
+  default:
+    break;
+  }
+  if (b < 0 || b > 63)
+    return false;
+  if (op == BinOp::kLshift)
+    out = x << b;
+  else if (op == BinOp::kRshift)
+    out = x >> b;
+  else
+    out = a >> b;
+  return true;
+}
+
+bool compare(RelOp op, int64_t a, int64_t b) {
+  uint64_t x = a, y = b;
+  switch (op) {
+  case RelOp::kEq:
+    return a == b;
+  case RelOp::kNe:
+    return a != b;
+  case RelOp::kLt:
+    return a < b;
+  case RelOp::kLe:
+    return a <= b;
+  case RelOp::kGt:
+    return a > b;
+  case RelOp::kGe:
+    return a >= b;
+  case RelOp::kUlt:
+    return x < y;
+  case RelOp::kUle:
+    return x <= y;
+  case RelOp::kUgt:
+    return x > y;
+  case RelOp::kUge:
+    return x >= y;
+  }
+  return false;
+}
+
+// e with the operations on constants it's left with folded
+Exp fold_constants(Arena &arena, Exp e) {
+  auto *b = std::get_if<BinopExp *>(&e);
+  if (!b)
+    return e;
+  Exp left = fold_constants(arena, (*b)->left);
+  Exp right = fold_constants(arena, (*b)->right);
+  auto *l = std::get_if<ConstExp *>(&left);
+  auto *r = std::get_if<ConstExp *>(&right);
+  int64_t value;
+  if (l && r && fold((*b)->op, (*l)->value, (*r)->value, value))
+    return Const(arena, value);
+  if (left == (*b)->left && right == (*b)->right)
+    return e;
+  return Binop(arena, (*b)->op, left, right);
+}
+
+// What SCCP knows of a temp's value: nothing yet, that it's a constant, or
+// that it can vary
+struct Value {
+  enum class Kind : uint8_t { kUnknown, kConst, kVaries };
+  Kind kind{Kind::kUnknown};
+  int64_t c{0};
+
+  static Value constant(int64_t c) { return {Kind::kConst, c}; }
+  static Value varies() { return {Kind::kVaries, 0}; }
+  bool operator==(const Value &v) const { return kind == v.kind && c == v.c; }
+  bool operator!=(const Value &v) const { return !(*this == v); }
+};
+
+Value meet(Value a, Value b) {
+  if (a.kind == Value::Kind::kUnknown)
+    return b;
+  if (b.kind == Value::Kind::kUnknown || a == b)
+    return a;
+  return Value::varies();
+}
+
+class Function {
+  Arena &arena_;
+  frame::Frame &frame_;
+  Stats &stats_;
+  std::vector<Block> blocks_;
+  Label done_;
+  std::unordered_map<Label, uint32_t> index_;
+  // The dominator tree: each block's immediate dominator, the entry being
+  // its own, and the blocks each immediately dominates; the blocks in
+  // reverse postorder; and when a walk of the tree enters and leaves each
+  // block, for telling whether one dominates another
+  std::vector<uint32_t> idom_, rpo_;
+  std::vector<std::vector<uint32_t>> children_;
+  std::vector<uint32_t> enter_, leave_;
+
+  bool is_reg(Temp t) const { return frame_.register_name(t) != nullptr; }
+
+  static std::vector<Label> targets(Stm last) {
+    if (auto *j = std::get_if<JumpStm *>(&last))
+      return {(*j)->target};
+    auto *c = std::get<CjumpStm *>(last);
+    return {c->t, c->f};
+  }
+
+  // whether the block calls a function that doesn't return, so that it
+  // never goes on to its jump
+  static bool ends(const Block &b) {
+    for (auto s : b.stms) {
+      auto *c = call_of(s);
+      if (c && !c->returns)
+        return true;
+    }
+    return false;
+  }
+
+  // Makes the block jump to `to` where it jumped to `from`
+  void retarget(uint32_t b, Label from, Label to) {
+    Stm &last = blocks_[b].stms.back();
+    auto swap = [&](Label l) { return l == from ? to : l; };
+    if (auto *j = std::get_if<JumpStm *>(&last)) {
+      last = Jump(arena_, swap((*j)->target));
+    } else {
+      auto *c = std::get<CjumpStm *>(last);
+      last = Cjump(arena_, c->op, c->left, c->right, swap(c->t), swap(c->f));
+    }
+  }
+
+  uint32_t add_block(Label target) {
+    Block b;
+    b.label = frame_.new_label(arena_);
+    b.stms.push_back(Jump(arena_, target));
+    blocks_.push_back(std::move(b));
+    return blocks_.size() - 1;
+  }
+
+  // Finds the edges between the blocks again, and drops the arguments of
+  // phis for blocks no longer jumping to theirs
+  void link() {
+    index_.clear();
+    for (uint32_t b = 0; b < blocks_.size(); b++) {
+      index_[blocks_[b].label] = b;
+      blocks_[b].preds.clear();
+      blocks_[b].succs.clear();
+    }
+    for (uint32_t b = 0; b < blocks_.size(); b++) {
+      if (ends(blocks_[b]))
+        continue;
+      for (auto l : targets(blocks_[b].stms.back())) {
+        auto it = index_.find(l);
+        auto &succs = blocks_[b].succs;
+        if (it == index_.end() ||
+            std::find(succs.begin(), succs.end(), it->second) != succs.end())
+          continue;
+        succs.push_back(it->second);
+        blocks_[it->second].preds.push_back(b);
+      }
+    }
+    for (auto &block : blocks_) {
+      for (auto &phi : block.phis) {
+        auto &args = phi.args;
+        args.erase(std::remove_if(args.begin(), args.end(),
+                                  [&](auto &arg) {
+                                    auto it = index_.find(arg.first);
+                                    return it == index_.end() ||
+                                           !is_pred(it->second, block);
+                                  }),
+                   args.end());
+      }
+    }
+  }
+
+  static bool is_pred(uint32_t p, const Block &b) {
+    return std::find(b.preds.begin(), b.preds.end(), p) != b.preds.end();
+  }
+
+  // Drops the blocks `keep` says not to, then links the rest
+  void keep(const std::vector<char> &keep) {
+    std::vector<Block> kept;
+    for (uint32_t b = 0; b < blocks_.size(); b++) {
+      if (keep[b])
+        kept.push_back(std::move(blocks_[b]));
+    }
+    blocks_ = std::move(kept);
+    link();
+  }
+
+  // Drops the blocks the entry can't reach
+  void prune() {
+    std::vector<char> reached(blocks_.size());
+    std::vector<uint32_t> work{0};
+    reached[0] = true;
+    while (!work.empty()) {
+      uint32_t b = work.back();
+      work.pop_back();
+      for (auto s : blocks_[b].succs) {
+        if (!reached[s]) {
+          reached[s] = true;
+          work.push_back(s);
+        }
+      }
+    }
+    keep(reached);
+  }
+
+  // The algorithm of Cooper, Harvey and Kennedy, over the reverse postorder
+  void dominators() {
+    uint32_t n = blocks_.size();
+    std::vector<uint32_t> order, number(n);
+    std::vector<char> seen(n);
+    std::vector<std::pair<uint32_t, size_t>> stack{{0, 0}};
+    seen[0] = true;
+    while (!stack.empty()) {
+      auto [b, i] = stack.back();
+      if (i < blocks_[b].succs.size()) {
+        stack.back().second++;
+        uint32_t s = blocks_[b].succs[i];
+        if (!seen[s]) {
+          seen[s] = true;
+          stack.push_back({s, 0});
+        }
+      } else {
+        number[b] = order.size();
+        order.push_back(b);
+        stack.pop_back();
+      }
+    }
+    rpo_.assign(order.rbegin(), order.rend());
+    idom_.assign(n, kNone);
+    idom_[0] = 0;
+    auto intersect = [&](uint32_t a, uint32_t b) {
+      while (a != b) {
+        while (number[a] < number[b])
+          a = idom_[a];
+        while (number[b] < number[a])
+          b = idom_[b];
+      }
+      return a;
+    };
+    for (bool changed = true; changed;) {
+      changed = false;
+      for (auto b : rpo_) {
+        if (b == 0)
+          continue;
+        uint32_t idom = kNone;
+        for (auto p : blocks_[b].preds) {
+          if (idom_[p] != kNone)
+            idom = idom == kNone ? p : intersect(p, idom);
+        }
+        if (idom_[b] != idom) {
+          idom_[b] = idom;
+          changed = true;
+        }
+      }
+    }
+    children_.assign(n, {});
+    for (auto b : rpo_) {
+      if (b != 0)
+        children_[idom_[b]].push_back(b);
+    }
+    enter_.assign(n, 0);
+    leave_.assign(n, 0);
+    uint32_t clock = 0;
+    std::vector<std::pair<uint32_t, size_t>> walk{{0, 0}};
+    enter_[0] = clock++;
+    while (!walk.empty()) {
+      auto [b, i] = walk.back();
+      if (i < children_[b].size()) {
+        walk.back().second++;
+        uint32_t c = children_[b][i];
+        enter_[c] = clock++;
+        walk.push_back({c, 0});
+      } else {
+        leave_[b] = clock++;
+        walk.pop_back();
+      }
+    }
+  }
+
+  bool dominates(uint32_t a, uint32_t b) const {
+    return enter_[a] <= enter_[b] && leave_[b] <= leave_[a];
+  }
+
+  // Gives each loop a preheader, a block that only jumps to its header and
+  // is the only way in from outside the loop, and splits each edge from a
+  // block with more than one successor to one with more than one
+  // predecessor with a block of its own, where the copies leaving the form
+  // can go
+  void shape() {
+    dominators();
+    for (uint32_t h = 1, n = blocks_.size(); h < n; h++) {
+      std::vector<uint32_t> outside;
+      bool loop = false;
+      for (auto p : blocks_[h].preds) {
+        if (dominates(h, p))
+          loop = true;
+        else
+          outside.push_back(p);
+      }
+      if (!loop ||
+          (outside.size() == 1 && blocks_[outside[0]].succs.size() == 1))
+        continue;
+      Label header = blocks_[h].label;
+      uint32_t pre = add_block(header);
+      for (auto p : outside)
+        retarget(p, header, blocks_[pre].label);
+    }
+    link();
+    for (uint32_t p = 0, n = blocks_.size(); p < n; p++) {
+      if (blocks_[p].succs.size() < 2)
+        continue;
+      for (auto s : std::vector<uint32_t>(blocks_[p].succs)) {
+        if (blocks_[s].preds.size() < 2)
+          continue;
+        Label target = blocks_[s].label;
+        uint32_t split = add_block(target);
+        retarget(p, target, blocks_[split].label);
+      }
+    }
+    link();
+    dominators();
+  }
+
+  // The temps live on entry to each block that `vars` says are variables
+  std::vector<Set> live_in(const std::vector<char> &vars) {
+    uint32_t n = blocks_.size();
+    std::vector<Set> uses(n), defs(n), in(n);
+    for (uint32_t b = 0; b < n; b++) {
+      for (auto s : blocks_[b].stms) {
+        auto use = [&](Temp t) {
+          if (t.id() < vars.size() && vars[t.id()] &&
+              !contains(defs[b], t.id()) &&
+              std::find(uses[b].begin(), uses[b].end(), t.id()) ==
+                  uses[b].end())
+            uses[b].push_back(t.id());
+        };
+        for_each_use(s, use);
+        std::sort(uses[b].begin(), uses[b].end());
+        auto *d = def_of(s);
+        if (d && d->temp.id() < vars.size() && vars[d->temp.id()] &&
+            !contains(defs[b], d->temp.id()))
+          defs[b].insert(std::upper_bound(defs[b].begin(), defs[b].end(),
+                                          d->temp.id()),
+                         d->temp.id());
+      }
+      in[b] = uses[b];
+    }
+    Set out, scratch, live;
+    for (bool changed = true; changed;) {
+      changed = false;
+      for (auto it = rpo_.rbegin(); it != rpo_.rend(); ++it) {
+        uint32_t b = *it;
+        out.clear();
+        for (auto s : blocks_[b].succs)
+          merge(out, in[s], scratch);
+        live.clear();
+        std::set_difference(out.begin(), out.end(), defs[b].begin(),
+                            defs[b].end(), std::back_inserter(live));
+        changed |= merge(in[b], live, scratch);
+      }
+    }
+    return in;
+  }
+
+  // Renames the variables defined in b and the blocks it dominates, whose
+  // current names are on top of `names`
+  void rename(uint32_t b, std::vector<std::vector<Temp>> &names) {
+    auto current = [&](Temp t) {
+      uint32_t id = t.id();
+      return id < names.size() && !names[id].empty() ? names[id].back() : t;
+    };
+    auto use = [&](TempExp *t) -> Exp {
+      Temp name = current(t->temp);
+      return name == t->temp ? Exp(t) : TempE(arena_, name);
+    };
+    std::vector<uint32_t> pushed;
+    auto define = [&](Temp var) {
+      Temp t = frame_.new_temp(frame_.is_pointer(var));
+      names[var.id()].push_back(t);
+      pushed.push_back(var.id());
+      return t;
+    };
+    auto &block = blocks_[b];
+    for (auto &phi : block.phis)
+      phi.dst = define(phi.var);
+    for (auto &s : block.stms) {
+      s = map(arena_, s, use);
+      auto *d = def_of(s);
+      if (d && d->temp.id() < names.size() && !names[d->temp.id()].empty())
+        s = Move(arena_, TempE(arena_, define(d->temp)), src_of(s));
+    }
+    for (auto succ : block.succs) {
+      for (auto &phi : blocks_[succ].phis) {
+        phi.args.emplace_back(block.label,
+                              TempE(arena_, current(phi.var)));
+      }
+    }
+    for (auto c : children_[b])
+      rename(c, names);
+    for (auto id : pushed)
+      names[id].pop_back();
+  }
+
+  // Puts the function in SSA form
+  void to_ssa() {
+    uint32_t n = blocks_.size(), temps = frame_.num_temps();
+    std::vector<uint32_t> count(temps);
+    std::vector<Set> sites(temps);
+    for (uint32_t b = 0; b < n; b++) {
+      for (auto s : blocks_[b].stms) {
+        auto *d = def_of(s);
+        if (!d || is_reg(d->temp))
+          continue;
+        count[d->temp.id()]++;
+        auto &where = sites[d->temp.id()];
+        if (where.empty() || where.back() != b)
+          where.push_back(b);
+      }
+    }
+    std::vector<char> vars(temps);
+    for (uint32_t t = 0; t < temps; t++)
+      vars[t] = count[t] > 1;
+    auto in = live_in(vars);
+
+    std::vector<Set> frontier(n);
+    for (uint32_t b = 0; b < n; b++) {
+      if (blocks_[b].preds.size() < 2)
+        continue;
+      for (auto p : blocks_[b].preds) {
+        for (uint32_t r = p; r != idom_[b]; r = idom_[r]) {
+          if (frontier[r].empty() || frontier[r].back() != b)
+            frontier[r].push_back(b);
+        }
+      }
+    }
+    // the last variable each block was given a phi for, and queued for
+    std::vector<uint32_t> has_phi(n, kNone), queued(n, kNone);
+    for (uint32_t v = 0; v < temps; v++) {
+      if (!vars[v])
+        continue;
+      std::vector<uint32_t> work(sites[v].begin(), sites[v].end());
+      for (auto b : work)
+        queued[b] = v;
+      while (!work.empty()) {
+        uint32_t b = work.back();
+        work.pop_back();
+        for (auto d : frontier[b]) {
+          if (has_phi[d] == v || !contains(in[d], v))
+            continue;
+          blocks_[d].phis.push_back({Temp(v), Temp(v), {}});
+          has_phi[d] = v;
+          if (queued[d] != v) {
+            queued[d] = v;
+            work.push_back(d);
+          }
+        }
+      }
+    }
+    std::vector<std::vector<Temp>> names(temps);
+    for (uint32_t v = 0; v < temps; v++) {
+      // until a variable is defined, it keeps its own name
+      if (vars[v])
+        names[v].push_back(Temp(v));
+    }
+    rename(0, names);
+  }
+
+  // Leaves SSA form, by copying the arguments of each phi to it at the end
+  // of each predecessor; through temps, since the copies are made at once
+  void from_ssa() {
+    for (auto &block : blocks_) {
+      if (block.phis.empty())
+        continue;
+      for (auto p : block.preds) {
+        auto &pred = blocks_[p];
+        CHECK(pred.succs.size() == 1) << "phi on a critical edge";
+        std::vector<Stm> copies, moves;
+        for (auto &phi : block.phis) {
+          auto arg =
+              std::find_if(phi.args.begin(), phi.args.end(),
+                           [&](auto &a) { return a.first == pred.label; });
+          CHECK(arg != phi.args.end()) << "phi without an argument";
+          Exp value = arg->second;
+          if (block.phis.size() > 1) {
+            Temp t = frame_.new_temp(frame_.is_pointer(phi.dst));
+            copies.push_back(Move(arena_, TempE(arena_, t), value));
+            value = TempE(arena_, t);
+          }
+          moves.push_back(Move(arena_, TempE(arena_, phi.dst), value));
+        }
+        copies.insert(copies.end(), moves.begin(), moves.end());
+        pred.stms.insert(pred.stms.end() - 1, copies.begin(), copies.end());
+      }
+      block.phis.clear();
+    }
+  }
+
+  // The block each temp is defined in
+  std::vector<uint32_t> def_blocks() const {
+    std::vector<uint32_t> where(frame_.num_temps(), kNone);
+    for (uint32_t b = 0; b < blocks_.size(); b++) {
+      for (auto &phi : blocks_[b].phis)
+        where[phi.dst.id()] = b;
+      for (auto s : blocks_[b].stms) {
+        if (auto *d = def_of(s))
+          where[d->temp.id()] = b;
+      }
+    }
+    return where;
+  }
+
+  // SCCP: what's known of each temp, starting from nothing
+  std::vector<Value> values_;
+  // the temps assigned, to tell them from those used before any assignment
+  std::vector<char> assigned_;
+
+  Value value(Temp t) const {
+    if (is_reg(t) || t.id() >= values_.size() || !assigned_[t.id()])
+      return Value::varies();
+    return values_[t.id()];
+  }
+
+  Value eval(Exp e) const {
+    if (auto *c = std::get_if<ConstExp *>(&e))
+      return Value::constant((*c)->value);
+    if (auto *t = std::get_if<TempExp *>(&e))
+      return value((*t)->temp);
+    if (auto *b = std::get_if<BinopExp *>(&e)) {
+      Value l = eval((*b)->left), r = eval((*b)->right);
+      int64_t v;
+      if (l.kind == Value::Kind::kConst && r.kind == Value::Kind::kConst)
+        return fold((*b)->op, l.c, r.c, v) ? Value::constant(v)
+                                           : Value::varies();
+      if (l.kind == Value::Kind::kVaries || r.kind == Value::Kind::kVaries)
+        return Value::varies();
+      return {};
+    }
+    return Value::varies();
+  }
+
+  // Lowers what's known of t to v, returning whether that changed it
+  bool lower(Temp t, Value v) {
+    Value now = meet(values_[t.id()], v);
+    if (now == values_[t.id()])
+      return false;
+    values_[t.id()] = now;
+    return true;
+  }
+
+  // Sparse conditional constant propagation, though by sweeps of the
+  // blocks reached, in reverse postorder, until nothing changes rather
+  // than from worklists: the values only ever go down a lattice three
+  // high, so a sweep or two past the deepest loop nest settles them
+  void sccp() {
+    uint32_t n = blocks_.size(), temps = frame_.num_temps();
+    values_.assign(temps, Value());
+    assigned_.assign(temps, false);
+    for (auto &block : blocks_) {
+      for (auto &phi : block.phis)
+        assigned_[phi.dst.id()] = true;
+      for (auto s : block.stms) {
+        if (auto *d = def_of(s))
+          assigned_[d->temp.id()] = !is_reg(d->temp);
+      }
+    }
+    std::vector<std::vector<char>> taken(n);
+    for (uint32_t b = 0; b < n; b++)
+      taken[b].assign(blocks_[b].succs.size(), false);
+    std::vector<char> reached(n);
+    reached[0] = true;
+    auto take = [&](uint32_t b, Label l) {
+      auto &succs = blocks_[b].succs;
+      for (size_t i = 0; i < succs.size(); i++) {
+        if (blocks_[succs[i]].label == l && !taken[b][i]) {
+          taken[b][i] = reached[succs[i]] = true;
+          return true;
+        }
+      }
+      return false;
+    };
+    auto was_taken = [&](uint32_t p, uint32_t b) {
+      auto &succs = blocks_[p].succs;
+      auto it = std::find(succs.begin(), succs.end(), b);
+      return it != succs.end() && taken[p][it - succs.begin()];
+    };
+    auto taken_to = [&](uint32_t b, Label l) {
+      auto it = index_.find(l);
+      return it == index_.end() || was_taken(b, it->second);
+    };
+    for (bool changed = true; changed;) {
+      changed = false;
+      for (auto b : rpo_) {
+        if (!reached[b])
+          continue;
+        auto &block = blocks_[b];
+        for (auto &phi : block.phis) {
+          Value v;
+          for (auto &[label, arg] : phi.args) {
+            if (was_taken(index_.at(label), b))
+              v = meet(v, eval(arg));
+          }
+          changed |= lower(phi.dst, v);
+        }
+        for (auto s : block.stms) {
+          auto *d = def_of(s);
+          if (d && !is_reg(d->temp)) {
+            Exp src = src_of(s);
+            changed |= lower(d->temp, std::holds_alternative<CallExp *>(src)
+                                          ? Value::varies()
+                                          : eval(src));
+          }
+        }
+        if (ends(block))
+          continue;
+        Stm last = block.stms.back();
+        if (auto *j = std::get_if<JumpStm *>(&last)) {
+          changed |= take(b, (*j)->target);
+          continue;
+        }
+        auto *c = std::get<CjumpStm *>(last);
+        Value l = eval(c->left), r = eval(c->right);
+        if (l.kind == Value::Kind::kConst && r.kind == Value::Kind::kConst) {
+          changed |= take(b, compare(c->op, l.c, r.c) ? c->t : c->f);
+        } else if (l.kind == Value::Kind::kVaries ||
+                   r.kind == Value::Kind::kVaries) {
+          changed |= take(b, c->t);
+          changed |= take(b, c->f);
+        }
+      }
+    }
+
+    auto constant = [&](TempExp *t) -> Exp {
+      Value v = value(t->temp);
+      if (v.kind == Value::Kind::kConst)
+        return Const(arena_, v.c);
+      return t;
+    };
+    for (uint32_t b = 0; b < n; b++) {
+      if (!reached[b])
+        continue;
+      auto &block = blocks_[b];
+      for (auto &phi : block.phis) {
+        if (value(phi.dst).kind == Value::Kind::kConst)
+          stats_.constants++;
+        for (auto &arg : phi.args)
+          arg.second = map(arena_, arg.second, constant);
+      }
+      for (auto &s : block.stms) {
+        auto *d = def_of(s);
+        Value v = d ? value(d->temp) : Value();
+        if (v.kind == Value::Kind::kConst) {
+          if (!std::holds_alternative<ConstExp *>(src_of(s)))
+            stats_.constants++;
+          s = Move(arena_, TempE(arena_, d->temp), Const(arena_, v.c));
+          continue;
+        }
+        s = map(arena_, s, constant);
+        if (auto *m = std::get_if<MoveStm *>(&s)) {
+          Exp src = fold_constants(arena_, (*m)->src);
+          if (src != (*m)->src)
+            s = Move(arena_, (*m)->dst, src);
+        }
+      }
+      Stm &last = block.stms.back();
+      if (auto *c = std::get_if<CjumpStm *>(&last)) {
+        Exp left = fold_constants(arena_, (*c)->left);
+        Exp right = fold_constants(arena_, (*c)->right);
+        auto *l = std::get_if<ConstExp *>(&left);
+        auto *r = std::get_if<ConstExp *>(&right);
+        if (l && r) {
+          bool t = compare((*c)->op, (*l)->value, (*r)->value);
+          last = Jump(arena_, t ? (*c)->t : (*c)->f);
+          stats_.branches++;
+        } else {
+          CHECK(ends(block) || (taken_to(b, (*c)->t) && taken_to(b, (*c)->f)))
+              << "branch not taken with operands not constant";
+        }
+      }
+    }
+    keep(reached);
+    dominators();
+  }
+
+  // GVN: the temp whose value each is known to have
+  std::vector<Temp> leader_;
+  // the expressions computed in the blocks dominating the one being walked,
+  // by the temps they were assigned to
+  std::unordered_map<std::string, Temp> available_;
+  // Bumped whenever memory can change, and at the start of each block, so
+  // that a load that can see a store isn't found available. Loads are
+  // only reused within a block; an immutable word is reused anywhere.
+  uint64_t epoch_{0};
+  std::vector<char> walked_;
+
+  Temp leader(Temp t) const {
+    return t.id() < leader_.size() ? leader_[t.id()] : t;
+  }
+
+  // Whether t can stand for u: a temp that isn't a record or array can't
+  // stand for one that is, since the collector wouldn't find it
+  bool can_replace(Temp t, Temp u) const {
+    return frame_.is_pointer(t) || !frame_.is_pointer(u);
+  }
+
+  // Appends what identifies the value of e to key, returning false if e can
+  // have effects or read a register other than the frame pointer. `derived`
+  // is set if it's a sum with a record or array, a pointer into one the
+  // collector can't update.
+  bool key(Exp e, std::string &key, bool &derived) const {
+    if (auto *c = std::get_if<ConstExp *>(&e)) {
+      key += std::to_string((*c)->value);
+      return true;
+    }
+    if (auto *n = std::get_if<NameExp *>(&e)) {
+      key += (*n)->label.name();
+      return true;
+    }
+    if (auto *t = std::get_if<TempExp *>(&e)) {
+      Temp temp = (*t)->temp;
+      if (is_reg(temp) && temp != frame_.fp())
+        return false;
+      derived |= frame_.is_pointer(temp);
+      key += "t" + std::to_string(temp.id());
+      return true;
+    }
+    if (auto *b = std::get_if<BinopExp *>(&e)) {
+      std::string left, right;
+      if (!this->key((*b)->left, left, derived) ||
+          !this->key((*b)->right, right, derived))
+        return false;
+      auto op = (*b)->op;
+      // either order of the operands of a commutative operation
+      if ((op == BinOp::kPlus || op == BinOp::kMul || op == BinOp::kAnd ||
+           op == BinOp::kOr || op == BinOp::kXor) &&
+          right < left)
+        std::swap(left, right);
+      key += "(" + std::to_string((int)op) + " " + left + " " + right + ")";
+      return true;
+    }
+    if (auto *m = std::get_if<MemExp *>(&e)) {
+      bool inner = false;
+      derived |= (*m)->pointer;
+      key += "[";
+      if (!this->key((*m)->addr, key, inner))
+        return false;
+      key += "]";
+      if (!(*m)->immutable)
+        key += std::to_string(epoch_);
+      if ((*m)->pointer)
+        key += "p";
+      if ((*m)->byte)
+        key += "b";
+      return true;
+    }
+    return false;
+  }
+
+  void number(uint32_t b) {
+    auto &block = blocks_[b];
+    auto lead = [&](TempExp *t) -> Exp {
+      Temp l = leader(t->temp);
+      return l == t->temp ? Exp(t) : TempE(arena_, l);
+    };
+    std::vector<std::string> added;
+    auto &phis = block.phis;
+    for (size_t i = 0; i < phis.size();) {
+      Temp dst = phis[i].dst;
+      // An argument from a block not walked yet, along a loop's back edge,
+      // has no number yet. One that's the phi itself, the value not
+      // changing around the loop, doesn't count.
+      bool known = true, same = true;
+      std::optional<Temp> only;
+      std::string k = std::string("phi ") + block.label.name();
+      for (auto &[label, arg] : phis[i].args) {
+        arg = map(arena_, arg, lead);
+        auto *t = std::get_if<TempExp *>(&arg);
+        if (t && (*t)->temp == dst)
+          continue;
+        known &= walked_[index_.at(label)];
+        bool derived = false;
+        k += " ";
+        key(arg, k, derived);
+        if (!t || (only && *only != (*t)->temp))
+          same = false;
+        else
+          only = (*t)->temp;
+      }
+      std::optional<Temp> found;
+      if (known && same && only) {
+        found = only;
+      } else if (auto it = available_.find(k);
+                 known && it != available_.end()) {
+        found = it->second;
+      }
+      if (!found || !can_replace(*found, dst)) {
+        if (known && available_.emplace(k, dst).second)
+          added.push_back(k);
+        i++;
+        continue;
+      }
+      leader_[dst.id()] = *found;
+      stats_.redundant++;
+      phis.erase(phis.begin() + i);
+    }
+    epoch_++;
+    auto &stms = block.stms;
+    for (size_t i = 0; i < stms.size();) {
+      Stm s = stms[i] = map(arena_, stms[i], lead);
+      if (stores(s))
+        epoch_++;
+      auto *d = def_of(s);
+      if (!d || is_reg(d->temp)) {
+        i++;
+        continue;
+      }
+      Exp src = src_of(s);
+      if (auto *t = std::get_if<TempExp *>(&src)) {
+        // a copy, whose uses can use what it copies
+        if (!is_reg((*t)->temp) && can_replace((*t)->temp, d->temp)) {
+          leader_[d->temp.id()] = (*t)->temp;
+          stms.erase(stms.begin() + i);
+          continue;
+        }
+        i++;
+        continue;
+      }
+      std::string k;
+      bool derived = false;
+      if (std::holds_alternative<ConstExp *>(src) ||
+          std::holds_alternative<NameExp *>(src) || !key(src, k, derived) ||
+          (derived && !std::holds_alternative<MemExp *>(src))) {
+        i++;
+        continue;
+      }
+      auto it = available_.find(k);
+      if (it != available_.end() && can_replace(it->second, d->temp)) {
+        leader_[d->temp.id()] = it->second;
+        stats_.redundant++;
+        stms.erase(stms.begin() + i);
+        continue;
+      }
+      if (available_.emplace(k, d->temp).second)
+        added.push_back(k);
+      i++;
+    }
+    walked_[b] = true;
+    for (auto c : children_[b])
+      number(c);
+    for (auto &k : added)
+      available_.erase(k);
+  }
+
+  // Global value numbering, by a walk of the dominator tree in which an
+  // expression computed in a dominating block is found available; its uses
+  // then use the temp it was first assigned to. Arguments of phis along
+  // back edges, and uses in blocks walked before what they use is found
+  // redundant, are given their numbers after the walk.
+  void gvn() {
+    uint32_t temps = frame_.num_temps();
+    leader_.resize(temps);
+    for (uint32_t t = 0; t < temps; t++)
+      leader_[t] = Temp(t);
+    walked_.assign(blocks_.size(), false);
+    number(0);
+    auto lead = [&](TempExp *t) -> Exp {
+      Temp l = leader(t->temp);
+      return l == t->temp ? Exp(t) : TempE(arena_, l);
+    };
+    for (auto &block : blocks_) {
+      for (auto &phi : block.phis) {
+        for (auto &arg : phi.args)
+          arg.second = map(arena_, arg.second, lead);
+      }
+      for (auto &s : block.stms)
+        s = map(arena_, s, lead);
+    }
+  }
+
+  // LICM, for one loop: the blocks in it, and whether any of them stores
+  // to memory
+  std::vector<char> in_loop_;
+  bool loop_stores_{false};
+  std::vector<uint32_t> def_block_;
+  // what's been moved to the preheader, by the key of the expression
+  std::unordered_map<std::string, Temp> hoisted_;
+  std::vector<Stm> moved_;
+
+  bool invariant(Temp t) const {
+    if (is_reg(t))
+      return t == frame_.fp();
+    return t.id() >= def_block_.size() || def_block_[t.id()] == kNone ||
+           !in_loop_[def_block_[t.id()]];
+  }
+
+  // Whether e can be computed before the loop: it has no effects, reads
+  // nothing the loop changes, and can't fault, unless `early` says it
+  // would have been computed before the loop did anything else anyway.
+  // `derived` is as for key().
+  bool movable(Exp e, bool early, bool &derived) const {
+    if (std::holds_alternative<ConstExp *>(e) ||
+        std::holds_alternative<NameExp *>(e))
+      return true;
+    if (auto *t = std::get_if<TempExp *>(&e)) {
+      derived |= frame_.is_pointer((*t)->temp);
+      return invariant((*t)->temp);
+    }
+    if (auto *b = std::get_if<BinopExp *>(&e))
+      return ((*b)->op != BinOp::kDiv || safe_divisor((*b)->right)) &&
+             movable((*b)->left, early, derived) &&
+             movable((*b)->right, early, derived);
+    if (auto *m = std::get_if<MemExp *>(&e)) {
+      bool inner = false;
+      derived |= (*m)->pointer;
+      return ((*m)->immutable || !loop_stores_) &&
+             (early || safe_address((*m)->addr, frame_.fp())) &&
+             movable((*m)->addr, early, inner);
+    }
+    return false;
+  }
+
+  // Whether computing e once rather than on each iteration saves more than
+  // the register its value takes: it loads, or does more than one
+  // operation, or a multiplication or division
+  static bool worth_moving(Exp e) {
+    if (std::holds_alternative<MemExp *>(e))
+      return true;
+    auto *b = std::get_if<BinopExp *>(&e);
+    if (!b)
+      return false;
+    auto leaf = [](Exp x) {
+      return std::holds_alternative<TempExp *>(x) ||
+             std::holds_alternative<ConstExp *>(x) ||
+             std::holds_alternative<NameExp *>(x);
+    };
+    return (*b)->op == BinOp::kMul || (*b)->op == BinOp::kDiv ||
+           !leaf((*b)->left) || !leaf((*b)->right);
+  }
+
+  // e with the largest parts of it that can be moved out of the loop
+  // replaced by temps computed in the preheader
+  Exp hoist(Exp e, bool early) {
+    bool derived = false;
+    if (worth_moving(e) && movable(e, early, derived) &&
+        (!derived || std::holds_alternative<MemExp *>(e))) {
+      std::string k;
+      bool ignored = false;
+      key(e, k, ignored);
+      auto [it, added] = hoisted_.emplace(k, Temp());
+      if (added) {
+        auto *m = std::get_if<MemExp *>(&e);
+        it->second = frame_.new_temp(m && (*m)->pointer);
+        moved_.push_back(Move(arena_, TempE(arena_, it->second), e));
+      }
+      stats_.hoisted++;
+      return TempE(arena_, it->second);
+    }
+    if (auto *b = std::get_if<BinopExp *>(&e)) {
+      Exp left = hoist((*b)->left, early), right = hoist((*b)->right, early);
+      if (left == (*b)->left && right == (*b)->right)
+        return e;
+      return Binop(arena_, (*b)->op, left, right);
+    }
+    if (auto *m = std::get_if<MemExp *>(&e)) {
+      Exp addr = hoist((*m)->addr, early);
+      if (addr == (*m)->addr)
+        return e;
+      auto *mem = arena_.New<MemExp>(**m);
+      mem->addr = addr;
+      return mem;
+    }
+    if (auto *c = std::get_if<CallExp *>(&e)) {
+      std::vector<Exp> args;
+      bool changed = false;
+      for (auto &arg : (*c)->args) {
+        args.push_back(hoist(arg, early));
+        changed |= args.back() != arg;
+      }
+      if (!changed)
+        return e;
+      auto *call = arena_.New<CallExp>(**c);
+      call->args = make_seq(arena_, args);
+      return call;
+    }
+    return e;
+  }
+
+  Stm hoist(Stm s, bool early) {
+    if (auto *m = std::get_if<MoveStm *>(&s)) {
+      Exp dst = (*m)->dst;
+      if (auto *mem = std::get_if<MemExp *>(&dst)) {
+        // the address of a store, not the store
+        Exp addr = hoist((*mem)->addr, early);
+        if (addr != (*mem)->addr) {
+          auto *copy = arena_.New<MemExp>(**mem);
+          copy->addr = addr;
+          dst = copy;
+        }
+      }
+      Exp src = hoist((*m)->src, early);
+      if (dst == (*m)->dst && src == (*m)->src)
+        return s;
+      return Move(arena_, dst, src);
+    }
+    if (auto *e = std::get_if<ExpStm *>(&s)) {
+      Exp exp = hoist((*e)->exp, early);
+      return exp == (*e)->exp ? s : ExpS(arena_, exp);
+    }
+    if (auto *c = std::get_if<CjumpStm *>(&s)) {
+      Exp left = hoist((*c)->left, early), right = hoist((*c)->right, early);
+      if (left == (*c)->left && right == (*c)->right)
+        return s;
+      return Cjump(arena_, (*c)->op, left, right, (*c)->t, (*c)->f);
+    }
+    return s;
+  }
+
+  // Moves what one loop computes the same on every iteration to its
+  // preheader
+  void hoist_loop(uint32_t header, const std::vector<uint32_t> &body) {
+    uint32_t n = blocks_.size();
+    uint32_t pre = kNone;
+    for (auto p : blocks_[header].preds) {
+      if (in_loop_[p])
+        continue;
+      if (pre != kNone)
+        return;
+      pre = p;
+    }
+    if (pre == kNone || blocks_[pre].succs.size() != 1)
+      return;
+    loop_stores_ = false;
+    std::vector<uint32_t> exits;
+    for (auto b : body) {
+      for (auto s : blocks_[b].stms)
+        loop_stores_ |= stores(s);
+      bool exit = false;
+      for (auto s : blocks_[b].succs)
+        exit |= (!in_loop_[s] && !ends(blocks_[s])) || s == header;
+      if (exit)
+        exits.push_back(b);
+    }
+    // A load is early if the loop reaches it on every way around or out of
+    // it, and before any call; then it would fault, if it could, before
+    // the loop does anything. A call that doesn't return, as to report a
+    // subscript out of range, isn't a way out.
+    std::vector<char> clean(n);
+    for (auto b : rpo_) {
+      if (!in_loop_[b])
+        continue;
+      bool in = true;
+      if (b != header) {
+        for (auto p : blocks_[b].preds)
+          in &= in_loop_[p] && clean[p];
+      }
+      for (auto s : blocks_[b].stms)
+        in &= !call_of(s);
+      clean[b] = in;
+    }
+    for (auto b : rpo_) {
+      if (!in_loop_[b])
+        continue;
+      bool early = std::all_of(exits.begin(), exits.end(),
+                               [&](uint32_t x) { return dominates(b, x); });
+      if (b != header) {
+        for (auto p : blocks_[b].preds)
+          early &= clean[p];
+      }
+      for (auto &s : blocks_[b].stms) {
+        s = hoist(s, early);
+        early &= !call_of(s);
+      }
+    }
+    auto &stms = blocks_[pre].stms;
+    stms.insert(stms.end() - 1, moved_.begin(), moved_.end());
+    def_block_.resize(frame_.num_temps(), kNone);
+    for (auto s : moved_)
+      def_block_[def_of(s)->temp.id()] = pre;
+  }
+
+  // Loop-invariant code motion, from the innermost loops out, so that
+  // what's moved out of a loop can be moved out of the one around it too
+  void licm() {
+    uint32_t n = blocks_.size();
+    std::vector<std::pair<uint32_t, std::vector<uint32_t>>> loops;
+    for (uint32_t h = 0; h < n; h++) {
+      std::vector<uint32_t> body{h}, work;
+      std::vector<char> in(n);
+      in[h] = true;
+      for (auto p : blocks_[h].preds) {
+        if (dominates(h, p) && !in[p]) {
+          in[p] = true;
+          work.push_back(p);
+        }
+      }
+      if (work.empty())
+        continue;
+      while (!work.empty()) {
+        uint32_t b = work.back();
+        work.pop_back();
+        body.push_back(b);
+        for (auto p : blocks_[b].preds) {
+          if (!in[p]) {
+            in[p] = true;
+            work.push_back(p);
+          }
+        }
+      }
+      loops.emplace_back(h, std::move(body));
+    }
+    std::stable_sort(loops.begin(), loops.end(), [](auto &a, auto &b) {
+      return a.second.size() < b.second.size();
+    });
+    def_block_ = def_blocks();
+    for (auto &[header, body] : loops) {
+      in_loop_.assign(n, false);
+      for (auto b : body)
+        in_loop_[b] = true;
+      hoisted_.clear();
+      moved_.clear();
+      hoist_loop(header, body);
+    }
+  }
+
+  // Whether s has an effect, or can fault. The moves from registers are
+  // kept too: they include those saving the callee-saved ones, which the
+  // frame restores from the temps directly.
+  bool critical(Stm s) const {
+    auto *d = def_of(s);
+    if (!d || is_reg(d->temp))
+      return true;
+    Exp src = src_of(s);
+    auto *t = std::get_if<TempExp *>(&src);
+    return may_trap(src, frame_.fp()) || (t && is_reg((*t)->temp));
+  }
+
+  // Dead code elimination: marks the statements with effects, and then the
+  // assignments of what they use, and so on; the rest go
+  void dce() {
+    uint32_t temps = frame_.num_temps();
+    // where each temp is assigned: the block, and the statement, or the
+    // phi counted back from -1
+    std::vector<std::pair<uint32_t, int64_t>> defs(temps, {kNone, 0});
+    std::vector<std::vector<char>> live_stms(blocks_.size()),
+        live_phis(blocks_.size());
+    for (uint32_t b = 0; b < blocks_.size(); b++) {
+      auto &block = blocks_[b];
+      live_stms[b].assign(block.stms.size(), false);
+      live_phis[b].assign(block.phis.size(), false);
+      for (size_t i = 0; i < block.phis.size(); i++)
+        defs[block.phis[i].dst.id()] = {b, -1 - (int64_t)i};
+      for (size_t i = 0; i < block.stms.size(); i++) {
+        if (auto *d = def_of(block.stms[i]))
+          defs[d->temp.id()] = {b, (int64_t)i};
+      }
+    }
+    std::vector<uint32_t> work;
+    std::vector<char> used(temps);
+    auto use = [&](Temp t) {
+      if (t.id() < temps && !used[t.id()]) {
+        used[t.id()] = true;
+        work.push_back(t.id());
+      }
+    };
+    for (uint32_t b = 0; b < blocks_.size(); b++) {
+      auto &stms = blocks_[b].stms;
+      for (size_t i = 0; i < stms.size(); i++) {
+        if (critical(stms[i])) {
+          live_stms[b][i] = true;
+          for_each_use(stms[i], use);
+        }
+      }
+    }
+    while (!work.empty()) {
+      auto [b, i] = defs[work.back()];
+      work.pop_back();
+      if (b == kNone)
+        continue;
+      if (i < 0) {
+        live_phis[b][-1 - i] = true;
+        for (auto &arg : blocks_[b].phis[-1 - i].args)
+          for_each_use(arg.second, use);
+      } else if (!live_stms[b][i]) {
+        live_stms[b][i] = true;
+        for_each_use(blocks_[b].stms[i], use);
+      }
+    }
+    for (uint32_t b = 0; b < blocks_.size(); b++) {
+      auto &block = blocks_[b];
+      std::vector<Phi> phis;
+      for (size_t i = 0; i < block.phis.size(); i++) {
+        if (live_phis[b][i])
+          phis.push_back(std::move(block.phis[i]));
+        else
+          stats_.dead++;
+      }
+      block.phis = std::move(phis);
+      std::vector<Stm> stms;
+      for (size_t i = 0; i < block.stms.size(); i++) {
+        Stm s = block.stms[i];
+        auto *d = def_of(s);
+        if (live_stms[b][i] || !d) {
+          stms.push_back(s);
+        } else if (has_call(src_of(s))) {
+          // the call stays, but its result isn't used
+          stms.push_back(ExpS(arena_, src_of(s)));
+        } else {
+          stats_.dead++;
+        }
+      }
+      block.stms = std::move(stms);
+    }
+  }
+
+public:
+  Function(Arena &arena, frame::Frame &frame, Stats &stats,
+           canon::Blocks blocks)
+      : arena_(arena), frame_(frame), stats_(stats), done_(blocks.done) {
+    for (auto &stms : blocks.blocks) {
+      Block b;
+      b.label = std::get<LabelStm *>(stms.front())->label;
+      b.stms.assign(stms.begin() + 1, stms.end());
+      blocks_.push_back(std::move(b));
+    }
+    link();
+  }
+
+  void optimize(const Options &options) {
+    prune();
+    shape();
+    to_ssa();
+    if (options.sccp)
+      sccp();
+    if (options.gvn)
+      gvn();
+    if (options.licm)
+      licm();
+    if (options.dce)
+      dce();
+    from_ssa();
+  }
+
+  canon::Blocks blocks() const {
+    canon::Blocks out{{}, done_};
+    for (auto &block : blocks_) {
+      std::vector<Stm> stms{LabelS(arena_, block.label)};
+      stms.insert(stms.end(), block.stms.begin(), block.stms.end());
+      out.blocks.push_back(std::move(stms));
+    }
+    return out;
+  }
+};
+} // namespace
+
+canon::Blocks optimize(absyn::Arena &arena, frame::Frame &frame,
+                       canon::Blocks blocks, const Options &options,
+                       Stats *stats) {
+  if (!options.any() || blocks.blocks.empty())
+    return blocks;
+  Stats ignored;
+  Function f(arena, frame, stats ? *stats : ignored, std::move(blocks));
+  f.optimize(options);
+  return f.blocks();
+}
+
+} // namespace ssa
@@ -0,0 +1,54 @@
+#ifndef SSA_H
+#define SSA_H
+#include "arena.h"
+#include "canon.h"
+#include "frame.h"
+#include <cstddef>
+
+// Optimization of a function's IR in static single assignment form, between
+// canon's basic blocks and trace scheduling. The form is built as Cytron et
+// al. describe: a temp the function assigns more than once is given a new
+// name for each assignment, with phi functions joining the names at the
+// dominance frontiers of the blocks assigning it, pruned to where it's live.
+// It's left again by copies at the ends of the blocks before each join,
+// which the register allocator mostly coalesces away. Temps assigned once
+// are already in the form, and keep their names.
+namespace ssa {
+
+// The passes to run, in this order
+struct Options {
+  // sparse conditional constant propagation (Wegman and Zadeck), which
+  // also drops the blocks no constant branch reaches
+  bool sccp{true};
+  // global value numbering over the dominator tree, and copy propagation
+  bool gvn{true};
+  // loop-invariant code motion to a preheader made for each loop
+  bool licm{true};
+  // dead code elimination
+  bool dce{true};
+  bool any() const { return sccp || gvn || licm || dce; }
+};
+
+// What the passes did, summed over the functions optimized
+struct Stats {
+  // temps found to be constant, and conditional jumps to go one way
+  size_t constants{0}, branches{0};
+  // values found to have been computed already
+  size_t redundant{0};
+  // expressions moved out of loops
+  size_t hoisted{0};
+  // assignments of values nothing uses
+  size_t dead{0};
+};
+
+// Runs the passes `options` says on the blocks of a function, as
+// canon::basic_blocks() leaves them, returning blocks of the same form. A
+// load is only moved to where it runs sooner than it did if it can't fault
+// there, or would have run before anything else the loop does, so a
+// program that dereferences nil still crashes where it did.
+canon::Blocks optimize(absyn::Arena &arena, frame::Frame &frame,
+                       canon::Blocks blocks, const Options &options,
+                       Stats *stats = nullptr);
+
+} // namespace ssa
+#endif
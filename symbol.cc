@@ -1,71 +1,54 @@
 #include "symbol.h"
 #include <cstdint>
-#include <cstdlib>
 #include <cstring>
-#include <unordered_set>
 
 namespace {
-class Hash {
-  using T = const char *;
-
-public:
-  uint32_t operator()(const T &str) const {
-    uint32_t hash = 2166136261u;
-    for (int i = 0; str[i] != '\0'; i++) {
-      hash ^= static_cast<uint8_t>(str[i]);
-      hash *= 16777619;
-    }
-    return hash;
-  }
-};
-class Pred {
-  using T = const char *;
-
-public:
-  bool operator()(const T &lhs, const T &rhs) const {
-    return strcmp(lhs, rhs) == 0;
+uint32_t fnv1a(std::string_view str) {
+  uint32_t hash = 2166136261u;
+  for (char c : str) {
+    hash ^= static_cast<uint8_t>(c);
+    hash *= 16777619;
   }
-};
-std::unordered_set<const char *, Hash, Pred> registry;
+  return hash;
+}
 } // namespace
 
 namespace symbol {
 
-// Strings passed to this constructor are allocated by the lexer. If it's new,
-// it's stashed away in the registry. Symbol itself doesn't own the string --
-// the registry does. If the string (the same sequence of characters, not the
-// same pointer) was seen before, it's released and the previously seen string
-// is used, guaranteeing uniqueness.
-Symbol::Symbol(const char *val) {
-  if (val == nullptr) {
-    this->val = nullptr;
-    return;
-  }
-  auto it = registry.find(val);
-  if (it == registry.end()) {
-    registry.insert(val);
-    this->val = val;
-  } else {
-    this->val = *it;
-    std::free(const_cast<char *>(val));
+void Registry::rehash() {
+  std::vector<Symbol::Entry *> slots(slots_.empty() ? 256 : slots_.size() * 2);
+  uint32_t mask = slots.size() - 1;
+  for (auto &e : entries_) {
+    uint32_t i = e.hash & mask;
+    while (slots[i])
+      i = (i + 1) & mask;
+    slots[i] = &e;
   }
+  slots_.swap(slots);
 }
 
-uint32_t Hash::operator()(const Symbol &s1) const {
-  return ::Hash{}(s1.name());
-}
-
-bool Pred::operator()(const Symbol &s1, const Symbol &s2) const {
-  return ::Pred{}(s1.name(), s2.name());
-}
-
-void Symbol::FreeAll() {
-  for (auto *str : registry) {
-    std::free(const_cast<char *>(str));
+// Symbol itself doesn't own the string -- the registry does. If the string
+// (the same sequence of characters, not the same pointer) was seen before,
+// the previously interned copy is used, guaranteeing uniqueness.
+Symbol Registry::intern(std::string_view str) {
+  if ((entries_.size() + 1) * 2 > slots_.size())
+    rehash();
+  uint32_t hash = fnv1a(str);
+  uint32_t mask = slots_.size() - 1;
+  uint32_t i = hash & mask;
+  for (; slots_[i]; i = (i + 1) & mask) {
+    auto *e = slots_[i];
+    if (e->hash == hash && e->len == str.size() &&
+        std::memcmp(e->name, str.data(), str.size()) == 0)
+      return Symbol(e);
   }
-  // remove the dangling pointers; all existing Symbols are invalid now except
-  // for equality comparison
-  registry.clear();
+  char *name = names_.NewArray<char>(str.size() + 1);
+  std::memcpy(name, str.data(), str.size());
+  name[str.size()] = '\0';
+  auto id = static_cast<uint32_t>(entries_.size());
+  slots_[i] = &entries_.emplace_back(
+      Symbol::Entry{name, static_cast<uint32_t>(str.size()), id, hash});
+  return Symbol(slots_[i]);
 }
 
 } // namespace symbol
@@ -1,60 +1,195 @@
 #ifndef SYMBOL_H
 #define SYMBOL_H
+#include "arena.h"
+#include <algorithm>
+#include <atomic>
 #include <cstdint>
-#include <forward_list>
+#include <deque>
 #include <optional>
-#include <unordered_map>
+#include <string_view>
+#include <utility>
+#include <vector>
 
 namespace symbol {
 
 class Symbol {
-  const char *val;
+public:
+  // One per distinct string, owned by the registry
+  struct Entry {
+    const char *name;
+    uint32_t len;
+    uint32_t id;
+    uint32_t hash;
+  };
+
+  // Left uninitialized; only for slots that are assigned before use, such
+  // as the parser's semantic values
+  Symbol() = default;
+  // The null symbol, standing for an absent name
+  explicit constexpr Symbol(std::nullptr_t) : entry_(nullptr) {}
+  bool operator==(const Symbol &other) const { return entry_ == other.entry_; }
+  bool operator!=(const Symbol &other) const { return entry_ != other.entry_; }
+  explicit operator bool() const { return entry_ != nullptr; }
+
+  // get the underlying string; invalid once the registry is destroyed
+  const char *name() const { return entry_ ? entry_->name : nullptr; }
+  // dense index in [0, Registry::size()), usable as a key into flat side
+  // tables
+  uint32_t id() const { return entry_->id; }
+  uint32_t hash() const { return entry_->hash; }
+
+private:
+  const Entry *entry_;
+  explicit Symbol(const Entry *entry) : entry_(entry) {}
+  friend class Registry;
+};
 
+// Interns strings as Symbols. Each compilation has a registry of its own, so
+// IDs are dense within it and no locking is needed. The hash of each string
+// is computed once, when it's first seen, and the string is copied into the
+// registry's arena only then; interning a known string allocates nothing.
+class Registry {
 public:
-  explicit Symbol(const char *);
-  bool operator==(const Symbol &other) const { return val == other.val; }
-  explicit operator bool() const { return val != nullptr; }
+  Registry() = default;
+  Registry(const Registry &) = delete;
+  Registry &operator=(const Registry &) = delete;
 
-  // get the underlying string; invalid after calling FreeAll
-  const char *name() const { return val; }
+  Symbol intern(std::string_view str);
+  // number of symbols interned so far
+  uint32_t size() const { return entries_.size(); }
 
-  // release all strings from the registry
-  static void FreeAll();
+private:
+  std::deque<Symbol::Entry> entries_;
+  // open-addressing hash set of the entries
+  std::vector<Symbol::Entry *> slots_;
+  absyn::Arena names_;
+
+  void rehash();
 };
 
 class Hash {
 public:
-  uint32_t operator()(const Symbol &) const;
+  uint32_t operator()(const Symbol &s) const { return s.hash(); }
 };
 
 class Pred {
 public:
-  bool operator()(const Symbol &lhs, const Symbol &rhs) const;
+  bool operator()(const Symbol &lhs, const Symbol &rhs) const {
+    return lhs == rhs;
+  }
+};
+
+// A set of symbols backed by an array indexed by symbol ID. Clearing only
+// bumps a generation counter, so one instance can be reused indefinitely.
+class Set {
+  std::vector<uint32_t> marks_;
+  uint32_t gen_{1};
+
+public:
+  bool insert(Symbol s) {
+    if (s.id() >= marks_.size())
+      marks_.resize(std::max<size_t>(marks_.size() * 2, s.id() + 1));
+    if (marks_[s.id()] == gen_)
+      return false;
+    marks_[s.id()] = gen_;
+    return true;
+  }
+  bool contains(Symbol s) const {
+    return s.id() < marks_.size() && marks_[s.id()] == gen_;
+  }
+  void clear() {
+    if (++gen_ == 0) {
+      std::fill(marks_.begin(), marks_.end(), 0);
+      gen_ = 1;
+    }
+  }
+};
+
+// Counts the lookups made in the tables that share it, and how many scopes
+// each one would have searched if every scope had a map of its own: those
+// from the innermost out to the binding's, or all of them for a miss.
+struct LookStats {
+  std::atomic<uint64_t> looks{0}, scopes{0};
+
+  void record(uint32_t depth) {
+    looks.fetch_add(1, std::memory_order_relaxed);
+    scopes.fetch_add(depth, std::memory_order_relaxed);
+  }
 };
 
+// A scoped symbol table in the style of Appel's imperative environments.
+// Every binding ever entered sits on one stack; the stack doubles as the undo
+// log for scopes. head_, indexed by symbol ID, points at the innermost live
+// binding of each symbol, and each binding points at the one it shadows.
+// Lookup is one array access at any nesting depth, and entering or leaving a
+// scope doesn't allocate once the stacks have grown to their working size.
+//
+// A table can be layered over a parent, which then answers lookups for the
+// symbols the table doesn't bind itself. Several threads can each work in
+// their own layer over one parent as long as nothing changes the parent.
 template <typename T> class Table {
 public:
-  using MapType = std::unordered_map<Symbol, T, Hash, Pred>;
-  using value_type = typename MapType::value_type;
+  using value_type = std::pair<Symbol, T>;
   Table() { begin_scope(); }
-  bool enter(const value_type &v) { return table_.front().insert(v).second; }
+  explicit Table(const Table *parent)
+      : parent_(parent), stats_(parent->stats_) {
+    begin_scope();
+  }
+  // Counts lookups from now on, including those of tables layered on this
+  void set_stats(LookStats *stats) { stats_ = stats; }
+  bool enter(const value_type &v) { return enter(value_type(v)); }
   bool enter(value_type &&v) {
-    return table_.front().insert(std::move(v)).second;
+    uint32_t id = v.first.id();
+    if (id >= head_.size())
+      head_.resize(std::max<size_t>(head_.size() * 2, id + 1), kNone);
+    int shadowed = head_[id];
+    if (shadowed != kNone && bindings_[shadowed].depth == marks_.size())
+      return false;
+    head_[id] = bindings_.size();
+    bindings_.push_back({v.first, std::move(v.second), shadowed,
+                         static_cast<uint32_t>(marks_.size())});
+    return true;
   }
-  std::optional<T> look(Symbol s) {
-    for (auto env = table_.begin(); env != table_.end(); env++) {
-      auto it = env->find(s);
-      if (it != env->end())
-        return it->second;
+  std::optional<T> look(Symbol s) const {
+    uint32_t depth = 0;
+    for (const Table *t = this; t; t = t->parent_) {
+      if (s.id() < t->head_.size() && t->head_[s.id()] != kNone) {
+        auto &b = t->bindings_[t->head_[s.id()]];
+        if (stats_)
+          stats_->record(depth + t->marks_.size() - b.depth + 1);
+        return b.value;
+      }
+      depth += t->marks_.size();
     }
+    if (stats_)
+      stats_->record(depth);
     return std::optional<T>{};
   }
 
 private:
-  std::forward_list<MapType> table_;
+  static constexpr int kNone = -1;
+  struct Binding {
+    Symbol sym;
+    T value;
+    int shadowed;
+    uint32_t depth;
+  };
+  std::vector<int> head_;
+  std::vector<Binding> bindings_;
+  // size of bindings_ when each open scope began
+  std::vector<uint32_t> marks_;
+  const Table *parent_{nullptr};
+  LookStats *stats_{nullptr};
 
-  void begin_scope() { table_.push_front(MapType{}); }
-  void end_scope() { table_.pop_front(); }
+  void begin_scope() { marks_.push_back(bindings_.size()); }
+  void end_scope() {
+    for (size_t n = marks_.back(); bindings_.size() > n;) {
+      auto &b = bindings_.back();
+      head_[b.sym.id()] = b.shadowed;
+      bindings_.pop_back();
+    }
+    marks_.pop_back();
+  }
   template <typename> friend class Scope;
 };
 
@@ -0,0 +1,226 @@
+#ifndef TAIL_H
+#define TAIL_H
+#include "absyn.h"
+#include "diagnostics.h"
+#include "symbol.h"
+#include <algorithm>
+#include <cstddef>
+#include <string>
+#include <unordered_map>
+#include <variant>
+#include <vector>
+
+namespace absyn {
+
+// The calls find_tail_calls() marked, and the recursive ones it warned of
+struct TailCounts {
+  size_t tail{0};
+  size_t recursive{0};
+};
+
+// Sets CallExprAST::tail on each call to a function of the program that's
+// in tail position in the body of the function it's made from: the body
+// itself, the last expression of a sequence, either branch of an if or the
+// body of a let in tail position. Nothing is left to do after such a call
+// but return what it returns, so -S compiles it to a jump that reuses the
+// caller's frame, and the VM to a TailCall. Marks every call afresh, so it
+// can run again after the program is rewritten. If `warnings` is given, a
+// recursive call that isn't in tail position, one to a function that can
+// call the caller back, is warned of there.
+TailCounts find_tail_calls(ExprAST &e, Diagnostics *warnings = nullptr);
+
+namespace detail {
+
+class TailFinder {
+  // The function each name in scope means, or null for a variable
+  symbol::Table<FundecTy *> env_;
+  // the function whose body is being walked, null outside any
+  FundecTy *current_{nullptr};
+  // whether the expression being walked is in tail position
+  bool tail_{false};
+  // the calls each function makes, not counting those from functions
+  // nested in it, and the calls not in tail position
+  std::unordered_map<FundecTy *, std::vector<FundecTy *>> callees_;
+  struct Site {
+    CallExprAST *call;
+    FundecTy *caller, *callee;
+  };
+  std::vector<Site> sites_;
+  TailCounts &counts_;
+
+  // for finding the cycles of the call graph
+  struct Node {
+    int index{-1}, low{0}, component{-1};
+    bool on_stack{false};
+  };
+  std::unordered_map<FundecTy *, Node> nodes_;
+  std::vector<FundecTy *> stack_;
+  int next_index_{0}, components_{0};
+
+  // Tarjan's algorithm; the map's nodes stay put as it grows
+  void connect(FundecTy *f) {
+    auto &node = nodes_[f];
+    node.index = node.low = next_index_++;
+    node.on_stack = true;
+    stack_.push_back(f);
+    for (auto *g : callees_[f]) {
+      auto &next = nodes_[g];
+      if (next.index < 0) {
+        connect(g);
+        node.low = std::min(node.low, next.low);
+      } else if (next.on_stack) {
+        node.low = std::min(node.low, next.index);
+      }
+    }
+    if (node.low != node.index)
+      return;
+    FundecTy *g;
+    do {
+      g = stack_.back();
+      stack_.pop_back();
+      nodes_[g].on_stack = false;
+      nodes_[g].component = components_;
+    } while (g != f);
+    components_++;
+  }
+
+public:
+  explicit TailFinder(TailCounts &counts) : counts_(counts) {}
+  void find(ExprAST &e, bool tail = false) {
+    bool outer = tail_;
+    tail_ = tail;
+    std::visit(*this, e);
+    tail_ = outer;
+  }
+  void find(VarAST &v) {
+    bool outer = tail_;
+    tail_ = false;
+    std::visit(*this, v);
+    tail_ = outer;
+  }
+  void find(DeclAST &d) { std::visit(*this, d); }
+
+  // Warns of the calls not in tail position from a function to one in the
+  // same cycle of the call graph
+  void warn(Diagnostics &warnings) {
+    for (auto &site : sites_) {
+      if (nodes_[site.caller].index < 0)
+        connect(site.caller);
+      if (nodes_[site.caller].component != nodes_[site.callee].component)
+        continue;
+      counts_.recursive++;
+      warnings.warning(site.call->pos,
+                       "Recursive call to '" +
+                           std::string(site.call->func.name()) +
+                           "' is not in tail position");
+    }
+  }
+
+  void operator()(SimpleVarAST *) {}
+  void operator()(FieldVarAST *v) { find(v->var); }
+  void operator()(IndexVarAST *v) {
+    find(v->var);
+    find(v->index);
+  }
+
+  void operator()(VarExprAST *e) { find(e->var); }
+  void operator()(NilExprAST *) {}
+  void operator()(IntExprAST *) {}
+  void operator()(StringExprAST *) {}
+  void operator()(CallExprAST *e) {
+    auto entry = env_.look(e->func);
+    FundecTy *callee = entry ? *entry : nullptr;
+    e->tail = tail_ && current_ && callee;
+    counts_.tail += e->tail;
+    if (current_ && callee) {
+      callees_[current_].push_back(callee);
+      if (!e->tail)
+        sites_.push_back({e, current_, callee});
+    }
+    for (auto &arg : e->args)
+      find(arg.exp);
+  }
+  void operator()(OpExprAST *e) {
+    find(e->lhs);
+    find(e->rhs);
+  }
+  void operator()(RecordExprAST *e) {
+    for (auto &field : e->fields)
+      find(field.value);
+  }
+  void operator()(ArrayExprAST *e) {
+    find(e->size);
+    find(e->init);
+  }
+  void operator()(SeqExprAST *e) {
+    bool tail = tail_;
+    for (size_t i = 0; i < e->exps.size(); i++)
+      find(e->exps[i].exp, tail && i + 1 == e->exps.size());
+  }
+  void operator()(AssignExprAST *e) {
+    find(e->var);
+    find(e->exp);
+  }
+  void operator()(IfExprAST *e) {
+    bool tail = tail_;
+    find(e->cond);
+    find(e->then, tail);
+    if (e->else_)
+      find(*e->else_, tail);
+  }
+  void operator()(WhileExprAST *e) {
+    find(e->cond);
+    find(e->body);
+  }
+  void operator()(ForExprAST *e) {
+    find(e->lo);
+    find(e->hi);
+    symbol::Scope scope(env_);
+    env_.enter({e->var, nullptr});
+    find(e->body);
+  }
+  void operator()(BreakExprAST *) {}
+  void operator()(LetExprAST *e) {
+    bool tail = tail_;
+    symbol::Scope scope(env_);
+    for (auto &dec : e->decs)
+      find(dec);
+    find(e->body, tail);
+  }
+  void operator()(UnitExprAST *) {}
+  void operator()(ErrorExprAST *) {}
+
+  void operator()(TypeDeclAST *) {}
+  void operator()(VarDeclAST *d) {
+    // the initializer can't see the variable
+    find(d->init);
+    env_.enter({d->name, nullptr});
+  }
+  void operator()(FuncDeclAST *d) {
+    for (auto &fundec : d->decls)
+      env_.enter({fundec.name, &fundec});
+    auto *outer = current_;
+    for (auto &fundec : d->decls) {
+      symbol::Scope scope(env_);
+      for (auto &param : fundec.params)
+        env_.enter({param.name, nullptr});
+      current_ = &fundec;
+      find(fundec.body, true);
+    }
+    current_ = outer;
+  }
+};
+
+} // namespace detail
+
+inline TailCounts find_tail_calls(ExprAST &e, Diagnostics *warnings) {
+  TailCounts counts;
+  detail::TailFinder finder(counts);
+  finder.find(e);
+  if (warnings)
+    finder.warn(*warnings);
+  return counts;
+}
+
+} // namespace absyn
+#endif
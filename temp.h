@@ -0,0 +1,46 @@
+#ifndef TEMP_H
+#define TEMP_H
+#include <cstdint>
+#include <functional>
+
+namespace temp {
+
+// A value held in a register, before registers are allocated. Temps are
+// numbered per function, from after the machine registers, which the frame
+// reserves the first numbers for; so a function can be translated without
+// coordinating with the others, including on another thread.
+class Temp {
+  uint32_t id_;
+
+public:
+  constexpr Temp() : id_(0) {}
+  constexpr explicit Temp(uint32_t id) : id_(id) {}
+  constexpr uint32_t id() const { return id_; }
+  constexpr bool operator==(Temp other) const { return id_ == other.id_; }
+  constexpr bool operator!=(Temp other) const { return id_ != other.id_; }
+};
+
+// A location in machine code. The name lives as long as the compilation and
+// is unique within it, so labels compare by the name's address.
+class Label {
+  const char *name_;
+
+public:
+  constexpr Label() : name_(nullptr) {}
+  constexpr explicit Label(const char *name) : name_(name) {}
+  constexpr const char *name() const { return name_; }
+  constexpr bool operator==(Label other) const { return name_ == other.name_; }
+  constexpr bool operator!=(Label other) const { return name_ != other.name_; }
+};
+
+} // namespace temp
+
+template <> struct std::hash<temp::Temp> {
+  size_t operator()(temp::Temp t) const { return t.id(); }
+};
+template <> struct std::hash<temp::Label> {
+  size_t operator()(temp::Label l) const {
+    return std::hash<const char *>()(l.name());
+  }
+};
+#endif
@@ -0,0 +1,45 @@
+#!/bin/sh
+# Runs each program in test/ that has a .out file on the VM and compiled,
+# and compares what it printed, followed by "exit" and its status, with
+# the .out file.
+#
+# Usage: test/run.sh [tiger] [build dir]
+tiger=${1:-./tiger}
+dir=${2:-build}
+cc=${CC:-cc}
+failed=0
+for out in test/*.out; do
+  name=$(basename "$out" .out)
+  for how in run native; do
+    if [ $how = run ]; then
+      "$tiger" --run "test/$name.tig" > "$dir/$name.stdout" 2> /dev/null
+    else
+      cp "test/$name.tig" "$dir/$name.tig" &&
+        "$tiger" -S "$dir/$name.tig" &&
+        $cc -o "$dir/$name" "$dir/$name.s" runtime/runtime.c &&
+        "$dir/$name" > "$dir/$name.stdout" 2> /dev/null
+    fi
+    echo "exit $?" >> "$dir/$name.stdout"
+    if ! cmp -s "$out" "$dir/$name.stdout"; then
+      echo "$name ($how) failed:"
+      diff "$out" "$dir/$name.stdout"
+      failed=1
+    fi
+  done
+done
+# Programs given together run one after another, in order, each reading
+# its own part of the input
+printf 'abcd' | "$tiger" -j2 --run test/run_first.tig test/run_second.tig \
+  > "$dir/run_order.stdout" 2> /dev/null
+echo "exit $?" >> "$dir/run_order.stdout"
+{
+  for i in $(seq 100); do echo 1 ab; done
+  for i in $(seq 100); do echo 2 cd; done
+  echo "exit 3"
+} > "$dir/run_order.out"
+if ! cmp -s "$dir/run_order.out" "$dir/run_order.stdout"; then
+  echo "run_first and run_second (run -j2) failed:"
+  diff "$dir/run_order.out" "$dir/run_order.stdout"
+  failed=1
+fi
+exit $failed
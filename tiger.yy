@@ -2,25 +2,25 @@
 %{
 #include "token.h"
 #include "absyn.h"
+#include "compilation.h"
 #include "location.h"
 
 // defined in lex.yy.cc
-int yylex(Token *yylval, Location *yylloc);
+int yylex(Token *yylval, Location *yylloc, void *scanner);
 
 using namespace absyn;
-// result of the parse
-uptr<ExprAST> parse_result;
 
 namespace yy {
-ExprAST *expseq_to_expr(ExprSeq *);
+ExprAST *expseq_to_expr(Compilation &, ExprSeq *);
 }
 
-#define E(type, ...) ExprAST{std::make_unique<type>(__VA_ARGS__)}
-#define V(type, ...) VarAST{std::make_unique<type>(__VA_ARGS__)}
-#define D(type, ...) DeclAST{std::make_unique<type>(__VA_ARGS__)}
-#define TV(type, ...) Ty{std::make_unique<type>(__VA_ARGS__)}
-#define TD(val) std::get<uptr<TypeDeclAST>>(val)
-#define FD(val) std::get<uptr<FuncDeclAST>>(val)
+// Every node, and every handle to one, is allocated in the compilation's
+// arena
+#define N(type, ...) comp.arena.New<type>(__VA_ARGS__)
+#define E(type, ...) N(ExprAST, N(type, __VA_ARGS__))
+#define V(type, ...) N(VarAST, N(type, __VA_ARGS__))
+#define D(type, ...) N(DeclAST, N(type, __VA_ARGS__))
+#define TV(type, ...) N(Ty, N(type, __VA_ARGS__))
 
 #define YYLLOC_DEFAULT(Current, Rhs, N)	 \
     do					 \
@@ -40,8 +40,11 @@ ExprAST *expseq_to_expr(ExprSeq *);
 %locations
 %define api.location.type {Location}
 %define api.value.type {Token}
+%define parse.error verbose
+%lex-param {void *scanner}
+%parse-param {void *scanner} {Compilation &comp}
 
-%token <str> ID
+%token <sym> ID
 %token <num> INT
 %token <str> STR
 %token NIL
@@ -62,7 +65,9 @@ ExprAST *expseq_to_expr(ExprSeq *);
 %nterm <field> field
 %nterm <exps> expseq exps argseq args
 %nterm <decls> decs
-%nterm <decl> dec vardec tydecs fundecs
+%nterm <decl> dec vardec
+%nterm <tydecs> tydecs
+%nterm <fundecs> fundecs
 %nterm <tydec> tydec
 %nterm <fundec> fundec
 %nterm <ty> ty
@@ -70,185 +75,184 @@ ExprAST *expseq_to_expr(ExprSeq *);
 %nterm <tyfield> tyfield
 
 %%
-prog:	exp				{ parse_result.reset($1); }
+prog:	exp				{ comp.ast = $1; }
 	;
 exp:	op_exp
 	|
-	lvalue ASSIGN exp		{ $$ = new E(AssignExprAST, $1, $3, @2); }
+	lvalue ASSIGN exp		{ $$ = E(AssignExprAST, $1, $3, @2); }
 	|
-	IF exp THEN exp			{ $$ = new E(IfExprAST, $2, $4, nullptr, @1); }
+	IF exp THEN exp			{ $$ = E(IfExprAST, $2, $4, nullptr, @1); }
 	|
-	IF exp THEN exp ELSE exp	{ $$ = new E(IfExprAST, $2, $4, $6, @1); }
+	IF exp THEN exp ELSE exp	{ $$ = E(IfExprAST, $2, $4, $6, @1); }
 	|
-	WHILE exp DO exp		{ $$ = new E(WhileExprAST, $2, $4, @1); }
+	WHILE exp DO exp		{ $$ = E(WhileExprAST, $2, $4, @1); }
 	|
-	FOR ID ASSIGN exp TO exp DO exp	{ $$ = new E(ForExprAST, $2, $4, $6, $8, @1); }
+	FOR ID ASSIGN exp TO exp DO exp	{ $$ = E(ForExprAST, $2, $4, $6, $8, @1); }
 	|
-	ID '{' fieldseq '}'		{ $$ = new E(RecordExprAST, $1, $3, @1); }
+	ID '{' fieldseq '}'		{ $$ = E(RecordExprAST, $1, $3, @1); }
 	|
-	ID '[' exp ']' OF exp		{ $$ = new E(ArrayExprAST, $1, $3, $6, @1); }
+	ID '[' exp ']' OF exp		{ $$ = E(ArrayExprAST, $1, $3, $6, @1); }
 	|
-	BREAK				{ $$ = new E(BreakExprAST, @1); }
+	BREAK				{ $$ = E(BreakExprAST, @1); }
+	|
+	error				{ $$ = E(ErrorExprAST); }
 	;
-lvalue: ID				{ $$ = new V(SimpleVarAST, $1, @1); }
+lvalue: ID				{ $$ = V(SimpleVarAST, $1, @1); }
 	|
 	member
 	;
-member:	lvalue '.' ID			{ $$ = new V(FieldVarAST, $1, $3, @2); }
+member:	lvalue '.' ID			{ $$ = V(FieldVarAST, $1, $3, @2); }
 	|
-	ID '[' exp ']'			{ $$ = new V(IndexVarAST, new V(SimpleVarAST, $1, @1), $3, @2); }
+	ID '[' exp ']'			{ $$ = V(IndexVarAST, V(SimpleVarAST, $1, @1), $3, @2); }
 	|
-	member '[' exp ']'		{ $$ = new V(IndexVarAST, $1, $3, @2); }
+	member '[' exp ']'		{ $$ = V(IndexVarAST, $1, $3, @2); }
 	;
-op_exp: op_exp '&' op_exp		{ $$ = new E(OpExprAST, $1, $3, Op::kAnd, @2); }
+op_exp: op_exp '&' op_exp		{ $$ = E(OpExprAST, $1, $3, Op::kAnd, @2); }
 	|
-	op_exp '|' op_exp		{ $$ = new E(OpExprAST, $1, $3, Op::kOr, @2); }
+	op_exp '|' op_exp		{ $$ = E(OpExprAST, $1, $3, Op::kOr, @2); }
 	|
-	op_exp '=' op_exp		{ $$ = new E(OpExprAST, $1, $3, Op::kEq, @2); }
+	op_exp '=' op_exp		{ $$ = E(OpExprAST, $1, $3, Op::kEq, @2); }
 	|
-	op_exp NEQ op_exp		{ $$ = new E(OpExprAST, $1, $3, Op::kNeq, @2); }
+	op_exp NEQ op_exp		{ $$ = E(OpExprAST, $1, $3, Op::kNeq, @2); }
 	|
-	op_exp '<' op_exp		{ $$ = new E(OpExprAST, $1, $3, Op::kLt, @2); }
+	op_exp '<' op_exp		{ $$ = E(OpExprAST, $1, $3, Op::kLt, @2); }
 	|
-	op_exp LE op_exp		{ $$ = new E(OpExprAST, $1, $3, Op::kLe, @2); }
+	op_exp LE op_exp		{ $$ = E(OpExprAST, $1, $3, Op::kLe, @2); }
 	|
-	op_exp '>' op_exp		{ $$ = new E(OpExprAST, $1, $3, Op::kGt, @2); }
+	op_exp '>' op_exp		{ $$ = E(OpExprAST, $1, $3, Op::kGt, @2); }
 	|
-	op_exp GE op_exp		{ $$ = new E(OpExprAST, $1, $3, Op::kGe, @2); }
+	op_exp GE op_exp		{ $$ = E(OpExprAST, $1, $3, Op::kGe, @2); }
 	|
-	op_exp '+' op_exp		{ $$ = new E(OpExprAST, $1, $3, Op::kPlus, @2); }
+	op_exp '+' op_exp		{ $$ = E(OpExprAST, $1, $3, Op::kPlus, @2); }
 	|
-	op_exp '-' op_exp		{ $$ = new E(OpExprAST, $1, $3, Op::kMinus, @2); }
+	op_exp '-' op_exp		{ $$ = E(OpExprAST, $1, $3, Op::kMinus, @2); }
 	|
-	op_exp '*' op_exp		{ $$ = new E(OpExprAST, $1, $3, Op::kMul, @2); }
+	op_exp '*' op_exp		{ $$ = E(OpExprAST, $1, $3, Op::kMul, @2); }
 	|
-	op_exp '/' op_exp		{ $$ = new E(OpExprAST, $1, $3, Op::kDiv, @2); }
+	op_exp '/' op_exp		{ $$ = E(OpExprAST, $1, $3, Op::kDiv, @2); }
 	|
-	'-' op_exp %prec UMINUS		{ $$ = new E(OpExprAST, new IntExprAST(0), $2, Op::kMinus, @1); }
+	'-' op_exp %prec UMINUS		{ $$ = E(OpExprAST, E(IntExprAST, 0), $2, Op::kMinus, @1); }
 	|
 	primary
 	;
 primary:
-	ID '(' argseq ')'		{ $$ = new E(CallExprAST, $1, $3, @2); }
+	ID '(' argseq ')'		{ $$ = E(CallExprAST, $1, $3, @2); }
 	|
-	LET decs IN expseq END		{ $$ = new E(LetExprAST, $2, expseq_to_expr($4), @1); }
+	LET decs IN expseq END		{ $$ = E(LetExprAST, $2, expseq_to_expr(comp, $4), @1); }
 	|
-	'(' expseq ')'			{ $$ = expseq_to_expr($2); }
+	'(' expseq ')'			{ $$ = expseq_to_expr(comp, $2); }
 	|
-	lvalue				{ $$ = new E(VarExprAST, $1); }
+	lvalue				{ $$ = E(VarExprAST, $1); }
 	|
-	INT				{ $$ = new E(IntExprAST, $1); }
+	INT				{ $$ = E(IntExprAST, $1); }
 	|
-	STR				{ $$ = new E(StringExprAST, $1); }
+	STR				{ $$ = E(StringExprAST, $1); }
 	|
-	NIL				{ $$ = new E(NilExprAST); }
+	NIL				{ $$ = E(NilExprAST); }
 	;
-expseq: /* empty */			{ $$ = new ExprSeq(); }
+expseq: /* empty */			{ $$ = N(ExprSeq, comp.arena); }
 	|
 	exps
 	;
-exps:	exp				{ $$ = new ExprSeq(); $$->AddExpr($1, @1); }
+exps:	exp				{ $$ = N(ExprSeq, comp.arena); $$->Add({*$1, @1}); }
 	|
-	exps ';' exp			{ $$ = $1; $$->AddExpr($3, @3); }
+	exps ';' exp			{ $$ = $1; $$->Add({*$3, @3}); }
 	;
-argseq: /* empty */			{ $$ = new ExprSeq(); }
+argseq: /* empty */			{ $$ = N(ExprSeq, comp.arena); }
 	|
 	args
 	;
-args:	exp				{ $$ = new ExprSeq(); $$->AddExpr($1, @1); }
+args:	exp				{ $$ = N(ExprSeq, comp.arena); $$->Add({*$1, @1}); }
 	|
-	args ',' exp			{ $$ = $1; $$->AddExpr($3, @3); }
+	args ',' exp			{ $$ = $1; $$->Add({*$3, @3}); }
 	;
 fieldseq:
-	/* empty */			{ $$ = new RExprFieldSeq(); }
+	/* empty */			{ $$ = N(RExprFieldSeq, comp.arena); }
 	|
 	fields
 	;
-fields: field				{ $$ = new RExprFieldSeq(); $$->AddField($1); }
+fields: field				{ $$ = N(RExprFieldSeq, comp.arena); $$->Add(*$1); }
 	|
-	fields ',' field		{ $$ = $1; $$->AddField($3); }
+	fields ',' field		{ $$ = $1; $$->Add(*$3); }
 	;
-field:	ID '=' exp			{ $$ = new RExprField($1, $3, @1); }
+field:	ID '=' exp			{ $$ = N(RExprField, $1, $3, @1); }
 	;
 
 /*============================== DECLARATIONS ==============================*/
 
-decs:	/* empty */			{ $$ = new DeclSeq(); }
+decs:	/* empty */			{ $$ = N(DeclSeq, comp.arena); }
 	|
-	decs dec			{ $$ = $1; $$->AddDecl($2); }
+	decs dec			{ $$ = $1; if ($2) $$->Add(*$2); }
 	;
-dec:	tydecs
+dec:	tydecs				{ $$ = D(TypeDeclAST, $1); }
 	|
 	vardec
 	|
-	fundecs
+	fundecs				{ $$ = D(FuncDeclAST, $1); }
+	|
+	error				{ $$ = nullptr; }
 	;
-tydecs: tydec				{ $$ = new D(TypeDeclAST); TD(*$$)->AddType($1); }
+tydecs: tydec				{ $$ = N(TypeSeq, comp.arena); $$->Add(*$1); }
 	|
-	tydecs tydec			{ $$ = $1; TD(*$$)->AddType($2); }
+	tydecs tydec			{ $$ = $1; $$->Add(*$2); }
 	;
-tydec:	TYPE ID '=' ty			{ $$ = new Type($2, $4, @1); }
+tydec:	TYPE ID '=' ty			{ $$ = N(Type, $2, $4, @1); }
 	;
-ty:	ID				{ $$ = new TV(NameTy, $1, @1); }
+ty:	ID				{ $$ = TV(NameTy, $1, @1); }
 	|
-	'{' tyfieldseq '}'		{ $$ = new TV(RecordTy, $2); }
+	'{' tyfieldseq '}'		{ $$ = TV(RecordTy, $2); }
 	|
-	ARRAY OF ID			{ $$ = new TV(ArrayTy, $3, @3); }
+	ARRAY OF ID			{ $$ = TV(ArrayTy, $3, @3); }
 	;
 tyfieldseq:
-	/* empty */			{ $$ = new RTyFieldSeq(); }
+	/* empty */			{ $$ = N(RTyFieldSeq, comp.arena); }
 	|
 	tyfields
 	;
 tyfields:
-	tyfield				{ $$ = new RTyFieldSeq(); $$->AddField($1); }
+	tyfield				{ $$ = N(RTyFieldSeq, comp.arena); $$->Add(*$1); }
 	|
-	tyfields ',' tyfield		{ $$ = $1; $$->AddField($3); }
+	tyfields ',' tyfield		{ $$ = $1; $$->Add(*$3); }
 	;
 tyfield:
-	ID ':' ID			{ $$ = new RTyField($1, $3, @1); }
+	ID ':' ID			{ $$ = N(RTyField, $1, $3, @1); }
 	;
-vardec:	VAR ID ASSIGN exp		{ $$ = new D(VarDeclAST, $2, nullptr, @1, $4, @1); }
+vardec:	VAR ID ASSIGN exp		{ $$ = D(VarDeclAST, $2, Symbol(nullptr), @1, $4, @1); }
 	|
-	VAR ID ':' ID ASSIGN exp	{ $$ = new D(VarDeclAST, $2, $4, @4, $6, @1); }
+	VAR ID ':' ID ASSIGN exp	{ $$ = D(VarDeclAST, $2, $4, @4, $6, @1); }
 	;
 fundecs:
-	fundec				{ $$ = new D(FuncDeclAST); FD(*$$)->AddFunc($1); }
+	fundec				{ $$ = N(FundecSeq, comp.arena); $$->Add(*$1); }
 	|
-	fundecs fundec			{ $$ = $1; FD(*$$)->AddFunc($2);
-	}
+	fundecs fundec			{ $$ = $1; $$->Add(*$2); }
 	;
 fundec: FUNC ID '(' tyfieldseq ')' '=' exp
 	{
-	    $$ = new FundecTy($2, $4, nullptr, @1, $7, @1);
+	    $$ = N(FundecTy, $2, $4, Symbol(nullptr), @1, $7, @1);
 	}
 	|
 	FUNC ID '(' tyfieldseq ')' ':' ID '=' exp
 	{
-	    $$ = new FundecTy($2, $4, $7, @7, $9, @1);
+	    $$ = N(FundecTy, $2, $4, $7, @7, $9, @1);
 	}
 	;
 
 %%
 namespace yy {
 
-ExprAST *expseq_to_expr(ExprSeq *exps) {
-    switch (exps->seq.size()) {
+ExprAST *expseq_to_expr(Compilation &comp, ExprSeq *exps) {
+    switch (exps->size()) {
     case 0:
-	delete exps;
-	return new E(UnitExprAST);
-    case 1: {
-	auto exp = new ExprAST{std::move(exps->seq[0].exp)};
-	delete exps;
-	return exp;
-    }
+	return E(UnitExprAST);
+    case 1:
+	return N(ExprAST, exps->Finish()[0].exp);
     default:
-	return new E(SeqExprAST, exps);
+	return E(SeqExprAST, exps);
     }
 }
 
 void parser::error(const Location& loc, const std::string& msg) {
-    std::printf("%s at %d:%d\n", msg.c_str(), loc.line, loc.column);
+    comp.diags.error(loc, msg);
 }
 
 } // namespace
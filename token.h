@@ -1,10 +1,13 @@
 #ifndef TOKEN_H
 #define TOKEN_H
 #include "absyn_common.h"
+#include "literal.h"
+#include "symbol.h"
 
 union Token {
   int num;
-  char *str;
+  symbol::Symbol sym;
+  literal::Literal str;
   absyn::ExprAST *exp;
   absyn::VarAST *var;
   absyn::ExprSeq *exps;
@@ -12,6 +15,8 @@ union Token {
   absyn::RExprField *field;
   absyn::DeclAST *decl;
   absyn::DeclSeq *decls;
+  absyn::TypeSeq *tydecs;
+  absyn::FundecSeq *fundecs;
   absyn::Ty *ty;
   absyn::Type *tydec;
   absyn::RTyFieldSeq *tyfields;
@@ -0,0 +1,657 @@
+#include "translate.h"
+#include "cache.h"
+
+namespace translate {
+
+namespace {
+using namespace tree;
+
+BinOp binop(absyn::Op op) {
+  switch (op) {
+  case absyn::Op::kMinus:
+    return BinOp::kMinus;
+  case absyn::Op::kMul:
+    return BinOp::kMul;
+  case absyn::Op::kDiv:
+    return BinOp::kDiv;
+  default:
+    return BinOp::kPlus;
+  }
+}
+
+RelOp relop(absyn::Op op) {
+  switch (op) {
+  case absyn::Op::kNeq:
+    return RelOp::kNe;
+  case absyn::Op::kLt:
+    return RelOp::kLt;
+  case absyn::Op::kLe:
+    return RelOp::kLe;
+  case absyn::Op::kGt:
+    return RelOp::kGt;
+  case absyn::Op::kGe:
+    return RelOp::kGe;
+  default:
+    return RelOp::kEq;
+  }
+}
+
+// The address of a field or element is a sum of the record or array and
+// offsets, with the record or array leftmost. Returns the address with that
+// replaced by `base`, setting *object to it.
+tree::Exp rebase(Arena &arena, tree::Exp addr, tree::Exp base,
+                 tree::Exp *object) {
+  auto *b = std::get_if<BinopExp *>(&addr);
+  if (!b || (*b)->op != BinOp::kPlus) {
+    *object = addr;
+    return base;
+  }
+  return Binop(arena, BinOp::kPlus, rebase(arena, (*b)->left, base, object),
+               (*b)->right);
+}
+
+// what's left of an expression semant couldn't check
+bool is_missing(const tree::Exp &e) {
+  auto *c = std::get_if<ConstExp *>(&e);
+  return c && !*c;
+}
+} // namespace
+
+temp::Label Level::child_label(absyn::Arena &arena, std::string_view name) {
+  std::string full =
+      std::string(frame_->name().name()) + "." + std::string(name);
+  // identifiers can't contain '$', so the numbered labels can't clash
+  if (int n = children_[full]++)
+    full += "$" + std::to_string(n);
+  return frame::named_label(arena, full);
+}
+
+Level *Fragments::outermost() {
+  auto frame = frame::new_frame(frame::named_label(arena(), "tigermain"), {});
+  return levels_
+      .emplace_back(std::make_unique<Level>(nullptr, std::move(frame)))
+      .get();
+}
+
+Level *Fragments::new_level(Level *parent, std::string_view name,
+                            const std::vector<bool> &escapes,
+                            const std::vector<bool> &pointers) {
+  std::vector<bool> formals{true}, formal_pointers{false};
+  formals.insert(formals.end(), escapes.begin(), escapes.end());
+  formal_pointers.insert(formal_pointers.end(), pointers.begin(),
+                         pointers.end());
+  auto frame = frame::new_frame(parent->child_label(arena(), name), formals,
+                                formal_pointers);
+  return levels_
+      .emplace_back(std::make_unique<Level>(parent, std::move(frame)))
+      .get();
+}
+
+void Fragments::append(Fragments &&other) {
+  for (auto &a : other.arenas_)
+    arenas_.push_back(std::move(a));
+  for (auto &l : other.levels_)
+    levels_.push_back(std::move(l));
+  for (auto &g : other.groups_) {
+    for (auto [range, n] :
+         {std::pair{&g.procs, procs_.size()}, {&g.strings, strings_.size()},
+          {&g.layouts, layouts_.size()}, {&g.code, code_.size()}}) {
+      range->begin += n;
+      range->end += n;
+    }
+    groups_.push_back(std::move(g));
+  }
+  procs_.insert(procs_.end(), other.procs_.begin(), other.procs_.end());
+  for (auto &s : other.strings_)
+    strings_.push_back(std::move(s));
+  for (auto &l : other.layouts_)
+    layouts_.push_back(std::move(l));
+  for (auto &c : other.code_)
+    code_.push_back(std::move(c));
+  other.arenas_.clear();
+  other.levels_.clear();
+  other.procs_.clear();
+  other.strings_.clear();
+  other.layouts_.clear();
+  other.code_.clear();
+  other.groups_.clear();
+}
+
+Fragments::Group Fragments::start_group(std::string key) const {
+  return {std::move(key),
+          {procs_.size(), 0},
+          {strings_.size(), 0},
+          {layouts_.size(), 0},
+          {code_.size(), 0}};
+}
+
+void Fragments::end_group(Group group) {
+  group.procs.end = procs_.size();
+  group.strings.end = strings_.size();
+  group.layouts.end = layouts_.size();
+  group.code.end = code_.size();
+  groups_.push_back(std::move(group));
+}
+
+// The strings, then the layouts, then the code, each kind counted first
+std::string
+Fragments::save(const Group &group,
+                const std::vector<frame::CodeFrag> &compiled) const {
+  cache::Writer out;
+  out.put(group.strings.end - group.strings.begin);
+  for (size_t i = group.strings.begin; i < group.strings.end; i++) {
+    out.put(strings_[i].label.name());
+    out.put(strings_[i].value);
+  }
+  out.put(group.layouts.end - group.layouts.begin);
+  for (size_t i = group.layouts.begin; i < group.layouts.end; i++) {
+    out.put(layouts_[i].label.name());
+    out.put(std::string(layouts_[i].pointers.begin(),
+                        layouts_[i].pointers.end()));
+  }
+  std::vector<const frame::CodeFrag *> code;
+  for (size_t i = group.procs.begin; i < group.procs.end; i++)
+    code.push_back(&compiled[i]);
+  for (size_t i = group.code.begin; i < group.code.end; i++)
+    code.push_back(&code_[i]);
+  out.put(code.size());
+  for (auto *c : code) {
+    out.put(c->text);
+    out.put(c->maps);
+    out.put(c->num_maps);
+  }
+  return out.data();
+}
+
+bool Fragments::load(std::string_view entry) {
+  cache::Reader in(entry);
+  std::vector<frame::StringFrag> strings;
+  std::vector<frame::LayoutFrag> layouts;
+  std::vector<frame::CodeFrag> code;
+  std::string label, value;
+  uint64_t n = 0;
+  in.get(n);
+  for (uint64_t i = 0; i < n && in.get(label) && in.get(value); i++)
+    strings.push_back({frame::named_label(arena(), label), value});
+  n = 0;
+  in.get(n);
+  for (uint64_t i = 0; i < n && in.get(label) && in.get(value); i++)
+    layouts.push_back({frame::named_label(arena(), label),
+                       std::vector<bool>(value.begin(), value.end())});
+  n = 0;
+  in.get(n);
+  for (uint64_t i = 0; i < n; i++) {
+    frame::CodeFrag c;
+    uint64_t num_maps;
+    if (!in.get(c.text) || !in.get(c.maps) || !in.get(num_maps))
+      break;
+    c.num_maps = num_maps;
+    code.push_back(std::move(c));
+  }
+  if (!in.at_end())
+    return false;
+  for (auto &s : strings)
+    add(std::move(s));
+  for (auto &l : layouts)
+    add(std::move(l));
+  for (auto &c : code)
+    add(std::move(c));
+  return true;
+}
+
+void Translator::do_patch(Patch *list, temp::Label label) {
+  for (; list; list = list->next)
+    *list->label = label;
+}
+
+Patch *Translator::join(Patch *a, Patch *b) {
+  if (!a)
+    return b;
+  Patch *p = a;
+  while (p->next)
+    p = p->next;
+  p->next = b;
+  return a;
+}
+
+tree::Stm Translator::seq(std::initializer_list<tree::Stm> stms) {
+  return seq(std::vector<tree::Stm>(stms));
+}
+
+tree::Stm Translator::seq(const std::vector<tree::Stm> &stms) {
+  if (stms.empty())
+    return ExpS(arena_, Const(arena_, 0));
+  tree::Stm s = stms.back();
+  for (size_t i = stms.size() - 1; i-- > 0;)
+    s = SeqS(arena_, stms[i], s);
+  return s;
+}
+
+tree::Exp Translator::un_ex(const Exp &e) {
+  if (auto *ex = std::get_if<Ex>(&e))
+    return is_missing(ex->exp) ? Const(arena_, 0) : ex->exp;
+  if (auto *nx = std::get_if<Nx>(&e))
+    return Eseq(arena_, nx->stm, Const(arena_, 0));
+  auto &cx = std::get<Cx>(e);
+  auto r = new_temp();
+  auto t = new_label(), f = new_label();
+  do_patch(cx.trues, t);
+  do_patch(cx.falses, f);
+  return Eseq(arena_,
+              seq({Move(arena_, TempE(arena_, r), Const(arena_, 1)), cx.stm,
+                   LabelS(arena_, f),
+                   Move(arena_, TempE(arena_, r), Const(arena_, 0)),
+                   LabelS(arena_, t)}),
+              TempE(arena_, r));
+}
+
+tree::Stm Translator::un_nx(const Exp &e) {
+  if (auto *nx = std::get_if<Nx>(&e))
+    return nx->stm;
+  if (auto *cx = std::get_if<Cx>(&e)) {
+    auto l = new_label();
+    do_patch(cx->trues, l);
+    do_patch(cx->falses, l);
+    return SeqS(arena_, cx->stm, LabelS(arena_, l));
+  }
+  return ExpS(arena_, un_ex(e));
+}
+
+Cx Translator::un_cx(const Exp &e) {
+  if (auto *cx = std::get_if<Cx>(&e))
+    return *cx;
+  auto ex = un_ex(e);
+  if (auto *c = std::get_if<ConstExp *>(&ex)) {
+    auto *jump = arena_.New<JumpStm>(JumpStm{});
+    if ((*c)->value)
+      return {jump, patch(&jump->target), nullptr};
+    return {jump, nullptr, patch(&jump->target)};
+  }
+  auto *cjump = arena_.New<CjumpStm>(
+      CjumpStm{RelOp::kNe, ex, Const(arena_, 0), {}, {}});
+  return {cjump, patch(&cjump->t), patch(&cjump->f)};
+}
+
+tree::Exp Translator::frame_of(Level *target) {
+  tree::Exp fp = TempE(arena_, level_->frame().fp());
+  for (Level *l = level_; l && l != target; l = l->parent()) {
+    auto &frame = l->frame();
+    fp = frame.exp(arena_, frame.formals()[0], fp);
+  }
+  return fp;
+}
+
+Exp Translator::simple_var(Access access) {
+  return Ex{access.level->frame().exp(arena_, access.access,
+                                      frame_of(access.level))};
+}
+
+// A record is a pointer to its fields, which is checked for nil before the
+// field is addressed.
+Exp Translator::field_var(const Exp &record, int index, bool pointer) {
+  int word = level_->frame().word_size();
+  auto r = new_temp(true);
+  auto ok = new_label(), bad = new_label();
+  auto error =
+      level_->frame().external_call(arena_, "tig_nil_error", Seq<tree::Exp>());
+  std::get<CallExp *>(error)->returns = false;
+  auto check = seq({Move(arena_, TempE(arena_, r), un_ex(record)),
+                    Cjump(arena_, RelOp::kNe, TempE(arena_, r),
+                          Const(arena_, 0), ok, bad),
+                    LabelS(arena_, bad), ExpS(arena_, error),
+                    LabelS(arena_, ok)});
+  auto addr = Binop(arena_, BinOp::kPlus, TempE(arena_, r),
+                    Const(arena_, index * word));
+  return Ex{Eseq(arena_, check, Mem(arena_, addr, pointer))};
+}
+
+// An array is a pointer to its length, which the elements follow. The index
+// is checked against the length before the element is addressed.
+Exp Translator::subscript_var(const Exp &array, const Exp &index,
+                              bool pointer, bool checked) {
+  int word = level_->frame().word_size();
+  if (!checked) {
+    auto offset =
+        Binop(arena_, BinOp::kMul, un_ex(index), Const(arena_, word));
+    auto addr = Binop(arena_, BinOp::kPlus,
+                      Binop(arena_, BinOp::kPlus, un_ex(array), offset),
+                      Const(arena_, word));
+    return Ex{Mem(arena_, addr, pointer)};
+  }
+  auto a = new_temp(true), i = new_temp();
+  auto ok = new_label(), bad = new_label();
+  auto length = Mem(arena_, TempE(arena_, a));
+  std::get<MemExp *>(length)->immutable = true;
+  std::vector<tree::Exp> args{TempE(arena_, i)};
+  auto error = level_->frame().external_call(arena_, "tig_index_error",
+                                             make_seq(arena_, args));
+  std::get<CallExp *>(error)->returns = false;
+  auto check = seq({Move(arena_, TempE(arena_, a), un_ex(array)),
+                    Move(arena_, TempE(arena_, i), un_ex(index)),
+                    Cjump(arena_, RelOp::kUlt, TempE(arena_, i), length, ok,
+                          bad),
+                    LabelS(arena_, bad), ExpS(arena_, error),
+                    LabelS(arena_, ok)});
+  auto offset = Binop(arena_, BinOp::kMul, TempE(arena_, i),
+                      Const(arena_, word));
+  auto addr = Binop(arena_, BinOp::kPlus,
+                    Binop(arena_, BinOp::kPlus, TempE(arena_, a), offset),
+                    Const(arena_, word));
+  return Ex{Eseq(arena_, check, Mem(arena_, addr, pointer))};
+}
+
+Exp Translator::int_exp(int64_t value) { return Ex{Const(arena_, value)}; }
+
+Exp Translator::nil_exp() { return Ex{Const(arena_, 0)}; }
+
+Exp Translator::unit_exp() { return Nx{ExpS(arena_, Const(arena_, 0))}; }
+
+Exp Translator::string_exp(std::string value) {
+  auto label = new_label();
+  frags_.add(frame::StringFrag{label, std::move(value)});
+  return Ex{Name(arena_, label)};
+}
+
+Exp Translator::call_exp(Level *callee, temp::Label label,
+                         const std::vector<Exp> &args, bool pointer,
+                         bool tail) {
+  std::vector<tree::Exp> exps;
+  if (callee)
+    exps.push_back(frame_of(callee->parent()));
+  for (auto &arg : args)
+    exps.push_back(un_ex(arg));
+  // the standard library is the runtime's, prefixed so as not to clash with
+  // the C library
+  if (!callee)
+    return Ex{level_->frame().external_call(
+        arena_, std::string("tig_") + label.name(), make_seq(arena_, exps))};
+  // A function nested in this one is passed this frame as its static link,
+  // so can't be called once the frame is gone
+  tail = tail && callee->parent() != level_;
+  auto call = Call(arena_, Name(arena_, label), make_seq(arena_, exps),
+                   pointer, true, tail);
+  std::get<CallExp *>(call)->stores = true;
+  return Ex{call};
+}
+
+// A string is a pointer to its length, which its characters follow. chr
+// looks the string up in the runtime's tig_chars, and only calls tig_chr to
+// report an argument out of range.
+Exp Translator::intrinsic(Intrinsic fn, const std::vector<Exp> &args) {
+  int word = level_->frame().word_size();
+  // strings never change, nor does tig_chars once the program starts
+  auto load = [&](tree::Exp addr, bool byte = false) {
+    auto e = Mem(arena_, addr);
+    auto *m = std::get<MemExp *>(e);
+    m->immutable = true;
+    m->byte = byte;
+    return e;
+  };
+  switch (fn) {
+  case Intrinsic::kSize:
+    return Ex{load(un_ex(args[0]))};
+  case Intrinsic::kNot:
+    return compare(absyn::Op::kEq, args[0], int_exp(0));
+  case Intrinsic::kOrd: {
+    // -1 for the empty string
+    auto s = new_temp(), c = new_temp();
+    auto first = new_label(), done = new_label();
+    auto chars =
+        Binop(arena_, BinOp::kPlus, TempE(arena_, s), Const(arena_, word));
+    auto stm = seq({Move(arena_, TempE(arena_, s), un_ex(args[0])),
+                    Move(arena_, TempE(arena_, c), Const(arena_, -1)),
+                    Cjump(arena_, RelOp::kEq, load(TempE(arena_, s)),
+                          Const(arena_, 0), done, first),
+                    LabelS(arena_, first),
+                    Move(arena_, TempE(arena_, c), load(chars, true)),
+                    LabelS(arena_, done)});
+    return Ex{Eseq(arena_, stm, TempE(arena_, c))};
+  }
+  default: {
+    // chr
+    auto i = new_temp();
+    auto ok = new_label(), bad = new_label();
+    std::vector<tree::Exp> error_args{TempE(arena_, i)};
+    auto error = level_->frame().external_call(arena_, "tig_chr",
+                                               make_seq(arena_, error_args));
+    std::get<CallExp *>(error)->returns = false;
+    auto check = seq({Move(arena_, TempE(arena_, i), un_ex(args[0])),
+                      Cjump(arena_, RelOp::kUle, TempE(arena_, i),
+                            Const(arena_, 255), ok, bad),
+                      LabelS(arena_, bad), ExpS(arena_, error),
+                      LabelS(arena_, ok)});
+    auto table = Name(arena_, frame::named_label(arena_, "tig_chars"));
+    auto offset =
+        Binop(arena_, BinOp::kMul, TempE(arena_, i), Const(arena_, word));
+    return Ex{Eseq(arena_, check,
+                   load(Binop(arena_, BinOp::kPlus, table, offset)))};
+  }
+  }
+}
+
+tree::Exp Translator::collecting_call(std::string_view name,
+                                      std::vector<tree::Exp> args) {
+  auto &frame = level_->frame();
+  args.push_back(TempE(arena_, frame.fp()));
+  auto call = frame.external_call(arena_, name, make_seq(arena_, args));
+  auto *c = std::get<CallExp *>(call);
+  c->pointer = c->collects = true;
+  return call;
+}
+
+Exp Translator::arith(absyn::Op op, const Exp &lhs, const Exp &rhs) {
+  return Ex{Binop(arena_, binop(op), un_ex(lhs), un_ex(rhs))};
+}
+
+Exp Translator::logical(absyn::Op op, const Exp &lhs, const Exp &rhs) {
+  auto a = un_cx(lhs);
+  auto b = un_cx(rhs);
+  auto z = new_label();
+  auto stm = seq({a.stm, LabelS(arena_, z), b.stm});
+  if (op == absyn::Op::kAnd) {
+    do_patch(a.trues, z);
+    return Cx{stm, b.trues, join(a.falses, b.falses)};
+  }
+  do_patch(a.falses, z);
+  return Cx{stm, join(a.trues, b.trues), b.falses};
+}
+
+Exp Translator::compare(absyn::Op op, const Exp &lhs, const Exp &rhs) {
+  auto *cjump = arena_.New<CjumpStm>(
+      CjumpStm{relop(op), un_ex(lhs), un_ex(rhs), {}, {}});
+  return Cx{cjump, patch(&cjump->t), patch(&cjump->f)};
+}
+
+// Strings are compared by the runtime: tig_string_equal says whether two
+// are equal, and tig_string_compare orders them like strcmp
+Exp Translator::string_compare(absyn::Op op, const Exp &lhs, const Exp &rhs) {
+  std::vector<tree::Exp> args{un_ex(lhs), un_ex(rhs)};
+  bool eq = op == absyn::Op::kEq || op == absyn::Op::kNeq;
+  auto call = level_->frame().external_call(
+      arena_, eq ? "tig_string_equal" : "tig_string_compare",
+      make_seq(arena_, args));
+  RelOp rel = eq ? (op == absyn::Op::kEq ? RelOp::kNe : RelOp::kEq)
+                 : relop(op);
+  auto *cjump = arena_.New<CjumpStm>(
+      CjumpStm{rel, call, Const(arena_, 0), {}, {}});
+  return Cx{cjump, patch(&cjump->t), patch(&cjump->f)};
+}
+
+// The fields are evaluated before the record is allocated, so that no
+// collection can move it before they're stored
+Exp Translator::record_exp(const std::vector<Exp> &fields,
+                           const std::vector<bool> &pointers) {
+  int word = level_->frame().word_size();
+  std::vector<tree::Stm> stms;
+  std::vector<tree::Exp> values;
+  for (size_t i = 0; i < fields.size(); i++) {
+    auto value = un_ex(fields[i]);
+    if (!std::holds_alternative<ConstExp *>(value) &&
+        !std::holds_alternative<NameExp *>(value)) {
+      auto t = new_temp(i < pointers.size() && pointers[i]);
+      stms.push_back(Move(arena_, TempE(arena_, t), value));
+      value = TempE(arena_, t);
+    }
+    values.push_back(value);
+  }
+  auto layout = new_label();
+  frags_.add(frame::LayoutFrag{
+      layout, std::vector<bool>(pointers.begin(),
+                                pointers.begin() + std::min(pointers.size(),
+                                                            fields.size()))});
+  auto r = new_temp(true);
+  stms.push_back(Move(arena_, TempE(arena_, r),
+                      collecting_call("tig_alloc_record",
+                                      {Name(arena_, layout)})));
+  for (size_t i = 0; i < values.size(); i++) {
+    auto addr = Binop(arena_, BinOp::kPlus, TempE(arena_, r),
+                      Const(arena_, i * word));
+    stms.push_back(Move(arena_, Mem(arena_, addr), values[i]));
+  }
+  return Ex{Eseq(arena_, seq(stms), TempE(arena_, r))};
+}
+
+Exp Translator::array_exp(const Exp &size, const Exp &init, bool pointer) {
+  return Ex{collecting_call("tig_init_array", {un_ex(size), un_ex(init),
+                                               Const(arena_, pointer)})};
+}
+
+Exp Translator::seq_exp(const std::vector<Exp> &exps) {
+  if (exps.empty())
+    return unit_exp();
+  if (exps.size() == 1)
+    return exps[0];
+  std::vector<tree::Stm> stms;
+  for (size_t i = 0; i + 1 < exps.size(); i++)
+    stms.push_back(un_nx(exps[i]));
+  if (std::holds_alternative<Nx>(exps.back())) {
+    stms.push_back(un_nx(exps.back()));
+    return Nx{seq(stms)};
+  }
+  return Ex{Eseq(arena_, seq(stms), un_ex(exps.back()))};
+}
+
+// The write barrier: the collector only looks for pointers to new objects
+// in the old objects it's been told might have them, so storing a pointer
+// to one in a record or array that isn't also new passes the record or
+// array to tig_remember. The nursery the new objects are in is at
+// tig_nursery, of tig_nursery_size bytes.
+Exp Translator::assign(const Exp &var, const Exp &value, bool barrier) {
+  auto dst = un_ex(var);
+  auto *es = std::get_if<EseqExp *>(&dst);
+  auto *mem = std::get_if<MemExp *>(es ? &(*es)->exp : &dst);
+  if (!barrier || !mem)
+    return Nx{Move(arena_, dst, un_ex(value))};
+  tree::Stm pre = es ? (*es)->stm : seq({});
+  // The object is held in a temp, which the collector updates if it moves
+  // it, and the address recomputed from that
+  auto object = new_temp(true), v = new_temp(true);
+  tree::Exp base;
+  auto addr = rebase(arena_, (*mem)->addr, TempE(arena_, object), &base);
+  // the runtime sets up the nursery before the program starts
+  auto global = [&](const char *name) {
+    auto e = Mem(arena_, Name(arena_, frame::named_label(arena_, name)));
+    std::get<MemExp *>(e)->immutable = true;
+    return e;
+  };
+  auto in_nursery = [&](temp::Temp t, temp::Label yes, temp::Label no) {
+    auto start = global("tig_nursery");
+    auto size = global("tig_nursery_size");
+    return Cjump(arena_, RelOp::kUlt,
+                 Binop(arena_, BinOp::kMinus, TempE(arena_, t), start), size,
+                 yes, no);
+  };
+  auto young = new_label(), old = new_label(), done = new_label();
+  std::vector<tree::Exp> args{TempE(arena_, object)};
+  return Nx{seq({pre, Move(arena_, TempE(arena_, object), base),
+                 Move(arena_, TempE(arena_, v), un_ex(value)),
+                 Move(arena_, Mem(arena_, addr), TempE(arena_, v)),
+                 in_nursery(v, young, done), LabelS(arena_, young),
+                 in_nursery(object, done, old), LabelS(arena_, old),
+                 ExpS(arena_, level_->frame().external_call(
+                                  arena_, "tig_remember",
+                                  make_seq(arena_, args))),
+                 LabelS(arena_, done)})};
+}
+
+Exp Translator::if_exp(const Exp &cond, const Exp &then, const Exp *else_,
+                       bool has_value, bool pointer) {
+  auto c = un_cx(cond);
+  auto t = new_label(), f = new_label();
+  do_patch(c.trues, t);
+  do_patch(c.falses, f);
+  if (!else_)
+    return Nx{seq({c.stm, LabelS(arena_, t), un_nx(then), LabelS(arena_, f)})};
+  auto join = new_label();
+  if (!has_value)
+    return Nx{seq({c.stm, LabelS(arena_, t), un_nx(then), Jump(arena_, join),
+                   LabelS(arena_, f), un_nx(*else_), LabelS(arena_, join)})};
+  auto r = new_temp(pointer);
+  return Ex{Eseq(arena_,
+                 seq({c.stm, LabelS(arena_, t),
+                      Move(arena_, TempE(arena_, r), un_ex(then)),
+                      Jump(arena_, join), LabelS(arena_, f),
+                      Move(arena_, TempE(arena_, r), un_ex(*else_)),
+                      LabelS(arena_, join)}),
+                 TempE(arena_, r))};
+}
+
+Exp Translator::while_exp(const Exp &cond, const Exp &body,
+                          temp::Label done) {
+  auto test = new_label(), loop = new_label();
+  auto c = un_cx(cond);
+  do_patch(c.trues, loop);
+  do_patch(c.falses, done);
+  return Nx{seq({LabelS(arena_, test), c.stm, LabelS(arena_, loop),
+                 un_nx(body), Jump(arena_, test), LabelS(arena_, done)})};
+}
+
+// The variable is compared with the limit before it's incremented, so that a
+// loop up to the largest int doesn't overflow
+Exp Translator::for_exp(Access var, const Exp &lo, const Exp &hi,
+                        const Exp &body, temp::Label done) {
+  auto limit = new_temp();
+  auto loop = new_label(), inc = new_label();
+  auto i = [&] { return un_ex(simple_var(var)); };
+  return Nx{seq({Move(arena_, i(), un_ex(lo)),
+                 Move(arena_, TempE(arena_, limit), un_ex(hi)),
+                 Cjump(arena_, RelOp::kGt, i(), TempE(arena_, limit), done,
+                       loop),
+                 LabelS(arena_, loop), un_nx(body),
+                 Cjump(arena_, RelOp::kGe, i(), TempE(arena_, limit), done,
+                       inc),
+                 LabelS(arena_, inc),
+                 Move(arena_, i(),
+                      Binop(arena_, BinOp::kPlus, i(), Const(arena_, 1))),
+                 Jump(arena_, loop), LabelS(arena_, done)})};
+}
+
+Exp Translator::break_exp(temp::Label done) {
+  return Nx{Jump(arena_, done)};
+}
+
+Exp Translator::let_exp(const std::vector<Exp> &inits, const Exp &body) {
+  if (inits.empty())
+    return body;
+  std::vector<tree::Stm> stms;
+  for (auto &init : inits)
+    stms.push_back(un_nx(init));
+  if (auto *cx = std::get_if<Cx>(&body)) {
+    stms.push_back(cx->stm);
+    return Cx{seq(stms), cx->trues, cx->falses};
+  }
+  if (std::holds_alternative<Nx>(body)) {
+    stms.push_back(un_nx(body));
+    return Nx{seq(stms)};
+  }
+  return Ex{Eseq(arena_, seq(stms), un_ex(body))};
+}
+
+void Translator::proc_entry_exit(const Exp &body, bool has_value) {
+  auto &frame = level_->frame();
+  auto stm = has_value ? Move(arena_, TempE(arena_, frame.rv()), un_ex(body))
+                       : un_nx(body);
+  frags_.add(frame::ProcFrag{frame.entry_exit1(arena_, stm), &frame});
+}
+
+} // namespace translate
@@ -0,0 +1,221 @@
+#ifndef TRANSLATE_H
+#define TRANSLATE_H
+#include "absyn.h"
+#include "arena.h"
+#include "frame.h"
+#include "temp.h"
+#include "tree.h"
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <variant>
+#include <vector>
+
+// Lowers checked Tiger expressions to the tree IR. semant calls in here as it
+// checks each expression, so the program is checked and translated in one
+// traversal.
+namespace translate {
+
+// The nesting level of a function, for following static links. Each level
+// has the frame of its function; the outermost level is the main program's.
+class Level {
+public:
+  Level(Level *parent, std::unique_ptr<frame::Frame> frame)
+      : parent_(parent), frame_(std::move(frame)) {}
+  Level *parent() const { return parent_; }
+  frame::Frame &frame() const { return *frame_; }
+  // The label of a function declared in this one: the name qualified by this
+  // function's, and numbered if a function of the same name was declared
+  // here before. Even the main program's functions are qualified, by
+  // tigermain, so that they can't clash with the runtime's symbols.
+  temp::Label child_label(absyn::Arena &arena, std::string_view name);
+
+private:
+  Level *parent_;
+  std::unique_ptr<frame::Frame> frame_;
+  std::unordered_map<std::string, int> children_;
+};
+
+// The functions of the standard library that are translated in place rather
+// than called
+enum class Intrinsic { kNone, kSize, kOrd, kChr, kNot };
+
+// A variable and the level of the function it belongs to
+struct Access {
+  Level *level;
+  frame::Access access;
+};
+
+// Appel's patch lists: the label fields of the jumps in a conditional that
+// are still to be pointed at where control goes when it's true or false
+struct Patch {
+  temp::Label *label;
+  Patch *next;
+};
+
+// A translated expression, in the form that suits it best until its use
+// says what's needed: a value, a statement, or a conditional jump
+struct Ex {
+  tree::Exp exp;
+};
+struct Nx {
+  tree::Stm stm;
+};
+struct Cx {
+  tree::Stm stm;
+  Patch *trues, *falses;
+};
+using Exp = std::variant<Ex, Nx, Cx>;
+
+// What translation produces for one compilation: the fragments of the
+// functions and string literals, and what they're built from. A part
+// translated on its own, such as a function body on another thread, gets
+// fragments of its own, which are appended in order afterwards.
+class Fragments {
+public:
+  Fragments() : arenas_(1) { arenas_[0] = std::make_unique<absyn::Arena>(); }
+  Fragments(const Fragments &) = delete;
+  Fragments &operator=(const Fragments &) = delete;
+
+  absyn::Arena &arena() { return *arenas_[0]; }
+  // The level of the main program, "tigermain"
+  Level *outermost();
+  // The level of a function declared in `parent`, given which of its formals
+  // escape and which are records or arrays; the static link is added in
+  // front of them
+  Level *new_level(Level *parent, std::string_view name,
+                   const std::vector<bool> &escapes,
+                   const std::vector<bool> &pointers);
+  void add(frame::ProcFrag frag) { procs_.push_back(frag); }
+  void add(frame::StringFrag frag) { strings_.push_back(std::move(frag)); }
+  void add(frame::LayoutFrag frag) { layouts_.push_back(std::move(frag)); }
+  void add(frame::CodeFrag frag) { code_.push_back(std::move(frag)); }
+  // moves the other's fragments after this one's
+  void append(Fragments &&other);
+
+  const std::vector<frame::ProcFrag> &procs() const { return procs_; }
+  const std::vector<frame::StringFrag> &strings() const { return strings_; }
+  const std::vector<frame::LayoutFrag> &layouts() const { return layouts_; }
+  const std::vector<frame::CodeFrag> &code() const { return code_; }
+
+  // The fragments of a group of functions, those of each kind added from
+  // start_group() to end_group(), which are cached together under `key`
+  struct Group {
+    struct Range {
+      size_t begin, end;
+    };
+    std::string key;
+    Range procs, strings, layouts, code;
+  };
+  Group start_group(std::string key) const;
+  void end_group(Group group);
+  const std::vector<Group> &groups() const { return groups_; }
+  // The group's fragments as a cache entry, with the assembly of each of
+  // its procs, which `compiled` has at the proc's index
+  std::string save(const Group &group,
+                   const std::vector<frame::CodeFrag> &compiled) const;
+  // Adds the fragments of a cache entry save() made, returning false, with
+  // nothing added, if the entry is damaged
+  bool load(std::string_view entry);
+
+private:
+  std::vector<std::unique_ptr<absyn::Arena>> arenas_;
+  std::vector<std::unique_ptr<Level>> levels_;
+  std::vector<frame::ProcFrag> procs_;
+  std::vector<frame::StringFrag> strings_;
+  std::vector<frame::LayoutFrag> layouts_;
+  std::vector<frame::CodeFrag> code_;
+  std::vector<Group> groups_;
+};
+
+// Builds the IR of each kind of expression, in the arena of the fragments
+// it's adding to, for code in the function at the current level
+class Translator {
+public:
+  Translator(Fragments &frags, Level *level)
+      : frags_(frags), arena_(frags.arena()), level_(level) {}
+
+  Fragments &frags() { return frags_; }
+  Level *level() const { return level_; }
+  // Makes `level` current, returning the level it replaces
+  Level *set_level(Level *level) {
+    std::swap(level, level_);
+    return level;
+  }
+  temp::Label new_label() { return level_->frame().new_label(arena_); }
+
+  tree::Exp un_ex(const Exp &e);
+  tree::Stm un_nx(const Exp &e);
+  Cx un_cx(const Exp &e);
+
+  // `pointer` says whether the field or element is a record or array
+  Exp simple_var(Access access);
+  Exp field_var(const Exp &record, int index, bool pointer);
+  // an unchecked subscript is one known to be in range
+  Exp subscript_var(const Exp &array, const Exp &index, bool pointer,
+                    bool checked = true);
+
+  Exp int_exp(int64_t value);
+  Exp nil_exp();
+  Exp unit_exp();
+  Exp string_exp(std::string value);
+  // A call to the function at `callee`, or to the runtime if callee is null.
+  // `pointer` says whether it returns a record or array, and `tail` whether
+  // it's in tail position.
+  Exp call_exp(Level *callee, temp::Label label, const std::vector<Exp> &args,
+               bool pointer, bool tail = false);
+  // A call to an intrinsic, with as many arguments as it takes
+  Exp intrinsic(Intrinsic fn, const std::vector<Exp> &args);
+  Exp arith(absyn::Op op, const Exp &lhs, const Exp &rhs);
+  // & and |, which only evaluate rhs if lhs doesn't decide the result
+  Exp logical(absyn::Op op, const Exp &lhs, const Exp &rhs);
+  Exp compare(absyn::Op op, const Exp &lhs, const Exp &rhs);
+  Exp string_compare(absyn::Op op, const Exp &lhs, const Exp &rhs);
+  // `pointers` says which fields are records or arrays
+  Exp record_exp(const std::vector<Exp> &fields,
+                 const std::vector<bool> &pointers);
+  Exp array_exp(const Exp &size, const Exp &init, bool pointer);
+  Exp seq_exp(const std::vector<Exp> &exps);
+  // `barrier` says whether var is a field or element, and value a record or
+  // array, which the collector has to be told about if it's stored in an
+  // older object than itself
+  Exp assign(const Exp &var, const Exp &value, bool barrier = false);
+  Exp if_exp(const Exp &cond, const Exp &then, const Exp *else_,
+             bool has_value, bool pointer = false);
+  // `done` is where a break in the body goes
+  Exp while_exp(const Exp &cond, const Exp &body, temp::Label done);
+  Exp for_exp(Access var, const Exp &lo, const Exp &hi, const Exp &body,
+              temp::Label done);
+  Exp break_exp(temp::Label done);
+  Exp let_exp(const std::vector<Exp> &inits, const Exp &body);
+
+  // Adds the fragment of the current level's function, whose body has been
+  // translated
+  void proc_entry_exit(const Exp &body, bool has_value);
+
+private:
+  Fragments &frags_;
+  absyn::Arena &arena_;
+  Level *level_;
+
+  temp::Temp new_temp(bool pointer = false) {
+    return level_->frame().new_temp(pointer);
+  }
+  // a call to the runtime during which the collector can run; it's passed
+  // the frame pointer to find the stack from
+  tree::Exp collecting_call(std::string_view name,
+                            std::vector<tree::Exp> args);
+  // the frame pointer of `target`, as seen from the current level
+  tree::Exp frame_of(Level *target);
+  tree::Stm seq(std::initializer_list<tree::Stm> stms);
+  tree::Stm seq(const std::vector<tree::Stm> &stms);
+  Patch *patch(temp::Label *label, Patch *next = nullptr) {
+    return arena_.New<Patch>(Patch{label, next});
+  }
+  static void do_patch(Patch *list, temp::Label label);
+  static Patch *join(Patch *a, Patch *b);
+};
+
+} // namespace translate
+#endif
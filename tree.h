@@ -0,0 +1,248 @@
+#ifndef TREE_H
+#define TREE_H
+#include "arena.h"
+#include "temp.h"
+#include <cstdint>
+#include <variant>
+
+// The intermediate representation: expression and statement trees over
+// temps, labels and memory, as in Appel's Tree language. Like the AST, the
+// nodes live in an arena and are referred to through variants of pointers.
+namespace tree {
+using absyn::Arena;
+using absyn::Seq;
+using temp::Label;
+using temp::Temp;
+
+enum class BinOp : int {
+  kPlus,
+  kMinus,
+  kMul,
+  kDiv,
+  kAnd,
+  kOr,
+  kXor,
+  kLshift,
+  kRshift,
+  kArshift,
+};
+
+// Comparisons; the unsigned ones serve bounds checks
+enum class RelOp : int {
+  kEq,
+  kNe,
+  kLt,
+  kLe,
+  kGt,
+  kGe,
+  kUlt,
+  kUle,
+  kUgt,
+  kUge,
+};
+
+RelOp negate(RelOp op);
+// the comparison that holds with the operands swapped
+RelOp commute(RelOp op);
+
+struct ConstExp;
+struct NameExp;
+struct TempExp;
+struct BinopExp;
+struct MemExp;
+struct CallExp;
+struct EseqExp;
+using Exp = std::variant<ConstExp *, NameExp *, TempExp *, BinopExp *,
+                         MemExp *, CallExp *, EseqExp *>;
+
+struct MoveStm;
+struct ExpStm;
+struct JumpStm;
+struct CjumpStm;
+struct SeqStm;
+struct LabelStm;
+using Stm =
+    std::variant<MoveStm *, ExpStm *, JumpStm *, CjumpStm *, SeqStm *,
+                 LabelStm *>;
+
+struct ConstExp {
+  int64_t value;
+};
+
+// the address of a label
+struct NameExp {
+  Label label;
+};
+
+struct TempExp {
+  Temp temp;
+};
+
+struct BinopExp {
+  BinOp op;
+  Exp left, right;
+};
+
+// the word at an address; as the destination of a move, a store
+struct MemExp {
+  Exp addr;
+  // whether the word is a record or array, which the collector has to find
+  bool pointer{false};
+  // whether the word never changes once what it's in is made, as an array's
+  // length doesn't
+  bool immutable{false};
+  // whether it's the byte at the address, zero-extended, rather than the
+  // word; only ever loaded
+  bool byte{false};
+};
+
+struct CallExp {
+  Exp func;
+  Seq<Exp> args;
+  // whether the result is a record or array
+  bool pointer{false};
+  // whether the collector can run during the call
+  bool collects{false};
+  // Whether the caller returns what the call returns, and nothing else
+  // needs its frame, so the call can jump to the function instead
+  bool tail{false};
+  // Whether the call can store into records, arrays or frames that existed
+  // before it. The runtime's functions only store into what they allocate.
+  bool stores{false};
+  // whether the call can return, which tig_index_error doesn't
+  bool returns{true};
+};
+
+// evaluates stm for its effects, then exp for its value
+struct EseqExp {
+  Stm stm;
+  Exp exp;
+};
+
+// dst is a TempExp or a MemExp
+struct MoveStm {
+  Exp dst, src;
+};
+
+struct ExpStm {
+  Exp exp;
+};
+
+struct JumpStm {
+  Label target;
+};
+
+struct CjumpStm {
+  RelOp op;
+  Exp left, right;
+  Label t, f;
+};
+
+struct SeqStm {
+  Stm left, right;
+};
+
+struct LabelStm {
+  Label label;
+};
+
+// Node constructors, allocating in the given arena
+inline Exp Const(Arena &a, int64_t value) {
+  return a.New<ConstExp>(ConstExp{value});
+}
+inline Exp Name(Arena &a, Label label) {
+  return a.New<NameExp>(NameExp{label});
+}
+inline Exp TempE(Arena &a, Temp temp) {
+  return a.New<TempExp>(TempExp{temp});
+}
+inline Exp Binop(Arena &a, BinOp op, Exp left, Exp right) {
+  return a.New<BinopExp>(BinopExp{op, left, right});
+}
+inline Exp Mem(Arena &a, Exp addr, bool pointer = false) {
+  return a.New<MemExp>(MemExp{addr, pointer});
+}
+inline Exp Call(Arena &a, Exp func, Seq<Exp> args, bool pointer = false,
+                bool collects = false, bool tail = false) {
+  return a.New<CallExp>(CallExp{func, args, pointer, collects, tail});
+}
+inline Exp Eseq(Arena &a, Stm stm, Exp exp) {
+  return a.New<EseqExp>(EseqExp{stm, exp});
+}
+inline Stm Move(Arena &a, Exp dst, Exp src) {
+  return a.New<MoveStm>(MoveStm{dst, src});
+}
+inline Stm ExpS(Arena &a, Exp exp) { return a.New<ExpStm>(ExpStm{exp}); }
+inline Stm Jump(Arena &a, Label target) {
+  return a.New<JumpStm>(JumpStm{target});
+}
+inline Stm Cjump(Arena &a, RelOp op, Exp left, Exp right, Label t, Label f) {
+  return a.New<CjumpStm>(CjumpStm{op, left, right, t, f});
+}
+inline Stm SeqS(Arena &a, Stm left, Stm right) {
+  return a.New<SeqStm>(SeqStm{left, right});
+}
+inline Stm LabelS(Arena &a, Label label) {
+  return a.New<LabelStm>(LabelStm{label});
+}
+
+// Copies a list of expressions into the arena
+template <typename C> Seq<Exp> make_seq(Arena &a, const C &exps) {
+  Exp *data = a.NewArray<Exp>(exps.size());
+  uint32_t n = 0;
+  for (auto &e : exps)
+    new (&data[n++]) Exp(e);
+  return {data, n};
+}
+
+inline RelOp negate(RelOp op) {
+  switch (op) {
+  case RelOp::kEq:
+    return RelOp::kNe;
+  case RelOp::kNe:
+    return RelOp::kEq;
+  case RelOp::kLt:
+    return RelOp::kGe;
+  case RelOp::kLe:
+    return RelOp::kGt;
+  case RelOp::kGt:
+    return RelOp::kLe;
+  case RelOp::kGe:
+    return RelOp::kLt;
+  case RelOp::kUlt:
+    return RelOp::kUge;
+  case RelOp::kUle:
+    return RelOp::kUgt;
+  case RelOp::kUgt:
+    return RelOp::kUle;
+  case RelOp::kUge:
+    return RelOp::kUlt;
+  }
+  return op;
+}
+
+inline RelOp commute(RelOp op) {
+  switch (op) {
+  case RelOp::kLt:
+    return RelOp::kGt;
+  case RelOp::kLe:
+    return RelOp::kGe;
+  case RelOp::kGt:
+    return RelOp::kLt;
+  case RelOp::kGe:
+    return RelOp::kLe;
+  case RelOp::kUlt:
+    return RelOp::kUgt;
+  case RelOp::kUle:
+    return RelOp::kUge;
+  case RelOp::kUgt:
+    return RelOp::kUlt;
+  case RelOp::kUge:
+    return RelOp::kUle;
+  default:
+    return op;
+  }
+}
+
+} // namespace tree
+#endif
@@ -0,0 +1,113 @@
+#ifndef TREE_PRINT_H
+#define TREE_PRINT_H
+#include "frame.h"
+#include "tree.h"
+#include <cstdio>
+#include <variant>
+
+namespace tree {
+
+// Prints the fragment's statements one per line, with the SEQs that join
+// them left out
+void print(const frame::ProcFrag &frag);
+void print(const frame::StringFrag &frag);
+
+namespace detail {
+
+class TreePrintVisitor {
+  const frame::Frame &frame_;
+
+public:
+  TreePrintVisitor(const frame::Frame &frame) : frame_(frame) {}
+  void print(Exp e) { std::visit(*this, e); }
+  void print(Stm s) {
+    if (auto *seq = std::get_if<SeqStm *>(&s)) {
+      print((*seq)->left);
+      print((*seq)->right);
+      return;
+    }
+    std::printf(std::holds_alternative<LabelStm *>(s) ? "" : "  ");
+    std::visit(*this, s);
+    std::printf("\n");
+  }
+
+  void operator()(ConstExp *e) {
+    std::printf("CONST %lld", (long long)e->value);
+  }
+  void operator()(NameExp *e) { std::printf("NAME %s", e->label.name()); }
+  void operator()(TempExp *e) {
+    if (auto *reg = frame_.register_name(e->temp))
+      std::printf("TEMP %%%s", reg);
+    else
+      std::printf("TEMP t%u", e->temp.id());
+  }
+  void operator()(BinopExp *e) {
+    const char *ops[] = {"PLUS", "MINUS", "MUL",    "DIV",    "AND",
+                         "OR",   "XOR",   "LSHIFT", "RSHIFT", "ARSHIFT"};
+    std::printf("BINOP(%s, ", ops[static_cast<int>(e->op)]);
+    print(e->left);
+    std::printf(", ");
+    print(e->right);
+    std::printf(")");
+  }
+  void operator()(MemExp *e) {
+    std::printf(e->byte ? "MEMB(" : "MEM(");
+    print(e->addr);
+    std::printf(")");
+  }
+  void operator()(CallExp *e) {
+    std::printf("CALL(");
+    print(e->func);
+    for (auto &arg : e->args) {
+      std::printf(", ");
+      print(arg);
+    }
+    std::printf(")");
+  }
+  void operator()(EseqExp *e) {
+    std::printf("ESEQ(\n");
+    print(e->stm);
+    std::printf("  , ");
+    print(e->exp);
+    std::printf(")");
+  }
+
+  void operator()(MoveStm *s) {
+    std::printf("MOVE(");
+    print(s->dst);
+    std::printf(", ");
+    print(s->src);
+    std::printf(")");
+  }
+  void operator()(ExpStm *s) {
+    std::printf("EXP(");
+    print(s->exp);
+    std::printf(")");
+  }
+  void operator()(JumpStm *s) { std::printf("JUMP %s", s->target.name()); }
+  void operator()(CjumpStm *s) {
+    const char *ops[] = {"EQ", "NE",  "LT",  "LE",  "GT",
+                         "GE", "ULT", "ULE", "UGT", "UGE"};
+    std::printf("CJUMP(%s, ", ops[static_cast<int>(s->op)]);
+    print(s->left);
+    std::printf(", ");
+    print(s->right);
+    std::printf(", %s, %s)", s->t.name(), s->f.name());
+  }
+  void operator()(SeqStm *s) { print(Stm(s)); }
+  void operator()(LabelStm *s) { std::printf("%s:", s->label.name()); }
+};
+
+} // namespace detail
+
+inline void print(const frame::ProcFrag &frag) {
+  std::printf("%s:\n", frag.frame->name().name());
+  detail::TreePrintVisitor(*frag.frame).print(frag.body);
+}
+
+inline void print(const frame::StringFrag &frag) {
+  std::printf("%s: \"%s\"\n", frag.label.name(), frag.value.c_str());
+}
+
+} // namespace tree
+#endif
@@ -1,65 +1,138 @@
 #include "types.h"
+#include <algorithm>
 
 namespace {
-int record_id = 0;
-int array_id = 0;
+// records with at most this many fields are searched linearly
+constexpr size_t kLinearFields = 8;
 } // namespace
 
 namespace types {
-namespace detail {
 
-class EqualityVisitor {
-  const Ty &ty1;
+Context::Context() {
+  // must match kIntTy, kStringTy, kNilTy, kUnitTy and kErrorTy
+  for (Kind k :
+       {Kind::kInt, Kind::kString, Kind::kNil, Kind::kUnit, Kind::kError})
+    add({k, 0, 0, kUnbound});
+}
 
-public:
-  EqualityVisitor(const Ty &ty1) : ty1(ty1) {}
-  bool operator()(const RecordTyRef &ty2) {
-    return as<RecordTyRef>(ty1)->id == ty2->id;
-  }
-  bool operator()(const ArrayTyRef &ty2) {
-    return as<ArrayTyRef>(ty1)->id == ty2->id;
+Context::Context(const Context *parent)
+    : parent_(parent), base_(parent->mark()),
+      list_base_(parent->list_base_ + parent->lists_.size()) {}
+
+Ty Context::add(Entry e) {
+  entries_.push_back(e);
+  return Ty(base_ + entries_.size() - 1);
+}
+
+Ty Context::make_record(const std::vector<RTyField> &fields) {
+  uint32_t first = fields_.size();
+  fields_.insert(fields_.end(), fields.begin(), fields.end());
+  uint32_t index = kUnbound;
+  if (fields.size() > kLinearFields) {
+    index = index_.size();
+    for (int i = 0; i < (int)fields.size(); i++)
+      index_.emplace_back(fields[i].name.id(), i);
+    std::sort(index_.begin() + index, index_.end());
   }
-  // XXX: We've eliminated NameTy before calling this.
-  bool operator()(const NameTyRef &ty2) { return false; }
-  bool operator()(const IntTy &ty2) { return true; }
-  bool operator()(const StringTy &ty2) { return true; }
-  // XXX: nil doesn't equal itself, since equality implies compatibility
-  // and two nil expressions aren't compatible. This is because with two
-  // nil expressions the record type can't be inferred.
-  bool operator()(const NilTy &ty2) { return false; }
-  bool operator()(const UnitTy &ty2) { return true; }
-};
+  return add({Kind::kRecord, first, (uint32_t)fields.size(), index});
+}
 
-} // namespace detail
+Ty Context::make_array(Ty element) {
+  return add({Kind::kArray, element.id(), 0, kUnbound});
+}
 
-RecordTy::RecordTy(std::vector<RTyField> &&fields)
-    : id(record_id++), fields(std::move(fields)) {}
+Ty Context::make_name(symbol::Symbol name) {
+  names_.push_back(name);
+  return add({Kind::kName, kUnbound, (uint32_t)names_.size() - 1, kUnbound});
+}
+
+void Context::bind_name(Ty name, Ty ty) { local(name).a = ty.id(); }
 
-ArrayTy::ArrayTy(Ty ty) : id(array_id++), base_type(ty) {}
+TyList Context::make_list(const std::vector<Ty> &tys) {
+  TyList list{list_base_ + (uint32_t)lists_.size(), (uint32_t)tys.size()};
+  lists_.insert(lists_.end(), tys.begin(), tys.end());
+  return list;
+}
 
-bool operator==(const Ty &ty1, const Ty &ty2) {
-  auto aty1 = actual_ty(ty1);
-  auto aty2 = actual_ty(ty2);
-  if (aty1.index() != aty2.index())
-    return false;
-  return std::visit(detail::EqualityVisitor(aty1), aty2);
+std::vector<symbol::Symbol> Context::resolve_names(uint32_t mark) {
+  // Everything made since the mark is in this context; anything older,
+  // including the parent's types, is already resolved.
+  uint32_t end = base_ + entries_.size();
+  std::vector<symbol::Symbol> cycles;
+  for (uint32_t i = mark; i < end; i++) {
+    if (local(Ty(i)).kind != Kind::kName)
+      continue;
+    // Walk to the end of the chain. Names resolved earlier in this loop
+    // already point at an actual type, so they end the walk right away.
+    uint32_t t = local(Ty(i)).a;
+    int steps = 0;
+    while (entry(Ty(t)).kind == Kind::kName) {
+      // a chain longer than the number of names in the group is a cycle
+      if (++steps > (int)(end - mark)) {
+        cycles.push_back(names_[local(Ty(i)).b]);
+        t = kErrorTy.id();
+        break;
+      }
+      t = entry(Ty(t)).a;
+    }
+    // With a cycle, this rewrites the whole of it to kErrorTy, so names
+    // that lead into it resolve without being reported again
+    for (uint32_t n = i;
+         n >= mark && local(Ty(n)).kind == Kind::kName && n != t;) {
+      uint32_t next = local(Ty(n)).a;
+      local(Ty(n)).a = t;
+      n = next;
+    }
+  }
+  for (uint32_t i = mark; i < end; i++) {
+    auto &e = local(Ty(i));
+    if (e.kind == Kind::kRecord) {
+      for (uint32_t f = e.a; f < e.a + e.b; f++)
+        fields_[f].ty = actual_ty(fields_[f].ty);
+    } else if (e.kind == Kind::kArray) {
+      e.a = actual_ty(Ty(e.a)).id();
+    }
+  }
+  return cycles;
 }
 
-bool is_compatible(const Ty &src, const Ty &dst) {
-  if (src == dst)
-    return true;
-  auto aty = actual_ty(dst);
-  return is<NilTy>(src) && is<RecordTyRef>(aty);
+const char *Context::describe(Ty ty) const {
+  switch (kind(ty)) {
+  case Kind::kInt:
+    return "int";
+  case Kind::kString:
+    return "string";
+  case Kind::kNil:
+    return "nil";
+  case Kind::kUnit:
+    return "unit";
+  case Kind::kRecord:
+    return "a record";
+  case Kind::kArray:
+    return "an array";
+  case Kind::kName:
+    return describe(actual_ty(ty));
+  case Kind::kError:
+    break;
+  }
+  return "an erroneous type";
 }
 
-Ty actual_ty(const Ty &ty) {
-  Ty ty1 = ty;
-  NameTyRef *t = nullptr;
-  while ((t = std::get_if<NameTyRef>(&ty1))) {
-    CHECK((*t)->ty) << (*t)->type_id.name() << ": Incomplete type";
-    ty1 = (*t)->ty.value();
+int Context::field_index(Ty record, symbol::Symbol name) const {
+  auto &c = owner(record);
+  auto &e = c.local(record);
+  if (e.c == kUnbound) {
+    for (uint32_t i = 0; i < e.b; i++) {
+      if (c.fields_[e.a + i].name == name)
+        return i;
+    }
+    return -1;
   }
-  return ty1;
+  auto begin = c.index_.begin() + e.c, end = begin + e.b;
+  auto it = std::lower_bound(begin, end, std::make_pair(name.id(), 0));
+  if (it == end || it->first != name.id())
+    return -1;
+  return it->second;
 }
 
 } // namespace types
@@ -3,61 +3,163 @@
 #include "box.h"
 #include "logging.h"
 #include "symbol.h"
-#include <memory>
+#include <cstdint>
 #include <optional>
 #include <variant>
 #include <vector>
 
 namespace types {
 
-template <typename T> using sptr = std::shared_ptr<T>;
-
-struct IntTy {};
-struct StringTy {};
-struct RecordTy;
-struct ArrayTy;
-struct NilTy {};
-struct UnitTy {};
-struct NameTy;
-
-using RecordTyRef = sptr<RecordTy>;
-using ArrayTyRef = sptr<ArrayTy>;
-using NameTyRef = sptr<NameTy>;
-using Ty = std::variant<IntTy, StringTy, RecordTyRef, ArrayTyRef, NilTy, UnitTy,
-                        NameTyRef>;
-using RTyField = std::pair<symbol::Symbol, Ty>;
+enum class Kind : uint8_t {
+  kInt,
+  kString,
+  kNil,
+  kUnit,
+  kRecord,
+  kArray,
+  kName,
+  // the type of anything whose checking failed; compatible with every type,
+  // so that one mistake is reported once rather than at every use
+  kError,
+};
 
-struct RecordTy {
-  int id;
+// A handle to a type interned in a Context. Once the NameTy chains of a
+// declaration group are resolved, two actual types are the same type iff
+// their handles are equal.
+class Ty {
+  uint32_t id_;
 
-  std::vector<RTyField> fields;
-  RecordTy(std::vector<RTyField> &&);
+public:
+  constexpr explicit Ty(uint32_t id) : id_(id) {}
+  constexpr uint32_t id() const { return id_; }
+  constexpr bool operator==(Ty other) const { return id_ == other.id_; }
+  constexpr bool operator!=(Ty other) const { return id_ != other.id_; }
 };
 
-struct ArrayTy {
-  int id;
+// The builtin types are interned by every Context at these handles
+constexpr Ty kIntTy{0};
+constexpr Ty kStringTy{1};
+constexpr Ty kNilTy{2};
+constexpr Ty kUnitTy{3};
+constexpr Ty kErrorTy{4};
 
-  Ty base_type;
-  ArrayTy(Ty);
+struct RTyField {
+  symbol::Symbol name;
+  Ty ty;
 };
 
-struct NameTy {
-  symbol::Symbol type_id;
-  std::optional<Ty> ty;
-  NameTy(symbol::Symbol t) : type_id(t) {}
-  NameTy(symbol::Symbol t, Ty ty) : type_id(t), ty(ty) {}
+// A list of types kept in a Context, such as a function's formals. It's
+// addressed by position, so it stays valid as the Context grows.
+struct TyList {
+  uint32_t first, size;
 };
 
-inline RecordTyRef make_record(std::vector<RTyField> &&fields) {
-  return std::make_shared<RecordTy>(std::move(fields));
-}
-inline ArrayTyRef make_array(Ty ty) { return std::make_shared<ArrayTy>(ty); }
-inline NameTyRef make_name(symbol::Symbol s) {
-  return std::make_shared<NameTy>(s);
-}
-inline NameTyRef make_name(symbol::Symbol s, Ty ty) {
-  return std::make_shared<NameTy>(s, ty);
-}
+// Owns every type of one compilation in a few contiguous tables. Record and
+// array types are generative in Tiger -- each declaration makes a new type
+// even if it's structurally identical to another -- so each gets its own
+// entry; everything else is a singleton or resolves to one.
+class Context {
+public:
+  Context();
+  // A scratch context layered over `parent`, for work that runs alongside
+  // other readers of the parent, such as checking one function body of a
+  // group. It sees every type of the parent, and its own types get handles
+  // after the parent's. The parent must not change while this is alive.
+  explicit Context(const Context *parent);
+  Context(const Context &) = delete;
+  Context &operator=(const Context &) = delete;
+
+  Kind kind(Ty ty) const { return entry(ty).kind; }
+  bool is_record(Ty ty) const { return kind(ty) == Kind::kRecord; }
+  bool is_array(Ty ty) const { return kind(ty) == Kind::kArray; }
+
+  Ty make_record(const std::vector<RTyField> &fields);
+  Ty make_array(Ty element);
+  // A placeholder for a type declared in the current group, to be bound to
+  // its definition with bind_name and resolved with resolve_names
+  Ty make_name(symbol::Symbol name);
+  void bind_name(Ty name, Ty ty);
+  TyList make_list(const std::vector<Ty> &tys);
+
+  // Marks the start of a declaration group
+  uint32_t mark() const { return base_ + entries_.size(); }
+  // Resolves all name types made since the mark, compressing each chain so
+  // that actual_ty is a single step, and rewrites the components of records
+  // and arrays made since the mark to actual types. Names on a cycle resolve
+  // to kErrorTy; one name from each cycle is returned.
+  std::vector<symbol::Symbol> resolve_names(uint32_t mark);
+
+  Ty actual_ty(Ty ty) const {
+    auto &e = entry(ty);
+    return e.kind == Kind::kName ? Ty(e.a) : ty;
+  }
+  bool is_compatible(Ty src, Ty dst) const {
+    if (src == kErrorTy || dst == kErrorTy)
+      return true;
+    // nil isn't compatible with itself: with two nils the record type
+    // couldn't be inferred
+    if (src == kNilTy)
+      return is_record(dst);
+    return src == dst;
+  }
+  // Whether values of ty are records or arrays, which the collector moves
+  bool is_pointer(Ty ty) const {
+    Ty a = actual_ty(ty);
+    return a == kNilTy || is_record(a) || is_array(a);
+  }
+
+  uint32_t num_fields(Ty record) const { return entry(record).b; }
+  const RTyField &field(Ty record, uint32_t i) const {
+    auto &c = owner(record);
+    return c.fields_[c.local(record).a + i];
+  }
+  // position of the named field, or -1 if there's no such field
+  int field_index(Ty record, symbol::Symbol name) const;
+  Ty element(Ty array) const { return Ty(entry(array).a); }
+  // the type's name for messages: a builtin's, or the kind of a record or
+  // array
+  const char *describe(Ty ty) const;
+  Ty at(TyList list, uint32_t i) const {
+    const Context *c = this;
+    while (list.first < c->list_base_)
+      c = c->parent_;
+    return c->lists_[list.first - c->list_base_ + i];
+  }
+
+private:
+  static constexpr uint32_t kUnbound = UINT32_MAX;
+  struct Entry {
+    Kind kind;
+    // record: first field in fields_; array: element type; name: target
+    uint32_t a;
+    // record: number of fields; name: declared name in names_
+    uint32_t b;
+    // record: first slot in index_, or kUnbound for narrow records
+    uint32_t c;
+  };
+  std::vector<Entry> entries_;
+  std::vector<RTyField> fields_;
+  // (symbol ID, position) pairs sorted by ID, for wide records
+  std::vector<std::pair<uint32_t, int>> index_;
+  std::vector<Ty> lists_;
+  std::vector<symbol::Symbol> names_;
+  // for a layered context: the handle of entries_[0] and the position of
+  // lists_[0], which follow everything in the parent
+  const Context *parent_{nullptr};
+  uint32_t base_{0}, list_base_{0};
+
+  Ty add(Entry e);
+  // the context in the chain that made the type
+  const Context &owner(Ty ty) const {
+    const Context *c = this;
+    while (ty.id() < c->base_)
+      c = c->parent_;
+    return *c;
+  }
+  const Entry &local(Ty ty) const { return entries_[ty.id() - base_]; }
+  Entry &local(Ty ty) { return entries_[ty.id() - base_]; }
+  const Entry &entry(Ty ty) const { return owner(ty).local(ty); }
+};
 
 template <typename T, typename U> bool is(const U &v) {
   return std::holds_alternative<T>(v);
@@ -66,9 +168,5 @@ template <typename T, typename U> const T &as(const U &v) {
   return std::get<T>(v);
 }
 
-bool operator==(const Ty &ty1, const Ty &ty2);
-bool is_compatible(const Ty &ty1, const Ty &ty2);
-Ty actual_ty(const Ty &ty);
-
 } // namespace types
 #endif
@@ -0,0 +1,480 @@
+#include "vm.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+// Computed goto is a GNU extension; elsewhere every instruction goes
+// through the switch
+#ifdef __GNUC__
+#define VM_THREADED 1
+#else
+#define VM_THREADED 0
+#endif
+
+namespace vm {
+
+namespace {
+
+bool string_equal(const String *a, const String *b) {
+  return a == b || (a->size == b->size &&
+                    std::memcmp(a->chars(), b->chars(), a->size) == 0);
+}
+
+int string_compare(const String *a, const String *b) {
+  int c = std::memcmp(a->chars(), b->chars(), std::min(a->size, b->size));
+  if (c == 0)
+    return a->size < b->size ? -1 : a->size > b->size;
+  return c < 0 ? -1 : 1;
+}
+
+// Tiger's integers wrap around
+int64_t wrap(uint64_t n) { return static_cast<int64_t>(n); }
+
+Value make_int(int64_t i) {
+  Value v;
+  v.i = i;
+  return v;
+}
+Value make_str(const String *s) {
+  Value v;
+  v.str = s;
+  return v;
+}
+
+// The standard library. Each gets its arguments in order and returns the
+// result, if any; one that fails says why to the VM.
+Value tig_print(VM &, Value *args) {
+  std::fwrite(args[0].str->chars(), 1, args[0].str->size, stdout);
+  return {};
+}
+Value tig_flush(VM &, Value *) {
+  std::fflush(stdout);
+  return {};
+}
+Value tig_getchar(VM &vm, Value *) {
+  int c = std::getchar();
+  return make_str(c == EOF ? vm.new_string(0) : vm.char_string(c));
+}
+Value tig_ord(VM &, Value *args) {
+  auto *s = args[0].str;
+  return make_int(s->size ? (unsigned char)s->chars()[0] : -1);
+}
+Value tig_chr(VM &vm, Value *args) {
+  int64_t i = args[0].i;
+  if (i < 0 || i > 255) {
+    vm.fail("chr(" + std::to_string(i) + ") is out of range");
+    return {};
+  }
+  return make_str(vm.char_string(i));
+}
+Value tig_size(VM &, Value *args) { return make_int(args[0].str->size); }
+Value tig_substring(VM &vm, Value *args) {
+  auto *s = args[0].str;
+  int64_t first = args[1].i, n = args[2].i;
+  if (first < 0 || n < 0 || first > s->size - n) {
+    vm.fail("substring(" + std::to_string(first) + ", " + std::to_string(n) +
+            ") is out of range for a string of size " +
+            std::to_string(s->size));
+    return {};
+  }
+  if (n == 1)
+    return make_str(vm.char_string(s->chars()[first]));
+  String *sub = vm.new_string(n);
+  std::memcpy(sub->chars(), s->chars() + first, n);
+  return make_str(sub);
+}
+Value tig_concat(VM &vm, Value *args) {
+  auto *a = args[0].str, *b = args[1].str;
+  if (a->size == 0)
+    return args[1];
+  if (b->size == 0)
+    return args[0];
+  String *s = vm.new_string(a->size + b->size);
+  std::memcpy(s->chars(), a->chars(), a->size);
+  std::memcpy(s->chars() + a->size, b->chars(), b->size);
+  return make_str(s);
+}
+Value tig_not(VM &, Value *args) { return make_int(args[0].i == 0); }
+Value tig_exit(VM &vm, Value *args) {
+  vm.exit(args[0].i);
+  return {};
+}
+
+struct RuntimeFunction {
+  const char *name;
+  Value (*fn)(VM &, Value *args);
+};
+constexpr RuntimeFunction kRuntime[] = {
+    {"print", tig_print},
+    {"flush", tig_flush},
+    {"getchar", tig_getchar},
+    {"ord", tig_ord},
+    {"chr", tig_chr},
+    {"size", tig_size},
+    {"substring", tig_substring},
+    {"concat", tig_concat},
+    {"not", tig_not},
+    {"exit", tig_exit},
+};
+
+// the frame `hops` static links out from fp
+Value *up(Value *fp, int32_t hops) {
+  for (; hops > 0; hops--)
+    fp = fp[0].frame;
+  return fp;
+}
+
+} // namespace
+
+int runtime_function(std::string_view name) {
+  for (size_t i = 0; i < std::size(kRuntime); i++) {
+    if (name == kRuntime[i].name)
+      return i;
+  }
+  return -1;
+}
+
+VM::VM(const Program &program, Dispatch dispatch, size_t stack_words)
+    : program_(program), dispatch_(dispatch),
+      stack_(new Value[stack_words]), stack_words_(stack_words),
+      // every frame takes at least its static link's word
+      returns_(new Return[stack_words]), max_depth_(stack_words),
+      caches_(program.num_caches, FieldCache{nullptr, 0}) {
+  for (int c = 0; c < 256; c++) {
+    String *s = new_string(1);
+    s->chars()[0] = c;
+    chars_[c] = s;
+  }
+}
+
+String *VM::new_string(size_t size) {
+  auto *s = static_cast<String *>(
+      heap_.Allocate(sizeof(String) + size, alignof(String)));
+  s->size = size;
+  return s;
+}
+
+Record *VM::new_record(const Layout *layout) {
+  auto *r = static_cast<Record *>(heap_.Allocate(
+      sizeof(Record) + layout->fields.size() * sizeof(Value), alignof(Record)));
+  r->layout = layout;
+  return r;
+}
+
+Array *VM::new_array(int64_t size, Value init) {
+  auto *a = static_cast<Array *>(
+      heap_.Allocate(sizeof(Array) + size * sizeof(Value), alignof(Array)));
+  a->size = size;
+  std::fill_n(a->elems(), size, init);
+  return a;
+}
+
+void VM::locate(const int32_t *pc) {
+  for (auto &proc : program_.procs) {
+    const int32_t *code = proc.code.data();
+    if (pc < code || pc >= code + proc.code.size())
+      continue;
+    uint32_t offset = pc - code;
+    auto line = std::lower_bound(
+        proc.lines.begin(), proc.lines.end(), offset,
+        [](auto &entry, uint32_t offset) { return entry.first < offset; });
+    if (line != proc.lines.end() && line->first == offset)
+      error_pos_ = line->second;
+    return;
+  }
+}
+
+bool VM::run() {
+#if VM_THREADED
+  if (dispatch_ == Dispatch::kThreaded)
+    return execute<true>();
+#endif
+  return execute<false>();
+}
+
+// Each instruction's code ends by dispatching the next one itself, either
+// through the table of their labels or by going back to the switch
+template <bool kThreaded> bool VM::execute() {
+  const Proc *procs = program_.procs.data();
+  const std::unique_ptr<Layout> *layouts = program_.layouts.data();
+  const String *const *strings = program_.strings.data();
+  const symbol::Symbol *names = program_.names.data();
+  FieldCache *caches = caches_.data();
+  Value *fp = stack_.get();
+  Value *stack_end = fp + stack_words_;
+  Return *returns = returns_.get(), *rsp = returns;
+  Return *returns_end = returns + max_depth_;
+  const int32_t *pc = procs[0].code.data();
+  if (procs[0].num_regs > stack_words_) {
+    fail("stack overflow");
+    return false;
+  }
+  fp[0].frame = nullptr;
+
+#if VM_THREADED
+  [[maybe_unused]] static const void *const kLabels[] = {
+#define VM_OP_LABEL(name, n) &&L_##name,
+      VM_OPS(VM_OP_LABEL)
+#undef VM_OP_LABEL
+  };
+#define VM_DISPATCH()                                                          \
+  do {                                                                         \
+    if constexpr (kThreaded)                                                   \
+      goto *kLabels[*pc];                                                      \
+    else                                                                       \
+      goto dispatch;                                                           \
+  } while (0)
+#define VM_CASE(name)                                                          \
+  case Op::k##name:                                                            \
+  L_##name:
+#else
+#define VM_DISPATCH() goto dispatch
+#define VM_CASE(name) case Op::k##name:
+#endif
+// the operand registers
+#define R(n) fp[pc[n]]
+// on to the next instruction, past this one's n operands
+#define VM_NEXT(n)                                                             \
+  do {                                                                         \
+    pc += (n) + 1;                                                             \
+    VM_DISPATCH();                                                             \
+  } while (0)
+#define VM_JUMP(n)                                                             \
+  do {                                                                         \
+    pc += pc[n];                                                               \
+    VM_DISPATCH();                                                             \
+  } while (0)
+#define VM_FAIL(msg)                                                           \
+  do {                                                                         \
+    fail(msg);                                                                 \
+    locate(pc);                                                                \
+    return false;                                                              \
+  } while (0)
+#define VM_COMPARE(name, op)                                                   \
+  VM_CASE(name) {                                                              \
+    R(1).i = R(2).i op R(3).i;                                                 \
+    VM_NEXT(3);                                                                \
+  }                                                                            \
+  VM_CASE(J##name) {                                                           \
+    if (R(1).i op R(2).i)                                                      \
+      VM_JUMP(3);                                                              \
+    VM_NEXT(3);                                                                \
+  }                                                                            \
+  VM_CASE(J##name##I) {                                                        \
+    if (R(1).i op pc[2])                                                       \
+      VM_JUMP(3);                                                              \
+    VM_NEXT(3);                                                                \
+  }
+
+  // The first instruction goes through the switch with either dispatch
+  goto dispatch;
+dispatch:
+  switch (static_cast<Op>(*pc)) {
+    VM_CASE(Mov) {
+      R(1) = R(2);
+      VM_NEXT(2);
+    }
+    VM_CASE(Int) {
+      R(1).i = pc[2];
+      VM_NEXT(2);
+    }
+    VM_CASE(Str) {
+      R(1).str = strings[pc[2]];
+      VM_NEXT(2);
+    }
+    VM_CASE(Link) {
+      R(1).frame = up(fp, pc[2]);
+      VM_NEXT(2);
+    }
+    VM_CASE(GetUp) {
+      R(1) = up(fp, pc[2])[pc[3]];
+      VM_NEXT(3);
+    }
+    VM_CASE(SetUp) {
+      up(fp, pc[1])[pc[2]] = R(3);
+      VM_NEXT(3);
+    }
+    VM_CASE(Add) {
+      R(1).i = wrap(uint64_t(R(2).i) + uint64_t(R(3).i));
+      VM_NEXT(3);
+    }
+    VM_CASE(Sub) {
+      R(1).i = wrap(uint64_t(R(2).i) - uint64_t(R(3).i));
+      VM_NEXT(3);
+    }
+    VM_CASE(Mul) {
+      R(1).i = wrap(uint64_t(R(2).i) * uint64_t(R(3).i));
+      VM_NEXT(3);
+    }
+    VM_CASE(Div) {
+      int64_t a = R(2).i, b = R(3).i;
+      if (b == 0)
+        VM_FAIL("division by zero");
+      // the one quotient that overflows wraps around too
+      R(1).i = b == -1 ? wrap(0 - uint64_t(a)) : a / b;
+      VM_NEXT(3);
+    }
+    VM_COMPARE(Eq, ==)
+    VM_COMPARE(Ne, !=)
+    VM_COMPARE(Lt, <)
+    VM_COMPARE(Le, <=)
+    VM_COMPARE(Gt, >)
+    VM_COMPARE(Ge, >=)
+    VM_CASE(StrEq) {
+      R(1).i = string_equal(R(2).str, R(3).str);
+      VM_NEXT(3);
+    }
+    VM_CASE(StrCmp) {
+      R(1).i = string_compare(R(2).str, R(3).str);
+      VM_NEXT(3);
+    }
+    VM_CASE(Jmp) { VM_JUMP(1); }
+    VM_CASE(Jt) {
+      if (R(1).i)
+        VM_JUMP(2);
+      VM_NEXT(2);
+    }
+    VM_CASE(Jf) {
+      if (!R(1).i)
+        VM_JUMP(2);
+      VM_NEXT(2);
+    }
+    VM_CASE(Record) {
+      const Layout *layout = layouts[pc[2]].get();
+      Record *r = new_record(layout);
+      std::copy_n(&R(3), layout->fields.size(), r->fields());
+      R(1).rec = r;
+      VM_NEXT(3);
+    }
+    VM_CASE(GetField) {
+      Record *r = R(2).rec;
+      if (!r)
+        VM_FAIL("field of nil record");
+      R(1) = r->fields()[r->layout->index(names[pc[3]])];
+      VM_NEXT(3);
+    }
+    VM_CASE(SetField) {
+      Record *r = R(1).rec;
+      if (!r)
+        VM_FAIL("field of nil record");
+      r->fields()[r->layout->index(names[pc[2]])] = R(3);
+      VM_NEXT(3);
+    }
+    VM_CASE(GetFieldIC) {
+      Record *r = R(2).rec;
+      if (!r)
+        VM_FAIL("field of nil record");
+      FieldCache &cache = caches[pc[4]];
+      if (cache.layout != r->layout)
+        cache = {r->layout, r->layout->index(names[pc[3]])};
+      R(1) = r->fields()[cache.index];
+      VM_NEXT(4);
+    }
+    VM_CASE(SetFieldIC) {
+      Record *r = R(1).rec;
+      if (!r)
+        VM_FAIL("field of nil record");
+      FieldCache &cache = caches[pc[4]];
+      if (cache.layout != r->layout)
+        cache = {r->layout, r->layout->index(names[pc[2]])};
+      r->fields()[cache.index] = R(3);
+      VM_NEXT(4);
+    }
+    VM_CASE(Array) {
+      int64_t size = R(2).i;
+      if (size < 0)
+        VM_FAIL("negative array size " + std::to_string(size));
+      R(1).arr = new_array(size, R(3));
+      VM_NEXT(3);
+    }
+    VM_CASE(GetElem) {
+      Array *a = R(2).arr;
+      int64_t i = R(3).i;
+      if (uint64_t(i) >= uint64_t(a->size))
+        VM_FAIL("index " + std::to_string(i) +
+                " is out of range for an array of size " +
+                std::to_string(a->size));
+      R(1) = a->elems()[i];
+      VM_NEXT(3);
+    }
+    VM_CASE(SetElem) {
+      Array *a = R(1).arr;
+      int64_t i = R(2).i;
+      if (uint64_t(i) >= uint64_t(a->size))
+        VM_FAIL("index " + std::to_string(i) +
+                " is out of range for an array of size " +
+                std::to_string(a->size));
+      a->elems()[i] = R(3);
+      VM_NEXT(3);
+    }
+    VM_CASE(Call) {
+      const Proc &callee = procs[pc[2]];
+      Value *frame = &R(3);
+      if (callee.num_regs > size_t(stack_end - frame) || rsp == returns_end)
+        VM_FAIL("stack overflow");
+      *rsp++ = {pc + 4, fp, pc[1]};
+      fp = frame;
+      pc = callee.code.data();
+      VM_DISPATCH();
+    }
+    VM_CASE(TailCall) {
+      // nothing's left to do here, so the callee's frame is moved down
+      // over this one, and it returns to this one's caller
+      const Proc &callee = procs[pc[1]];
+      if (callee.num_regs > size_t(stack_end - fp))
+        VM_FAIL("stack overflow");
+      std::copy(&R(2), &R(2) + pc[3], fp);
+      pc = callee.code.data();
+      VM_DISPATCH();
+    }
+    VM_CASE(CallRt) {
+      Value v = kRuntime[pc[2]].fn(*this, &R(3));
+      if (!error_.empty()) {
+        locate(pc);
+        return false;
+      }
+      if (exited_)
+        return true;
+      R(1) = v;
+      VM_NEXT(4);
+    }
+    VM_CASE(Ret) {
+      Value v = R(1);
+      if (rsp == returns) {
+        value_ = v;
+        return true;
+      }
+      --rsp;
+      pc = rsp->pc;
+      fp = rsp->fp;
+      fp[rsp->dst] = v;
+      VM_DISPATCH();
+    }
+    VM_CASE(AddI) {
+      R(1).i = wrap(uint64_t(R(2).i) + uint64_t(int64_t(pc[3])));
+      VM_NEXT(3);
+    }
+    VM_CASE(ForLoop) {
+      Value &var = R(1);
+      if (var.i < R(2).i) {
+        var.i++;
+        VM_JUMP(3);
+      }
+      VM_NEXT(3);
+    }
+  }
+  fail("bad opcode " + std::to_string(*pc));
+  return false;
+
+#undef VM_DISPATCH
+#undef VM_CASE
+#undef R
+#undef VM_NEXT
+#undef VM_JUMP
+#undef VM_FAIL
+#undef VM_COMPARE
+}
+
+} // namespace vm
@@ -0,0 +1,89 @@
+#ifndef VM_H
+#define VM_H
+#include "arena.h"
+#include "bytecode.h"
+#include "location.h"
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace vm {
+
+// The index of the runtime function of that name, for CallRt, or -1 if the
+// VM doesn't provide it
+int runtime_function(std::string_view name);
+
+// How the VM goes from one instruction to the next: through a jump from
+// the end of each instruction's code to the next one's, or back through a
+// switch for every instruction
+enum class Dispatch { kThreaded, kSwitch };
+
+// Runs a compiled program. The stack holds the register windows of the
+// active functions, and the objects the program makes live until the VM is
+// destroyed.
+class VM {
+public:
+  VM(const Program &program, Dispatch dispatch = Dispatch::kThreaded,
+     size_t stack_words = size_t(1) << 20);
+  VM(const VM &) = delete;
+  VM &operator=(const VM &) = delete;
+
+  // Runs the main program to the end, or until it calls exit. Returns false
+  // if it stopped on a runtime error, which error() then describes.
+  bool run();
+  // what the main program evaluated to
+  Value value() const { return value_; }
+  // the status the program passed to exit, or 0
+  int status() const { return status_; }
+  const std::string &error() const { return error_; }
+  // where the failing instruction came from, or 0:0 if that's not known
+  Location error_pos() const { return error_pos_; }
+
+  // For the runtime functions
+  String *new_string(size_t size);
+  const String *char_string(unsigned char c) const { return chars_[c]; }
+  void fail(std::string msg) { error_ = std::move(msg); }
+  void exit(int status) {
+    status_ = status;
+    exited_ = true;
+  }
+
+private:
+  struct Return {
+    const int32_t *pc;
+    Value *fp;
+    int32_t dst;
+  };
+  // The inline cache of one field access: the layout last seen there, and
+  // where the field is in records of that layout
+  struct FieldCache {
+    const Layout *layout;
+    int index;
+  };
+
+  const Program &program_;
+  Dispatch dispatch_;
+  std::unique_ptr<Value[]> stack_;
+  size_t stack_words_;
+  std::unique_ptr<Return[]> returns_;
+  size_t max_depth_;
+  std::vector<FieldCache> caches_;
+  absyn::Arena heap_;
+  const String *chars_[256];
+  Value value_{};
+  int status_{0};
+  bool exited_{false};
+  std::string error_;
+  Location error_pos_{0, 0};
+
+  template <bool kThreaded> bool execute();
+  Record *new_record(const Layout *layout);
+  Array *new_array(int64_t size, Value init);
+  // records where the instruction at pc came from, after a failure
+  void locate(const int32_t *pc);
+};
+
+} // namespace vm
+#endif
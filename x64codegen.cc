@@ -0,0 +1,429 @@
+#include "codegen.h"
+#include "logging.h"
+#include "x64frame.h"
+#include <algorithm>
+#include <iterator>
+#include <string>
+
+namespace codegen {
+
+namespace {
+using namespace tree;
+using assem::Instr;
+using temp::Temp;
+using namespace frame::x64;
+
+bool fits32(int64_t v) { return v == static_cast<int32_t>(v); }
+
+// the constant if e is one that fits an instruction's immediate field
+bool imm(Exp e, int64_t &value) {
+  auto *c = std::get_if<ConstExp *>(&e);
+  if (!c || !fits32((*c)->value))
+    return false;
+  value = (*c)->value;
+  return true;
+}
+
+Temp reg(Reg r) { return Temp(r); }
+
+// What a call may overwrite: the result and the registers the caller saves
+std::vector<Temp> call_defs() {
+  std::vector<Temp> defs;
+  for (auto r : kCallerSaves)
+    defs.push_back(reg(r));
+  return defs;
+}
+
+const char *jump(RelOp op) {
+  static const char *names[] = {"je", "jne", "jl", "jle", "jg",
+                                "jge", "jb", "jbe", "ja", "jae"};
+  return names[static_cast<int>(op)];
+}
+
+// An operand of an instruction other than the registers it's written to:
+// an immediate, a memory address or a register. The text refers to the
+// registers as sources numbered from the `first` it was made with.
+struct Operand {
+  std::string text;
+  std::vector<Temp> regs;
+};
+
+class Muncher {
+  frame::Frame &frame_;
+  std::vector<Instr> out_;
+  // whether a tail call, or a call that doesn't return, has left the
+  // function, so that nothing can be reached before the next label
+  bool left_{false};
+
+public:
+  explicit Muncher(frame::Frame &frame) : frame_(frame) {}
+  std::vector<Instr> result() { return std::move(out_); }
+
+  void emit(Instr instr) {
+    if (!left_)
+      out_.push_back(std::move(instr));
+  }
+  void move(Temp dst, Temp src) {
+    if (dst != src)
+      emit(Instr::move("movq 's0, 'd0", dst, src));
+  }
+
+  static std::string src(size_t n) { return "'s" + std::to_string(n); }
+
+  // The address e computes, as a base register, an index register scaled by
+  // 1, 2, 4 or 8, and a displacement, which any of may be left out of
+  Operand address(Exp e, size_t first) {
+    int64_t disp = 0;
+    if (auto *b = std::get_if<BinopExp *>(&e)) {
+      int64_t c;
+      if ((*b)->op == BinOp::kPlus && imm((*b)->right, c)) {
+        disp = c;
+        e = (*b)->left;
+      } else if ((*b)->op == BinOp::kPlus && imm((*b)->left, c)) {
+        disp = c;
+        e = (*b)->right;
+      } else if ((*b)->op == BinOp::kMinus && imm((*b)->right, c) &&
+                 fits32(-c)) {
+        disp = -c;
+        e = (*b)->left;
+      }
+    }
+    std::string d = disp ? std::to_string(disp) : "";
+    if (auto *n = std::get_if<NameExp *>(&e))
+      return {std::string((*n)->label.name()) + (disp ? "+" + d : "") +
+                  "(%rip)",
+              {}};
+    Exp base = e, index;
+    int64_t scale = 0;
+    if (auto *b = std::get_if<BinopExp *>(&e); b && (*b)->op == BinOp::kPlus) {
+      for (int side = 0; side < 2 && !scale; side++) {
+        Exp l = side ? (*b)->right : (*b)->left;
+        Exp r = side ? (*b)->left : (*b)->right;
+        if (scaled(r, index, scale))
+          base = l;
+      }
+      if (!scale) {
+        base = (*b)->left;
+        index = (*b)->right;
+        scale = 1;
+      }
+    } else if (scaled(e, index, scale)) {
+      auto i = munch(index);
+      return {d + "(," + src(first) + "," + std::to_string(scale) + ")", {i}};
+    }
+    auto b = munch(base);
+    if (!scale)
+      return {d + "(" + src(first) + ")", {b}};
+    auto i = munch(index);
+    return {d + "(" + src(first) + "," + src(first + 1) + "," +
+                std::to_string(scale) + ")",
+            {b, i}};
+  }
+
+  // whether e is an index times a scale an address can apply
+  static bool scaled(Exp e, Exp &index, int64_t &scale) {
+    auto *b = std::get_if<BinopExp *>(&e);
+    int64_t c;
+    if (!b || (*b)->op != BinOp::kMul || !imm((*b)->right, c) ||
+        (c != 1 && c != 2 && c != 4 && c != 8))
+      return false;
+    index = (*b)->left;
+    scale = c;
+    return true;
+  }
+
+  // e as the source operand of an instruction: an immediate if it's a small
+  // enough constant, memory if it's a load, and otherwise a register
+  Operand operand(Exp e, size_t first) {
+    int64_t c;
+    if (imm(e, c))
+      return {"$" + std::to_string(c), {}};
+    if (auto *m = std::get_if<MemExp *>(&e); m && !(*m)->byte)
+      return address((*m)->addr, first);
+    return {src(first), {munch(e)}};
+  }
+
+  void munch(Stm s) {
+    if (auto *m = std::get_if<MoveStm *>(&s))
+      return munch_move((*m)->dst, (*m)->src);
+    if (auto *e = std::get_if<ExpStm *>(&s)) {
+      if (auto *c = std::get_if<CallExp *>(&(*e)->exp))
+        return munch_call(*c);
+      munch((*e)->exp);
+      return;
+    }
+    if (auto *j = std::get_if<JumpStm *>(&s))
+      return emit(Instr::oper("jmp 'j0", {}, {}, {(*j)->target}));
+    if (auto *c = std::get_if<CjumpStm *>(&s))
+      return munch_cjump(*c);
+    if (auto *l = std::get_if<LabelStm *>(&s)) {
+      left_ = false;
+      return emit(Instr::label_at(std::string((*l)->label.name()) + ":",
+                                  (*l)->label));
+    }
+    LOG_FATAL << "unexpected statement after canon";
+  }
+
+  void munch_move(Exp dst, Exp src) {
+    if (auto *m = std::get_if<MemExp *>(&dst)) {
+      int64_t c;
+      if (imm(src, c)) {
+        auto a = address((*m)->addr, 0);
+        return emit(Instr::oper("movq $" + std::to_string(c) + ", " + a.text,
+                                {}, a.regs));
+      }
+      auto v = munch(src);
+      auto a = address((*m)->addr, 1);
+      a.regs.insert(a.regs.begin(), v);
+      return emit(Instr::oper("movq 's0, " + a.text, {}, a.regs));
+    }
+    Temp d = std::get<TempExp *>(dst)->temp;
+    if (auto *c = std::get_if<CallExp *>(&src)) {
+      munch_call(*c);
+      return move(d, frame_.rv());
+    }
+    if (auto *b = std::get_if<BinopExp *>(&src)) {
+      // an update in place, as in i := i + 1
+      auto *l = std::get_if<TempExp *>(&(*b)->left);
+      if (l && (*l)->temp == d && in_place(*b))
+        return binop(d, (*b)->op, operand((*b)->right, 0));
+    }
+    munch_to(d, src);
+  }
+
+  // evaluates e into d
+  void munch_to(Temp d, Exp e) {
+    if (auto *t = std::get_if<TempExp *>(&e))
+      return move(d, (*t)->temp);
+    if (auto *c = std::get_if<ConstExp *>(&e)) {
+      int64_t v = (*c)->value;
+      return emit(Instr::oper(
+          (fits32(v) ? "movq $" : "movabsq $") + std::to_string(v) + ", 'd0",
+          {d}, {}));
+    }
+    if (auto *n = std::get_if<NameExp *>(&e))
+      return emit(Instr::oper(
+          "leaq " + std::string((*n)->label.name()) + "(%rip), 'd0", {d}, {}));
+    if (auto *m = std::get_if<MemExp *>(&e)) {
+      auto a = address((*m)->addr, 0);
+      return emit(Instr::oper(((*m)->byte ? "movzbq " : "movq ") + a.text +
+                                  ", 'd0",
+                              {d}, a.regs));
+    }
+    if (auto *b = std::get_if<BinopExp *>(&e))
+      return munch_binop(d, *b);
+    move(d, munch(e));
+  }
+
+  Temp munch(Exp e) {
+    if (auto *t = std::get_if<TempExp *>(&e))
+      return (*t)->temp;
+    if (auto *c = std::get_if<CallExp *>(&e)) {
+      munch_call(*c);
+      Temp d = frame_.new_temp((*c)->pointer);
+      move(d, frame_.rv());
+      return d;
+    }
+    Temp d = frame_.new_temp();
+    munch_to(d, e);
+    return d;
+  }
+
+  // whether binop can update its left operand where it is
+  static bool in_place(BinopExp *b) {
+    switch (b->op) {
+    case BinOp::kDiv:
+      return false;
+    case BinOp::kLshift:
+    case BinOp::kRshift:
+    case BinOp::kArshift:
+      return std::holds_alternative<ConstExp *>(b->right);
+    default:
+      return true;
+    }
+  }
+
+  void munch_binop(Temp d, BinopExp *b) {
+    int64_t c;
+    if (b->op == BinOp::kPlus) {
+      // lea computes a sum without disturbing the operands
+      if (imm(b->right, c) || imm(b->left, c)) {
+        Exp other = imm(b->right, c) ? b->left : b->right;
+        return emit(Instr::oper("leaq " + std::to_string(c) + "('s0), 'd0",
+                                {d}, {munch(other)}));
+      }
+      return emit(Instr::oper("leaq ('s0,'s1), 'd0", {d},
+                              {munch(b->left), munch(b->right)}));
+    }
+    if (b->op == BinOp::kMinus && imm(b->left, c) && c == 0) {
+      move(d, munch(b->right));
+      return emit(Instr::oper("negq 'd0", {d}, {d}));
+    }
+    if (b->op == BinOp::kMul && (imm(b->right, c) || imm(b->left, c))) {
+      Exp other = imm(b->right, c) ? b->left : b->right;
+      return emit(Instr::oper("imulq $" + std::to_string(c) + ", 's0, 'd0",
+                              {d}, {munch(other)}));
+    }
+    if (b->op == BinOp::kDiv) {
+      // idiv divides rdx:rax, which cqto sign-extends rax into
+      auto dividend = munch(b->left), divisor = munch(b->right);
+      move(reg(kRax), dividend);
+      emit(Instr::oper("cqto", {reg(kRdx)}, {reg(kRax)}));
+      emit(Instr::oper("idivq 's0", {reg(kRax), reg(kRdx)},
+                       {divisor, reg(kRax), reg(kRdx)}));
+      return move(d, reg(kRax));
+    }
+    if (!in_place(b)) {
+      // a shift by a register must be by cl
+      auto value = munch(b->left), count = munch(b->right);
+      move(d, value);
+      move(reg(kRcx), count);
+      return emit(Instr::oper(std::string(shift(b->op)) + " %cl, 'd0", {d},
+                              {d, reg(kRcx)}));
+    }
+    // d can only take the left operand once the right has been read
+    auto left = munch(b->left);
+    auto rhs = operand(b->right, 0);
+    bool reads_d = std::find(rhs.regs.begin(), rhs.regs.end(), d) !=
+                   rhs.regs.end();
+    Temp t = reads_d ? frame_.new_temp() : d;
+    move(t, left);
+    binop(t, b->op, std::move(rhs));
+    move(d, t);
+  }
+
+  static const char *shift(BinOp op) {
+    return op == BinOp::kLshift   ? "salq"
+           : op == BinOp::kRshift ? "shrq"
+                                  : "sarq";
+  }
+
+  // d = d op rhs, for an op the instruction set can do in place
+  void binop(Temp d, BinOp op, Operand rhs) {
+    const char *name;
+    switch (op) {
+    case BinOp::kPlus:
+      name = "addq";
+      break;
+    case BinOp::kMinus:
+      name = "subq";
+      break;
+    case BinOp::kMul:
+      name = "imulq";
+      break;
+    case BinOp::kAnd:
+      name = "andq";
+      break;
+    case BinOp::kOr:
+      name = "orq";
+      break;
+    case BinOp::kXor:
+      name = "xorq";
+      break;
+    default:
+      name = shift(op);
+    }
+    rhs.regs.push_back(d);
+    emit(Instr::oper(std::string(name) + " " + rhs.text + ", 'd0", {d},
+                     rhs.regs));
+  }
+
+  void munch_cjump(CjumpStm *c) {
+    RelOp op = c->op;
+    Exp left = c->left, right = c->right;
+    int64_t v;
+    if (imm(left, v) && !imm(right, v)) {
+      std::swap(left, right);
+      op = commute(op);
+    }
+    auto l = munch(left);
+    std::vector<temp::Label> targets{c->t, c->f};
+    if (imm(right, v) && v == 0) {
+      emit(Instr::oper("testq 's0, 's0", {}, {l}));
+    } else {
+      auto rhs = operand(right, 1);
+      rhs.regs.insert(rhs.regs.begin(), l);
+      emit(Instr::oper("cmpq " + rhs.text + ", 's0", {}, rhs.regs));
+    }
+    emit(Instr::oper(std::string(jump(op)) + " 'j0", {}, {}, targets));
+  }
+
+  // Arguments go in registers as the ABI says, and past the sixth on the
+  // stack, pushed last first over padding that keeps rsp aligned. A tail
+  // call with all its arguments in registers jumps to the function instead,
+  // leaving its caller to return to ours; one that needs the stack is made
+  // as any other call, since its arguments would go where this function's
+  // caller put ours.
+  void munch_call(CallExp *call) {
+    constexpr size_t kRegArgs = std::size(kArgRegs);
+    std::vector<Temp> values;
+    for (auto &arg : call->args) {
+      int64_t c;
+      values.push_back(imm(arg, c) ? Temp() : munch(arg));
+    }
+    // the arguments are all evaluated before any is moved into place, since
+    // evaluating one can use the argument registers
+    Temp func;
+    if (!std::holds_alternative<NameExp *>(call->func))
+      func = munch(call->func);
+    size_t stack = call->args.size() > kRegArgs ? call->args.size() - kRegArgs
+                                                : 0;
+    size_t pad = stack % 2;
+    if (pad)
+      emit(Instr::oper("subq $8, %rsp", {}, {}));
+    for (size_t i = call->args.size(); i-- > kRegArgs;) {
+      int64_t c;
+      if (imm(call->args[i], c))
+        emit(Instr::oper("pushq $" + std::to_string(c), {}, {}));
+      else
+        emit(Instr::oper("pushq 's0", {}, {values[i]}));
+    }
+    std::vector<Temp> uses;
+    for (size_t i = 0; i < call->args.size() && i < kRegArgs; i++) {
+      Temp r = reg(kArgRegs[i]);
+      int64_t c;
+      if (imm(call->args[i], c))
+        emit(Instr::oper("movq $" + std::to_string(c) + ", 'd0", {r}, {}));
+      else
+        move(r, values[i]);
+      uses.push_back(r);
+    }
+    auto *name = std::get_if<NameExp *>(&call->func);
+    if (call->tail && name && !stack) {
+      frame_.tail_exit(out_, (*name)->label, std::move(uses));
+      left_ = true;
+      return;
+    }
+    std::string text = "call *'s0";
+    if (name)
+      text = "call " + std::string((*name)->label.name());
+    else
+      uses.insert(uses.begin(), func);
+    if (!call->returns && name) {
+      // a jump out of the body as far as the allocator can tell, so that
+      // nothing is live across it
+      emit(Instr::oper(std::move(text), call_defs(), std::move(uses),
+                       {(*name)->label}));
+      left_ = true;
+      return;
+    }
+    if (call->collects)
+      emit(Instr::call(std::move(text), call_defs(), std::move(uses)));
+    else
+      emit(Instr::oper(std::move(text), call_defs(), std::move(uses)));
+    if (stack + pad)
+      emit(Instr::oper("addq $" + std::to_string(8 * (stack + pad)) + ", %rsp",
+                       {}, {}));
+  }
+};
+} // namespace
+
+std::vector<assem::Instr> select(frame::Frame &frame,
+                                 const std::vector<tree::Stm> &stms) {
+  Muncher m(frame);
+  for (auto s : stms)
+    m.munch(s);
+  return m.result();
+}
+
+} // namespace codegen
@@ -0,0 +1,216 @@
+#include "x64frame.h"
+#include <algorithm>
+#include <cstdio>
+#include <iterator>
+
+namespace frame {
+
+namespace x64 {
+const char *reg_name(temp::Temp reg) {
+  static const char *names[] = {"rax", "rbx", "rcx", "rdx", "rsi", "rdi",
+                                "rbp", "rsp", "r8",  "r9",  "r10", "r11",
+                                "r12", "r13", "r14", "r15"};
+  return reg.id() < kNumRegs ? names[reg.id()] : nullptr;
+}
+} // namespace x64
+
+std::unique_ptr<Frame> new_frame(temp::Label name,
+                                 const std::vector<bool> &escapes,
+                                 const std::vector<bool> &pointers) {
+  return std::make_unique<X64Frame>(name, escapes, pointers);
+}
+
+X64Frame::X64Frame(temp::Label name, const std::vector<bool> &escapes,
+                   const std::vector<bool> &pointers)
+    : Frame(name, x64::kNumRegs) {
+  constexpr size_t kRegArgs = std::size(x64::kArgRegs);
+  for (size_t i = 0; i < escapes.size(); i++) {
+    bool pointer = i < pointers.size() && pointers[i];
+    if (i >= kRegArgs) {
+      // above the return address and the saved rbp
+      int32_t offset = 16 + 8 * (i - kRegArgs);
+      formals_.push_back(Access::in_frame(offset, pointer));
+      if (pointer)
+        pointer_slots_.push_back(offset);
+    } else {
+      formals_.push_back(alloc_local(escapes[i], pointer));
+    }
+  }
+}
+
+Access X64Frame::alloc_local(bool escape, bool pointer) {
+  if (!escape)
+    return Access::in_reg(new_temp(pointer), pointer);
+  int32_t offset = -8 * ++locals_;
+  if (pointer)
+    pointer_slots_.push_back(offset);
+  return Access::in_frame(offset, pointer);
+}
+
+tree::Exp X64Frame::exp(absyn::Arena &arena, Access access,
+                        tree::Exp frame_ptr) const {
+  if (access.kind == Access::Kind::kReg)
+    return tree::TempE(arena, access.reg);
+  return tree::Mem(arena,
+                   tree::Binop(arena, tree::BinOp::kPlus, frame_ptr,
+                               tree::Const(arena, access.offset)),
+                   access.pointer);
+}
+
+tree::Exp X64Frame::external_call(absyn::Arena &arena, std::string_view name,
+                                  tree::Seq<tree::Exp> args) const {
+  return tree::Call(arena, tree::Name(arena, named_label(arena, name)), args);
+}
+
+tree::Stm X64Frame::entry_exit1(absyn::Arena &arena, tree::Stm body) {
+  std::vector<tree::Stm> entry, exit;
+  // Callee-saved registers are copied to temps, which the register
+  // allocator can then spill if it needs the registers. They're copied
+  // first, so that the formals don't interfere with them, and can be
+  // coalesced with the temps instead.
+  for (auto reg : x64::kCalleeSaves) {
+    saved_.push_back(new_temp());
+    auto saved = tree::TempE(arena, saved_.back());
+    auto r = tree::TempE(arena, temp::Temp(reg));
+    entry.push_back(tree::Move(arena, saved, r));
+    exit.push_back(tree::Move(arena, r, saved));
+  }
+  for (size_t i = 0; i < formals_.size() && i < std::size(x64::kArgRegs);
+       i++) {
+    auto fp = tree::TempE(arena, this->fp());
+    entry.push_back(tree::Move(
+        arena, exp(arena, formals_[i], fp),
+        tree::TempE(arena, temp::Temp(x64::kArgRegs[i]))));
+  }
+  tree::Stm stm = body;
+  for (auto it = entry.rbegin(); it != entry.rend(); ++it)
+    stm = tree::SeqS(arena, *it, stm);
+  for (auto &s : exit)
+    stm = tree::SeqS(arena, stm, s);
+  return stm;
+}
+
+void X64Frame::entry_exit2(std::vector<assem::Instr> &body) const {
+  std::vector<temp::Temp> live{temp::Temp(x64::kRax), temp::Temp(x64::kRsp),
+                               temp::Temp(x64::kRbp)};
+  for (auto reg : x64::kCalleeSaves)
+    live.push_back(temp::Temp(reg));
+  body.push_back(assem::Instr::oper("", {}, std::move(live)));
+}
+
+// The caller's rsp is as it was on entry once the frame is left, so the
+// callee finds the return address where a call would have put it
+void X64Frame::tail_exit(std::vector<assem::Instr> &body, temp::Label callee,
+                         std::vector<temp::Temp> args) const {
+  for (size_t i = 0; i < saved_.size(); i++) {
+    temp::Temp reg(x64::kCalleeSaves[i]);
+    body.push_back(assem::Instr::move("movq 's0, 'd0", reg, saved_[i]));
+    args.push_back(reg);
+  }
+  args.push_back(temp::Temp(x64::kRsp));
+  args.push_back(temp::Temp(x64::kRbp));
+  // the callee isn't a label in the body, so nothing follows the jump
+  body.push_back(
+      assem::Instr::oper("leave\n\tjmp 'j0", {}, std::move(args), {callee}));
+}
+
+// The locals are kept a multiple of 16 bytes, so that rsp stays aligned for
+// calls as the ABI requires. The slots the collector reads are cleared, so
+// that it never finds garbage in one that hasn't been stored to yet.
+std::string X64Frame::prologue() const {
+  const char *name = name_.name();
+  std::string s = std::string("\t.p2align 4\n\t.type ") + name +
+                  ", @function\n" + name + ":\n\tpushq %rbp\n" +
+                  "\tmovq %rsp, %rbp\n";
+  if (int32_t size = (locals_size() + 15) & ~15)
+    s += "\tsubq $" + std::to_string(size) + ", %rsp\n";
+  std::vector<int32_t> cleared;
+  for (auto offset : pointer_slots_)
+    cleared.push_back(offset);
+  for (auto &site : call_sites_)
+    cleared.insert(cleared.end(), site.slots.begin(), site.slots.end());
+  std::sort(cleared.begin(), cleared.end());
+  cleared.erase(std::unique(cleared.begin(), cleared.end()), cleared.end());
+  for (auto offset : cleared) {
+    // the formals passed on the stack are the caller's to set
+    if (offset < 0)
+      s += "\tmovq $0, " + std::to_string(offset) + "(%rbp)\n";
+  }
+  return s;
+}
+
+std::string X64Frame::epilogue() const {
+  return std::string("\tleave\n\tret\n\t.size ") + name_.name() + ", .-" +
+         name_.name() + "\n";
+}
+
+// All but rsp and rbp. The caller-saved ones come first, so that a temp not
+// live across a call gets one of them when it can, leaving the callee-saved
+// ones, which have to be saved to be used, for the temps that are.
+const std::vector<temp::Temp> &X64Frame::registers() const {
+  static const std::vector<temp::Temp> regs = [] {
+    std::vector<temp::Temp> regs;
+    for (auto r : x64::kCallerSaves)
+      regs.push_back(temp::Temp(r));
+    for (auto r : x64::kCalleeSaves)
+      regs.push_back(temp::Temp(r));
+    return regs;
+  }();
+  return regs;
+}
+
+// A string is its length, a word, followed by its characters
+std::string string_literal(const std::vector<temp::Label> &labels,
+                           std::string_view value) {
+  std::string s = "\t.p2align 3\n";
+  for (auto label : labels)
+    s += std::string(label.name()) + ":\n";
+  s += "\t.quad " + std::to_string(value.size()) + "\n\t.ascii \"";
+  for (unsigned char c : value) {
+    if (c == '"' || c == '\\') {
+      s += '\\';
+      s += c;
+    } else if (c >= ' ' && c < 0x7f) {
+      s += c;
+    } else {
+      char octal[5];
+      std::snprintf(octal, sizeof octal, "\\%03o", c);
+      s += octal;
+    }
+  }
+  return s + "\"\n";
+}
+
+// The number of fields, then a bitmap of those that are pointers, 64 to a
+// word starting from the low bit
+std::string record_layout(temp::Label label,
+                          const std::vector<bool> &pointers) {
+  std::string s = std::string("\t.p2align 3\n") + label.name() +
+                  ":\n\t.quad " + std::to_string(pointers.size()) + "\n";
+  for (size_t i = 0; i < pointers.size(); i += 64) {
+    uint64_t bits = 0;
+    for (size_t j = i; j < pointers.size() && j < i + 64; j++)
+      bits |= (uint64_t)pointers[j] << (j - i);
+    s += "\t.quad " + std::to_string(bits) + "\n";
+  }
+  return s;
+}
+
+// For each call site, its return address, then the number of slots holding
+// pointers and their offsets
+std::string frame_maps(const Frame &frame, size_t *count) {
+  std::string s;
+  for (auto &site : frame.call_sites()) {
+    auto &always = frame.pointer_slots();
+    s += std::string("\t.quad ") + site.ret.name() + ", " +
+         std::to_string(always.size() + site.slots.size()) + "\n";
+    for (auto *slots : {&always, &site.slots}) {
+      for (auto offset : *slots)
+        s += "\t.quad " + std::to_string(offset) + "\n";
+    }
+    ++*count;
+  }
+  return s;
+}
+
+} // namespace frame
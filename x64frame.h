@@ -0,0 +1,72 @@
+#ifndef X64FRAME_H
+#define X64FRAME_H
+#include "frame.h"
+
+namespace frame {
+
+// The x86-64 registers, which are temps 0 to 15 of every function
+namespace x64 {
+enum Reg : uint32_t {
+  kRax,
+  kRbx,
+  kRcx,
+  kRdx,
+  kRsi,
+  kRdi,
+  kRbp,
+  kRsp,
+  kR8,
+  kR9,
+  kR10,
+  kR11,
+  kR12,
+  kR13,
+  kR14,
+  kR15,
+  kNumRegs,
+};
+constexpr Reg kArgRegs[] = {kRdi, kRsi, kRdx, kRcx, kR8, kR9};
+constexpr Reg kCalleeSaves[] = {kRbx, kR12, kR13, kR14, kR15};
+constexpr Reg kCallerSaves[] = {kRax, kRcx, kRdx, kRsi, kRdi,
+                                kR8,  kR9,  kR10, kR11};
+const char *reg_name(temp::Temp reg);
+} // namespace x64
+
+// The System V AMD64 frame. rbp is the frame pointer; the return address
+// and then any arguments past the sixth are above it, and locals below it.
+// Every formal comes in a register or in the caller's frame, as the ABI
+// says; the static link is always the first. Formals that escape and came
+// in a register are given a slot below rbp by the view shift.
+class X64Frame : public Frame {
+public:
+  X64Frame(temp::Label name, const std::vector<bool> &escapes,
+           const std::vector<bool> &pointers);
+
+  Access alloc_local(bool escape, bool pointer = false) override;
+  int32_t locals_size() const override { return locals_ * 8; }
+  int word_size() const override { return 8; }
+  temp::Temp fp() const override { return temp::Temp(x64::kRbp); }
+  temp::Temp rv() const override { return temp::Temp(x64::kRax); }
+  const char *register_name(temp::Temp t) const override {
+    return x64::reg_name(t);
+  }
+  tree::Exp exp(absyn::Arena &arena, Access access,
+                tree::Exp frame_ptr) const override;
+  tree::Exp external_call(absyn::Arena &arena, std::string_view name,
+                          tree::Seq<tree::Exp> args) const override;
+  tree::Stm entry_exit1(absyn::Arena &arena, tree::Stm body) override;
+  void entry_exit2(std::vector<assem::Instr> &body) const override;
+  void tail_exit(std::vector<assem::Instr> &body, temp::Label callee,
+                 std::vector<temp::Temp> args) const override;
+  std::string prologue() const override;
+  std::string epilogue() const override;
+  const std::vector<temp::Temp> &registers() const override;
+
+private:
+  int32_t locals_{0};
+  // the temps entry_exit1 saved kCalleeSaves in
+  std::vector<temp::Temp> saved_;
+};
+
+} // namespace frame
+#endif